@@ -0,0 +1,313 @@
+#include "db/db.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fmt/format.h"
+
+namespace foodculator {
+namespace {
+
+constexpr int64_t kInMemory = 0;
+constexpr int64_t kOnDisk = 1;
+
+// A database with `rows` ingredients, `rows` / 10 pots and `rows` / 10 recipes of 4 ingredients
+// each. Datasets are built once per (rows, storage) and shared by all benchmarks.
+struct Dataset {
+    std::unique_ptr<DB> db;
+    std::vector<size_t> ingredients;
+    std::vector<size_t> recipes;
+};
+
+std::string DiskPath(int64_t rows) {
+    return (std::filesystem::temp_directory_path() /
+            ("foodculator_bench_" + std::to_string(rows) + ".db"))
+        .string();
+}
+
+Dataset Populate(int64_t rows, int64_t storage) {
+    Dataset data;
+    if (storage == kOnDisk) {
+        std::remove(DiskPath(rows).c_str());
+        data.db = DB::Create(DiskPath(rows));
+    } else {
+        data.db = DB::Create(":memory:");
+    }
+    if (!data.db) {
+        fmt::print(stderr, "DB::Create failed\n");
+        exit(1);
+    }
+
+    DB& db = *data.db;
+    auto code = db.InTransaction([&] {
+        for (int64_t i = 0; i < rows; ++i) {
+            auto id = db.AddProduct("ingredient #" + std::to_string(i), i % 900);
+            if (!id.Ok()) {
+                return id.Code();
+            }
+            data.ingredients.push_back(id.Value());
+        }
+
+        for (int64_t i = 0; i < rows / 10; ++i) {
+            if (auto st = db.AddTableware("pot #" + std::to_string(i), i % 5000); !st.Ok()) {
+                return st.Code();
+            }
+
+            std::map<size_t, uint32_t> ingredients;
+            for (size_t j = 0; j < 4; ++j) {
+                ingredients[data.ingredients[(i * 4 + j) % data.ingredients.size()]] = 100;
+            }
+            auto id = db.CreateRecipe("recipe #" + std::to_string(i), "description", ingredients);
+            if (!id.Ok()) {
+                return id.Code();
+            }
+            data.recipes.push_back(id.Value());
+        }
+        return StatusCode::OK;
+    });
+    if (code != StatusCode::OK) {
+        fmt::print(stderr, "Populating the database failed: {}\n", ToString(code));
+        exit(1);
+    }
+    return data;
+}
+
+Dataset& GetDataset(const benchmark::State& state) {
+    static std::mutex mu;
+    static std::map<std::pair<int64_t, int64_t>, Dataset> datasets;
+
+    std::lock_guard<std::mutex> lock(mu);
+    auto key = std::make_pair(state.range(0), state.range(1));
+    auto it = datasets.find(key);
+    if (it == datasets.end()) {
+        it = datasets.emplace(key, Populate(key.first, key.second)).first;
+    }
+    return it->second;
+}
+
+void CatalogSizes(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"rows", "disk"});
+    for (int64_t storage : {kInMemory, kOnDisk}) {
+        for (int64_t rows : {1000, 100000, 1000000}) {
+            b->Args({rows, storage});
+        }
+    }
+}
+
+// Read-only benchmarks also run with concurrent readers sharing one DB.
+void Readers(benchmark::internal::Benchmark* b) {
+    CatalogSizes(b);
+    b->ThreadRange(1, 8)->UseRealTime();
+}
+
+// Returns a sequence of ids shared by all benchmark threads, so that writes don't collide.
+size_t NextId() {
+    static std::atomic<size_t> next = 0;
+    return next.fetch_add(1);
+}
+
+void BM_GetProduct(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    size_t idx = 0;
+    for (auto _ : state) {
+        auto id = data.ingredients[(idx++ * 7919) % data.ingredients.size()];
+        benchmark::DoNotOptimize(data.db->GetProduct(id));
+    }
+}
+BENCHMARK(BM_GetProduct)->Apply(Readers);
+
+void BM_GetProducts(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(data.db->GetProducts());
+    }
+    state.SetItemsProcessed(state.iterations() * data.ingredients.size());
+}
+BENCHMARK(BM_GetProducts)->Apply(Readers)->Unit(benchmark::kMillisecond);
+
+void BM_GetProductsSince(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    // Asks for the last ~100 writes, as a client that was offline for a short while would.
+    const uint64_t version = data.db->GetProductsSince(0).Value().version;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(data.db->GetProductsSince(version > 100 ? version - 100 : 0));
+    }
+}
+BENCHMARK(BM_GetProductsSince)->Apply(Readers);
+
+void BM_GetTableware(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(data.db->GetTableware());
+    }
+}
+BENCHMARK(BM_GetTableware)->Apply(Readers)->Unit(benchmark::kMillisecond);
+
+void BM_GetTablewareSince(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    const uint64_t version = data.db->GetTablewareSince(0).Value().version;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(data.db->GetTablewareSince(version > 100 ? version - 100 : 0));
+    }
+}
+BENCHMARK(BM_GetTablewareSince)->Apply(Readers);
+
+void BM_GetRecipes(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(data.db->GetRecipes());
+    }
+    state.SetItemsProcessed(state.iterations() * data.recipes.size());
+}
+BENCHMARK(BM_GetRecipes)->Apply(Readers)->Unit(benchmark::kMillisecond);
+
+void BM_GetRecipesSince(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    const uint64_t version = data.db->GetRecipesSince(0).Value().version;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(data.db->GetRecipesSince(version > 100 ? version - 100 : 0));
+    }
+}
+BENCHMARK(BM_GetRecipesSince)->Apply(Readers);
+
+void BM_GetRecipeInfo(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    size_t idx = 0;
+    for (auto _ : state) {
+        auto id = data.recipes[(idx++ * 7919) % data.recipes.size()];
+        benchmark::DoNotOptimize(data.db->GetRecipeInfo(id));
+    }
+}
+BENCHMARK(BM_GetRecipeInfo)->Apply(Readers);
+
+void BM_GetRecipeKcalPer100g(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    size_t idx = 0;
+    for (auto _ : state) {
+        auto id = data.recipes[(idx++ * 7919) % data.recipes.size()];
+        benchmark::DoNotOptimize(data.db->GetRecipeKcalPer100g(id));
+    }
+}
+BENCHMARK(BM_GetRecipeKcalPer100g)->Apply(Readers);
+
+// Unlike the profiles of saved recipes, unsaved mixes are not memoized: every iteration reads
+// the ingredients.
+void BM_CalculateNutrients(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    size_t idx = 0;
+    for (auto _ : state) {
+        std::map<size_t, uint32_t> ingredients;
+        for (size_t j = 0; j < 4; ++j) {
+            ingredients[data.ingredients[(idx++ * 7919) % data.ingredients.size()]] = 100;
+        }
+        benchmark::DoNotOptimize(data.db->CalculateNutrients(ingredients, {}));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CalculateNutrients)->Apply(Readers);
+
+void BM_Generation(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(data.db->Generation(DB::Table::RECIPE));
+    }
+}
+BENCHMARK(BM_Generation)->Apply(Readers);
+
+// Write benchmarks run on one thread: DB serializes statements anyway.
+
+void BM_AddDeleteProduct(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    for (auto _ : state) {
+        auto id = data.db->AddProduct("new ingredient #" + std::to_string(NextId()), 100);
+        data.db->DeleteProduct(id.Value());
+    }
+}
+BENCHMARK(BM_AddDeleteProduct)->Apply(CatalogSizes);
+
+void BM_AddDeleteTableware(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    for (auto _ : state) {
+        auto id = data.db->AddTableware("new pot #" + std::to_string(NextId()), 100);
+        data.db->DeleteTableware(id.Value());
+    }
+}
+BENCHMARK(BM_AddDeleteTableware)->Apply(CatalogSizes);
+
+void BM_CreateRecipe(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    const std::map<size_t, uint32_t> ingredients = {
+        {data.ingredients[0], 100}, {data.ingredients[1], 200}, {data.ingredients[2], 300}};
+
+    std::vector<size_t> created;
+    for (auto _ : state) {
+        auto id = data.db->CreateRecipe("new recipe #" + std::to_string(NextId()), "",
+                                        ingredients);
+        created.push_back(id.Value());
+    }
+
+    state.PauseTiming();
+    for (size_t id : created) {
+        data.db->DeleteRecipe(id);
+    }
+    state.ResumeTiming();
+}
+BENCHMARK(BM_CreateRecipe)->Apply(CatalogSizes);
+
+void BM_DeleteRecipe(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    const std::map<size_t, uint32_t> ingredients = {
+        {data.ingredients[0], 100}, {data.ingredients[1], 200}, {data.ingredients[2], 300}};
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto id = data.db->CreateRecipe("new recipe #" + std::to_string(NextId()), "",
+                                        ingredients);
+        state.ResumeTiming();
+        data.db->DeleteRecipe(id.Value());
+    }
+}
+BENCHMARK(BM_DeleteRecipe)->Apply(CatalogSizes);
+
+void BM_CompactTombstones(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            data.db->CompactTombstones(std::chrono::system_clock::now() - std::chrono::hours(1)));
+    }
+}
+BENCHMARK(BM_CompactTombstones)->Apply(CatalogSizes);
+
+void BM_InTransaction_AddProducts(benchmark::State& state) {
+    Dataset& data = GetDataset(state);
+    for (auto _ : state) {
+        std::vector<size_t> added;
+        data.db->InTransaction([&] {
+            for (size_t i = 0; i < 100; ++i) {
+                added.push_back(
+                    data.db->AddProduct("bulk #" + std::to_string(NextId()), 100).Value());
+            }
+            return StatusCode::OK;
+        });
+
+        state.PauseTiming();
+        for (size_t id : added) {
+            data.db->DeleteProduct(id);
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * 100);
+}
+BENCHMARK(BM_InTransaction_AddProducts)->Apply(CatalogSizes);
+
+}  // namespace
+}  // namespace foodculator
@@ -0,0 +1,46 @@
+#include "search/name_index.h"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace foodculator {
+namespace {
+
+const std::vector<std::string> kWords = {
+    "молоко", "сахар",  "мука",   "масло",     "сливочное", "пшеничная", "ржаная", "творог",
+    "сыр",    "яйцо",   "курица", "говядина",  "свинина",   "рис",       "гречка", "овсянка",
+    "milk",   "butter", "cheese", "chocolate", "vanilla",   "almond",    "oat",    "sugar",
+};
+
+NameIndex BuildIndex(size_t size) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> word(0, kWords.size() - 1);
+    std::uniform_int_distribution<int> fat(0, 99);
+
+    NameIndex index;
+    for (size_t id = 1; id <= size; ++id) {
+        std::string name = kWords[word(rng)] + " " + kWords[word(rng)] + " " +
+                           std::to_string(fat(rng) / 10) + "," + std::to_string(fat(rng) % 10) +
+                           "% #" + std::to_string(id);
+        index.Add(NameIndex::Kind::INGREDIENT, id, std::move(name));
+    }
+    return index;
+}
+
+void BM_NameIndexFind(benchmark::State& state) {
+    const NameIndex index = BuildIndex(state.range(0));
+    const std::vector<std::string> queries = {"молоко 3,2", "Сливочное масло", "сыр творог 5%",
+                                              "chocolate milk", "гречкa"};
+
+    size_t idx = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(index.Find(queries[idx++ % queries.size()]));
+    }
+}
+BENCHMARK(BM_NameIndexFind)->Arg(1000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace foodculator
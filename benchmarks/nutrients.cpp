@@ -0,0 +1,36 @@
+#include "db/nutrients.h"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+namespace foodculator {
+namespace {
+
+// Evaluates mixes of state.range(0) foods with random profiles, e.g. the ingredients of a
+// recipe. Items per second are evaluations per second.
+void BM_MixPer100g(benchmark::State& state) {
+    const size_t count = state.range(0);
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> grams(0, 100);
+    std::vector<NutrientProfile> profiles(count);
+    std::vector<float> weights(count);
+    for (size_t idx = 0; idx < count; ++idx) {
+        Nutrients nutrients;
+        for (float& v : nutrients) {
+            v = grams(rng);
+        }
+        profiles[idx] = NutrientProfile(grams(rng) * 9, nutrients);
+        weights[idx] = grams(rng) * 5;
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(MixPer100g(profiles.data(), weights.data(), count));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MixPer100g)->Arg(4)->Arg(16)->Arg(64)->Arg(1024);
+
+}  // namespace
+}  // namespace foodculator
@@ -0,0 +1,95 @@
+#include "util/router.h"
+
+#include <benchmark/benchmark.h>
+
+#include <regex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace foodculator {
+namespace {
+
+// The foodculator routes in registration order, as httplib sees them.
+const std::vector<std::pair<std::string, std::string>> kRegexRoutes = {
+    {"GET", "/"},
+    {"GET", "/ingredients"},
+    {"GET", "/tableware"},
+    {"GET", "/recipe"},
+    {"GET", "/get_ingredients"},
+    {"POST", "/add_ingredient"},
+    {"GET", R"(/ingredient/(\d+))"},
+    {"DELETE", R"(/ingredient/(\d+))"},
+    {"GET", "/get_tableware"},
+    {"POST", "/add_tableware"},
+    {"DELETE", R"(/tableware/(\d+))"},
+    {"GET", "/get_recipes"},
+    {"POST", "/create_recipe"},
+    {"GET", R"(/recipe/(\d+))"},
+    {"DELETE", R"(/recipe/(\d+))"},
+    {"POST", "/dialogflow"},
+    {"GET", "/version"},
+};
+
+const std::vector<std::pair<std::string, std::string>> kRequests = {
+    {"GET", "/get_ingredients"},   {"GET", "/recipe/1234"},    {"DELETE", "/ingredient/77"},
+    {"POST", "/dialogflow"},       {"GET", "/version"},        {"DELETE", "/recipe/987654"},
+    {"GET", "/ingredient/31337"},  {"GET", "/no/such/route"},
+};
+
+// Mimics httplib: every route is a std::regex that is tried in turn, the id is then
+// converted with std::stoull.
+void BM_RegexRouting(benchmark::State& state) {
+    std::vector<std::pair<std::string, std::regex>> routes;
+    for (const auto& [method, pattern] : kRegexRoutes) {
+        routes.emplace_back(method, std::regex(pattern));
+    }
+
+    size_t idx = 0;
+    for (auto _ : state) {
+        const auto& [method, path] = kRequests[idx++ % kRequests.size()];
+        std::smatch matches;
+        size_t found = routes.size();
+        for (size_t i = 0; i < routes.size(); ++i) {
+            if (routes[i].first == method && std::regex_match(path, matches, routes[i].second)) {
+                found = i;
+                break;
+            }
+        }
+        size_t id = (found != routes.size() && matches.size() > 1) ? std::stoull(matches[1]) : 0;
+        benchmark::DoNotOptimize(found);
+        benchmark::DoNotOptimize(id);
+    }
+}
+BENCHMARK(BM_RegexRouting);
+
+// The server dispatches with the trie before httplib routes a request, except for a request
+// with a body: httplib reads it only before its regex-based handlers, so the request still
+// passes the `.*` of a catch-all handler.
+void BM_TrieRouting(benchmark::State& state) {
+    const std::regex catch_all(".*");
+    Router<size_t> router;
+    for (size_t i = 0; i < kRegexRoutes.size(); ++i) {
+        std::string pattern = std::regex_replace(kRegexRoutes[i].second, std::regex(R"(\(\\d\+\))"),
+                                                 ":id");
+        router.Add(kRegexRoutes[i].first, pattern, i);
+    }
+
+    size_t idx = 0;
+    RouteParams params;
+    for (auto _ : state) {
+        const auto& [method, path] = kRequests[idx++ % kRequests.size()];
+        if (method == "POST") {
+            std::smatch matches;
+            benchmark::DoNotOptimize(std::regex_match(path, matches, catch_all));
+        }
+        const size_t* found = router.Match(method, path, &params);
+        size_t id = (params.size() > 0) ? params[0] : 0;
+        benchmark::DoNotOptimize(found);
+        benchmark::DoNotOptimize(id);
+    }
+}
+BENCHMARK(BM_TrieRouting);
+
+}  // namespace
+}  // namespace foodculator
@@ -0,0 +1,116 @@
+#include "bot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "fmt/format.h"
+
+namespace foodculator {
+
+Bot::Bot(BotApi* api, DB* db, size_t workers) : api_(api), commands_(db), pool_(workers) {}
+
+void Bot::Run() {
+    int64_t offset = 0;
+    while (!stopped_) {
+        auto updates = api_->GetUpdates(offset, kPollTimeoutSec);
+        if (!updates.Ok()) {
+            fmt::print(stderr, "[bot] {}\n", updates.Error());
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            continue;
+        }
+
+        for (const auto& update : updates.Value()) {
+            offset = std::max(offset, update.update_id + 1);
+            if (update.chat_id != 0 && !update.text.empty()) {
+                Enqueue(update);
+            }
+        }
+    }
+}
+
+void Bot::Enqueue(const BotUpdate& update) {
+    bool idle = false;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto [it, inserted] = pending_.try_emplace(update.chat_id);
+        it->second.push_back(update.text);
+        idle = inserted;
+    }
+
+    if (idle) {
+        pool_.Submit([this, chat_id = update.chat_id] { Drain(chat_id); });
+    }
+}
+
+void Bot::Drain(int64_t chat_id) {
+    while (true) {
+        std::vector<std::string> texts;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            auto it = pending_.find(chat_id);
+            if (it->second.empty()) {
+                pending_.erase(it);
+                return;
+            }
+            texts.swap(it->second);
+        }
+
+        std::string reply;
+        for (const auto& text : texts) {
+            if (!reply.empty()) {
+                reply += "\n\n";
+            }
+            reply += commands_.Handle(text);
+        }
+        for (const auto& message : SplitMessage(reply)) {
+            api_->SendMessage(chat_id, message);
+        }
+    }
+}
+
+std::vector<std::string> SplitMessage(std::string_view text, size_t max_length) {
+    std::vector<std::string> ret;
+    // The message being measured is text[start, pos), and its last line break is at `cut`.
+    size_t start = 0;
+    size_t pos = 0;
+    size_t cut = std::string_view::npos;
+    size_t length = 0;
+    while (pos < text.size()) {
+        const auto c = static_cast<unsigned char>(text[pos]);
+        const size_t bytes =
+            std::min<size_t>(c < 0xc0 ? 1 : c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4, text.size() - pos);
+        // Characters outside the BMP take a surrogate pair.
+        const size_t units = bytes == 4 ? 2 : 1;
+        if (length + units <= max_length || pos == start) {
+            if (c == '\n' && pos > start) {
+                cut = pos;
+            }
+            length += units;
+            pos += bytes;
+            continue;
+        }
+
+        size_t end = cut != std::string_view::npos ? cut : pos;
+        while (end > start && text[end - 1] == '\n') {
+            --end;
+        }
+        if (end == start) {
+            end = pos;
+        }
+        ret.emplace_back(text.substr(start, end - start));
+        start = text.find_first_not_of('\n', end);
+        if (start == std::string_view::npos) {
+            return ret;
+        }
+        pos = start;
+        cut = std::string_view::npos;
+        length = 0;
+    }
+    if (start < text.size()) {
+        ret.emplace_back(text.substr(start));
+    }
+    return ret;
+}
+
+}  // namespace foodculator
@@ -0,0 +1,61 @@
+#ifndef __SRC_BOT_BOT_H__
+#define __SRC_BOT_BOT_H__
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "bot/bot_api.h"
+#include "bot/commands.h"
+#include "db/db.h"
+#include "util/thread_pool.h"
+
+namespace foodculator {
+
+// Bot serves the Telegram chat front-end.
+//
+// Run() long-polls BotApi on the calling thread and hands the updates over to a pool of
+// `workers` threads that share `db`. Updates of one chat are processed in order by one worker
+// at a time, and all replies that are ready by the time it sends are batched into a single
+// message, so a chat that sends several commands at once gets one answer. Answers longer than
+// BotApi::kMaxMessageLength are sent in several messages, see SplitMessage().
+class Bot {
+   public:
+    Bot(BotApi* api, DB* db, size_t workers);
+
+    // Returns after Stop() is called.
+    void Run();
+    // Thread-safe. Stops Run() after the current long-poll returns.
+    void Stop() { stopped_ = true; }
+
+    static constexpr int kPollTimeoutSec = 30;
+
+   private:
+    void Enqueue(const BotUpdate& update);
+    void Drain(int64_t chat_id);
+
+    BotApi* api_;
+    BotCommands commands_;
+    std::atomic<bool> stopped_ = false;
+
+    // Guards `pending_`, which holds texts of each chat that a worker is busy with.
+    std::mutex mu_;
+    std::unordered_map<int64_t, std::vector<std::string>> pending_;
+
+    // Destroyed first, so that workers are done before the rest of the members go away.
+    ThreadPool pool_;
+};
+
+// Splits `text` into messages of at most `max_length` UTF-16 code units, which is how Telegram
+// counts the length of a message. A message ends at the last line break that fits, or between
+// two characters if a line doesn't fit on its own. The line breaks at the cuts are dropped.
+std::vector<std::string> SplitMessage(std::string_view text,
+                                      size_t max_length = BotApi::kMaxMessageLength);
+
+}  // namespace foodculator
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __SRC_BOT_BOT_API_H__
+#define __SRC_BOT_BOT_API_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "util/statusor.h"
+
+namespace TgBot {
+class HttpClient;
+}
+
+namespace foodculator {
+
+struct BotUpdate {
+    int64_t update_id;
+    int64_t chat_id;
+    std::string text;
+};
+
+// BotApi is the part of the Telegram Bot API that the bot needs.
+class BotApi {
+   public:
+    virtual ~BotApi() = default;
+
+    // Waits up to `timeout_sec` seconds for updates with id >= `offset`.
+    virtual StatusOr<std::vector<BotUpdate>> GetUpdates(int64_t offset, int timeout_sec) = 0;
+    // Telegram refuses texts longer than kMaxMessageLength UTF-16 code units.
+    virtual StatusCode SendMessage(int64_t chat_id, const std::string& text) = 0;
+
+    static constexpr size_t kMaxMessageLength = 4096;
+};
+
+// Returns BotApi talking to the Telegram servers on behalf of the bot with `token`.
+std::unique_ptr<BotApi> CreateTelegramApi(const std::string& token);
+// Same, but sends the requests through `http`, which has to outlive the returned BotApi.
+std::unique_ptr<BotApi> CreateTelegramApi(const std::string& token,
+                                          const TgBot::HttpClient& http);
+
+}  // namespace foodculator
+
+#endif
@@ -0,0 +1,121 @@
+#include "commands.h"
+
+#include "fmt/format.h"
+
+namespace foodculator {
+
+namespace {
+
+constexpr std::string_view kHelp =
+    "Я умею:\n"
+    "/ingredients - показать все ингредиенты\n"
+    "/pots - показать всю посуду\n"
+    "/ingredient <название> - найти ингредиент\n"
+    "/energy <рецепт> - посчитать калорийность рецепта";
+
+constexpr std::string_view kDbError = "База данных недоступна, попробуйте позже.";
+
+// Splits "/command@bot_name argument" into "/command" and "argument".
+std::pair<std::string_view, std::string_view> ParseCommand(std::string_view text) {
+    size_t space = text.find(' ');
+    std::string_view command = text.substr(0, space);
+    std::string_view argument = space == std::string_view::npos ? "" : text.substr(space + 1);
+    command = command.substr(0, command.find('@'));
+    return {command, argument};
+}
+
+}  // namespace
+
+std::string BotCommands::Handle(std::string_view text) {
+    auto [command, argument] = ParseCommand(text);
+    if (command == "/ingredients") {
+        return ListIngredients();
+    }
+    if (command == "/pots") {
+        return ListPots();
+    }
+    if (command == "/ingredient" && !argument.empty()) {
+        return FindIngredient(argument);
+    }
+    if (command == "/energy" && !argument.empty()) {
+        return RecipeEnergy(argument);
+    }
+    return std::string(kHelp);
+}
+
+std::string BotCommands::ListIngredients() {
+    auto products = db_->GetProducts();
+    if (!products.Ok()) {
+        return std::string(kDbError);
+    }
+    if (products.Value().empty()) {
+        return "Ингредиентов пока нет.";
+    }
+
+    fmt::memory_buffer text;
+    fmt::format_to(text, "Наши ингредиенты:");
+    for (const auto& ingredient : products.Value()) {
+        fmt::format_to(text, "\n{} - {} ккал/100г", ingredient.name, ingredient.kcal);
+    }
+    return fmt::to_string(text);
+}
+
+std::string BotCommands::ListPots() {
+    auto tw = db_->GetTableware();
+    if (!tw.Ok()) {
+        return std::string(kDbError);
+    }
+    if (tw.Value().empty()) {
+        return "Посуды пока нет.";
+    }
+
+    fmt::memory_buffer text;
+    fmt::format_to(text, "Наша посуда:");
+    for (const auto& pot : tw.Value()) {
+        fmt::format_to(text, "\n{} - {} г", pot.name, pot.weight);
+    }
+    return fmt::to_string(text);
+}
+
+std::string BotCommands::FindIngredient(std::string_view name) {
+    auto match = catalog_.Find(name, NameIndex::Kind::INGREDIENT);
+    if (!match.Ok()) {
+        if (match.Code() == StatusCode::NOT_FOUND) {
+            return fmt::format("Ингредиент \"{}\" не найден.", name);
+        }
+        return std::string(kDbError);
+    }
+
+    auto product = db_->GetProduct(match.Value().entry.id);
+    if (!product.Ok()) {
+        return std::string(kDbError);
+    }
+    return fmt::format("{} - {} ккал/100г", product.Value().name, product.Value().kcal);
+}
+
+std::string BotCommands::RecipeEnergy(std::string_view name) {
+    auto match = catalog_.Find(name, NameIndex::Kind::RECIPE);
+    if (!match.Ok()) {
+        if (match.Code() == StatusCode::NOT_FOUND) {
+            return fmt::format("Рецепт \"{}\" не найден.", name);
+        }
+        return std::string(kDbError);
+    }
+
+    const size_t recipe_id = match.Value().entry.id;
+    auto recipe = db_->GetRecipeInfo(recipe_id);
+    auto kcal = db_->GetRecipeKcalPer100g(recipe_id);
+    if (!recipe.Ok() || !kcal.Ok()) {
+        return std::string(kDbError);
+    }
+
+    uint64_t weight = 0;
+    for (const auto& ingredient : recipe.Value().ingredients) {
+        weight += ingredient.weight;
+    }
+    return fmt::format("{}: {:.0f} ккал/100г, всего {:.0f} ккал на {} г",
+                       recipe.Value().header.name, kcal.Value(), kcal.Value() * weight / 100,
+                       weight);
+}
+
+}  // namespace foodculator
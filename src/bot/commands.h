@@ -0,0 +1,37 @@
+#ifndef __SRC_BOT_COMMANDS_H__
+#define __SRC_BOT_COMMANDS_H__
+
+#include <string>
+#include <string_view>
+
+#include "db/db.h"
+#include "search/catalog_index.h"
+
+namespace foodculator {
+
+// BotCommands answers the chat commands supported by the Telegram bot:
+//   /ingredients         - lists all ingredients;
+//   /pots                - lists all pots;
+//   /ingredient <name>   - finds an ingredient by name;
+//   /energy <recipe>     - computes the energy of a recipe.
+// Anything else gets the list of commands.
+class BotCommands {
+   public:
+    explicit BotCommands(DB* db) : db_(db), catalog_(db) {}
+
+    // Thread-safe.
+    std::string Handle(std::string_view text);
+
+   private:
+    std::string ListIngredients();
+    std::string ListPots();
+    std::string FindIngredient(std::string_view name);
+    std::string RecipeEnergy(std::string_view name);
+
+    DB* db_;
+    CatalogIndex catalog_;
+};
+
+}  // namespace foodculator
+
+#endif
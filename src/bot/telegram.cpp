@@ -0,0 +1,59 @@
+#include <exception>
+
+#include "bot_api.h"
+#include "fmt/format.h"
+#include "tgbot/tgbot.h"
+
+namespace foodculator {
+
+namespace {
+
+class TelegramApi : public BotApi {
+   public:
+    explicit TelegramApi(const std::string& token) : bot_(token) {}
+    TelegramApi(const std::string& token, const TgBot::HttpClient& http) : bot_(token, http) {}
+
+    StatusOr<std::vector<BotUpdate>> GetUpdates(int64_t offset, int timeout_sec) override {
+        std::vector<BotUpdate> ret;
+        try {
+            for (const auto& update : bot_.getApi().getUpdates(offset, 100, timeout_sec)) {
+                if (!update->message) {
+                    // Still has to be acknowledged by the next offset.
+                    ret.push_back(BotUpdate{update->updateId, 0, ""});
+                    continue;
+                }
+                ret.push_back(
+                    BotUpdate{update->updateId, update->message->chat->id, update->message->text});
+            }
+        } catch (const std::exception& e) {
+            return {StatusCode::INTERNAL_ERROR, fmt::format("getUpdates failed: {}", e.what())};
+        }
+        return StatusOr{std::move(ret)};
+    }
+
+    StatusCode SendMessage(int64_t chat_id, const std::string& text) override {
+        try {
+            bot_.getApi().sendMessage(chat_id, text);
+        } catch (const std::exception& e) {
+            fmt::print(stderr, "[telegram] sendMessage({}) failed: {}\n", chat_id, e.what());
+            return StatusCode::INTERNAL_ERROR;
+        }
+        return StatusCode::OK;
+    }
+
+   private:
+    TgBot::Bot bot_;
+};
+
+}  // namespace
+
+std::unique_ptr<BotApi> CreateTelegramApi(const std::string& token) {
+    return std::make_unique<TelegramApi>(token);
+}
+
+std::unique_ptr<BotApi> CreateTelegramApi(const std::string& token,
+                                          const TgBot::HttpClient& http) {
+    return std::make_unique<TelegramApi>(token, http);
+}
+
+}  // namespace foodculator
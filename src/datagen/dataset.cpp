@@ -0,0 +1,194 @@
+#include "dataset.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "fmt/format.h"
+
+namespace foodculator {
+
+namespace {
+
+const std::vector<std::string> kFoods = {
+    "молоко",   "кефир",    "сметана", "творог",   "сыр",      "масло",   "мука",    "сахар",
+    "соль",     "яйцо",     "курица",  "говядина", "свинина",  "индейка", "рис",     "гречка",
+    "овсянка",  "картофель", "морковь", "лук",     "капуста",  "свекла",  "томаты",  "огурцы",
+    "яблоко",   "банан",    "шоколад", "мед",      "орехи",    "фасоль",  "milk",    "butter",
+    "cheese",   "yogurt",   "flour",   "sugar",    "chicken",  "beef",    "pork",    "salmon",
+    "rice",     "oats",     "quinoa",  "potato",   "carrot",   "onion",   "tomato",  "apple",
+    "banana",   "chocolate", "honey",  "almond",   "walnut",   "lentils", "tofu",    "pasta",
+};
+
+const std::vector<std::string> kQualifiers = {
+    "пастеризованное", "обезжиренный", "домашний", "свежий",    "замороженный", "копченый",
+    "отварной",        "сушеный",      "цельный",  "фермерский", "organic",     "light",
+    "whole",           "smoked",       "frozen",   "dried",     "fresh",        "raw",
+};
+
+const std::vector<std::string> kBrands = {
+    "Простоквашино", "Вкусвилл",  "Агуша",  "Домик в деревне", "Черкизово", "Мираторг",
+    "Макфа",         "Увелка",    "Danone", "President",       "Valio",     "Barilla",
+    "Heinz",         "Nestle",    "Alpro",  "Lurpak",          "Arla",      "Bonduelle",
+};
+
+const std::vector<std::string> kPots = {
+    "кастрюля", "сковорода", "сотейник", "противень", "форма для запекания", "ковш",
+    "pot",      "pan",       "wok",      "skillet",   "dutch oven",          "saucepan",
+};
+
+const std::vector<std::string> kMaterials = {
+    "чугун", "сталь", "алюминий", "керамика", "стекло", "cast iron", "steel", "ceramic",
+};
+
+const std::vector<std::string> kDishes = {
+    "салат",   "суп",     "каша",  "запеканка", "пирог", "блины", "омлет", "рагу",
+    "плов",    "паста",   "salad", "soup",      "stew",  "pie",   "curry", "risotto",
+    "pancake", "omelette", "bowl", "casserole",
+};
+
+// The standard random distributions are implementation-defined, so values are derived from
+// the raw engine output to make datasets identical across standard libraries.
+class Random {
+   public:
+    explicit Random(uint32_t seed) : engine_(seed) {}
+
+    // Uniform in [0, n).
+    size_t Below(size_t n) { return static_cast<size_t>(engine_() % n); }
+    // Uniform in [0, 1).
+    double Unit() { return static_cast<double>(engine_() >> 11) * 0x1.0p-53; }
+
+    const std::string& Pick(const std::vector<std::string>& words) {
+        return words[Below(words.size())];
+    }
+
+   private:
+    std::mt19937_64 engine_;
+};
+
+// Draws ranks in [0, n) with P(rank) proportional to 1 / (rank + 1).
+class Zipf {
+   public:
+    explicit Zipf(size_t n) : cdf_(n) {
+        double sum = 0;
+        for (size_t rank = 0; rank < n; ++rank) {
+            sum += 1.0 / static_cast<double>(rank + 1);
+            cdf_[rank] = sum;
+        }
+        for (double& v : cdf_) {
+            v /= sum;
+        }
+    }
+
+    size_t Draw(Random& rnd) const {
+        auto it = std::upper_bound(cdf_.begin(), cdf_.end(), rnd.Unit());
+        return std::min<size_t>(it - cdf_.begin(), cdf_.size() - 1);
+    }
+
+   private:
+    std::vector<double> cdf_;
+};
+
+// Returns `name`, or `name` with a number appended if it has already been taken.
+std::string Unique(std::string name, std::unordered_set<std::string>* taken) {
+    if (taken->insert(name).second) {
+        return name;
+    }
+    for (size_t n = 2;; ++n) {
+        std::string candidate = fmt::format("{} ({})", name, n);
+        if (taken->insert(candidate).second) {
+            return candidate;
+        }
+    }
+}
+
+std::vector<Ingredient> GenerateIngredients(const DatasetSpec& spec, Random& rnd) {
+    std::unordered_set<std::string> taken;
+    taken.reserve(spec.ingredients);
+
+    std::vector<Ingredient> ret;
+    ret.reserve(spec.ingredients);
+    for (size_t idx = 0; idx < spec.ingredients; ++idx) {
+        std::string name = rnd.Pick(kFoods) + " " + rnd.Pick(kQualifiers) + " " + rnd.Pick(kBrands);
+        if (rnd.Below(2) == 0) {
+            name += fmt::format(" {},{}%", rnd.Below(30), rnd.Below(10));
+        }
+        auto kcal = static_cast<uint32_t>(rnd.Below(901));
+        ret.emplace_back(Unique(std::move(name), &taken), kcal, idx + 1);
+    }
+    return ret;
+}
+
+std::vector<Tableware> GenerateTableware(const DatasetSpec& spec, Random& rnd) {
+    std::unordered_set<std::string> taken;
+    taken.reserve(spec.tableware);
+
+    std::vector<Tableware> ret;
+    ret.reserve(spec.tableware);
+    for (size_t idx = 0; idx < spec.tableware; ++idx) {
+        std::string name =
+            fmt::format("{} {} {} см", rnd.Pick(kPots), rnd.Pick(kMaterials), 16 + rnd.Below(20));
+        auto weight = static_cast<uint32_t>(200 + rnd.Below(4801));
+        ret.emplace_back(Unique(std::move(name), &taken), weight, idx + 1);
+    }
+    return ret;
+}
+
+std::vector<FullRecipe> GenerateRecipes(const DatasetSpec& spec,
+                                        const std::vector<Ingredient>& ingredients, Random& rnd) {
+    std::unordered_set<std::string> taken;
+    taken.reserve(spec.recipes);
+    const Zipf popularity(ingredients.size());
+
+    std::vector<FullRecipe> ret(spec.recipes);
+    for (size_t idx = 0; idx < spec.recipes; ++idx) {
+        FullRecipe& recipe = ret[idx];
+        recipe.header.id = idx + 1;
+        recipe.header.name =
+            Unique(rnd.Pick(kDishes) + " с " + rnd.Pick(kFoods) + " и " + rnd.Pick(kFoods),
+                   &taken);
+        recipe.description = "Смешать, приготовить, подать.";
+        if (ingredients.empty()) {
+            continue;
+        }
+
+        // 2 + Geometric(1/4): the mean is 5, and only a few recipes out of 100k reach 40.
+        size_t count = 2;
+        while (count < 40 && rnd.Unit() >= 0.25) {
+            ++count;
+        }
+        count = std::min(count, ingredients.size());
+
+        std::unordered_set<size_t> used;
+        while (used.size() < count) {
+            size_t id = ingredients[popularity.Draw(rnd)].id;
+            if (used.insert(id).second) {
+                recipe.ingredients.emplace_back(id, static_cast<uint32_t>(5 + rnd.Below(496)));
+            }
+        }
+    }
+    return ret;
+}
+
+}  // namespace
+
+StatusCode GenerateDataset(DB* db, const DatasetSpec& spec) {
+    Random rnd(spec.seed);
+    const auto ingredients = GenerateIngredients(spec, rnd);
+    const auto tableware = GenerateTableware(spec, rnd);
+    const auto recipes = GenerateRecipes(spec, ingredients, rnd);
+
+    return db->InTransaction([&] {
+        if (auto code = db->ImportProducts(ingredients); code != StatusCode::OK) {
+            return code;
+        }
+        if (auto code = db->ImportTableware(tableware); code != StatusCode::OK) {
+            return code;
+        }
+        return db->ImportRecipes(recipes);
+    });
+}
+
+}  // namespace foodculator
@@ -0,0 +1,27 @@
+#ifndef __SRC_DATAGEN_DATASET_H__
+#define __SRC_DATAGEN_DATASET_H__
+
+#include <cstdint>
+
+#include "db/db.h"
+#include "util/statusor.h"
+
+namespace foodculator {
+
+// Shape of a synthetic catalog. The defaults match the production scale.
+struct DatasetSpec {
+    size_t ingredients = 1000000;
+    size_t tableware = 50000;
+    size_t recipes = 200000;
+    uint32_t seed = 1;
+};
+
+// Fills the empty `db` with a synthetic catalog described by `spec` in a single transaction.
+// Ingredient and pot names mix Cyrillic and Latin words. Recipes use popular ingredients much
+// more often than rare ones, and most have 2-8 ingredients with a long tail up to 40. The same
+// spec always produces the same database.
+StatusCode GenerateDataset(DB* db, const DatasetSpec& spec);
+
+}  // namespace foodculator
+
+#endif
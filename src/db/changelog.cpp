@@ -0,0 +1,115 @@
+#include "changelog.h"
+
+#include <random>
+
+namespace foodculator {
+
+namespace {
+
+uint64_t RandomEpoch() {
+    std::mt19937_64 gen(std::random_device{}());
+    // Never 0, which stands for a reader without an epoch.
+    return std::uniform_int_distribution<uint64_t>(1)(gen);
+}
+
+}  // namespace
+
+std::string_view ToString(DB::Table table) {
+    switch (table) {
+        case DB::Table::INGREDIENTS:
+            return "ingredients";
+        case DB::Table::TABLEWARE:
+            return "tableware";
+        default:
+            return "recipes";
+    }
+}
+
+ChangeLog::ChangeLog(size_t capacity) : capacity_(capacity), epoch_(RandomEpoch()) {}
+
+void ChangeLog::Append(DB::Table table, Change::Op op, size_t id, json11::Json row) {
+    std::map<uint64_t, std::function<void()>> subscribers;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        changes_.push_back(Change{++last_seq_, table, op, id, std::move(row)});
+        if (changes_.size() > capacity_) {
+            changes_.pop_front();
+        }
+        subscribers.swap(subscribers_);
+    }
+    cv_.notify_all();
+    Notify(std::move(subscribers));
+}
+
+void ChangeLog::Reset() {
+    std::map<uint64_t, std::function<void()>> subscribers;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        changes_.clear();
+        ++last_seq_;
+        subscribers.swap(subscribers_);
+    }
+    cv_.notify_all();
+    Notify(std::move(subscribers));
+}
+
+uint64_t ChangeLog::LastSeq() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return last_seq_;
+}
+
+ChangeDelta ChangeLog::Wait(uint64_t since, std::chrono::milliseconds timeout) const {
+    std::unique_lock<std::mutex> lock(mu_);
+    cv_.wait_for(lock, timeout, [this, since] { return last_seq_ != since; });
+    return Collect(since);
+}
+
+ChangeDelta ChangeLog::Wait(uint64_t epoch, uint64_t since,
+                            std::chrono::milliseconds timeout) const {
+    if (epoch != epoch_) {
+        return ChangeDelta{LastSeq(), epoch_, true, {}};
+    }
+    return Wait(since, timeout);
+}
+
+uint64_t ChangeLog::Subscribe(uint64_t since, std::function<void()> callback) const {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (last_seq_ == since) {
+            subscribers_.emplace(++last_subscriber_, std::move(callback));
+            return last_subscriber_;
+        }
+    }
+    callback();
+    return 0;
+}
+
+void ChangeLog::Unsubscribe(uint64_t id) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    subscribers_.erase(id);
+}
+
+void ChangeLog::Notify(std::map<uint64_t, std::function<void()>> subscribers) {
+    // Called without `mu_`, so that a callback may read the log.
+    for (auto& [id, callback] : subscribers) {
+        callback();
+    }
+}
+
+ChangeDelta ChangeLog::Collect(uint64_t since) const {
+    // Sequence numbers in `changes_` are consecutive.
+    const uint64_t first = changes_.empty() ? last_seq_ + 1 : changes_.front().seq;
+
+    ChangeDelta ret{last_seq_, epoch_, false, {}};
+    if (since > last_seq_ || since + 1 < first) {
+        ret.reset = true;
+        return ret;
+    }
+
+    for (auto it = changes_.begin() + (since + 1 - first); it != changes_.end(); ++it) {
+        ret.changes.push_back(*it);
+    }
+    return ret;
+}
+
+}  // namespace foodculator
@@ -0,0 +1,112 @@
+#ifndef __SRC_DB_CHANGELOG_H__
+#define __SRC_DB_CHANGELOG_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "db/db.h"
+#include "json11/json11.hpp"
+
+namespace foodculator {
+
+std::string_view ToString(DB::Table table);
+
+struct Change {
+    enum class Op { ADDED, DELETED };
+
+    uint64_t seq;
+    DB::Table table;
+    Op op;
+    size_t id;
+    // The row in the format of the list endpoints, null for deletions.
+    json11::Json row;
+
+    json11::Json to_json() const {
+        return json11::Json::object{{"seq", std::to_string(seq)},
+                                    {"table", std::string(ToString(table))},
+                                    {"op", op == Op::ADDED ? "added" : "deleted"},
+                                    {"id", std::to_string(id)},
+                                    {"row", row}};
+    }
+};
+
+struct ChangeDelta {
+    // Sequence number of the last change in the log.
+    uint64_t seq;
+    // The log that `seq` belongs to, see ChangeLog::Epoch().
+    uint64_t epoch;
+    // Set if the changes the reader asked for are no longer in the log, e.g. because they were
+    // evicted or the server was restarted. The reader has to reload the whole tables.
+    bool reset;
+    std::vector<Change> changes;
+
+    json11::Json to_json() const {
+        return json11::Json::object{{"seq", std::to_string(seq)},
+                                    {"epoch", std::to_string(epoch)},
+                                    {"reset", reset},
+                                    {"changes", changes}};
+    }
+};
+
+// ChangeLog keeps the most recent DB writes in memory, numbered by a sequence number that
+// grows by one with every write. Readers that can block a thread wait for new entries without
+// registering anywhere. Readers that can't, e.g. long polls parked in an event loop, subscribe
+// instead, and the next write calls them back.
+//
+// Sequence numbers only mean something within one log: every log gets a random epoch, and a
+// reader that comes with the epoch of another log, e.g. of the server before a restart or of
+// another worker process, gets a reset.
+class ChangeLog {
+   public:
+    explicit ChangeLog(size_t capacity = 4096);
+
+    void Append(DB::Table table, Change::Op op, size_t id, json11::Json row = nullptr);
+
+    // Forgets all changes, so that every reader gets a reset.
+    void Reset();
+
+    // Returns the sequence number of the last change, 0 if there were none.
+    uint64_t LastSeq() const;
+    uint64_t Epoch() const { return epoch_; }
+
+    // Returns the changes with sequence numbers greater than `since`. If there are none,
+    // waits up to `timeout` for the next change.
+    ChangeDelta Wait(uint64_t since, std::chrono::milliseconds timeout) const;
+    // The same for a reader that got `since` from the log with `epoch`. Returns a reset right
+    // away if that is another log.
+    ChangeDelta Wait(uint64_t epoch, uint64_t since, std::chrono::milliseconds timeout) const;
+
+    // Calls `callback` once there are changes after `since`: right away if there are, and
+    // otherwise from the Append() or Reset() that makes one, so it should return quickly.
+    // Returns an id for Unsubscribe(), 0 if `callback` was called right away.
+    uint64_t Subscribe(uint64_t since, std::function<void()> callback) const;
+    // Forgets the callback of a subscription, unless it was called already.
+    void Unsubscribe(uint64_t id) const;
+
+   private:
+    ChangeDelta Collect(uint64_t since) const;
+    // Calls the subscribers taken from `subscribers_`.
+    static void Notify(std::map<uint64_t, std::function<void()>> subscribers);
+
+    const size_t capacity_;
+    const uint64_t epoch_;
+
+    mutable std::mutex mu_;
+    mutable std::condition_variable cv_;
+    std::deque<Change> changes_;
+    uint64_t last_seq_ = 0;
+    // Subscribers waiting for the change after `last_seq_`, by id.
+    mutable std::map<uint64_t, std::function<void()>> subscribers_;
+    mutable uint64_t last_subscriber_ = 0;
+};
+
+}  // namespace foodculator
+
+#endif
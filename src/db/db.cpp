@@ -2,12 +2,20 @@
 
 #include <sqlite3.h>
 
+#include <algorithm>
+#include <cctype>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
 #include <sstream>
 #include <string>
 #include <string_view>
 
+#include "changelog.h"
+#include "recipe_nutrition.h"
 #include "fmt/format.h"
+#include "util/timing.h"
 
 namespace foodculator {
 
@@ -25,22 +33,375 @@ StatusCode ConvertSqliteToStatus(int status) {
     }
 }
 
+// Schema changes made on top of the tables created in DB::Create, in the order they were
+// introduced. PRAGMA user_version stores how many of them have been applied to a database.
+const char* const kMigrations[] = {
+    // Row versions and tombstones for delta sync. SYNC_CLOCK.VERSION is bumped by every write;
+    // the written row (or its tombstone) is stamped with the new value. Rows that existed
+    // before the migration get version 1. TOMBSTONES.TBL holds DB::Table values.
+    R"*(
+        CREATE TABLE SYNC_CLOCK(
+            ID              INTEGER   PRIMARY KEY   CHECK (ID = 0),
+            VERSION         INTEGER                               NOT NULL,
+            COMPACTED       INTEGER                               NOT NULL
+        );
+        INSERT INTO SYNC_CLOCK VALUES (0, 1, 0);
+
+        CREATE TABLE TOMBSTONES(
+            TBL             INTEGER                               NOT NULL,
+            ROW_ID          INTEGER                               NOT NULL,
+            VERSION         INTEGER                               NOT NULL,
+            DELETED_AT      INTEGER                               NOT NULL
+        );
+        CREATE INDEX TOMBSTONES_BY_VERSION ON TOMBSTONES(TBL, VERSION);
+        CREATE INDEX TOMBSTONES_BY_TIME ON TOMBSTONES(DELETED_AT);
+
+        ALTER TABLE INGREDIENTS ADD COLUMN VERSION INTEGER DEFAULT 1 NOT NULL;
+        ALTER TABLE TABLEWARE ADD COLUMN VERSION INTEGER DEFAULT 1 NOT NULL;
+        ALTER TABLE RECIPE ADD COLUMN VERSION INTEGER DEFAULT 1 NOT NULL;
+        CREATE INDEX INGREDIENTS_BY_VERSION ON INGREDIENTS(VERSION);
+        CREATE INDEX TABLEWARE_BY_VERSION ON TABLEWARE(VERSION);
+        CREATE INDEX RECIPE_BY_VERSION ON RECIPE(VERSION);
+
+        CREATE TRIGGER INGREDIENTS_INSERT AFTER INSERT ON INGREDIENTS BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE INGREDIENTS SET VERSION = (SELECT VERSION FROM SYNC_CLOCK) WHERE ID = NEW.ID;
+        END;
+        CREATE TRIGGER INGREDIENTS_UPDATE AFTER UPDATE OF NAME, KCAL ON INGREDIENTS BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE INGREDIENTS SET VERSION = (SELECT VERSION FROM SYNC_CLOCK) WHERE ID = NEW.ID;
+        END;
+        CREATE TRIGGER INGREDIENTS_DELETE AFTER DELETE ON INGREDIENTS BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            INSERT INTO TOMBSTONES SELECT 0, OLD.ID, VERSION, strftime('%s', 'now')
+                FROM SYNC_CLOCK;
+        END;
+
+        CREATE TRIGGER TABLEWARE_INSERT AFTER INSERT ON TABLEWARE BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE TABLEWARE SET VERSION = (SELECT VERSION FROM SYNC_CLOCK) WHERE ID = NEW.ID;
+        END;
+        CREATE TRIGGER TABLEWARE_UPDATE AFTER UPDATE OF NAME, WEIGHT ON TABLEWARE BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE TABLEWARE SET VERSION = (SELECT VERSION FROM SYNC_CLOCK) WHERE ID = NEW.ID;
+        END;
+        CREATE TRIGGER TABLEWARE_DELETE AFTER DELETE ON TABLEWARE BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            INSERT INTO TOMBSTONES SELECT 1, OLD.ID, VERSION, strftime('%s', 'now')
+                FROM SYNC_CLOCK;
+        END;
+
+        CREATE TRIGGER RECIPE_INSERT AFTER INSERT ON RECIPE BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE RECIPE SET VERSION = (SELECT VERSION FROM SYNC_CLOCK) WHERE ID = NEW.ID;
+        END;
+        CREATE TRIGGER RECIPE_UPDATE AFTER UPDATE OF NAME, DESC ON RECIPE BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE RECIPE SET VERSION = (SELECT VERSION FROM SYNC_CLOCK) WHERE ID = NEW.ID;
+        END;
+        CREATE TRIGGER RECIPE_DELETE AFTER DELETE ON RECIPE BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            INSERT INTO TOMBSTONES SELECT 2, OLD.ID, VERSION, strftime('%s', 'now')
+                FROM SYNC_CLOCK;
+        END;
+
+        -- A recipe changes together with its list of ingredients.
+        CREATE TRIGGER RECIPE_INGREDIENTS_INSERT AFTER INSERT ON RECIPE_INGREDIENTS BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE RECIPE SET VERSION = (SELECT VERSION FROM SYNC_CLOCK)
+                WHERE ID = NEW.RECIPE_ID;
+        END;
+        CREATE TRIGGER RECIPE_INGREDIENTS_UPDATE AFTER UPDATE ON RECIPE_INGREDIENTS BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE RECIPE SET VERSION = (SELECT VERSION FROM SYNC_CLOCK)
+                WHERE ID = NEW.RECIPE_ID;
+        END;
+        CREATE TRIGGER RECIPE_INGREDIENTS_DELETE AFTER DELETE ON RECIPE_INGREDIENTS
+            WHEN EXISTS (SELECT 1 FROM RECIPE WHERE ID = OLD.RECIPE_ID) BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE RECIPE SET VERSION = (SELECT VERSION FROM SYNC_CLOCK)
+                WHERE ID = OLD.RECIPE_ID;
+        END;
+    )*",
+    // Recipe lookups and the foreign key checks made when deleting a recipe or an ingredient
+    // used to scan the whole RECIPE_INGREDIENTS table.
+    R"*(
+        CREATE INDEX RECIPE_INGREDIENTS_BY_RECIPE ON RECIPE_INGREDIENTS(RECIPE_ID);
+        CREATE INDEX RECIPE_INGREDIENTS_BY_INGREDIENT ON RECIPE_INGREDIENTS(INGR_ID);
+    )*",
+    // Bulk imports stamp all their rows with one version while SYNC_CLOCK.IMPORTING is set,
+    // instead of bumping the clock and rewriting every inserted row from a trigger.
+    R"*(
+        ALTER TABLE SYNC_CLOCK ADD COLUMN IMPORTING INTEGER DEFAULT 0 NOT NULL;
+
+        DROP TRIGGER INGREDIENTS_INSERT;
+        CREATE TRIGGER INGREDIENTS_INSERT AFTER INSERT ON INGREDIENTS
+            WHEN (SELECT IMPORTING FROM SYNC_CLOCK) = 0 BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE INGREDIENTS SET VERSION = (SELECT VERSION FROM SYNC_CLOCK) WHERE ID = NEW.ID;
+        END;
+        DROP TRIGGER TABLEWARE_INSERT;
+        CREATE TRIGGER TABLEWARE_INSERT AFTER INSERT ON TABLEWARE
+            WHEN (SELECT IMPORTING FROM SYNC_CLOCK) = 0 BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE TABLEWARE SET VERSION = (SELECT VERSION FROM SYNC_CLOCK) WHERE ID = NEW.ID;
+        END;
+        DROP TRIGGER RECIPE_INSERT;
+        CREATE TRIGGER RECIPE_INSERT AFTER INSERT ON RECIPE
+            WHEN (SELECT IMPORTING FROM SYNC_CLOCK) = 0 BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE RECIPE SET VERSION = (SELECT VERSION FROM SYNC_CLOCK) WHERE ID = NEW.ID;
+        END;
+        DROP TRIGGER RECIPE_INGREDIENTS_INSERT;
+        CREATE TRIGGER RECIPE_INGREDIENTS_INSERT AFTER INSERT ON RECIPE_INGREDIENTS
+            WHEN (SELECT IMPORTING FROM SYNC_CLOCK) = 0 BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE RECIPE SET VERSION = (SELECT VERSION FROM SYNC_CLOCK)
+                WHERE ID = NEW.RECIPE_ID;
+        END;
+    )*",
+    // Full-text search over recipes, see DB::SearchRecipes(). FTS5 reads the text from RECIPE
+    // instead of keeping a copy, and the triggers keep the index in sync with it. Version bumps
+    // don't touch NAME or DESC, so they don't reindex the recipe. There are no prefix indices:
+    // they made indexing three times slower and prefix queries only a bit faster.
+    R"*(
+        CREATE VIRTUAL TABLE RECIPE_SEARCH USING fts5(
+            NAME, DESC, content='RECIPE', content_rowid='ID');
+        INSERT INTO RECIPE_SEARCH(RECIPE_SEARCH) VALUES ('rebuild');
+
+        CREATE TRIGGER RECIPE_SEARCH_INSERT AFTER INSERT ON RECIPE BEGIN
+            INSERT INTO RECIPE_SEARCH(ROWID, NAME, DESC) VALUES (NEW.ID, NEW.NAME, NEW.DESC);
+        END;
+        CREATE TRIGGER RECIPE_SEARCH_DELETE AFTER DELETE ON RECIPE BEGIN
+            INSERT INTO RECIPE_SEARCH(RECIPE_SEARCH, ROWID, NAME, DESC)
+                VALUES ('delete', OLD.ID, OLD.NAME, OLD.DESC);
+        END;
+        CREATE TRIGGER RECIPE_SEARCH_UPDATE AFTER UPDATE OF NAME, DESC ON RECIPE BEGIN
+            INSERT INTO RECIPE_SEARCH(RECIPE_SEARCH, ROWID, NAME, DESC)
+                VALUES ('delete', OLD.ID, OLD.NAME, OLD.DESC);
+            INSERT INTO RECIPE_SEARCH(ROWID, NAME, DESC) VALUES (NEW.ID, NEW.NAME, NEW.DESC);
+        END;
+    )*",
+    // Recipes used as ingredients of other recipes, e.g. a stock in a soup. A recipe that is
+    // used can't be deleted, and DB::UpdateRecipe() refuses to create cycles. A recipe changes
+    // with its list of sub-recipes, like with its ingredients.
+    R"*(
+        CREATE TABLE RECIPE_SUBRECIPES(
+            RECIPE_ID       INTEGER                               NOT NULL,
+            SUBRECIPE_ID    INTEGER                               NOT NULL,
+            WEIGHT          INTEGER                               NOT NULL,
+            FOREIGN KEY(RECIPE_ID)    REFERENCES RECIPE(ID) ON DELETE CASCADE,
+            FOREIGN KEY(SUBRECIPE_ID) REFERENCES RECIPE(ID)
+        );
+        CREATE INDEX RECIPE_SUBRECIPES_BY_RECIPE ON RECIPE_SUBRECIPES(RECIPE_ID);
+        CREATE INDEX RECIPE_SUBRECIPES_BY_SUBRECIPE ON RECIPE_SUBRECIPES(SUBRECIPE_ID);
+
+        CREATE TRIGGER RECIPE_SUBRECIPES_INSERT AFTER INSERT ON RECIPE_SUBRECIPES
+            WHEN (SELECT IMPORTING FROM SYNC_CLOCK) = 0 BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE RECIPE SET VERSION = (SELECT VERSION FROM SYNC_CLOCK)
+                WHERE ID = NEW.RECIPE_ID;
+        END;
+        CREATE TRIGGER RECIPE_SUBRECIPES_UPDATE AFTER UPDATE ON RECIPE_SUBRECIPES BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE RECIPE SET VERSION = (SELECT VERSION FROM SYNC_CLOCK)
+                WHERE ID = NEW.RECIPE_ID;
+        END;
+        CREATE TRIGGER RECIPE_SUBRECIPES_DELETE AFTER DELETE ON RECIPE_SUBRECIPES
+            WHEN EXISTS (SELECT 1 FROM RECIPE WHERE ID = OLD.RECIPE_ID) BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE RECIPE SET VERSION = (SELECT VERSION FROM SYNC_CLOCK)
+                WHERE ID = OLD.RECIPE_ID;
+        END;
+    )*",
+    // Nutrients of ingredients in grams per 100g besides KCAL, see Nutrient. Existing
+    // ingredients get zeros.
+    R"*(
+        ALTER TABLE INGREDIENTS ADD COLUMN PROTEIN REAL DEFAULT 0 NOT NULL;
+        ALTER TABLE INGREDIENTS ADD COLUMN FAT REAL DEFAULT 0 NOT NULL;
+        ALTER TABLE INGREDIENTS ADD COLUMN CARBOHYDRATE REAL DEFAULT 0 NOT NULL;
+        ALTER TABLE INGREDIENTS ADD COLUMN FIBRE REAL DEFAULT 0 NOT NULL;
+        ALTER TABLE INGREDIENTS ADD COLUMN SALT REAL DEFAULT 0 NOT NULL;
+        ALTER TABLE INGREDIENTS ADD COLUMN SUGAR REAL DEFAULT 0 NOT NULL;
+
+        DROP TRIGGER INGREDIENTS_UPDATE;
+        CREATE TRIGGER INGREDIENTS_UPDATE AFTER UPDATE OF
+            NAME, KCAL, PROTEIN, FAT, CARBOHYDRATE, FIBRE, SALT, SUGAR ON INGREDIENTS BEGIN
+            UPDATE SYNC_CLOCK SET VERSION = VERSION + 1;
+            UPDATE INGREDIENTS SET VERSION = (SELECT VERSION FROM SYNC_CLOCK) WHERE ID = NEW.ID;
+        END;
+    )*",
+    // The version of the leader a follower has replayed, see DB::ApplyReplication().
+    R"*(
+        CREATE TABLE REPLICA(
+            ID              INTEGER   PRIMARY KEY   CHECK (ID = 0),
+            VERSION         INTEGER                               NOT NULL
+        );
+    )*",
+    // Replication batches walk the tombstones of a version in the order of their row ids.
+    R"*(
+        DROP INDEX TOMBSTONES_BY_VERSION;
+        CREATE INDEX TOMBSTONES_BY_VERSION ON TOMBSTONES(TBL, VERSION, ROW_ID);
+    )*",
+};
+
+// Turns the words of a user's query into an FTS5 query that matches all of them, the last one
+// also as a prefix, so that FTS5 operators and quotes in the input are taken literally.
+// Returns an empty string if there are no words.
+std::string FtsQuery(std::string_view query) {
+    std::string ret;
+    size_t idx = 0;
+    while (idx < query.size()) {
+        // Bytes of multibyte UTF-8 characters are word characters; FTS5 tokenizes the phrase
+        // again and drops the punctuation among them.
+        auto is_word = [&query](size_t idx) {
+            const auto c = static_cast<unsigned char>(query[idx]);
+            return c >= 0x80 || std::isalnum(c);
+        };
+        while (idx < query.size() && !is_word(idx)) {
+            ++idx;
+        }
+        const size_t start = idx;
+        while (idx < query.size() && is_word(idx)) {
+            ++idx;
+        }
+        if (idx > start) {
+            if (!ret.empty()) {
+                ret += ' ';
+            }
+            ret += '"';
+            ret += query.substr(start, idx - start);
+            ret += '"';
+        }
+    }
+    if (!ret.empty()) {
+        ret += '*';
+    }
+    return ret;
+}
+
+// The columns of INGREDIENTS that make up the profile of an ingredient, see ParseProfile().
+constexpr char kNutrientColumns[] = "PROTEIN, FAT, CARBOHYDRATE, FIBRE, SALT, SUGAR";
+constexpr char kProfileColumns[] = "KCAL, PROTEIN, FAT, CARBOHYDRATE, FIBRE, SALT, SUGAR";
+
+// Reads the nutrients of an ingredient from the kNutrientColumns of `row` starting at `first`.
+Nutrients ParseNutrients(const std::vector<std::string>& row, size_t first, std::string_view sql) {
+    if (row.size() < first + kNutrientCount) {
+        fmt::print(stderr, "'{}' returned {} columns\n", sql, row.size());
+        exit(2);
+    }
+    Nutrients ret;
+    for (size_t idx = 0; idx < kNutrientCount; ++idx) {
+        ret[idx] = std::stof(row[first + idx]);
+    }
+    return ret;
+}
+
+// Reads the profile of an ingredient from the kProfileColumns of `row` starting at `first`.
+NutrientProfile ParseProfile(const std::vector<std::string>& row, size_t first,
+                             std::string_view sql) {
+    if (row.size() < first + 1) {
+        fmt::print(stderr, "'{}' returned {} columns\n", sql, row.size());
+        exit(2);
+    }
+    return NutrientProfile(std::stof(row[first]), ParseNutrients(row, first + 1, sql));
+}
+
+// A table holding the ingredients or the sub-recipes of recipes, the column with their ids,
+// and the rows of a recipe that go there.
+struct RecipeList {
+    std::string_view table;
+    std::string_view column;
+    const std::vector<RecipeIngredient>* rows;
+};
+
+// Passes the rows returned by `select_page(after_id)` to `visit` until a page comes back empty.
+// `row_id(row)` is the id to select the next page after. Sets `*stopped` if `visit` returned
+// false.
+template <class SelectPage, class RowId>
+StatusCode VisitPages(SelectPage select_page, RowId row_id,
+                      const std::function<bool(const CatalogRow&)>& visit, bool* stopped) {
+    size_t after_id = 0;
+    while (true) {
+        auto page = select_page(after_id);
+        if (!page.Ok()) {
+            return page.Code();
+        }
+        if (page.Value().empty()) {
+            return StatusCode::OK;
+        }
+        after_id = row_id(page.Value().back());
+        for (auto& row : page.Value()) {
+            if (!visit(CatalogRow(std::move(row)))) {
+                *stopped = true;
+                return StatusCode::OK;
+            }
+        }
+    }
+}
+
+// Applies the migrations from kMigrations that `db` hasn't seen yet.
+bool Migrate(sqlite3* db) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, nullptr) != SQLITE_OK ||
+        sqlite3_step(stmt) != SQLITE_ROW) {
+        fmt::print(stderr, "Can't read the schema version: {}\n", sqlite3_errmsg(db));
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    const size_t applied = static_cast<size_t>(sqlite3_column_int(stmt, 0));
+    sqlite3_finalize(stmt);
+
+    for (size_t idx = applied; idx < std::size(kMigrations); ++idx) {
+        std::string sql = fmt::format("BEGIN; {} PRAGMA user_version = {}; COMMIT;",
+                                      kMigrations[idx], idx + 1);
+        char* err = nullptr;
+        if (sqlite3_exec(db, sql.c_str(), nullptr, 0, &err) != SQLITE_OK) {
+            fmt::print(stderr, "Migration #{} failed: {}\n", idx + 1, err);
+            sqlite3_free(err);
+            sqlite3_exec(db, "ROLLBACK;", nullptr, 0, nullptr);
+            return false;
+        }
+    }
+    return true;
+}
+
 }  // namespace
 
 std::unique_ptr<DB> DB::Create(std::string_view path) {
     sqlite3* db = nullptr;
 
-    if (path != ":memory:") {
+    // SQLite can only be configured before it's initialized, i.e. before the first database is
+    // opened. Processes with many tenants open many.
+    static const bool configured = [path] {
+        if (path == ":memory:") {
+            return false;
+        }
         if (int st = sqlite3_config(SQLITE_CONFIG_SERIALIZED); st != SQLITE_OK) {
             fmt::print(stderr, "SQL config error: {}\n", st);
         }
-    }
+        return true;
+    }();
+    (void)configured;
 
     if (sqlite3_open(path.data(), &db) != SQLITE_OK) {
         fmt::print(stderr, "Can't open database: {}\n", path);
         return nullptr;
     }
 
+    // Several processes may share the file: WAL lets them read while one of them writes, and
+    // writers wait for each other instead of failing with SQLITE_BUSY.
+    sqlite3_busy_timeout(db, kBusyTimeoutMs);
+    if (path != ":memory:") {
+        char* err = nullptr;
+        if (sqlite3_exec(db, "PRAGMA journal_mode = WAL;", nullptr, 0, &err) != SQLITE_OK) {
+            fmt::print(stderr, "Can't switch {} to WAL: {}\n", path, err);
+            sqlite3_free(err);
+            sqlite3_close(db);
+            return nullptr;
+        }
+    }
+
     const char sql[] =
         R"*(
         PRAGMA foreign_keys = ON;
@@ -79,19 +440,62 @@ std::unique_ptr<DB> DB::Create(std::string_view path) {
         return nullptr;
     }
 
-    return std::unique_ptr<DB>(new DB(db));
+    if (!Migrate(db)) {
+        sqlite3_close(db);
+        return nullptr;
+    }
+
+    // Imports clear IMPORTING in the transaction that sets it, but an import that crashed
+    // before they did could have left it set, and with it the version triggers off.
+    if (sqlite3_exec(db, "UPDATE SYNC_CLOCK SET IMPORTING = 0 WHERE IMPORTING != 0;", nullptr, 0,
+                     &err) != SQLITE_OK) {
+        fmt::print(stderr, "SQL error: {} \n", err);
+        sqlite3_free(err);
+        sqlite3_close(db);
+        return nullptr;
+    }
+
+    auto ret = std::unique_ptr<DB>(new DB(db));
+    ret->CatchUpExternalWrites();
+    return ret;
 }
 
+DB::DB(sqlite3* db)
+    : db_(db),
+      changes_(std::make_unique<ChangeLog>()),
+      nutrition_(std::make_unique<RecipeNutrition>()) {}
+
 DB::~DB() {
     if (db_) {
         sqlite3_close(db_);
     }
 }
 
-StatusOr<size_t> DB::AddProduct(std::string name, uint32_t kcal) {
+void DB::SetMemoryLimit(int64_t bytes) { sqlite3_soft_heap_limit64(bytes); }
+
+int64_t DB::MemoryUsed() { return sqlite3_memory_used(); }
+
+uint64_t DB::Generation(Table table) const {
+    return generations_[static_cast<size_t>(table)].load(std::memory_order_acquire);
+}
+
+void DB::BumpGeneration(Table table) {
+    generations_[static_cast<size_t>(table)].fetch_add(1, std::memory_order_acq_rel);
+}
+
+StatusOr<size_t> DB::AddProduct(std::string name, uint32_t kcal, const Nutrients& nutrients) {
+    // Held until the change is appended, so that Changes() lists the writes in commit order.
+    std::lock_guard<std::recursive_mutex> lock(mu_);
     std::vector<BindParameter> params = {{std::move(name)}, {kcal}};
-    switch (Insert("INGREDIENTS", {"NAME", "KCAL"}, params)) {
+    std::vector<BindParameter> insert_params = params;
+    for (float value : nutrients) {
+        insert_params.emplace_back(fmt::format("{}", value));
+    }
+    switch (Insert("INGREDIENTS",
+                   {"NAME", "KCAL", "PROTEIN", "FAT", "CARBOHYDRATE", "FIBRE", "SALT", "SUGAR"},
+                   insert_params)) {
         case StatusCode::OK:
+            BumpGeneration(Table::INGREDIENTS);
             break;
         case StatusCode::INVALID_ARGUMENT:
             return {StatusCode::INVALID_ARGUMENT,
@@ -103,14 +507,20 @@ StatusOr<size_t> DB::AddProduct(std::string name, uint32_t kcal) {
     auto st = SelectId("INGREDIENTS", {"NAME", "KCAL"}, params, "ID");
     if (!st.Ok()) {
         Exec("DELETE FROM INGREDIENTS WHERE NAME=?1 AND KCAL=?2;", params);
+        return st;
     }
+
+    Ingredient added(std::move(std::get<std::string>(params[0])), kcal, st.Value(), nutrients);
+    changes_->Append(Table::INGREDIENTS, Change::Op::ADDED, added.id, added.to_json());
     return st;
 }
 
 StatusOr<size_t> DB::AddTableware(std::string name, uint32_t weight) {
+    std::lock_guard<std::recursive_mutex> lock(mu_);
     std::vector<BindParameter> params = {{std::move(name)}, {weight}};
     switch (Insert("TABLEWARE", {"NAME", "WEIGHT"}, params)) {
         case StatusCode::OK:
+            BumpGeneration(Table::TABLEWARE);
             break;
         case StatusCode::INVALID_ARGUMENT:
             return {StatusCode::INVALID_ARGUMENT, "This pot already exists in the database."};
@@ -121,7 +531,11 @@ StatusOr<size_t> DB::AddTableware(std::string name, uint32_t weight) {
     auto st = SelectId("TABLEWARE", {"NAME", "WEIGHT"}, params, "ID");
     if (!st.Ok()) {
         Exec("DELETE FROM TABLEWARE WHERE NAME=?1 AND WEIGHT=?2;", params);
+        return st;
     }
+
+    Tableware added(std::move(std::get<std::string>(params[0])), weight, st.Value());
+    changes_->Append(Table::TABLEWARE, Change::Op::ADDED, added.id, added.to_json());
     return st;
 }
 
@@ -195,7 +609,8 @@ StatusOr<size_t> DB::SelectId(std::string_view table, const std::vector<std::str
 }
 
 StatusOr<Ingredient> DB::GetProduct(size_t id) {
-    std::string_view sql = "SELECT NAME, KCAL from INGREDIENTS WHERE ID=?1;";
+    static const std::string sql =
+        fmt::format("SELECT NAME, KCAL, {} from INGREDIENTS WHERE ID=?1;", kNutrientColumns);
     auto res = Exec(sql, {{id}});
     if (!res.Ok()) {
         return {res.Code(), std::move(res.Error())};
@@ -206,26 +621,48 @@ StatusOr<Ingredient> DB::GetProduct(size_t id) {
     }
 
     auto& row = res.Value()[0];
-    if (row.size() != 2) {
+    if (row.size() != 2 + kNutrientCount) {
         fmt::print(stderr, "'{}' returned {} columns\n", sql, row.size());
         exit(2);
     }
 
     std::string name = std::move(row[0]);
     auto kcal = static_cast<uint32_t>(std::stoul(row[1]));
-    return StatusOr{Ingredient{std::move(name), kcal, id}};
+    return StatusOr{Ingredient{std::move(name), kcal, id, ParseNutrients(row, 2, sql)}};
 }
 
 StatusOr<std::vector<Ingredient>> DB::GetProducts() {
+    static const std::string sql =
+        fmt::format("SELECT NAME, KCAL, ID, {} from INGREDIENTS;", kNutrientColumns);
+    return SelectProducts(sql, {});
+}
+
+StatusOr<RowDelta<Ingredient>> DB::GetProductsSince(uint64_t since) {
+    RowDelta<Ingredient> delta;
+    if (auto code = StartDelta(Table::INGREDIENTS, since, &delta); code != StatusCode::OK) {
+        return {code, "DB request failed. Try again later."};
+    }
+
+    static const std::string sql = fmt::format(
+        "SELECT NAME, KCAL, ID, {} FROM INGREDIENTS WHERE VERSION > ?1;", kNutrientColumns);
+    auto rows = SelectProducts(sql, {{std::to_string(delta.reset ? 0 : since)}});
+    if (!rows.Ok()) {
+        return {rows.Code(), std::move(rows.Error())};
+    }
+    delta.changed = std::move(rows.Value());
+    return StatusOr{std::move(delta)};
+}
+
+StatusOr<std::vector<Ingredient>> DB::SelectProducts(std::string_view sql,
+                                                     const std::vector<BindParameter>& params) {
     std::vector<Ingredient> ret;
-    std::string_view sql = "SELECT NAME, KCAL, ID from INGREDIENTS;";
-    auto res = Exec(sql, {});
+    auto res = Exec(sql, params);
     if (!res.Ok()) {
         return {res.Code(), std::move(res.Error())};
     }
 
     for (auto& row : res.Value()) {
-        if (row.size() != 3) {
+        if (row.size() != 3 + kNutrientCount) {
             fmt::print(stderr, "'{}' returned {} columns\n", sql, row.size());
             exit(2);
         }
@@ -233,15 +670,34 @@ StatusOr<std::vector<Ingredient>> DB::GetProducts() {
         std::string name = std::move(row[0]);
         uint32_t kcal = static_cast<uint32_t>(std::stoul(row[1]));
         size_t id = static_cast<size_t>(std::stoull(row[2]));
-        ret.emplace_back(std::move(name), kcal, id);
+        ret.emplace_back(std::move(name), kcal, id, ParseNutrients(row, 3, sql));
     }
     return StatusOr{std::move(ret)};
 }
 
 StatusOr<std::vector<Tableware>> DB::GetTableware() {
+    return SelectTableware("SELECT NAME, WEIGHT, ID from TABLEWARE;", {});
+}
+
+StatusOr<RowDelta<Tableware>> DB::GetTablewareSince(uint64_t since) {
+    RowDelta<Tableware> delta;
+    if (auto code = StartDelta(Table::TABLEWARE, since, &delta); code != StatusCode::OK) {
+        return {code, "DB request failed. Try again later."};
+    }
+
+    auto rows = SelectTableware("SELECT NAME, WEIGHT, ID FROM TABLEWARE WHERE VERSION > ?1;",
+                                {{std::to_string(delta.reset ? 0 : since)}});
+    if (!rows.Ok()) {
+        return {rows.Code(), std::move(rows.Error())};
+    }
+    delta.changed = std::move(rows.Value());
+    return StatusOr{std::move(delta)};
+}
+
+StatusOr<std::vector<Tableware>> DB::SelectTableware(std::string_view sql,
+                                                     const std::vector<BindParameter>& params) {
     std::vector<Tableware> ret;
-    std::string_view sql = "SELECT NAME, WEIGHT, ID from TABLEWARE;";
-    auto res = Exec(sql, {});
+    auto res = Exec(sql, params);
     if (!res.Ok()) {
         return {res.Code(), std::move(res.Error())};
     }
@@ -261,19 +717,120 @@ StatusOr<std::vector<Tableware>> DB::GetTableware() {
 }
 
 bool DB::DeleteProduct(size_t id) {
-    return Exec("DELETE from INGREDIENTS where ID = ?1;", {{id}}).Ok();
+    std::lock_guard<std::recursive_mutex> lock(mu_);
+    size_t deleted = 0;
+    if (!Exec("DELETE from INGREDIENTS where ID = ?1;", {{id}}, &deleted).Ok()) {
+        return false;
+    }
+    BumpGeneration(Table::INGREDIENTS);
+    nutrition_->InvalidateIngredient(id);
+    if (deleted > 0) {
+        changes_->Append(Table::INGREDIENTS, Change::Op::DELETED, id);
+    }
+    return true;
+}
+
+StatusCode DB::MergeProducts(size_t into, const std::vector<size_t>& duplicates) {
+    if (std::find(duplicates.begin(), duplicates.end(), into) != duplicates.end()) {
+        return StatusCode::INVALID_ARGUMENT;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(mu_);
+    // The recipes that used the duplicates, by id.
+    std::map<size_t, RecipeHeader> affected;
+    auto code = InTransaction([&] {
+        if (auto found = Exec("SELECT ID FROM INGREDIENTS WHERE ID = ?1;", {{into}});
+            !found.Ok() || found.Value().empty()) {
+            return found.Ok() ? StatusCode::NOT_FOUND : found.Code();
+        }
+
+        for (size_t id : duplicates) {
+            auto users = SelectRecipes(R"(
+                SELECT NAME, ID FROM RECIPE WHERE ID IN (
+                    SELECT RECIPE_ID FROM RECIPE_INGREDIENTS WHERE INGR_ID = ?1);)",
+                                       {{id}});
+            if (!users.Ok()) {
+                return users.Code();
+            }
+            for (auto& recipe : users.Value()) {
+                affected.emplace(recipe.id, std::move(recipe));
+            }
+
+            auto st = Exec("UPDATE RECIPE_INGREDIENTS SET INGR_ID = ?1 WHERE INGR_ID = ?2;",
+                           {{into}, {id}});
+            if (!st.Ok()) {
+                return st.Code();
+            }
+        }
+
+        // Recipes that had more than one of the products keep the first row with the sum.
+        auto st = Exec(R"(
+            UPDATE RECIPE_INGREDIENTS SET WEIGHT = (
+                SELECT SUM(R.WEIGHT) FROM RECIPE_INGREDIENTS AS R
+                WHERE R.RECIPE_ID = RECIPE_INGREDIENTS.RECIPE_ID AND R.INGR_ID = ?1)
+            WHERE ROWID IN (SELECT MIN(ROWID) FROM RECIPE_INGREDIENTS WHERE INGR_ID = ?1
+                            GROUP BY RECIPE_ID HAVING COUNT(*) > 1);)",
+                       {{into}});
+        if (st.Ok()) {
+            st = Exec(R"(
+                DELETE FROM RECIPE_INGREDIENTS WHERE INGR_ID = ?1 AND ROWID NOT IN (
+                    SELECT MIN(ROWID) FROM RECIPE_INGREDIENTS WHERE INGR_ID = ?1
+                    GROUP BY RECIPE_ID);)",
+                      {{into}});
+        }
+        if (!st.Ok()) {
+            return st.Code();
+        }
+
+        for (size_t id : duplicates) {
+            size_t deleted = 0;
+            if (auto st = Exec("DELETE FROM INGREDIENTS WHERE ID = ?1;", {{id}}, &deleted);
+                !st.Ok() || deleted == 0) {
+                return st.Ok() ? StatusCode::NOT_FOUND : st.Code();
+            }
+        }
+        return StatusCode::OK;
+    });
+    if (code != StatusCode::OK) {
+        return code;
+    }
+
+    BumpGeneration(Table::INGREDIENTS);
+    BumpGeneration(Table::RECIPE);
+    for (size_t id : duplicates) {
+        // The recipes that used the duplicates now use `into`, which may have other kcal.
+        nutrition_->InvalidateIngredient(id);
+        changes_->Append(Table::INGREDIENTS, Change::Op::DELETED, id);
+    }
+    for (const auto& [id, recipe] : affected) {
+        // Like a rename in UpdateRecipe(): readers of Changes() only add rows they don't have.
+        changes_->Append(Table::RECIPE, Change::Op::DELETED, id);
+        changes_->Append(Table::RECIPE, Change::Op::ADDED, id, recipe.to_json());
+    }
+    return StatusCode::OK;
 }
 
 bool DB::DeleteTableware(size_t id) {
-    return Exec("DELETE FROM TABLEWARE WHERE ID = ?1;", {{id}}).Ok();
+    std::lock_guard<std::recursive_mutex> lock(mu_);
+    size_t deleted = 0;
+    if (!Exec("DELETE FROM TABLEWARE WHERE ID = ?1;", {{id}}, &deleted).Ok()) {
+        return false;
+    }
+    BumpGeneration(Table::TABLEWARE);
+    if (deleted > 0) {
+        changes_->Append(Table::TABLEWARE, Change::Op::DELETED, id);
+    }
+    return true;
 }
 
 StatusOr<size_t> DB::CreateRecipe(const std::string& name, const std::string& description,
-                                  const std::map<size_t, uint32_t>& ingredients) {
+                                  const std::map<size_t, uint32_t>& ingredients,
+                                  const std::map<size_t, uint32_t>& subrecipes) {
     if (name.empty()) {
         return {StatusCode::INVALID_ARGUMENT, "Name of the recipe has to be non-empty."};
     }
 
+    std::lock_guard<std::recursive_mutex> lock(mu_);
     switch (Insert("RECIPE", {"NAME", "DESC"}, {{name}, {description}})) {
         case StatusCode::OK:
             break;
@@ -287,18 +844,41 @@ StatusOr<size_t> DB::CreateRecipe(const std::string& name, const std::string& de
     auto st = SelectId("RECIPE", {"NAME", "DESC"}, {{name}, {description}}, "ID");
     if (!st.Ok()) {
         Exec("DELETE FROM RECIPE WHERE NAME=?1;", {{name}});
+        BumpGeneration(Table::RECIPE);
         return st;
     }
 
     const size_t recipe_id = st.Value();
 
-    if (ingredients.empty()) {
-        return StatusOr{recipe_id};
+    std::string_view missing = "Some of the ingredients don't exist in the database.";
+    auto code = InsertRecipeRows("RECIPE_INGREDIENTS", "INGR_ID", recipe_id, ingredients);
+    if (code == StatusCode::OK) {
+        missing = "Some of the sub-recipes don't exist in the database.";
+        code = InsertRecipeRows("RECIPE_SUBRECIPES", "SUBRECIPE_ID", recipe_id, subrecipes);
     }
+    if (code != StatusCode::OK) {
+        // The rows of the recipe are deleted with it.
+        Exec("DELETE FROM RECIPE WHERE ID=?1;", {{recipe_id}});
+        BumpGeneration(Table::RECIPE);
+
+        if (code == StatusCode::INVALID_ARGUMENT) {
+            return {code, std::string(missing)};
+        }
+
+        return {code, "DB request failed. Try again later."};
+    }
+
+    BumpGeneration(Table::RECIPE);
+    changes_->Append(Table::RECIPE, Change::Op::ADDED, recipe_id,
+                     RecipeHeader(name, recipe_id).to_json());
+    return StatusOr{recipe_id};
+}
 
+StatusCode DB::InsertRecipeRows(std::string_view table, std::string_view column, size_t recipe_id,
+                                const std::map<size_t, uint32_t>& rows) {
     std::vector<BindParameter> params;
-    params.reserve(ingredients.size() * 3);
-    for (const auto& [id, weight] : ingredients) {
+    params.reserve(rows.size() * 3);
+    for (const auto& [id, weight] : rows) {
         if (weight == 0) {
             continue;
         }
@@ -306,25 +886,84 @@ StatusOr<size_t> DB::CreateRecipe(const std::string& name, const std::string& de
         params.emplace_back(id);
         params.emplace_back(weight);
     }
+    if (params.empty()) {
+        return StatusCode::OK;
+    }
+    return Insert(table, {"RECIPE_ID", column, "WEIGHT"}, params);
+}
 
-    if (auto code = Insert("RECIPE_INGREDIENTS", {"RECIPE_ID", "INGR_ID", "WEIGHT"}, params);
-        code != StatusCode::OK) {
-        Exec("DELETE FROM RECIPE_INGREDIENTS WHERE RECIPE_ID=?1;", {{recipe_id}});
-        Exec("DELETE FROM RECIPE WHERE ID=?1;", {{recipe_id}});
+StatusCode DB::UpdateRecipeRows(std::string_view table, std::string_view column, size_t recipe_id,
+                                const std::map<size_t, uint32_t>& rows, bool* written) {
+    // Rows of ids that stay in the recipe are updated in place, if at all; whatever is left in
+    // `added` is new.
+    std::map<size_t, uint32_t> added;
+    for (const auto& [id, weight] : rows) {
+        if (weight > 0) {
+            added.emplace(id, weight);
+        }
+    }
 
-        if (code == StatusCode::INVALID_ARGUMENT) {
-            return {code, "Some of the ingredients don't exist in the database."};
+    const std::string sql =
+        fmt::format("SELECT ROWID, {}, WEIGHT FROM {} WHERE RECIPE_ID = ?1;", column, table);
+    auto stored = Exec(sql, {{recipe_id}});
+    if (!stored.Ok()) {
+        return stored.Code();
+    }
+    for (const auto& row : stored.Value()) {
+        if (row.size() != 3) {
+            fmt::print(stderr, "'{}' returned {} columns\n", sql, row.size());
+            exit(2);
+        }
+        const std::string& rowid = row[0];
+        const auto it = added.find(static_cast<size_t>(std::stoull(row[1])));
+        StatusCode code = StatusCode::OK;
+        if (it == added.end()) {
+            // Removed, or a second row of the same id.
+            code = Exec(fmt::format("DELETE FROM {} WHERE ROWID = ?1;", table), {{rowid}}).Code();
+            *written = true;
+        } else {
+            if (static_cast<uint32_t>(std::stoul(row[2])) != it->second) {
+                code = Exec(fmt::format("UPDATE {} SET WEIGHT = ?2 WHERE ROWID = ?1;", table),
+                            {{rowid}, {it->second}})
+                           .Code();
+                *written = true;
+            }
+            added.erase(it);
+        }
+        if (code != StatusCode::OK) {
+            return code;
         }
+    }
 
+    if (added.empty()) {
+        return StatusCode::OK;
+    }
+    *written = true;
+    return InsertRecipeRows(table, column, recipe_id, added);
+}
+
+StatusOr<std::vector<RecipeHeader>> DB::GetRecipes() {
+    return SelectRecipes("SELECT NAME, ID FROM RECIPE;", {});
+}
+
+StatusOr<RowDelta<RecipeHeader>> DB::GetRecipesSince(uint64_t since) {
+    RowDelta<RecipeHeader> delta;
+    if (auto code = StartDelta(Table::RECIPE, since, &delta); code != StatusCode::OK) {
         return {code, "DB request failed. Try again later."};
     }
 
-    return StatusOr{recipe_id};
+    auto rows = SelectRecipes("SELECT NAME, ID FROM RECIPE WHERE VERSION > ?1;",
+                              {{std::to_string(delta.reset ? 0 : since)}});
+    if (!rows.Ok()) {
+        return {rows.Code(), std::move(rows.Error())};
+    }
+    delta.changed = std::move(rows.Value());
+    return StatusOr{std::move(delta)};
 }
 
-StatusOr<std::vector<RecipeHeader>> DB::GetRecipes() {
-    std::string_view sql = "SELECT NAME, ID FROM RECIPE;";
-    auto res = Exec(sql, {});
+StatusOr<std::vector<RecipeHeader>> DB::SelectRecipes(std::string_view sql,
+                                                      const std::vector<BindParameter>& params) {
+    auto res = Exec(sql, params);
     if (!res.Ok()) {
         return {res.Code(), std::move(res.Error())};
     }
@@ -343,8 +982,9 @@ StatusOr<std::vector<RecipeHeader>> DB::GetRecipes() {
     return StatusOr{std::move(ret)};
 }
 
-StatusOr<FullRecipe> DB::GetRecipeInfo(size_t recipe_id) {
-    std::string_view sql = "SELECT NAME, DESC FROM RECIPE WHERE ID=?1;";
+StatusOr<FullRecipe> DB::GetRecipeInfo(size_t recipe_id,
+                                       std::vector<Ingredient>* ingredient_details) {
+    std::string_view sql = "SELECT NAME, DESC, VERSION FROM RECIPE WHERE ID=?1;";
     auto desc = Exec(sql, {{recipe_id}});
     if (!desc.Ok()) {
         return {desc.Code(), std::move(desc.Error())};
@@ -356,24 +996,39 @@ StatusOr<FullRecipe> DB::GetRecipeInfo(size_t recipe_id) {
     }
 
     auto& header_data = desc.Value()[0];
-    if (header_data.size() != 2) {
+    if (header_data.size() != 3) {
         fmt::print(stderr, "'{}' returned {} columns\n", sql, header_data.size());
         exit(2);
     }
 
-    sql = "SELECT INGR_ID, WEIGHT FROM RECIPE_INGREDIENTS WHERE RECIPE_ID=?1;";
+    static const std::string details_sql = fmt::format(
+        "SELECT RI.INGR_ID, RI.WEIGHT, I.NAME, I.KCAL, {} FROM RECIPE_INGREDIENTS RI "
+        "JOIN INGREDIENTS I ON I.ID = RI.INGR_ID WHERE RI.RECIPE_ID=?1 ORDER BY RI.ROWID;",
+        kNutrientColumns);
+    sql = ingredient_details != nullptr
+              ? std::string_view(details_sql)
+              : "SELECT INGR_ID, WEIGHT FROM RECIPE_INGREDIENTS WHERE RECIPE_ID=?1;";
     auto ingredients = Exec(sql, {{recipe_id}});
     if (!ingredients.Ok()) {
         return {ingredients.Code(), std::move(ingredients.Error())};
     }
 
+    std::string_view subrecipes_sql =
+        "SELECT SUBRECIPE_ID, WEIGHT FROM RECIPE_SUBRECIPES WHERE RECIPE_ID=?1;";
+    auto subrecipes = Exec(subrecipes_sql, {{recipe_id}});
+    if (!subrecipes.Ok()) {
+        return {subrecipes.Code(), std::move(subrecipes.Error())};
+    }
+
     FullRecipe recipe;
     recipe.header.id = recipe_id;
     recipe.header.name = std::move(header_data[0]);
     recipe.description = std::move(header_data[1]);
+    recipe.version = static_cast<uint64_t>(std::stoull(header_data[2]));
 
-    for (const auto& row : ingredients.Value()) {
-        if (row.size() != 2) {
+    const size_t columns = ingredient_details != nullptr ? 4 + kNutrientCount : 2;
+    for (auto& row : ingredients.Value()) {
+        if (row.size() != columns) {
             fmt::print(stderr, "'{}' returned {} columns\n", sql, row.size());
             exit(2);
         }
@@ -381,39 +1036,1104 @@ StatusOr<FullRecipe> DB::GetRecipeInfo(size_t recipe_id) {
         size_t id = static_cast<size_t>(std::stoull(row[0]));
         uint32_t weight = static_cast<uint32_t>(std::stoul(row[1]));
         recipe.ingredients.emplace_back(id, weight);
+        if (ingredient_details != nullptr) {
+            ingredient_details->emplace_back(std::move(row[2]),
+                                             static_cast<uint32_t>(std::stoul(row[3])), id,
+                                             ParseNutrients(row, 4, sql));
+        }
+    }
+    for (const auto& row : subrecipes.Value()) {
+        if (row.size() != 2) {
+            fmt::print(stderr, "'{}' returned {} columns\n", subrecipes_sql, row.size());
+            exit(2);
+        }
+
+        recipe.subrecipes.emplace_back(static_cast<size_t>(std::stoull(row[0])),
+                                       static_cast<uint32_t>(std::stoul(row[1])));
     }
     return StatusOr{std::move(recipe)};
 }
 
-bool DB::DeleteRecipe(size_t id) { return Exec("DELETE FROM RECIPE WHERE ID=?1;", {{id}}).Ok(); }
+StatusOr<uint64_t> DB::UpdateRecipe(size_t id, uint64_t expected_version, const std::string& name,
+                                    const std::string& description,
+                                    const std::map<size_t, uint32_t>& ingredients,
+                                    const std::map<size_t, uint32_t>& subrecipes) {
+    if (name.empty()) {
+        return {StatusCode::INVALID_ARGUMENT, "Name of the recipe has to be non-empty."};
+    }
+
+    std::string error = "DB request failed. Try again later.";
+    bool written = false;
+    bool renamed = false;
+    uint64_t version = 0;
+    std::lock_guard<std::recursive_mutex> lock(mu_);
+    auto code = InTransaction([&] {
+        std::string_view sql = "SELECT NAME, DESC, VERSION FROM RECIPE WHERE ID = ?1;";
+        auto current = Exec(sql, {{id}});
+        if (!current.Ok()) {
+            return current.Code();
+        }
+        if (current.Value().empty()) {
+            error = fmt::format("No recipe with id={} exists in the database.", id);
+            return StatusCode::NOT_FOUND;
+        }
+        const auto& header = current.Value()[0];
+        if (header.size() != 3) {
+            fmt::print(stderr, "'{}' returned {} columns\n", sql, header.size());
+            exit(2);
+        }
+        version = static_cast<uint64_t>(std::stoull(header[2]));
+        if (version != expected_version) {
+            error = fmt::format("The recipe was changed after version {}. Reload it and try again.",
+                                expected_version);
+            return StatusCode::CONFLICT;
+        }
+
+        if (header[0] != name || header[1] != description) {
+            auto st = Exec("UPDATE RECIPE SET NAME = ?2, DESC = ?3 WHERE ID = ?1;",
+                           {{id}, {name}, {description}});
+            if (!st.Ok()) {
+                if (st.Code() == StatusCode::INVALID_ARGUMENT) {
+                    error = "A recipe with this name already exists in the database.";
+                }
+                return st.Code();
+            }
+            written = true;
+            renamed = header[0] != name;
+        }
+
+        auto status =
+            UpdateRecipeRows("RECIPE_INGREDIENTS", "INGR_ID", id, ingredients, &written);
+        if (status != StatusCode::OK) {
+            if (status == StatusCode::INVALID_ARGUMENT) {
+                error = "Some of the ingredients don't exist in the database.";
+            }
+            return status;
+        }
+
+        // A recipe can't become a sub-recipe of itself or of one of its sub-recipes, so none
+        // of the recipes that contain it may be among `subrecipes`.
+        sql = R"(
+            WITH RECURSIVE USERS(ID) AS (
+                SELECT ?1
+                UNION
+                SELECT RECIPE_ID FROM RECIPE_SUBRECIPES JOIN USERS ON SUBRECIPE_ID = USERS.ID)
+            SELECT ID FROM USERS;)";
+        if (!subrecipes.empty()) {
+            auto users = Exec(sql, {{id}});
+            if (!users.Ok()) {
+                return users.Code();
+            }
+            for (const auto& row : users.Value()) {
+                if (row.size() != 1) {
+                    fmt::print(stderr, "'{}' returned {} columns\n", sql, row.size());
+                    exit(2);
+                }
+                const size_t user = static_cast<size_t>(std::stoull(row[0]));
+                if (auto it = subrecipes.find(user); it != subrecipes.end() && it->second > 0) {
+                    error = fmt::format(
+                        "Recipe {} contains this recipe, so it can't be its sub-recipe.", user);
+                    return StatusCode::INVALID_ARGUMENT;
+                }
+            }
+        }
+
+        status = UpdateRecipeRows("RECIPE_SUBRECIPES", "SUBRECIPE_ID", id, subrecipes, &written);
+        if (status != StatusCode::OK) {
+            if (status == StatusCode::INVALID_ARGUMENT) {
+                error = "Some of the sub-recipes don't exist in the database.";
+            }
+            return status;
+        }
+
+        if (!written) {
+            return StatusCode::OK;
+        }
+        auto st = Exec("SELECT VERSION FROM RECIPE WHERE ID = ?1;", {{id}});
+        if (!st.Ok() || st.Value().size() != 1) {
+            return st.Ok() ? StatusCode::INTERNAL_ERROR : st.Code();
+        }
+        version = static_cast<uint64_t>(std::stoull(st.Value()[0][0]));
+        return StatusCode::OK;
+    });
+    if (code != StatusCode::OK) {
+        return {code, std::move(error)};
+    }
+
+    if (written) {
+        BumpGeneration(Table::RECIPE);
+        nutrition_->InvalidateRecipe(id);
+    }
+    if (renamed) {
+        // Readers of Changes() only add rows they don't have, so the old name is dropped first.
+        changes_->Append(Table::RECIPE, Change::Op::DELETED, id);
+        changes_->Append(Table::RECIPE, Change::Op::ADDED, id, RecipeHeader(name, id).to_json());
+    }
+    return StatusOr{version};
+}
+
+StatusOr<std::vector<FullRecipe>> DB::GetFullRecipes() {
+    // One read transaction, so that no recipe is created between the scans of RECIPE and of its
+    // lists.
+    std::lock_guard<std::recursive_mutex> lock(mu_);
+    if (auto st = Exec("BEGIN;", {}); !st.Ok()) {
+        return {st.Code(), std::move(st.Error())};
+    }
+    auto ret = SelectFullRecipes("", {});
+    Exec("COMMIT;", {});
+    return ret;
+}
 
-StatusOr<std::vector<DB::DBRow>> DB::Exec(std::string_view sql,
-                                          const std::vector<BindParameter>& params) {
-    sqlite3_stmt* stmt = nullptr;
-    int st = sqlite3_prepare_v2(db_, sql.data(), -1, &stmt, nullptr);
-    if (st != SQLITE_OK || stmt == nullptr) {
-        fmt::print(stderr, "Prepare failed: {} SQL: {}\n", st, sql);
-        return {ConvertSqliteToStatus(st), "sqlite3_prepare_v2 failed."};
+StatusOr<std::vector<FullRecipe>> DB::SelectFullRecipes(std::string_view recipe_ids,
+                                                        const std::vector<BindParameter>& params) {
+    // Without a filter, the plain scans are cheaper than going through the indices.
+    const std::string filter =
+        recipe_ids.empty() ? "" : fmt::format("WHERE RECIPE_ID IN ({}) ", recipe_ids);
+    const std::string sql =
+        recipe_ids.empty()
+            ? "SELECT NAME, DESC, ID, VERSION FROM RECIPE ORDER BY ID;"
+            : fmt::format(
+                  "SELECT NAME, DESC, ID, VERSION FROM RECIPE WHERE ID IN ({}) ORDER BY ID;",
+                  recipe_ids);
+    auto recipes = Exec(sql, params);
+    if (!recipes.Ok()) {
+        return {recipes.Code(), std::move(recipes.Error())};
     }
 
-    for (auto i = 0; i < params.size(); ++i) {
-        if (params[i].index() == 0) {
-            st = sqlite3_bind_int(stmt, i + 1, std::get<uint32_t>(params[i]));
-        } else {
-            st = sqlite3_bind_text(stmt, i + 1, std::get<std::string>(params[i]).c_str(), -1,
-                                   SQLITE_TRANSIENT);
+    std::vector<FullRecipe> ret;
+    ret.reserve(recipes.Value().size());
+    for (auto& row : recipes.Value()) {
+        if (row.size() != 4) {
+            fmt::print(stderr, "'{}' returned {} columns\n", sql, row.size());
+            exit(2);
         }
 
-        if (st != SQLITE_OK) {
-            fmt::print(stderr, "Bind failed: {} SQL: {}\n", st, sql);
-            return {ConvertSqliteToStatus(st), "sqlite3_bind failed."};
+        FullRecipe& recipe = ret.emplace_back();
+        recipe.header.name = std::move(row[0]);
+        recipe.description = std::move(row[1]);
+        recipe.header.id = static_cast<size_t>(std::stoull(row[2]));
+        recipe.version = static_cast<uint64_t>(std::stoull(row[3]));
+    }
+
+    // The same order as in GetRecipeInfo, which reads them through the indices by recipe.
+    const std::pair<std::string, std::vector<RecipeIngredient> FullRecipe::*> lists[] = {
+        {fmt::format("SELECT RECIPE_ID, INGR_ID, WEIGHT FROM RECIPE_INGREDIENTS "
+                     "{}ORDER BY RECIPE_ID, ROWID;",
+                     filter),
+         &FullRecipe::ingredients},
+        {fmt::format("SELECT RECIPE_ID, SUBRECIPE_ID, WEIGHT FROM RECIPE_SUBRECIPES "
+                     "{}ORDER BY RECIPE_ID, ROWID;",
+                     filter),
+         &FullRecipe::subrecipes},
+    };
+    for (const auto& [list_sql, list] : lists) {
+        auto rows = Exec(list_sql, params);
+        if (!rows.Ok()) {
+            return {rows.Code(), std::move(rows.Error())};
+        }
+
+        // Both lists are sorted by recipe id.
+        auto recipe = ret.begin();
+        for (const auto& row : rows.Value()) {
+            if (row.size() != 3) {
+                fmt::print(stderr, "'{}' returned {} columns\n", list_sql, row.size());
+                exit(2);
+            }
+
+            const size_t recipe_id = static_cast<size_t>(std::stoull(row[0]));
+            while (recipe != ret.end() && recipe->header.id < recipe_id) {
+                ++recipe;
+            }
+            if (recipe == ret.end() || recipe->header.id != recipe_id) {
+                // Only if the tables were written between the scans, outside of a transaction.
+                fmt::print(stderr, "'{}' returned a row of unknown recipe {}\n", list_sql,
+                           recipe_id);
+                return {StatusCode::INTERNAL_ERROR, "DB request failed. Try again later."};
+            }
+            ((*recipe).*list)
+                .emplace_back(static_cast<size_t>(std::stoull(row[1])),
+                              static_cast<uint32_t>(std::stoul(row[2])));
         }
     }
+    return StatusOr{std::move(ret)};
+}
+
+StatusCode DB::ExportCatalog(const std::function<bool(const CatalogRow&)>& visit) {
+    // Every page is a separate statement that seeks to the first id after the previous page, so
+    // no statement stays open, and no lock is held, while `visit` runs.
+    const auto page = [](size_t after_id) {
+        return std::vector<BindParameter>{{std::to_string(after_id)}, {kExportPageSize}};
+    };
+    static const std::string ingredients_sql = fmt::format(
+        "SELECT NAME, KCAL, ID, {} FROM INGREDIENTS WHERE ID > ?1 ORDER BY ID LIMIT ?2;",
+        kNutrientColumns);
+    bool stopped = false;
+
+    auto code = VisitPages(
+        [&](size_t after_id) { return SelectProducts(ingredients_sql, page(after_id)); },
+        [](const Ingredient& v) { return v.id; }, visit, &stopped);
+    if (code != StatusCode::OK || stopped) {
+        return code;
+    }
+
+    code = VisitPages(
+        [&](size_t after_id) {
+            return SelectTableware(
+                "SELECT NAME, WEIGHT, ID FROM TABLEWARE WHERE ID > ?1 ORDER BY ID LIMIT ?2;",
+                page(after_id));
+        },
+        [](const Tableware& v) { return v.id; }, visit, &stopped);
+    if (code != StatusCode::OK || stopped) {
+        return code;
+    }
 
-    std::lock_guard<std::mutex> lock(mu_);
+    return VisitPages(
+        [&](size_t after_id) {
+            // One read transaction, so that the recipes and their ingredients match.
+            std::lock_guard<std::recursive_mutex> lock(mu_);
+            if (auto st = Exec("BEGIN;", {}); !st.Ok()) {
+                return StatusOr<std::vector<FullRecipe>>(st.Code(), std::move(st.Error()));
+            }
+            auto ret = SelectFullRecipes("SELECT ID FROM RECIPE WHERE ID > ?1 ORDER BY ID LIMIT ?2",
+                                         page(after_id));
+            Exec("COMMIT;", {});
+            return ret;
+        },
+        [](const FullRecipe& v) { return v.header.id; }, visit, &stopped);
+}
+
+StatusOr<std::vector<RecipeMatch>> DB::SearchRecipes(std::string_view query, uint32_t offset,
+                                                      uint32_t limit) {
+    const std::string fts_query = FtsQuery(query);
+    if (fts_query.empty()) {
+        return {StatusCode::INVALID_ARGUMENT, "The search query should contain a word."};
+    }
 
+    // Matches in the name weigh 10 times more than in the description. Calling bm25() directly
+    // is faster than ORDER BY RANK, which makes FTS5 sort all the matches in a temporary table.
+    std::string_view sql =
+        "SELECT NAME, ROWID, snippet(RECIPE_SEARCH, 1, '**', '**', '...', 16) FROM RECIPE_SEARCH "
+        "WHERE RECIPE_SEARCH MATCH ?1 ORDER BY bm25(RECIPE_SEARCH, 10.0, 1.0) LIMIT ?2 OFFSET ?3;";
+    auto rows = Exec(sql, {{fts_query}, {limit}, {offset}});
+    if (!rows.Ok()) {
+        return {rows.Code(), "DB request failed. Try again later."};
+    }
+
+    std::vector<RecipeMatch> ret;
+    ret.reserve(rows.Value().size());
+    for (auto& row : rows.Value()) {
+        if (row.size() != 3) {
+            fmt::print(stderr, "'{}' returned {} columns\n", sql, row.size());
+            exit(2);
+        }
+
+        RecipeMatch& match = ret.emplace_back();
+        match.header.name = std::move(row[0]);
+        match.header.id = static_cast<size_t>(std::stoull(row[1]));
+        match.snippet = std::move(row[2]);
+    }
+    return StatusOr{std::move(ret)};
+}
+
+StatusOr<NutrientProfile> DB::GetRecipeNutrientsPer100g(size_t recipe_id) {
+    if (auto cached = nutrition_->Get(recipe_id)) {
+        return StatusOr{*cached};
+    }
+    std::lock_guard<std::recursive_mutex> lock(mu_);
+    std::vector<size_t> path;
+    return ComputeNutrientsPer100g(recipe_id, &path);
+}
+
+StatusOr<double> DB::GetRecipeKcalPer100g(size_t recipe_id) {
+    auto profile = GetRecipeNutrientsPer100g(recipe_id);
+    if (!profile.Ok()) {
+        return {profile.Code(), std::move(profile.Error())};
+    }
+    return StatusOr{static_cast<double>(profile.Value().kcal())};
+}
+
+StatusOr<NutrientProfile> DB::CalculateNutrients(const std::map<size_t, uint32_t>& ingredients,
+                                                 const std::map<size_t, uint32_t>& subrecipes) {
+    std::vector<NutrientProfile> profiles;
+    std::vector<float> weights;
+    std::lock_guard<std::recursive_mutex> lock(mu_);
+
+    const std::string sql =
+        fmt::format("SELECT {} FROM INGREDIENTS WHERE ID = ?1;", kProfileColumns);
+    for (const auto& [id, weight] : ingredients) {
+        if (weight == 0) {
+            continue;
+        }
+        auto rows = Exec(sql, {{id}});
+        if (!rows.Ok()) {
+            return {rows.Code(), std::move(rows.Error())};
+        }
+        if (rows.Value().empty()) {
+            return {StatusCode::NOT_FOUND, fmt::format("Product with id={} wasn't found.", id)};
+        }
+        profiles.push_back(ParseProfile(rows.Value()[0], 0, sql));
+        weights.push_back(weight);
+    }
+
+    std::vector<std::pair<size_t, uint32_t>> mixed(subrecipes.begin(), subrecipes.end());
+    std::vector<size_t> path;
+    std::string error;
+    if (auto code = AddSubrecipeProfiles(mixed, &path, &profiles, &weights, &error);
+        code != StatusCode::OK) {
+        return {code, std::move(error)};
+    }
+    return StatusOr{MixPer100g(profiles.data(), weights.data(), profiles.size())};
+}
+
+StatusOr<NutrientProfile> DB::ComputeNutrientsPer100g(size_t recipe_id,
+                                                      std::vector<size_t>* path) {
+    if (auto cached = nutrition_->Get(recipe_id)) {
+        return StatusOr{*cached};
+    }
+    if (std::find(path->begin(), path->end(), recipe_id) != path->end()) {
+        return {StatusCode::INTERNAL_ERROR,
+                fmt::format("Recipe {} is its own sub-recipe.", recipe_id)};
+    }
+
+    std::string_view sql = "SELECT ID FROM RECIPE WHERE ID=?1;";
+    auto found = Exec(sql, {{recipe_id}});
+    if (!found.Ok()) {
+        return {found.Code(), std::move(found.Error())};
+    }
+    if (found.Value().empty()) {
+        return {StatusCode::NOT_FOUND,
+                fmt::format("No recipe with id={} exists in the database.", recipe_id)};
+    }
+
+    std::vector<NutrientProfile> profiles;
+    std::vector<float> weights;
+    std::vector<size_t> ingredient_ids;
+    static const std::string ingredients_sql = fmt::format(
+        "SELECT RI.INGR_ID, RI.WEIGHT, {} FROM RECIPE_INGREDIENTS RI "
+        "JOIN INGREDIENTS I ON I.ID = RI.INGR_ID WHERE RI.RECIPE_ID=?1;",
+        kProfileColumns);
+    auto ingredients = Exec(ingredients_sql, {{recipe_id}});
+    if (!ingredients.Ok()) {
+        return {ingredients.Code(), std::move(ingredients.Error())};
+    }
+    for (const auto& row : ingredients.Value()) {
+        ingredient_ids.push_back(static_cast<size_t>(std::stoull(row.at(0))));
+        weights.push_back(std::stof(row.at(1)));
+        profiles.push_back(ParseProfile(row, 2, ingredients_sql));
+    }
+
+    std::vector<std::pair<size_t, uint32_t>> subrecipes;
+    sql = "SELECT SUBRECIPE_ID, WEIGHT FROM RECIPE_SUBRECIPES WHERE RECIPE_ID=?1;";
+    auto rows = Exec(sql, {{recipe_id}});
+    if (!rows.Ok()) {
+        return {rows.Code(), std::move(rows.Error())};
+    }
+    for (const auto& row : rows.Value()) {
+        if (row.size() != 2) {
+            fmt::print(stderr, "'{}' returned {} columns\n", sql, row.size());
+            exit(2);
+        }
+        subrecipes.emplace_back(static_cast<size_t>(std::stoull(row[0])),
+                                static_cast<uint32_t>(std::stoul(row[1])));
+    }
+
+    path->push_back(recipe_id);
+    std::string error;
+    if (auto code = AddSubrecipeProfiles(subrecipes, path, &profiles, &weights, &error);
+        code != StatusCode::OK) {
+        return {code, std::move(error)};
+    }
+    path->pop_back();
+
+    std::vector<size_t> subrecipe_ids;
+    for (const auto& [id, weight] : subrecipes) {
+        subrecipe_ids.push_back(id);
+    }
+    const auto ret = MixPer100g(profiles.data(), weights.data(), profiles.size());
+    nutrition_->Set(recipe_id, ret, ingredient_ids, subrecipe_ids);
+    return StatusOr{ret};
+}
+
+StatusCode DB::AddSubrecipeProfiles(const std::vector<std::pair<size_t, uint32_t>>& subrecipes,
+                                    std::vector<size_t>* path,
+                                    std::vector<NutrientProfile>* profiles,
+                                    std::vector<float>* weights, std::string* error) {
+    for (const auto& [id, weight] : subrecipes) {
+        if (weight == 0) {
+            continue;
+        }
+        auto profile = ComputeNutrientsPer100g(id, path);
+        if (!profile.Ok()) {
+            *error = std::move(profile.Error());
+            return profile.Code();
+        }
+        profiles->push_back(profile.Value());
+        weights->push_back(weight);
+    }
+    return StatusCode::OK;
+}
+
+bool DB::DeleteRecipe(size_t id) {
+    std::lock_guard<std::recursive_mutex> lock(mu_);
+    size_t deleted = 0;
+    if (!Exec("DELETE FROM RECIPE WHERE ID=?1;", {{id}}, &deleted).Ok()) {
+        return false;
+    }
+    BumpGeneration(Table::RECIPE);
+    nutrition_->InvalidateRecipe(id);
+    if (deleted > 0) {
+        changes_->Append(Table::RECIPE, Change::Op::DELETED, id);
+    }
+    return true;
+}
+
+template <class T>
+StatusCode DB::StartDelta(Table table, uint64_t since, RowDelta<T>* delta) {
+    // The clock is read before the rows, so a write racing with this request is at worst
+    // returned twice, never missed.
+    std::string_view sql = "SELECT VERSION, COMPACTED FROM SYNC_CLOCK;";
+    auto clock = Exec(sql, {});
+    if (!clock.Ok()) {
+        return clock.Code();
+    }
+    if (clock.Value().size() != 1 || clock.Value()[0].size() != 2) {
+        fmt::print(stderr, "'{}' returned {} rows\n", sql, clock.Value().size());
+        exit(2);
+    }
+
+    delta->version = std::stoull(clock.Value()[0][0]);
+    const uint64_t compacted = std::stoull(clock.Value()[0][1]);
+    delta->reset = since > delta->version || (since > 0 && since < compacted);
+    if (since == 0 || delta->reset) {
+        return StatusCode::OK;
+    }
+
+    sql = "SELECT ROW_ID FROM TOMBSTONES WHERE TBL = ?1 AND VERSION > ?2;";
+    auto deleted = Exec(sql, {{static_cast<uint32_t>(table)}, {std::to_string(since)}});
+    if (!deleted.Ok()) {
+        return deleted.Code();
+    }
+    for (const auto& row : deleted.Value()) {
+        if (row.size() != 1) {
+            fmt::print(stderr, "'{}' returned {} columns\n", sql, row.size());
+            exit(2);
+        }
+        delta->deleted.push_back(static_cast<size_t>(std::stoull(row[0])));
+    }
+    return StatusCode::OK;
+}
+
+template <class Row, class Bind>
+StatusCode DB::ImportRows(std::string_view table, const std::vector<std::string_view>& fields,
+                          const std::vector<Row>& rows, Bind bind) {
+    // IMPORTING is set and cleared in one transaction, so that a crash can't leave the version
+    // triggers off, and `mu_` keeps the writes of other threads, which need the triggers, out
+    // of it.
+    std::lock_guard<std::recursive_mutex> lock(mu_);
+    if (sqlite3_get_autocommit(db_)) {
+        return InTransaction([&] { return ImportRows(table, fields, rows, bind); });
+    }
+
+    // All the rows get the same new version, and the INSERT triggers skip them.
+    if (auto st = Exec("UPDATE SYNC_CLOCK SET VERSION = VERSION + 1, IMPORTING = 1;", {});
+        !st.Ok()) {
+        return st.Code();
+    }
+    std::string_view sql = "SELECT VERSION FROM SYNC_CLOCK;";
+    auto clock = Exec(sql, {});
+    if (!clock.Ok()) {
+        return clock.Code();
+    }
+    if (clock.Value().size() != 1 || clock.Value()[0].size() != 1) {
+        fmt::print(stderr, "'{}' returned {} rows\n", sql, clock.Value().size());
+        exit(2);
+    }
+    const std::string& version = clock.Value()[0][0];
+
+    // SQLite before 3.32 allows at most 999 parameters per statement.
+    const size_t rows_per_insert = 999 / fields.size();
+
+    StatusCode code = StatusCode::OK;
+    std::vector<BindParameter> params;
+    for (size_t start = 0; start < rows.size() && code == StatusCode::OK;
+         start += rows_per_insert) {
+        params.clear();
+        const size_t end = std::min(rows.size(), start + rows_per_insert);
+        for (size_t idx = start; idx < end; ++idx) {
+            bind(rows[idx], version, &params);
+        }
+        code = Insert(table, fields, params);
+    }
+
+    if (auto st = Exec("UPDATE SYNC_CLOCK SET IMPORTING = 0;", {}); !st.Ok()) {
+        return st.Code();
+    }
+    return code;
+}
+
+StatusCode DB::ImportProducts(const std::vector<Ingredient>& products) {
+    auto code =
+        ImportRows("INGREDIENTS",
+                   {"ID", "NAME", "KCAL", "VERSION", "PROTEIN", "FAT", "CARBOHYDRATE", "FIBRE",
+                    "SALT", "SUGAR"},
+                   products,
+                   [](const Ingredient& v, const std::string& version,
+                      std::vector<BindParameter>* params) {
+                       params->emplace_back(v.id);
+                       params->emplace_back(v.name);
+                       params->emplace_back(v.kcal);
+                       params->emplace_back(version);
+                       for (float value : v.nutrients) {
+                           params->emplace_back(fmt::format("{}", value));
+                       }
+                   });
+    BumpGeneration(Table::INGREDIENTS);
+    changes_->Reset();
+    nutrition_->Clear();
+    return code;
+}
+
+StatusCode DB::ImportTableware(const std::vector<Tableware>& tableware) {
+    auto code =
+        ImportRows("TABLEWARE", {"ID", "NAME", "WEIGHT", "VERSION"}, tableware,
+                   [](const Tableware& v, const std::string& version,
+                      std::vector<BindParameter>* params) {
+                       params->emplace_back(v.id);
+                       params->emplace_back(v.name);
+                       params->emplace_back(v.weight);
+                       params->emplace_back(version);
+                   });
+    BumpGeneration(Table::TABLEWARE);
+    changes_->Reset();
+    return code;
+}
+
+StatusCode DB::ImportRecipes(const std::vector<FullRecipe>& recipes) {
+    auto code =
+        ImportRows("RECIPE", {"ID", "NAME", "DESC", "VERSION"}, recipes,
+                   [](const FullRecipe& v, const std::string& version,
+                      std::vector<BindParameter>* params) {
+                       params->emplace_back(v.header.id);
+                       params->emplace_back(v.header.name);
+                       params->emplace_back(v.description);
+                       params->emplace_back(version);
+                   });
+    if (code == StatusCode::OK) {
+        std::vector<std::pair<size_t, RecipeIngredient>> ingredients;
+        for (const auto& recipe : recipes) {
+            for (const auto& ingredient : recipe.ingredients) {
+                if (ingredient.weight > 0) {
+                    ingredients.emplace_back(recipe.header.id, ingredient);
+                }
+            }
+        }
+
+        // The recipes themselves were stamped above.
+        using Row = std::pair<size_t, RecipeIngredient>;
+        code = ImportRows("RECIPE_INGREDIENTS", {"RECIPE_ID", "INGR_ID", "WEIGHT"}, ingredients,
+                          [](const Row& v, const std::string&,
+                             std::vector<BindParameter>* params) {
+                              params->emplace_back(v.first);
+                              params->emplace_back(v.second.ingredient_id);
+                              params->emplace_back(v.second.weight);
+                          });
+    }
+    if (code == StatusCode::OK) {
+        // Sub-recipes may come later in `recipes`, so they are linked once all are imported.
+        std::vector<std::pair<size_t, RecipeIngredient>> subrecipes;
+        for (const auto& recipe : recipes) {
+            for (const auto& subrecipe : recipe.subrecipes) {
+                if (subrecipe.weight > 0) {
+                    subrecipes.emplace_back(recipe.header.id, subrecipe);
+                }
+            }
+        }
+
+        using Row = std::pair<size_t, RecipeIngredient>;
+        code = ImportRows("RECIPE_SUBRECIPES", {"RECIPE_ID", "SUBRECIPE_ID", "WEIGHT"},
+                          subrecipes,
+                          [](const Row& v, const std::string&,
+                             std::vector<BindParameter>* params) {
+                              params->emplace_back(v.first);
+                              params->emplace_back(v.second.ingredient_id);
+                              params->emplace_back(v.second.weight);
+                          });
+    }
+    BumpGeneration(Table::RECIPE);
+    changes_->Reset();
+    nutrition_->Clear();
+    return code;
+}
+
+StatusCode DB::InTransaction(const std::function<StatusCode()>& body) {
+    std::lock_guard<std::recursive_mutex> lock(mu_);
+    // IMMEDIATE takes the write lock up front. A deferred transaction that reads first would
+    // fail with SQLITE_BUSY instead of waiting if another process wrote in the meantime.
+    if (auto st = Exec("BEGIN IMMEDIATE;", {}); !st.Ok()) {
+        return st.Code();
+    }
+
+    StatusCode code = body();
+    if (code == StatusCode::OK) {
+        code = Exec("COMMIT;", {}).Code();
+        if (code == StatusCode::OK) {
+            return code;
+        }
+    }
+
+    Exec("ROLLBACK;", {});
+    // The rolled back writes have already been announced, so everything derived from the
+    // tables has to be recomputed.
+    for (Table table : {Table::INGREDIENTS, Table::TABLEWARE, Table::RECIPE}) {
+        BumpGeneration(table);
+    }
+    changes_->Reset();
+    nutrition_->Clear();
+    return code;
+}
+
+StatusOr<uint64_t> DB::Version() {
+    std::string_view sql = "SELECT VERSION FROM SYNC_CLOCK;";
+    auto rows = Exec(sql, {});
+    if (!rows.Ok()) {
+        return {rows.Code(), std::move(rows.Error())};
+    }
+    if (rows.Value().size() != 1 || rows.Value()[0].size() != 1) {
+        fmt::print(stderr, "'{}' returned {} rows\n", sql, rows.Value().size());
+        exit(2);
+    }
+    return StatusOr{static_cast<uint64_t>(std::stoull(rows.Value()[0][0]))};
+}
+
+bool DB::CatchUpExternalWrites() {
+    std::lock_guard<std::recursive_mutex> lock(mu_);
+    std::string_view sql = "PRAGMA data_version;";
+    auto rows = Exec(sql, {});
+    if (!rows.Ok()) {
+        return false;
+    }
+    if (rows.Value().size() != 1 || rows.Value()[0].size() != 1) {
+        fmt::print(stderr, "'{}' returned {} rows\n", sql, rows.Value().size());
+        exit(2);
+    }
+
+    const uint64_t version = std::stoull(rows.Value()[0][0]);
+    if (data_version_ == version) {
+        return false;
+    }
+    const bool changed = data_version_.has_value();
+    data_version_ = version;
+
+    // A table was written to if its latest row version or its latest tombstone moved. Both
+    // are looked up through the VERSION indices.
+    sql = R"(
+        SELECT (SELECT IFNULL(MAX(VERSION), 0) FROM INGREDIENTS),
+               (SELECT IFNULL(MAX(VERSION), 0) FROM TABLEWARE),
+               (SELECT IFNULL(MAX(VERSION), 0) FROM RECIPE),
+               (SELECT IFNULL(MAX(VERSION), 0) FROM TOMBSTONES WHERE TBL = 0),
+               (SELECT IFNULL(MAX(VERSION), 0) FROM TOMBSTONES WHERE TBL = 1),
+               (SELECT IFNULL(MAX(VERSION), 0) FROM TOMBSTONES WHERE TBL = 2);)";
+    rows = Exec(sql, {});
+    std::array<uint64_t, 6> table_versions = {};
+    if (rows.Ok()) {
+        if (rows.Value().size() != 1 || rows.Value()[0].size() != table_versions.size()) {
+            fmt::print(stderr, "'{}' returned {} rows\n", sql, rows.Value().size());
+            exit(2);
+        }
+        for (size_t idx = 0; idx < table_versions.size(); ++idx) {
+            table_versions[idx] = std::stoull(rows.Value()[0][idx]);
+        }
+    }
+    if (!changed) {
+        table_versions_ = table_versions;
+        return false;
+    }
+
+    bool any = false;
+    for (Table table : {Table::INGREDIENTS, Table::TABLEWARE, Table::RECIPE}) {
+        const size_t idx = static_cast<size_t>(table);
+        // If the versions can't be read, all tables are taken for written.
+        if (!rows.Ok() || table_versions[idx] != table_versions_[idx] ||
+            table_versions[idx + 3] != table_versions_[idx + 3]) {
+            BumpGeneration(table);
+            any = true;
+        }
+    }
+    table_versions_ = table_versions;
+    if (any) {
+        changes_->Reset();
+        nutrition_->Clear();
+    }
+    return true;
+}
+
+StatusOr<size_t> DB::CompactTombstones(std::chrono::system_clock::time_point deleted_before) {
+    const std::string cutoff = std::to_string(
+        std::chrono::duration_cast<std::chrono::seconds>(deleted_before.time_since_epoch())
+            .count());
+
+    // COMPACTED is raised before the tombstones are dropped, so a failure in between only
+    // causes needless resets.
+    auto st = Exec(
+        "UPDATE SYNC_CLOCK SET COMPACTED = MAX(COMPACTED, "
+        "(SELECT IFNULL(MAX(VERSION), 0) FROM TOMBSTONES WHERE DELETED_AT < ?1));",
+        {{cutoff}});
+    if (!st.Ok()) {
+        return {st.Code(), std::move(st.Error())};
+    }
+
+    size_t dropped = 0;
+    st = Exec("DELETE FROM TOMBSTONES WHERE DELETED_AT < ?1;", {{cutoff}}, &dropped);
+    if (!st.Ok()) {
+        return {st.Code(), std::move(st.Error())};
+    }
+    return StatusOr{dropped};
+}
+
+StatusOr<ReplicationBatch> DB::GetReplicationBatch(const ReplicationCursor& after,
+                                                   uint64_t limit) {
+    // One read transaction, so that all tables are read at the same version.
+    std::lock_guard<std::recursive_mutex> lock(mu_);
+    if (auto st = Exec("BEGIN;", {}); !st.Ok()) {
+        return {st.Code(), std::move(st.Error())};
+    }
+    auto ret = ReadReplicationBatch(after, limit);
+    Exec("COMMIT;", {});
+    return ret;
+}
+
+StatusOr<ReplicationBatch> DB::ReadReplicationBatch(const ReplicationCursor& after,
+                                                    uint64_t limit) {
+    std::string_view sql = "SELECT VERSION, COMPACTED FROM SYNC_CLOCK;";
+    auto clock = Exec(sql, {});
+    if (!clock.Ok()) {
+        return {clock.Code(), std::move(clock.Error())};
+    }
+    if (clock.Value().size() != 1 || clock.Value()[0].size() != 2) {
+        fmt::print(stderr, "'{}' returned {} rows\n", sql, clock.Value().size());
+        exit(2);
+    }
+    const uint64_t version = std::stoull(clock.Value()[0][0]);
+    const uint64_t compacted = std::stoull(clock.Value()[0][1]);
+
+    // A follower can't catch up on one table and reload another one: the recipes refer to the
+    // ingredients. A cursor in the middle of a version continues a batch that was checked
+    // already.
+    ReplicationBatch ret;
+    const bool reset =
+        after.kind == ReplicationCursor::kVersionEnd &&
+        (after.version == 0 || after.version > version || after.version < compacted);
+    ret.ingredients.version = ret.tableware.version = ret.recipes.version = version;
+    ret.ingredients.reset = ret.tableware.reset = ret.recipes.reset = reset;
+    const ReplicationCursor from = reset ? ReplicationCursor{} : after;
+
+    // The writes of one kind after a cursor are the rows with (VERSION, ID) greater than the
+    // cursor's version and this id. Ids start at 1.
+    constexpr uint64_t kMaxId = std::numeric_limits<int64_t>::max();
+    const auto id_bound = [](const ReplicationCursor& cursor, uint32_t kind) -> uint64_t {
+        return kind < cursor.kind ? kMaxId : kind == cursor.kind ? cursor.id : 0;
+    };
+
+    // Without a limit the batch has everything up to the end of the tables.
+    ReplicationCursor end{kMaxId};
+    if (limit > 0) {
+        // Every kind is read through its VERSION index from `from` on. The `limit`-th write of
+        // all of them is the last one of the batch, and the one after it says there are more.
+        // SQLite doesn't seek an index by a row value that ends in the rowid, so the rest of the
+        // version of `from` and the versions after it are read as separate ranges.
+        static const std::string cut_sql = [] {
+            const char* const tables[] = {"INGREDIENTS", "TABLEWARE", "RECIPE"};
+            std::vector<std::string> sources;
+            for (uint32_t kind = 0; kind < 3; ++kind) {
+                sources.push_back(
+                    fmt::format("SELECT * FROM (SELECT VERSION, {0} AS KIND, ID FROM {1} "
+                                "WHERE VERSION = ?1 AND ID > ?{2} ORDER BY ID LIMIT ?8)",
+                                kind, tables[kind], kind + 2));
+                sources.push_back(
+                    fmt::format("SELECT * FROM (SELECT VERSION, {0} AS KIND, ID FROM {1} "
+                                "WHERE VERSION > ?1 ORDER BY VERSION, ID LIMIT ?8)",
+                                kind, tables[kind]));
+            }
+            for (uint32_t kind = 3; kind < ReplicationCursor::kVersionEnd; ++kind) {
+                sources.push_back(fmt::format(
+                    "SELECT * FROM (SELECT VERSION, {0} AS KIND, ROW_ID AS ID FROM TOMBSTONES "
+                    "WHERE TBL = {1} AND (VERSION, ROW_ID) > (?1, ?{2}) "
+                    "ORDER BY VERSION, ROW_ID LIMIT ?8)",
+                    kind, kind - 3, kind + 2));
+            }
+            return fmt::format(
+                "SELECT VERSION, KIND, ID FROM ({}) ORDER BY VERSION, KIND, ID LIMIT 2 OFFSET ?9;",
+                fmt::join(sources, " UNION ALL "));
+        }();
+        std::vector<BindParameter> params = {{std::to_string(from.version)}};
+        for (uint32_t kind = 0; kind < ReplicationCursor::kVersionEnd; ++kind) {
+            params.emplace_back(std::to_string(id_bound(from, kind)));
+        }
+        params.emplace_back(std::to_string(limit + 1));
+        params.emplace_back(std::to_string(limit - 1));
+        auto rows = Exec(cut_sql, params);
+        if (!rows.Ok()) {
+            return {rows.Code(), std::move(rows.Error())};
+        }
+        if (rows.Value().size() == 2) {
+            const auto& last = rows.Value()[0];
+            end = {std::stoull(last[0]), static_cast<uint32_t>(std::stoul(last[1])),
+                   static_cast<size_t>(std::stoull(last[2]))};
+            ret.more = true;
+            ret.next = end;
+        }
+    }
+
+    // The rows of a kind after `from` and up to `end`: the rest of the version of `from`, the
+    // versions in between, and the start of the version of `end`, for the same reason.
+    const bool one_version = from.version == end.version;
+    const auto range = [&](uint32_t kind) {
+        return std::vector<BindParameter>{
+            {std::to_string(from.version)},
+            {std::to_string(id_bound(from, kind))},
+            {std::to_string(end.version)},
+            {std::to_string(id_bound(end, kind))},
+            {std::to_string(one_version ? id_bound(end, kind) : kMaxId)},
+            {std::to_string(one_version ? kMaxId : 0)}};
+    };
+    const auto range_ids = [](std::string_view table) {
+        return fmt::format(
+            "SELECT ID FROM {0} WHERE VERSION = ?1 AND ID > ?2 AND ID <= ?5 "
+            "UNION ALL SELECT ID FROM {0} WHERE VERSION > ?1 AND VERSION < ?3 "
+            "UNION ALL SELECT ID FROM {0} WHERE VERSION = ?3 AND ID > ?6 AND ID <= ?4",
+            table);
+    };
+
+    static const std::string ingredients_sql =
+        fmt::format("SELECT NAME, KCAL, ID, {} FROM INGREDIENTS WHERE ID IN ({});",
+                    kNutrientColumns, range_ids("INGREDIENTS"));
+    auto ingredients = SelectProducts(ingredients_sql, range(0));
+    if (!ingredients.Ok()) {
+        return {ingredients.Code(), std::move(ingredients.Error())};
+    }
+    ret.ingredients.changed = std::move(ingredients.Value());
+    static const std::string tableware_sql = fmt::format(
+        "SELECT NAME, WEIGHT, ID FROM TABLEWARE WHERE ID IN ({});", range_ids("TABLEWARE"));
+    auto tableware = SelectTableware(tableware_sql, range(1));
+    if (!tableware.Ok()) {
+        return {tableware.Code(), std::move(tableware.Error())};
+    }
+    ret.tableware.changed = std::move(tableware.Value());
+    auto recipes = reset && !ret.more ? SelectFullRecipes("", {})
+                                      : SelectFullRecipes(range_ids("RECIPE"), range(2));
+    if (!recipes.Ok()) {
+        return {recipes.Code(), std::move(recipes.Error())};
+    }
+    ret.recipes.changed = std::move(recipes.Value());
+
+    // A follower that reloads the tables drops all its rows, so it doesn't need tombstones.
+    if (reset) {
+        return StatusOr{std::move(ret)};
+    }
+    std::vector<size_t>* const deleted[] = {&ret.ingredients.deleted, &ret.tableware.deleted,
+                                            &ret.recipes.deleted};
+    for (uint32_t table = 0; table < 3; ++table) {
+        sql = "SELECT ROW_ID FROM TOMBSTONES WHERE TBL = ?7 AND (VERSION, ROW_ID) > (?1, ?2) "
+              "AND (VERSION, ROW_ID) <= (?3, ?4);";
+        auto params = range(table + 3);
+        params.emplace_back(table);
+        auto rows = Exec(sql, params);
+        if (!rows.Ok()) {
+            return {rows.Code(), std::move(rows.Error())};
+        }
+        for (const auto& row : rows.Value()) {
+            if (row.size() != 1) {
+                fmt::print(stderr, "'{}' returned {} columns\n", sql, row.size());
+                exit(2);
+            }
+            deleted[table]->push_back(static_cast<size_t>(std::stoull(row[0])));
+        }
+    }
+    return StatusOr{std::move(ret)};
+}
+
+StatusCode DB::ApplyReplication(
+    const ReplicationBatch& batch,
+    const std::function<StatusOr<ReplicationBatch>(const ReplicationCursor& after)>& next) {
+    auto code = InTransaction([&] {
+        // Rows are deleted before the ones that may reuse their names are written, so the
+        // references among them are only checked once all batches are in.
+        if (auto st = Exec("PRAGMA defer_foreign_keys = ON;", {}); !st.Ok()) {
+            return st.Code();
+        }
+
+        // Only the batch being written is kept.
+        const ReplicationBatch* current = &batch;
+        ReplicationBatch fetched;
+        while (true) {
+            if (auto code = ReplayBatch(*current); code != StatusCode::OK) {
+                return code;
+            }
+            if (!current->more || !next) {
+                break;
+            }
+            auto page = next(current->next);
+            if (!page.Ok()) {
+                return page.Code();
+            }
+            fetched = std::move(page.Value());
+            current = &fetched;
+        }
+
+        return Exec("INSERT INTO REPLICA VALUES (0, ?1) "
+                    "ON CONFLICT(ID) DO UPDATE SET VERSION = excluded.VERSION;",
+                    {{std::to_string(current->version())}})
+            .Code();
+    });
+    if (code != StatusCode::OK) {
+        return code;
+    }
+
+    // The follower's readers reload everything, as after an import.
+    for (Table table : {Table::INGREDIENTS, Table::TABLEWARE, Table::RECIPE}) {
+        BumpGeneration(table);
+    }
+    changes_->Reset();
+    nutrition_->Clear();
+    return code;
+}
+
+StatusCode DB::ReplayBatch(const ReplicationBatch& batch) {
+    const std::pair<const char*, const std::vector<size_t>*> deletions[] = {
+        {"RECIPE", &batch.recipes.deleted},
+        {"INGREDIENTS", &batch.ingredients.deleted},
+        {"TABLEWARE", &batch.tableware.deleted},
+    };
+    for (const auto& [table, ids] : deletions) {
+        if (batch.reset()) {
+            if (auto st = Exec(fmt::format("DELETE FROM {};", table), {}); !st.Ok()) {
+                return st.Code();
+            }
+            continue;
+        }
+        const std::string sql = fmt::format("DELETE FROM {} WHERE ID = ?1;", table);
+        for (size_t id : *ids) {
+            if (auto st = Exec(sql, {{id}}); !st.Ok()) {
+                return st.Code();
+            }
+        }
+    }
+
+    static const std::string ingredient_sql = fmt::format(
+        "INSERT INTO INGREDIENTS(ID, NAME, KCAL, {0}) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, "
+        "?9) ON CONFLICT(ID) DO UPDATE SET NAME = excluded.NAME, KCAL = excluded.KCAL, "
+        "PROTEIN = excluded.PROTEIN, FAT = excluded.FAT, "
+        "CARBOHYDRATE = excluded.CARBOHYDRATE, FIBRE = excluded.FIBRE, "
+        "SALT = excluded.SALT, SUGAR = excluded.SUGAR;",
+        kNutrientColumns);
+    for (const auto& v : batch.ingredients.changed) {
+        std::vector<BindParameter> params = {{v.id}, {v.name}, {v.kcal}};
+        for (float value : v.nutrients) {
+            params.emplace_back(fmt::format("{}", value));
+        }
+        if (auto st = Exec(ingredient_sql, params); !st.Ok()) {
+            return st.Code();
+        }
+    }
+    for (const auto& v : batch.tableware.changed) {
+        auto st = Exec(
+            "INSERT INTO TABLEWARE(ID, NAME, WEIGHT) VALUES (?1, ?2, ?3) ON CONFLICT(ID) "
+            "DO UPDATE SET NAME = excluded.NAME, WEIGHT = excluded.WEIGHT;",
+            {{v.id}, {v.name}, {v.weight}});
+        if (!st.Ok()) {
+            return st.Code();
+        }
+    }
+    for (const auto& v : batch.recipes.changed) {
+        auto st = Exec(
+            "INSERT INTO RECIPE(ID, NAME, DESC) VALUES (?1, ?2, ?3) ON CONFLICT(ID) "
+            "DO UPDATE SET NAME = excluded.NAME, DESC = excluded.DESC;",
+            {{v.header.id}, {v.header.name}, {v.description}});
+        if (!st.Ok()) {
+            return st.Code();
+        }
+        const RecipeList lists[] = {{"RECIPE_INGREDIENTS", "INGR_ID", &v.ingredients},
+                                    {"RECIPE_SUBRECIPES", "SUBRECIPE_ID", &v.subrecipes}};
+        for (const auto& [table, column, list] : lists) {
+            st = Exec(fmt::format("DELETE FROM {} WHERE RECIPE_ID = ?1;", table), {{v.header.id}});
+            if (!st.Ok()) {
+                return st.Code();
+            }
+            std::map<size_t, uint32_t> rows;
+            for (const auto& row : *list) {
+                rows[row.ingredient_id] += row.weight;
+            }
+            if (auto code = InsertRecipeRows(table, column, v.header.id, rows);
+                code != StatusCode::OK) {
+                return code;
+            }
+        }
+    }
+    return StatusCode::OK;
+}
+
+StatusOr<uint64_t> DB::ReplicatedVersion() {
+    std::string_view sql = "SELECT VERSION FROM REPLICA;";
+    auto rows = Exec(sql, {});
+    if (!rows.Ok()) {
+        return {rows.Code(), std::move(rows.Error())};
+    }
+    if (rows.Value().empty()) {
+        return StatusOr{uint64_t{0}};
+    }
+    if (rows.Value().size() != 1 || rows.Value()[0].size() != 1) {
+        fmt::print(stderr, "'{}' returned {} rows\n", sql, rows.Value().size());
+        exit(2);
+    }
+    return StatusOr{static_cast<uint64_t>(std::stoull(rows.Value()[0][0]))};
+}
+
+StatusOr<std::vector<DB::DBRow>> DB::Exec(std::string_view sql,
+                                          const std::vector<BindParameter>& params,
+                                          size_t* changed_rows) {
+    sqlite3_stmt* stmt = nullptr;
+    {
+        TimingSpan span("db_prepare");
+        int st = sqlite3_prepare_v2(db_, sql.data(), -1, &stmt, nullptr);
+        if (st != SQLITE_OK || stmt == nullptr) {
+            fmt::print(stderr, "Prepare failed: {} SQL: {}\n", st, sql);
+            return {ConvertSqliteToStatus(st), "sqlite3_prepare_v2 failed."};
+        }
+
+        for (auto i = 0; i < params.size(); ++i) {
+            if (params[i].index() == 0) {
+                st = sqlite3_bind_int64(stmt, i + 1, std::get<uint32_t>(params[i]));
+            } else {
+                st = sqlite3_bind_text(stmt, i + 1, std::get<std::string>(params[i]).c_str(), -1,
+                                       SQLITE_TRANSIENT);
+            }
+
+            if (st != SQLITE_OK) {
+                fmt::print(stderr, "Bind failed: {} SQL: {}\n", st, sql);
+                return {ConvertSqliteToStatus(st), "sqlite3_bind failed."};
+            }
+        }
+    }
+
+    std::unique_lock<std::recursive_mutex> lock(mu_, std::defer_lock);
+    {
+        TimingSpan span("db_wait");
+        lock.lock();
+    }
+
+    RequestTiming* const timing = RequestTiming::Current();
     std::vector<DBRow> rows;
-    for (st = sqlite3_step(stmt); st == SQLITE_ROW; st = sqlite3_step(stmt)) {
+    int st = SQLITE_OK;
+    while (true) {
+        {
+            TimingSpan span(timing, "db_step");
+            st = sqlite3_step(stmt);
+        }
+        if (st != SQLITE_ROW) {
+            break;
+        }
+
+        TimingSpan span(timing, "db_rows");
         rows.emplace_back();
         auto& row = rows.back();
         const int column_count = sqlite3_column_count(stmt);
@@ -422,6 +2142,10 @@ StatusOr<std::vector<DB::DBRow>> DB::Exec(std::string_view sql,
         }
     }
 
+    if (changed_rows != nullptr) {
+        *changed_rows = static_cast<size_t>(sqlite3_changes(db_));
+    }
+
     sqlite3_reset(stmt);
     sqlite3_finalize(stmt);
 
@@ -452,7 +2176,7 @@ std::ostream& operator<<(std::ostream& out, const FullRecipe& v) {
 }
 
 bool Ingredient::operator==(const Ingredient& rhs) const {
-    return name == rhs.name && kcal == rhs.kcal && id == rhs.id;
+    return name == rhs.name && kcal == rhs.kcal && id == rhs.id && nutrients == rhs.nutrients;
 }
 
 bool Tableware::operator==(const Tableware& rhs) const {
@@ -468,7 +2192,8 @@ bool RecipeHeader::operator==(const RecipeHeader& rhs) const {
 }
 
 bool FullRecipe::operator==(const FullRecipe& rhs) const {
-    return header == rhs.header && description == rhs.description && ingredients == rhs.ingredients;
+    return header == rhs.header && description == rhs.description &&
+           ingredients == rhs.ingredients && subrecipes == rhs.subrecipes;
 }
 
 }  // namespace foodculator
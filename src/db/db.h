@@ -1,13 +1,20 @@
 #ifndef __SRC_DB_DB_H__
 #define __SRC_DB_DB_H__
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <variant>
 #include <vector>
 
+#include "db/nutrients.h"
 #include "json11/json11.hpp"
 #include "util/statusor.h"
 
@@ -15,19 +22,25 @@ class sqlite3;
 
 namespace foodculator {
 
+class ChangeLog;
+class RecipeNutrition;
+
 struct Ingredient {
     std::string name;
     uint32_t kcal;
     size_t id;
+    Nutrients nutrients;
 
-    Ingredient(std::string name, uint32_t kcal, size_t id = 0)
-        : name(std::move(name)), kcal(kcal), id(id) {}
+    Ingredient(std::string name, uint32_t kcal, size_t id = 0, const Nutrients& nutrients = {})
+        : name(std::move(name)), kcal(kcal), id(id), nutrients(nutrients) {}
 
     bool operator==(const Ingredient& rhs) const;
 
     json11::Json to_json() const {
-        return json11::Json::object{
-            {"name", name}, {"kcal", std::to_string(kcal)}, {"id", std::to_string(id)}};
+        return json11::Json::object{{"name", name},
+                                    {"kcal", std::to_string(kcal)},
+                                    {"id", std::to_string(id)},
+                                    {"nutrients", ToJson(nutrients)}};
     }
 };
 
@@ -87,40 +100,253 @@ struct FullRecipe {
     RecipeHeader header;
     std::string description;
     std::vector<RecipeIngredient> ingredients;
+    // Other recipes used as ingredients, e.g. a stock. `ingredient_id` is the id of the recipe.
+    std::vector<RecipeIngredient> subrecipes;
+    // The sync version of the last write to the recipe, to pass to DB::UpdateRecipe(). 0 if
+    // unknown, e.g. for recipes that are about to be imported.
+    uint64_t version = 0;
 
+    // Compares the contents and ignores the version.
     bool operator==(const FullRecipe& rhs) const;
 
     json11::Json to_json() const {
         return json11::Json::object{{"header", header.to_json()},
                                     {"description", description},
-                                    {"ingredients", ingredients}};
+                                    {"ingredients", ingredients},
+                                    {"subrecipes", subrecipes},
+                                    {"version", std::to_string(version)}};
     }
 };
 
 std::ostream& operator<<(std::ostream& out, const FullRecipe& v);
 
+// A recipe found by DB::SearchRecipes().
+struct RecipeMatch {
+    RecipeHeader header;
+    // The part of the description around the matched words, which are wrapped in `**`.
+    std::string snippet;
+
+    json11::Json to_json() const {
+        return json11::Json::object{{"header", header.to_json()}, {"snippet", snippet}};
+    }
+};
+
+// Rows of one table written after some version, see DB::GetProductsSince().
+template <class T>
+struct RowDelta {
+    // The version to pass as `since` in the next request.
+    uint64_t version = 0;
+    // Set if the delta can't be computed from the given version, because tombstones it needs
+    // have been compacted or the version is from the future. `changed` then holds the whole
+    // table, and the client should drop its copy.
+    bool reset = false;
+    std::vector<T> changed;
+    std::vector<size_t> deleted;
+
+    json11::Json to_json() const {
+        json11::Json::array deleted_ids;
+        deleted_ids.reserve(deleted.size());
+        for (size_t id : deleted) {
+            deleted_ids.emplace_back(std::to_string(id));
+        }
+        return json11::Json::object{{"version", std::to_string(version)},
+                                    {"reset", reset},
+                                    {"changed", changed},
+                                    {"deleted", std::move(deleted_ids)}};
+    }
+};
+
+// A position in the writes of a leader, see DB::GetReplicationBatch(). The writes are ordered
+// by version, then by kind: the rows of the three tables in the order of DB::Table, then the
+// deletions from them; and then by id. So a batch can stop in the middle of a version, e.g.
+// of an import, which stamps all its rows with one version.
+struct ReplicationCursor {
+    // After all writes of `version`.
+    static constexpr uint32_t kVersionEnd = 6;
+
+    uint64_t version = 0;
+    uint32_t kind = kVersionEnd;
+    size_t id = 0;
+
+    json11::Json to_json() const {
+        return json11::Json::object{{"version", std::to_string(version)},
+                                    {"kind", std::to_string(kind)},
+                                    {"id", std::to_string(id)}};
+    }
+};
+
+// The writes made to all tables after some position, for a follower to replay, see
+// DB::GetReplicationBatch(). All three deltas are read at the same version.
+struct ReplicationBatch {
+    RowDelta<Ingredient> ingredients;
+    RowDelta<Tableware> tableware;
+    RowDelta<FullRecipe> recipes;
+
+    // Set if the leader has more writes than fit one batch. The next batch, after `next`,
+    // returns them.
+    bool more = false;
+    ReplicationCursor next;
+
+    // The version of the leader the follower is at once it has applied the batch.
+    uint64_t version() const { return ingredients.version; }
+    // Set if the batch holds the whole tables, and the follower has to drop its rows first.
+    bool reset() const { return ingredients.reset; }
+    bool empty() const {
+        return !reset() && ingredients.changed.empty() && ingredients.deleted.empty() &&
+               tableware.changed.empty() && tableware.deleted.empty() &&
+               recipes.changed.empty() && recipes.deleted.empty();
+    }
+
+    json11::Json to_json() const {
+        return json11::Json::object{{"ingredients", ingredients},
+                                    {"tableware", tableware},
+                                    {"recipes", recipes},
+                                    {"more", more},
+                                    {"next", next}};
+    }
+};
+
+// A row of DB::ExportCatalog().
+using CatalogRow = std::variant<Ingredient, Tableware, FullRecipe>;
+
 class DB {
    public:
+    enum class Table { INGREDIENTS = 0, TABLEWARE, RECIPE };
+
     static std::unique_ptr<DB> Create(std::string_view path);
     ~DB();
 
-    StatusOr<size_t> AddProduct(std::string name, uint32_t kcal);
+    // Asks SQLite to keep the memory of all open databases together under `bytes` by shrinking
+    // their page caches. 0 lifts the limit.
+    static void SetMemoryLimit(int64_t bytes);
+    // The memory SQLite holds for all open databases.
+    static int64_t MemoryUsed();
+
+    // Returns a counter that is incremented after every write to `table`. Callers may cache
+    // anything derived from the table until its generation changes.
+    uint64_t Generation(Table table) const;
+
+    // Recent writes, in the order they happened.
+    ChangeLog& Changes() { return *changes_; }
+
+    StatusOr<size_t> AddProduct(std::string name, uint32_t kcal, const Nutrients& nutrients = {});
     StatusOr<Ingredient> GetProduct(size_t id);
     StatusOr<std::vector<Ingredient>> GetProducts();
+    // Returns the products added or modified after version `since`, and the ids of the ones
+    // deleted after it. `since` = 0 returns the whole table.
+    StatusOr<RowDelta<Ingredient>> GetProductsSince(uint64_t since);
     bool DeleteProduct(size_t id);
+    // Replaces `duplicates` with `into` in all recipes and deletes them, in one transaction, so
+    // it can't be called inside InTransaction(). A recipe that had several of them gets one
+    // ingredient with their total weight. Fails with NOT_FOUND if any of the products doesn't
+    // exist.
+    StatusCode MergeProducts(size_t into, const std::vector<size_t>& duplicates);
 
     StatusOr<size_t> AddTableware(std::string name, uint32_t weight);
     StatusOr<std::vector<Tableware>> GetTableware();
+    StatusOr<RowDelta<Tableware>> GetTablewareSince(uint64_t since);
     bool DeleteTableware(size_t id);
 
+    // `ingredients` and `subrecipes` map ids of ingredients and of other recipes to weights.
     StatusOr<size_t> CreateRecipe(const std::string& name, const std::string& description,
-                                  const std::map<size_t, uint32_t>& ingredients);
+                                  const std::map<size_t, uint32_t>& ingredients,
+                                  const std::map<size_t, uint32_t>& subrecipes = {});
     StatusOr<std::vector<RecipeHeader>> GetRecipes();
-    StatusOr<FullRecipe> GetRecipeInfo(size_t recipe_id);
+    StatusOr<RowDelta<RecipeHeader>> GetRecipesSince(uint64_t since);
+    // If `ingredient_details` is set, it receives the ingredients of the recipe in the order of
+    // FullRecipe::ingredients, read with the same query through a join.
+    StatusOr<FullRecipe> GetRecipeInfo(size_t recipe_id,
+                                       std::vector<Ingredient>* ingredient_details = nullptr);
+    // Replaces the name, description and ingredients of the recipe if it's still at
+    // `expected_version`, i.e. nobody has changed it since the caller read it. Only the rows
+    // that differ are written, in one transaction, so it can't be called inside
+    // InTransaction(). Ingredients with zero weight are removed. Returns the new version of
+    // the recipe. Fails with NOT_FOUND, with CONFLICT if the recipe has another version, and
+    // with INVALID_ARGUMENT if the name is taken, an ingredient doesn't exist or a sub-recipe
+    // contains this recipe.
+    StatusOr<uint64_t> UpdateRecipe(size_t id, uint64_t expected_version, const std::string& name,
+                                    const std::string& description,
+                                    const std::map<size_t, uint32_t>& ingredients,
+                                    const std::map<size_t, uint32_t>& subrecipes = {});
+    // All recipes with their descriptions and ingredients, sorted by id, read in one
+    // transaction. Can't be called inside InTransaction().
+    StatusOr<std::vector<FullRecipe>> GetFullRecipes();
+    // Passes all ingredients, then all tableware and then all recipes to `visit`, each sorted by
+    // id. The tables are read kExportPageSize rows at a time, so the memory used doesn't grow
+    // with them, and writes wait for one page at most rather than for the whole walk. Rows
+    // written during the walk may be missed. Stops early if `visit` returns false.
+    StatusCode ExportCatalog(const std::function<bool(const CatalogRow&)>& visit);
+    static constexpr uint32_t kExportPageSize = 500;
+    // Finds the recipes with all the words of `query` in their name or description, the last
+    // word also as a prefix, best matches first. Returns at most `limit` of them after skipping
+    // the first `offset`. Fails with INVALID_ARGUMENT if `query` has no words.
+    StatusOr<std::vector<RecipeMatch>> SearchRecipes(std::string_view query, uint32_t offset,
+                                                     uint32_t limit);
+    // Returns the energy and nutrients of 100g of the recipe computed from the weights of its
+    // ingredients and sub-recipes. Profiles are memoized until a write changes the recipe or
+    // anything it uses.
+    StatusOr<NutrientProfile> GetRecipeNutrientsPer100g(size_t recipe_id);
+    StatusOr<double> GetRecipeKcalPer100g(size_t recipe_id);
+    // Returns the profile of 100g of an unsaved mix of ingredients and recipes, given as maps
+    // from ids to weights. Fails with NOT_FOUND if any of them doesn't exist.
+    StatusOr<NutrientProfile> CalculateNutrients(const std::map<size_t, uint32_t>& ingredients,
+                                                 const std::map<size_t, uint32_t>& subrecipes);
+    // Fails if the recipe is a sub-recipe of another one.
     bool DeleteRecipe(size_t id);
 
+    // Bulk import of rows with known ids, e.g. generated or restored ones. Rows are written with
+    // multi-row INSERTs in one transaction; call these inside InTransaction() to import several
+    // tables at once.
+    // Imported rows are not reported to Changes() one by one: its readers get a reset instead.
+    // For delta sync, every call is a single write that changes all of its rows at once.
+    StatusCode ImportProducts(const std::vector<Ingredient>& products);
+    StatusCode ImportTableware(const std::vector<Tableware>& tableware);
+    StatusCode ImportRecipes(const std::vector<FullRecipe>& recipes);
+
+    // Runs `body` in a single SQLite transaction, which is committed if `body` returns OK and
+    // rolled back otherwise. Statements from other threads wait until it's over, so this is
+    // meant for bulk loads. Transactions can't be nested.
+    StatusCode InTransaction(const std::function<StatusCode()>& body);
+
+    // The version of the latest write, as returned by the delta requests.
+    StatusOr<uint64_t> Version();
+
+    // Notices commits made to the database file by other connections, e.g. by other worker
+    // processes. If there were any, returns true and bumps the generations of the tables they
+    // wrote to. Those also reset the readers of Changes(), which only lists the writes made
+    // through this DB.
+    bool CatchUpExternalWrites();
+
+    // Drops the tombstones of rows deleted before `deleted_before`. Clients that synced before
+    // those deletions get a reset on their next delta request. Returns the number of dropped
+    // tombstones.
+    StatusOr<size_t> CompactTombstones(std::chrono::system_clock::time_point deleted_before);
+
+    // Replication to read-only followers, see Follower. The sync versions of the leader number
+    // its writes: GetReplicationBatch() returns the writes after `after`, or whole tables if
+    // `after` is the end of version 0 or the tombstones it needs have been compacted. With
+    // `limit` > 0 the batch stops after `limit` writes and sets `more`, and `next` to its last
+    // write, also in the middle of a version.
+    StatusOr<ReplicationBatch> GetReplicationBatch(const ReplicationCursor& after,
+                                                   uint64_t limit = 0);
+    // The writes after version `since`.
+    StatusOr<ReplicationBatch> GetReplicationBatch(uint64_t since, uint64_t limit = 0) {
+        return GetReplicationBatch(ReplicationCursor{since}, limit);
+    }
+    // Replays a batch of the leader and records its version, which ReplicatedVersion() returns
+    // from then on, also after a restart. While a batch has `more`, the next one is read with
+    // `next(batch.next)` and replayed too. All of them go in one transaction, as a batch may
+    // refer to rows that only come in the next one; `next` should not wait. The follower's own
+    // sync versions are independent of the leader's.
+    StatusCode ApplyReplication(
+        const ReplicationBatch& batch,
+        const std::function<StatusOr<ReplicationBatch>(const ReplicationCursor& after)>& next =
+            nullptr);
+    // The version of the leader the database has replayed, 0 if none.
+    StatusOr<uint64_t> ReplicatedVersion();
+
    private:
-    explicit DB(sqlite3* db) : db_(db) {}
+    explicit DB(sqlite3* db);
 
     using BindParameter = std::variant<uint32_t, std::string>;
     StatusCode Insert(std::string_view table, const std::vector<std::string_view>& fields,
@@ -129,11 +355,73 @@ class DB {
                               const std::vector<BindParameter>& params, std::string_view id_field);
 
     using DBRow = std::vector<std::string>;
+    // If `changed_rows` is set, it receives the number of rows modified by the statement.
     StatusOr<std::vector<DBRow>> Exec(std::string_view sql,
-                                      const std::vector<BindParameter>& params);
-
-    std::mutex mu_;
+                                      const std::vector<BindParameter>& params,
+                                      size_t* changed_rows = nullptr);
+
+    void BumpGeneration(Table table);
+
+    StatusOr<std::vector<Ingredient>> SelectProducts(std::string_view sql,
+                                                     const std::vector<BindParameter>& params);
+    StatusOr<std::vector<Tableware>> SelectTableware(std::string_view sql,
+                                                     const std::vector<BindParameter>& params);
+    StatusOr<std::vector<RecipeHeader>> SelectRecipes(std::string_view sql,
+                                                      const std::vector<BindParameter>& params);
+    // The recipes with the ids selected by `recipe_ids`, a SELECT from RECIPE with `params`,
+    // together with their ingredients, sorted by id. An empty `recipe_ids` selects all recipes.
+    StatusOr<std::vector<FullRecipe>> SelectFullRecipes(std::string_view recipe_ids,
+                                                        const std::vector<BindParameter>& params);
+    // GetReplicationBatch() without the transaction around it.
+    StatusOr<ReplicationBatch> ReadReplicationBatch(const ReplicationCursor& after,
+                                                    uint64_t limit);
+    // Writes the rows of one batch of ApplyReplication().
+    StatusCode ReplayBatch(const ReplicationBatch& batch);
+
+    // Inserts `rows` into `table` with as few statements as SQLite's limit on the number of
+    // bound parameters allows. `bind(row, version, &params)` appends the values of `fields` for
+    // a row to `params`; `version` is the sync version all the imported rows should get.
+    template <class Row, class Bind>
+    StatusCode ImportRows(std::string_view table, const std::vector<std::string_view>& fields,
+                          const std::vector<Row>& rows, Bind bind);
+
+    // Inserts the rows of a recipe into RECIPE_INGREDIENTS or RECIPE_SUBRECIPES. `rows` maps
+    // the values of `column` to weights; zero weights are skipped.
+    StatusCode InsertRecipeRows(std::string_view table, std::string_view column, size_t recipe_id,
+                                const std::map<size_t, uint32_t>& rows);
+    // Like InsertRecipeRows, but makes the stored rows match `rows` by writing only the ones
+    // that differ. Sets `*written` if anything was written.
+    StatusCode UpdateRecipeRows(std::string_view table, std::string_view column, size_t recipe_id,
+                                const std::map<size_t, uint32_t>& rows, bool* written);
+    // Computes the profile of 100g of the recipe, and first of its sub-recipes that aren't
+    // memoized. `path` holds the recipes being computed, to catch cycles. Expects `mu_` held,
+    // so that no write slips in between reading the rows and memoizing the profile.
+    StatusOr<NutrientProfile> ComputeNutrientsPer100g(size_t recipe_id, std::vector<size_t>* path);
+    // Appends the profiles and weights of `subrecipes` to `profiles` and `weights`, computing
+    // the missing profiles like ComputeNutrientsPer100g.
+    StatusCode AddSubrecipeProfiles(const std::vector<std::pair<size_t, uint32_t>>& subrecipes,
+                                    std::vector<size_t>* path,
+                                    std::vector<NutrientProfile>* profiles,
+                                    std::vector<float>* weights, std::string* error);
+
+    // Fills everything but `changed` for a delta of `table` after version `since`.
+    template <class T>
+    StatusCode StartDelta(Table table, uint64_t since, RowDelta<T>* delta);
+
+    // How long a statement waits for another process to release the database.
+    static constexpr int kBusyTimeoutMs = 5000;
+
+    // Held by Exec while a statement runs, by InTransaction for the whole transaction, and by
+    // the write methods until their change is in `changes_`.
+    std::recursive_mutex mu_;
     sqlite3* db_;
+    std::array<std::atomic<uint64_t>, 3> generations_ = {};
+    std::unique_ptr<ChangeLog> changes_;
+    std::unique_ptr<RecipeNutrition> nutrition_;
+    // The last PRAGMA data_version seen by CatchUpExternalWrites, and the latest row version
+    // and tombstone version of each table at that time. Guarded by `mu_`.
+    std::optional<uint64_t> data_version_;
+    std::array<uint64_t, 6> table_versions_ = {};
 };
 
 }  // namespace foodculator
@@ -0,0 +1,74 @@
+#include "nutrients.h"
+
+#include <string>
+
+#include "fmt/format.h"
+
+namespace foodculator {
+
+std::string_view ToString(Nutrient nutrient) {
+    switch (nutrient) {
+        case Nutrient::PROTEIN:
+            return "protein";
+        case Nutrient::FAT:
+            return "fat";
+        case Nutrient::CARBOHYDRATE:
+            return "carbohydrate";
+        case Nutrient::FIBRE:
+            return "fibre";
+        case Nutrient::SALT:
+            return "salt";
+        default:
+            return "sugar";
+    }
+}
+
+json11::Json ToJson(const Nutrients& nutrients) {
+    json11::Json::object ret;
+    for (size_t idx = 0; idx < kNutrientCount; ++idx) {
+        // The shortest form that reads back as the same float, e.g. "3.2".
+        ret.emplace(ToString(static_cast<Nutrient>(idx)), fmt::format("{}", nutrients[idx]));
+    }
+    return ret;
+}
+
+NutrientProfile::NutrientProfile(float kcal, const Nutrients& nutrients) {
+    lanes[0] = kcal;
+    for (size_t idx = 0; idx < kNutrientCount; ++idx) {
+        lanes[1 + idx] = nutrients[idx];
+    }
+}
+
+json11::Json NutrientProfile::to_json() const {
+    json11::Json::object ret = {{"kcal", fmt::format("{:.2f}", kcal())}};
+    for (size_t idx = 0; idx < kNutrientCount; ++idx) {
+        const auto nutrient = static_cast<Nutrient>(idx);
+        ret.emplace(ToString(nutrient), fmt::format("{:.2f}", Get(nutrient)));
+    }
+    return ret;
+}
+
+std::ostream& operator<<(std::ostream& out, const NutrientProfile& v) {
+    return out << v.to_json().dump();
+}
+
+NutrientProfile MixPer100g(const NutrientProfile* profiles, const float* weights, size_t count) {
+    NutrientProfile ret;
+    float total = 0;
+    for (size_t idx = 0; idx < count; ++idx) {
+        const float weight = weights[idx];
+        for (size_t lane = 0; lane < NutrientProfile::kLanes; ++lane) {
+            ret.lanes[lane] += profiles[idx].lanes[lane] * weight;
+        }
+        total += weight;
+    }
+    if (total <= 0) {
+        return NutrientProfile();
+    }
+    for (size_t lane = 0; lane < NutrientProfile::kLanes; ++lane) {
+        ret.lanes[lane] /= total;
+    }
+    return ret;
+}
+
+}  // namespace foodculator
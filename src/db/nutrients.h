@@ -0,0 +1,56 @@
+#ifndef __SRC_DB_NUTRIENTS_H__
+#define __SRC_DB_NUTRIENTS_H__
+
+#include <array>
+#include <cstddef>
+#include <ostream>
+#include <string_view>
+
+#include "json11/json11.hpp"
+
+namespace foodculator {
+
+// The nutrients tracked besides energy, in grams per 100g.
+enum class Nutrient { PROTEIN = 0, FAT, CARBOHYDRATE, FIBRE, SALT, SUGAR };
+constexpr size_t kNutrientCount = 6;
+// The name of the nutrient in json and in the INGREDIENTS table (upper-cased).
+std::string_view ToString(Nutrient nutrient);
+
+// Grams of every nutrient in 100g of an ingredient, indexed by Nutrient.
+using Nutrients = std::array<float, kNutrientCount>;
+
+json11::Json ToJson(const Nutrients& nutrients);
+
+// Energy and nutrients of 100g of food. The values are kept in one 32-byte array of 8 floats:
+// kcal, the nutrients in Nutrient order, and a zero, so that arrays of profiles are contiguous
+// and every profile is one 256-bit (or two 128-bit) vector.
+struct alignas(32) NutrientProfile {
+    static constexpr size_t kLanes = 8;
+    std::array<float, kLanes> lanes = {};
+
+    NutrientProfile() = default;
+    NutrientProfile(float kcal, const Nutrients& nutrients);
+
+    float kcal() const { return lanes[0]; }
+    float Get(Nutrient nutrient) const { return lanes[1 + static_cast<size_t>(nutrient)]; }
+
+    bool operator==(const NutrientProfile& rhs) const { return lanes == rhs.lanes; }
+
+    json11::Json to_json() const;
+};
+
+std::ostream& operator<<(std::ostream& out, const NutrientProfile& v);
+
+static_assert(sizeof(NutrientProfile) == 32 && 1 + kNutrientCount <= NutrientProfile::kLanes);
+
+// Computes the profile of 100g of a mix of `count` foods with the given profiles per 100g and
+// weights in grams. A mix that weighs nothing has an all-zero profile.
+//
+// The weighted sums are accumulated lane by lane over the contiguous arrays, which compiles to
+// packed multiply-adds without any intrinsics, so one call costs about a vector operation per
+// food.
+NutrientProfile MixPer100g(const NutrientProfile* profiles, const float* weights, size_t count);
+
+}  // namespace foodculator
+
+#endif
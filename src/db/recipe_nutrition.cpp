@@ -0,0 +1,99 @@
+#include "recipe_nutrition.h"
+
+namespace foodculator {
+
+namespace {
+
+void Unlink(std::unordered_map<size_t, std::unordered_set<size_t>>* users, size_t used,
+            size_t user) {
+    auto it = users->find(used);
+    if (it == users->end()) {
+        return;
+    }
+    it->second.erase(user);
+    if (it->second.empty()) {
+        users->erase(it);
+    }
+}
+
+}  // namespace
+
+std::optional<NutrientProfile> RecipeNutrition::Get(size_t recipe) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = nodes_.find(recipe);
+    if (it == nodes_.end()) {
+        return std::nullopt;
+    }
+    return it->second.per_100g;
+}
+
+void RecipeNutrition::Set(size_t recipe, const NutrientProfile& per_100g,
+                          const std::vector<size_t>& ingredients,
+                          const std::vector<size_t>& subrecipes) {
+    std::lock_guard<std::mutex> lock(mu_);
+    // The recipes that use the old value are recomputed from the new one.
+    InvalidateLocked(recipe);
+    for (size_t id : ingredients) {
+        ingredient_users_[id].insert(recipe);
+    }
+    for (size_t id : subrecipes) {
+        recipe_users_[id].insert(recipe);
+    }
+    nodes_.emplace(recipe, Node{per_100g, ingredients, subrecipes});
+}
+
+void RecipeNutrition::InvalidateRecipe(size_t recipe) {
+    std::lock_guard<std::mutex> lock(mu_);
+    InvalidateLocked(recipe);
+}
+
+void RecipeNutrition::InvalidateIngredient(size_t ingredient) {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = ingredient_users_.find(ingredient);
+    if (it == ingredient_users_.end()) {
+        return;
+    }
+    const std::vector<size_t> users(it->second.begin(), it->second.end());
+    for (size_t user : users) {
+        InvalidateLocked(user);
+    }
+}
+
+void RecipeNutrition::Clear() {
+    std::lock_guard<std::mutex> lock(mu_);
+    nodes_.clear();
+    ingredient_users_.clear();
+    recipe_users_.clear();
+}
+
+size_t RecipeNutrition::size() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return nodes_.size();
+}
+
+void RecipeNutrition::InvalidateLocked(size_t recipe) {
+    std::vector<size_t> pending = {recipe};
+    while (!pending.empty()) {
+        const size_t id = pending.back();
+        pending.pop_back();
+
+        if (auto it = recipe_users_.find(id); it != recipe_users_.end()) {
+            pending.insert(pending.end(), it->second.begin(), it->second.end());
+            recipe_users_.erase(it);
+        }
+
+        auto node = nodes_.find(id);
+        if (node == nodes_.end()) {
+            continue;
+        }
+        for (size_t used : node->second.ingredients) {
+            Unlink(&ingredient_users_, used, id);
+        }
+        for (size_t used : node->second.subrecipes) {
+            Unlink(&recipe_users_, used, id);
+        }
+        nodes_.erase(node);
+    }
+}
+
+}  // namespace foodculator
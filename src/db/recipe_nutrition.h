@@ -0,0 +1,57 @@
+#ifndef __SRC_DB_RECIPE_NUTRITION_H__
+#define __SRC_DB_RECIPE_NUTRITION_H__
+
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "nutrients.h"
+
+namespace foodculator {
+
+// RecipeNutrition memoizes the nutrient profiles of recipes together with what each one was
+// computed from: the ingredients of the recipe and its sub-recipes. The recipes form a DAG,
+// and a change to an ingredient or a recipe drops only the values of the recipes that
+// (transitively) use it; everything else stays cached.
+//
+// The profiles are computed by the caller, see DB::GetRecipeNutrientsPer100g(). All methods are
+// thread-safe.
+class RecipeNutrition {
+   public:
+    std::optional<NutrientProfile> Get(size_t recipe) const;
+
+    // Memoizes the profile of 100g of `recipe`, which has been computed from `ingredients` and
+    // `subrecipes`. The profiles of the sub-recipes are expected to be memoized already.
+    void Set(size_t recipe, const NutrientProfile& per_100g,
+             const std::vector<size_t>& ingredients, const std::vector<size_t>& subrecipes);
+
+    // Drops the value of `recipe` and of all recipes that use it, directly or not.
+    void InvalidateRecipe(size_t recipe);
+    // Drops the values of all recipes that use `ingredient`, directly or not.
+    void InvalidateIngredient(size_t ingredient);
+    void Clear();
+
+    // The number of memoized values.
+    size_t size() const;
+
+   private:
+    struct Node {
+        NutrientProfile per_100g;
+        std::vector<size_t> ingredients;
+        std::vector<size_t> subrecipes;
+    };
+
+    void InvalidateLocked(size_t recipe);
+
+    mutable std::mutex mu_;
+    std::unordered_map<size_t, Node> nodes_;
+    // Reverse edges: the memoized recipes that use an ingredient or a recipe.
+    std::unordered_map<size_t, std::unordered_set<size_t>> ingredient_users_;
+    std::unordered_map<size_t, std::unordered_set<size_t>> recipe_users_;
+};
+
+}  // namespace foodculator
+
+#endif
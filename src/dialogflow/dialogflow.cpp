@@ -0,0 +1,151 @@
+#include "dialogflow.h"
+
+#include "fmt/format.h"
+
+namespace foodculator {
+
+std::string RenderDialogflowResponse(std::string text) {
+    auto simpleResponse =
+        json11::Json::object{{"simpleResponse", json11::Json::object{{"textToSpeech", text}}}};
+
+    json11::Json ret = json11::Json::object{
+        {"fulfillmentMessages",
+         json11::Json::array{
+             json11::Json::object{
+                 {"text", json11::Json::object{{"text", json11::Json::array{std::move(text)}}}}},
+         }},
+        {
+            "payload",
+            json11::Json::object{
+                {"google", json11::Json::object{{
+                               "richResponse",
+                               json11::Json::object{
+                                   {"items", json11::Json::array{std::move(simpleResponse)}}},
+                           }}}},
+        },
+    };
+    return ret.dump();
+}
+
+Dialogflow::Dialogflow(DB* db) : db_(db), catalog_(db) {
+    RegisterCached("ingredients", {DB::Table::INGREDIENTS}, [](DB& db) -> StatusOr<std::string> {
+        auto products = db.GetProducts();
+        if (!products.Ok()) {
+            return {products.Code(), std::move(products.Error())};
+        }
+
+        fmt::memory_buffer text;
+        fmt::format_to(text, "Наши ингредиенты:");
+        for (const auto& ingredient : products.Value()) {
+            fmt::format_to(text, "\n{} по {} калории,", ingredient.name, ingredient.kcal);
+        }
+        return StatusOr{fmt::to_string(text)};
+    });
+
+    RegisterCached("pots", {DB::Table::TABLEWARE}, [](DB& db) -> StatusOr<std::string> {
+        auto tw = db.GetTableware();
+        if (!tw.Ok()) {
+            return {tw.Code(), std::move(tw.Error())};
+        }
+
+        fmt::memory_buffer text;
+        fmt::format_to(text, "Наша посуда:");
+        for (const auto& pot : tw.Value()) {
+            fmt::format_to(text, "\n{} по {} грам,", pot.name, pot.weight);
+        }
+        return StatusOr{fmt::to_string(text)};
+    });
+
+    // "How many calories are in X?" The product is passed in the `food` parameter.
+    Register("calories", [this](DB& db, const json11::Json& query) -> StatusOr<std::string> {
+        std::string food = query["parameters"]["food"].string_value();
+        if (food.empty()) {
+            food = query["queryText"].string_value();
+        }
+
+        auto match = catalog_.Find(food);
+        if (!match.Ok()) {
+            if (match.Code() == StatusCode::NOT_FOUND) {
+                return StatusOr{fmt::format("Я не нашла {} в нашей базе.", food)};
+            }
+            return {match.Code(), std::move(match.Error())};
+        }
+
+        const auto& entry = match.Value().entry;
+        if (entry.kind == NameIndex::Kind::INGREDIENT) {
+            auto product = db.GetProduct(entry.id);
+            if (!product.Ok()) {
+                return {product.Code(), std::move(product.Error())};
+            }
+            return StatusOr{fmt::format("{}: {} калорий на 100 грамм.", product.Value().name,
+                                        product.Value().kcal)};
+        }
+
+        auto kcal = db.GetRecipeKcalPer100g(entry.id);
+        if (!kcal.Ok()) {
+            return {kcal.Code(), std::move(kcal.Error())};
+        }
+        return StatusOr{fmt::format("{}: {:.0f} калорий на 100 грамм.", entry.name, kcal.Value())};
+    });
+}
+
+void Dialogflow::RegisterCached(std::string name, std::vector<DB::Table> tables,
+                                CachedIntent intent) {
+    auto entry = std::make_unique<Intent>();
+    entry->tables = std::move(tables);
+    entry->cached = std::move(intent);
+    intents_[std::move(name)] = std::move(entry);
+}
+
+void Dialogflow::Register(std::string name, QueryIntent intent) {
+    auto entry = std::make_unique<Intent>();
+    entry->query = std::move(intent);
+    intents_[std::move(name)] = std::move(entry);
+}
+
+StatusOr<std::string> Dialogflow::Handle(const json11::Json& in) {
+    const auto& query = in["queryResult"];
+    const std::string& intent_name = query["intent"]["displayName"].string_value();
+
+    auto it = intents_.find(intent_name);
+    if (it == intents_.end()) {
+        return {StatusCode::NOT_FOUND, fmt::format("Intent '{}' is not supported.", intent_name)};
+    }
+
+    Intent& intent = *it->second;
+    if (intent.cached) {
+        return HandleCached(intent);
+    }
+
+    auto text = intent.query(*db_, query);
+    if (!text.Ok()) {
+        return text;
+    }
+    return StatusOr{RenderDialogflowResponse(std::move(text.Value()))};
+}
+
+StatusOr<std::string> Dialogflow::HandleCached(Intent& intent) {
+    // Generations are read before the tables, so a write that races with rendering leaves
+    // the cache stale and it is rebuilt by the next request.
+    std::vector<uint64_t> generations;
+    generations.reserve(intent.tables.size());
+    for (DB::Table table : intent.tables) {
+        generations.push_back(db_->Generation(table));
+    }
+
+    std::lock_guard<std::mutex> lock(intent.mu);
+    if (!intent.response.empty() && intent.generations == generations) {
+        return StatusOr{intent.response};
+    }
+
+    auto text = intent.cached(*db_);
+    if (!text.Ok()) {
+        return text;
+    }
+
+    intent.response = RenderDialogflowResponse(std::move(text.Value()));
+    intent.generations = std::move(generations);
+    return StatusOr{intent.response};
+}
+
+}  // namespace foodculator
@@ -0,0 +1,63 @@
+#ifndef __SRC_DIALOGFLOW_DIALOGFLOW_H__
+#define __SRC_DIALOGFLOW_DIALOGFLOW_H__
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "db/db.h"
+#include "json11/json11.hpp"
+#include "search/catalog_index.h"
+#include "util/statusor.h"
+
+namespace foodculator {
+
+// Wraps `text` into a Dialogflow webhook response body.
+std::string RenderDialogflowResponse(std::string text);
+
+// Dialogflow dispatches webhook requests to intents registered by their display name.
+class Dialogflow {
+   public:
+    // Returns the text that the assistant should say.
+    using CachedIntent = std::function<StatusOr<std::string>(DB& db)>;
+    using QueryIntent =
+        std::function<StatusOr<std::string>(DB& db, const json11::Json& query_result)>;
+
+    // Registers the built-in "ingredients", "pots" and "calories" intents.
+    explicit Dialogflow(DB* db);
+
+    // Registers an intent whose answer depends only on the contents of `tables`. Its rendered
+    // response is cached until DB::Generation() of one of these tables changes.
+    void RegisterCached(std::string name, std::vector<DB::Table> tables, CachedIntent intent);
+
+    // Registers an intent whose answer depends on the request, e.g. on its parameters.
+    void Register(std::string name, QueryIntent intent);
+
+    // Returns the response body for the webhook request `in`.
+    // Returns NOT_FOUND if the intent is not supported.
+    StatusOr<std::string> Handle(const json11::Json& in);
+
+   private:
+    struct Intent {
+        std::vector<DB::Table> tables;
+        CachedIntent cached;
+        QueryIntent query;
+
+        std::mutex mu;
+        std::vector<uint64_t> generations;
+        std::string response;
+    };
+
+    StatusOr<std::string> HandleCached(Intent& intent);
+
+    DB* db_;
+    CatalogIndex catalog_;
+    std::unordered_map<std::string, std::unique_ptr<Intent>> intents_;
+};
+
+}  // namespace foodculator
+
+#endif
@@ -1,60 +1,43 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <csignal>
-#include <fstream>
-#include <streambuf>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <unordered_map>
+#include <thread>
 
+#include "bot/bot.h"
 #include "db/db.h"
 #include "fmt/format.h"
 #include "httplib.h"
-#include "json11/json11.hpp"
-#include "tgbot/tgbot.h"
-
-namespace {
-std::string ReadHtml(const std::string& path) {
-    std::ifstream in(path);
-    std::string str{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
-    in.close();
-    return str;
-}
-
-void ReplyErr(std::string msg, int status, httplib::Response* res) {
-    res->set_content(std::move(msg), "text/plain");
-    res->status = status;
-}
-
-// TODO(luckygeck): Move to separate file.
-std::string RenderDialogflowResponse(std::string text) {
-    std::vector<json11::Json> jsons;
-    auto simpleResponse =
-        json11::Json::object{{"simpleResponse", json11::Json::object{{"textToSpeech", text}}}};
-
-    json11::Json ret = json11::Json::object{
-        {"fulfillmentMessages",
-         json11::Json::array{
-             json11::Json::object{
-                 {"text", json11::Json::object{{"text", json11::Json::array{std::move(text)}}}}},
-         }},
-        {
-            "payload",
-            json11::Json::object{
-                {"google", json11::Json::object{{
-                               "richResponse",
-                               json11::Json::object{
-                                   {"items", json11::Json::array{std::move(simpleResponse)}}},
-                           }}}},
-        },
-    };
-    return ret.dump();
-}
+#include "server/capture.h"
+#include "server/follower.h"
+#include "server/server.h"
+#include "server/supervisor.h"
+#include "server/tenant_pool.h"
+#include "snapshot/catalog_snapshot.h"
 
-}  // namespace
-
-httplib::Server* server = nullptr;
+foodculator::Server* server = nullptr;
 
 void signal_handler(int signal) {
     if (server) {
-        server->stop();
+        server->Stop();
+    }
+}
+
+// Drops the tombstones older than `retention_days`.
+void CompactTombstones(foodculator::DB* db, int retention_days) {
+    auto retention = std::chrono::hours(24) * retention_days;
+    auto dropped = db->CompactTombstones(std::chrono::system_clock::now() - retention);
+    if (!dropped.Ok()) {
+        fmt::print(stderr, "CompactTombstones failed: {}\n", dropped.Error());
+    } else if (dropped.Value() > 0) {
+        fmt::print("Compacted {} tombstones\n", dropped.Value());
     }
 }
 
@@ -62,266 +45,221 @@ int main(int argc, char** argv) {
     using foodculator::DB;
 
     if (argc != 3) {
-        fmt::print(stderr, "usage: {} path_to_static_files path_to_database\n", argv[0]);
+        fmt::print(stderr, "usage: {} path_to_static_files path_to_database_or_dir\n", argv[0]);
         return 1;
     }
 
-    fmt::print("Working with sqlite db in {}\n", argv[2]);
-
-    auto db = DB::Create(argv[2]);
-    if (!db) {
-        fmt::print(stderr, "DB::Create({}) failed.\n", argv[2]);
+    // WORKER_PROCESSES=N serves the port from N processes managed by a supervisor.
+    size_t processes = 1;
+    if (char* v = std::getenv("WORKER_PROCESSES"); v) {
+        processes = std::max(1, std::stoi(v));
+    }
+    // A directory instead of a database file serves a kitchen per database in it.
+    const bool multi_tenant = std::filesystem::is_directory(argv[2]);
+    if (multi_tenant && processes > 1) {
+        fmt::print(stderr, "WORKER_PROCESSES can't serve a directory of kitchens.\n");
         return 1;
     }
-
-    std::string path_to_static = argv[1];
-
-    httplib::Server srv;
-
-    std::vector<std::pair<const char*, const char*>> html_pages = {
-        {"/", "/index.html"},
-        {"/ingredients", "/ingredients.html"},
-        {"/tableware", "/tableware.html"},
-        {"/recipe", "/recipe.html"},
-    };
-
-    for (const auto& [page, path] : html_pages) {
-        srv.Get(page, [abs_path = (path_to_static + path)](const httplib::Request& req,
-                                                           httplib::Response& res) {
-            res.set_content(ReadHtml(abs_path), "text/html");
-        });
+    // LEADER_URL=http://<host>:<port> makes this instance a read-only copy of the leader.
+    const char* leader_url = std::getenv("LEADER_URL");
+    if (leader_url && *leader_url && (multi_tenant || processes > 1)) {
+        fmt::print(stderr, "A follower serves one database from one process.\n");
+        return 1;
     }
-
-    srv.Get("/get_ingredients", [&db](const httplib::Request& req, httplib::Response& res) {
-        auto products = db->GetProducts();
-        if (!products.Ok()) {
-            ReplyErr(std::move(products.Error()), 500, &res);
-            return;
-        }
-        res.set_content(json11::Json(std::move(products.Value())).dump(), "text/json");
-    });
-
-    srv.Post("/add_ingredient", [&db](const httplib::Request& req, httplib::Response& res) {
-        std::string err;
-        json11::Json input = json11::Json::parse(req.body, err);
-        if (!err.empty()) {
-            ReplyErr("Failed to parse the request: " + err, 400, &res);
-            return;
-        }
-
-        std::string name = input["product"].string_value();
-        if (name.empty() || !input.has_shape({{"kcal", json11::Json::NUMBER}}, err)) {
-            ReplyErr("Ingredient should have `product` (string) and `kcal` (number) fields.", 400,
-                     &res);
-            return;
-        }
-
-        double kcal = input["kcal"].number_value();
-        if (kcal < 0.0) {
-            ReplyErr("Ingredient cannot have negative `kcal` value.", 400, &res);
-            return;
-        }
-
-        auto st = db->AddProduct(std::move(name), static_cast<uint32_t>(kcal));
-        if (!st.Ok()) {
-            ReplyErr(std::move(st.Error()), 500, &res);
-            return;
-        }
-        res.set_content(std::to_string(st.Value()), "text/plain");
-    });
-
-    srv.Get(R"(/ingredient/(\d+))", [&db](const httplib::Request& req, httplib::Response& res) {
-        size_t id = static_cast<size_t>(std::stoull(req.matches[1].str()));
-        auto product = db->GetProduct(id);
-        if (!product.Ok()) {
-            int code = (product.Code() == foodculator::StatusCode::NOT_FOUND) ? 404 : 500;
-            ReplyErr(std::move(product.Error()), code, &res);
-            return;
-        }
-        res.set_content(json11::Json(std::move(product.Value())).dump(), "text/json");
-    });
-
-    srv.Delete(R"(/ingredient/(\d+))", [&db](const httplib::Request& req, httplib::Response& res) {
-        if (!db->DeleteProduct(std::stoull(req.matches[1].str()))) {
-            ReplyErr("DB request failed. Try again later.", 500, &res);
-        }
-    });
-
-    srv.Get("/get_tableware", [&db](const httplib::Request& req, httplib::Response& res) {
-        auto tw = db->GetTableware();
-        if (!tw.Ok()) {
-            ReplyErr(std::move(tw.Error()), 500, &res);
-            return;
-        }
-        res.set_content(json11::Json(std::move(tw.Value())).dump(), "text/json");
-    });
-
-    srv.Post("/add_tableware", [&db](const httplib::Request& req, httplib::Response& res) {
-        std::string err;
-        json11::Json input = json11::Json::parse(req.body, err);
-        if (!err.empty()) {
-            ReplyErr("Failed to parse the request: " + err, 400, &res);
-            return;
-        }
-
-        std::string name = input["name"].string_value();
-        if (name.empty() || !input.has_shape({{"weight", json11::Json::NUMBER}}, err)) {
-            ReplyErr("The pot should have `name` (string) and `weight` (number) fields.", 400,
-                     &res);
-            return;
-        }
-        double weight_double = input["weight"].number_value();
-        if (weight_double < 0.0) {
-            ReplyErr("The weight couldn't be negative.", 400, &res);
-            return;
+    int port = 1234;
+    if (char* v = std::getenv("PORT"); v) {
+        port = std::stoi(v);
+    }
+    const auto worker_index = foodculator::SupervisedWorkerIndex();
+    if (processes > 1 && !worker_index) {
+        // Migrations and the switch to WAL happen once, before the workers open the file.
+        if (!DB::Create(argv[2])) {
+            fmt::print(stderr, "DB::Create({}) failed.\n", argv[2]);
+            return 1;
         }
-
-        uint32_t weight = static_cast<uint32_t>(weight_double);
-        auto st = db->AddTableware(std::move(name), weight);
-        if (!st.Ok()) {
-            ReplyErr(std::move(st.Error()), 500, &res);
-            return;
+        return foodculator::Supervisor(argc, argv, processes, port).Run();
+    }
+    // Background jobs run in one process only.
+    const bool primary = worker_index.value_or(0) == 0;
+
+    std::unique_ptr<DB> db;
+    if (!multi_tenant) {
+        fmt::print("Working with sqlite db in {}\n", argv[2]);
+        db = DB::Create(argv[2]);
+        if (!db) {
+            fmt::print(stderr, "DB::Create({}) failed.\n", argv[2]);
+            return 1;
         }
-        res.set_content(std::to_string(st.Value()), "text/plain");
-    });
+    }
 
-    srv.Delete(R"(/tableware/(\d+))", [&db](const httplib::Request& req, httplib::Response& res) {
-        if (!db->DeleteTableware(std::stoull(req.matches[1].str()))) {
-            ReplyErr("A pot wasn't deleted. Some SQL error occured.", 500, &res);
-        }
-    });
+    std::string version = "UNKNOWN";
+    if (char* v = std::getenv("VERSION"); v) {
+        version = v;
+    }
 
-    srv.Get("/get_recipes", [&db](const httplib::Request& req, httplib::Response& res) {
-        auto recipes = db->GetRecipes();
-        if (!recipes.Ok()) {
-            ReplyErr(std::move(recipes.Error()), 500, &res);
-            return;
-        }
-        res.set_content(json11::Json(std::move(recipes.Value())).dump(), "text/json");
-    });
+    // Tombstones are kept for TOMBSTONE_RETENTION_DAYS; clients that haven't synced for longer
+    // reload the whole table.
+    int retention_days = 30;
+    if (char* v = std::getenv("TOMBSTONE_RETENTION_DAYS"); v) {
+        retention_days = std::max(1, std::stoi(v));
+    }
 
-    srv.Post("/create_recipe", [&db](const httplib::Request& req, httplib::Response& res) {
-        std::string err;
-        json11::Json input = json11::Json::parse(req.body, err);
-        if (!err.empty()) {
-            ReplyErr("Failed to parse the request: " + err, 400, &res);
-            return;
+    // CAPTURE_FILE records the API traffic for tools/replay.
+    std::unique_ptr<foodculator::CaptureWriter> capture;
+    if (char* v = std::getenv("CAPTURE_FILE"); v && *v) {
+        // Every worker process writes its own log.
+        std::string path = worker_index ? fmt::format("{}.{}", v, getpid()) : v;
+        capture = foodculator::CaptureWriter::Create(path);
+        if (!capture) {
+            return 1;
         }
+        fmt::print("Capturing requests to {}\n", path);
+    }
 
-        std::string name = input["header"]["name"].string_value();
-        if (name.empty()) {
-            ReplyErr("Recipe name should not be empty.", 400, &res);
-            return;
+    // SNAPSHOT_FILE serves the catalog from a memory-mapped file, so a restart doesn't have to
+    // read it from SQLite. The primary process rewrites it after writes, the others reload it.
+    // A snapshot covers one database, so kitchens don't get one.
+    std::unique_ptr<foodculator::CatalogSnapshot> snapshot;
+    if (char* v = std::getenv("SNAPSHOT_FILE"); db && v && *v) {
+        snapshot = std::make_unique<foodculator::CatalogSnapshot>(db.get(), v);
+        if (snapshot->Load()) {
+            fmt::print("Loaded the catalog snapshot from {}\n", v);
         }
+    }
 
-        std::map<size_t, uint32_t> ingredients;
-        for (const auto& v : input["ingredients"].array_items()) {
-            if (!v.has_shape({{"id", json11::Json::NUMBER}, {"weight", json11::Json::NUMBER}},
-                             err)) {
-                ReplyErr("Each ingredient should have id and weight number fields.", 400, &res);
-                return;
-            }
-
-            double id = v["id"].number_value();
-            double weight = v["weight"].number_value();
-            if (id < 0.0 || weight < 0.0) {
-                ReplyErr("id and weight must be >= 0.", 400, &res);
-                return;
-            }
+    // TIMING_SAMPLE=N logs where the time of every N-th request went.
+    uint32_t timing_sample = 0;
+    if (char* v = std::getenv("TIMING_SAMPLE"); v) {
+        timing_sample = static_cast<uint32_t>(std::max(0, std::stoi(v)));
+    }
 
-            ingredients[static_cast<size_t>(id)] = static_cast<uint32_t>(weight);
+    // At most TENANT_MAX_OPEN kitchens are open at a time, and the ones nobody has used for
+    // TENANT_IDLE_SECONDS are closed. SQLite tries to keep all of them under TENANT_MEMORY_MB.
+    std::unique_ptr<foodculator::TenantPool> tenants;
+    if (multi_tenant) {
+        foodculator::TenantOptions options;
+        options.dir = argv[2];
+        if (char* v = std::getenv("TENANT_MAX_OPEN"); v) {
+            options.max_open = std::max(1, std::stoi(v));
         }
-
-        std::string description = input["description"].string_value();
-
-        auto st = db->CreateRecipe(name, description, ingredients);
-        if (!st.Ok()) {
-            ReplyErr(std::move(st.Error()), 500, &res);
-            return;
+        if (char* v = std::getenv("TENANT_IDLE_SECONDS"); v) {
+            options.idle_timeout = std::chrono::seconds(std::max(1, std::stoi(v)));
         }
-        res.set_content(std::to_string(st.Value()), "text/plain");
-    });
-
-    srv.Get(R"(/recipe/(\d+))", [&db](const httplib::Request& req, httplib::Response& res) {
-        size_t id = std::stoull(req.matches[1].str());
-        auto recipe = db->GetRecipeInfo(id);
-        if (!recipe.Ok()) {
-            int code = (recipe.Code() == foodculator::StatusCode::NOT_FOUND) ? 404 : 500;
-            ReplyErr(std::move(recipe.Error()), code, &res);
-            return;
+        options.memory_limit = int64_t{256} << 20;
+        if (char* v = std::getenv("TENANT_MEMORY_MB"); v) {
+            options.memory_limit = int64_t{std::max(0, std::stoi(v))} << 20;
         }
+        tenants = std::make_unique<foodculator::TenantPool>(std::move(options), [&](DB* tenant) {
+            // Kitchens are opened and closed all the time, so their tombstones are compacted
+            // when they are opened rather than hourly.
+            CompactTombstones(tenant, retention_days);
+            auto ret = std::make_unique<foodculator::Server>(tenant, argv[1], version);
+            ret->SetCapture(capture.get());
+            ret->SetTimingSample(timing_sample);
+            return ret;
+        });
+        fmt::print("Serving the kitchens in {}\n", argv[2]);
+    }
 
-        res.set_content(json11::Json(std::move(recipe.Value())).dump(), "text/json");
-    });
-
-    srv.Delete(R"(/recipe/(\d+))", [&db](const httplib::Request& req, httplib::Response& res) {
-        if (!db->DeleteRecipe(std::stoull(req.matches[1].str()))) {
-            ReplyErr("DB request failed. Try again later.", 500, &res);
-            return;
+    foodculator::Server srv = tenants ? foodculator::Server(tenants.get(), argv[1], version)
+                                      : foodculator::Server(db.get(), argv[1], version);
+    // EVENT_LOOP_WORKERS=N serves the connections from one epoll thread and runs the requests on
+    // N threads, so that idle keep-alive clients don't hold a thread each. Workers of a
+    // supervisor always do, to accept from the socket it listens on.
+    size_t event_loop_workers = 0;
+    if (char* v = std::getenv("EVENT_LOOP_WORKERS"); v && *v) {
+        event_loop_workers = std::max(1, std::stoi(v));
+    }
+    const auto listening_socket = foodculator::SupervisedListeningSocket();
+    if (listening_socket && event_loop_workers == 0) {
+        event_loop_workers = std::max(8u, std::thread::hardware_concurrency());
+    }
+    if (event_loop_workers > 0) {
+        srv.UseEventLoop(event_loop_workers);
+        fmt::print("Serving connections from an event loop with {} workers\n",
+                   event_loop_workers);
+    }
+    srv.SetCapture(capture.get());
+    srv.SetSnapshot(snapshot.get());
+
+    // The follower refuses requests while it's more than FOLLOWER_MAX_STALENESS_SECONDS behind
+    // the leader.
+    std::unique_ptr<foodculator::LeaderApi> leader;
+    std::unique_ptr<foodculator::Follower> follower;
+    std::thread follower_thread;
+    if (leader_url && *leader_url) {
+        int max_staleness = 10;
+        if (char* v = std::getenv("FOLLOWER_MAX_STALENESS_SECONDS"); v) {
+            max_staleness = std::max(1, std::stoi(v));
         }
-    });
-
-    srv.Post("/dialogflow", [&db](const httplib::Request& req, httplib::Response& res) {
-        std::string err;
-        const json11::Json in = json11::Json::parse(req.body, err);
-        if (!err.empty()) {
-            ReplyErr("Failed to parse input as json: " + err, 400, &res);
-            return;
+        leader = foodculator::CreateHttpLeaderApi(leader_url);
+        follower = std::make_unique<foodculator::Follower>(db.get(), leader.get(),
+                                                           std::chrono::seconds(max_staleness));
+        srv.SetFollower(follower.get());
+        follower_thread = std::thread([&follower] { follower->Run(); });
+        fmt::print("Following {} from version {}\n", leader_url, follower->version());
+    }
+    srv.SetTimingSample(timing_sample);
+
+    // The Telegram bot shares `db` with the HTTP server.
+    std::unique_ptr<foodculator::BotApi> bot_api;
+    std::unique_ptr<foodculator::Bot> bot;
+    std::thread bot_thread;
+    if (char* token = std::getenv("TELEGRAM_TOKEN"); db && primary && token && *token) {
+        size_t workers = 4;
+        if (char* v = std::getenv("TELEGRAM_WORKERS"); v) {
+            workers = std::max(1, std::stoi(v));
         }
 
-        const std::string& resp_id = in["responseId"].string_value();
-        const std::string& session = in["session"].string_value();
-        const auto& query = in["queryResult"];
-        const std::string& query_text = query["queryText"].string_value();
-        const std::string& intent_name = query["intent"]["displayName"].string_value();
-
-        fmt::print("[dialogflow] id={} session={} query={} intent={}\n", resp_id, session,
-                   query_text, intent_name);
+        bot_api = foodculator::CreateTelegramApi(token);
+        bot = std::make_unique<foodculator::Bot>(bot_api.get(), db.get(), workers);
+        bot_thread = std::thread([&bot] { bot->Run(); });
+        fmt::print("Telegram bot started with {} workers\n", workers);
+    }
 
-        fmt::memory_buffer text;
-        if (intent_name == "ingredients") {
-            auto products = db->GetProducts();
-            if (!products.Ok()) {
-                ReplyErr(std::move(products.Error()), 500, &res);
-                return;
-            }
+    std::mutex background_mu;
+    std::condition_variable background_cv;
+    bool stopping = false;
+    // Starts a thread that runs `job` right away and then every `period` until the server
+    // stops. Jobs run without `background_mu`, so that a slow one, e.g. a snapshot rewrite,
+    // doesn't hold up the others.
+    const auto every = [&](std::chrono::milliseconds period, std::function<void()> job) {
+        return std::thread([&, period, job = std::move(job)] {
+            std::unique_lock<std::mutex> lock(background_mu);
+            do {
+                lock.unlock();
+                job();
+                lock.lock();
+            } while (!background_cv.wait_for(lock, period, [&] { return stopping; }));
+        });
+    };
 
-            fmt::format_to(text, "Наши ингредиенты:");
-            for (const auto& ingredient : products.Value()) {
-                fmt::format_to(text, "\n{} по {} калории,", ingredient.name, ingredient.kcal);
-            }
-        } else if (intent_name == "pots") {
-            auto tw = db->GetTableware();
-            if (!tw.Ok()) {
-                ReplyErr(std::move(tw.Error()), 500, &res);
-                return;
-            }
+    std::thread compactor;
+    if (db && primary) {
+        compactor = every(std::chrono::hours(1),
+                          [&] { CompactTombstones(db.get(), retention_days); });
+    }
 
-            fmt::format_to(text, "Наша посуда:");
-            for (const auto& pot : tw.Value()) {
-                fmt::format_to(text, "\n{} по {} грам,", pot.name, pot.weight);
+    std::thread tenant_sweeper;
+    if (tenants) {
+        tenant_sweeper = every(std::chrono::seconds(10), [&] {
+            if (size_t closed = tenants->CloseIdle(); closed > 0) {
+                fmt::print("Closed {} idle kitchens\n", closed);
             }
-        } else {
-            // This intent is not supported.
-            return;
-        }
-        res.set_content(RenderDialogflowResponse(fmt::to_string(text)), "text/json; charset=utf-8");
-    });
-
-    std::string version = "UNKNOWN";
-    if (char* v = std::getenv("VERSION"); v) {
-        version = v;
+        });
     }
 
-    srv.Get("/version", [&version](const httplib::Request& req, httplib::Response& res) {
-        res.set_content("Foodculator version: " + version, "text/plain");
-    });
-
-    srv.set_mount_point("/static", path_to_static.c_str());
+    // Caches derived from the tables notice the writes of other processes within 100ms: of the
+    // other workers, and of tools such as dedup that write to the file of a running server.
+    std::thread watcher;
+    if (db) {
+        watcher = every(std::chrono::milliseconds(100), [&] { db->CatchUpExternalWrites(); });
+    }
 
-    int port = 1234;
-    if (char* v = std::getenv("PORT"); v) {
-        port = std::stoi(v);
+    // Until a stale snapshot is refreshed, the reads go to SQLite.
+    std::thread snapshot_refresher;
+    if (snapshot) {
+        snapshot_refresher = every(std::chrono::seconds(5), [&] { snapshot->Refresh(primary); });
     }
 
     fmt::print("Foodculator version: {}\n", version);
@@ -330,17 +268,53 @@ int main(int argc, char** argv) {
     server = &srv;
     std::signal(SIGTERM, signal_handler);
 
-    srv.set_logger([](const httplib::Request& req, const httplib::Response& res) {
+    srv.SetLogger([](const httplib::Request& req, const httplib::Response& res,
+                     std::string_view timing) {
         if (res.status != 200) {
             fmt::print(stderr, "{} {}:\tcode={} content={}\n", req.method, req.path, res.status,
                        res.body);
             return;
         }
 
+        if (!timing.empty()) {
+            fmt::print("{} {}:\tsize={}b timing={}\n", req.method, req.path, res.body.length(),
+                       timing);
+            return;
+        }
         fmt::print("{} {}:\tsize={}b\n", req.method, req.path, res.body.length());
     });
-    srv.listen("0.0.0.0", port);
+    int exit_code = 0;
+    if ((listening_socket ? srv.Adopt(*listening_socket) : srv.Bind("0.0.0.0", port)) < 0) {
+        fmt::print(stderr, "Can't listen on port {}\n", port);
+        exit_code = 1;
+    } else {
+        foodculator::NotifySupervisor();
+        if (!srv.Listen()) {
+            exit_code = 1;
+        }
+    }
+
+    if (bot) {
+        // Returns once the current long-poll is over.
+        bot->Stop();
+        bot_thread.join();
+    }
+    if (follower) {
+        follower->Stop();
+        follower_thread.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(background_mu);
+        stopping = true;
+    }
+    background_cv.notify_all();
+    for (auto* thread : {&compactor, &tenant_sweeper, &watcher, &snapshot_refresher}) {
+        if (thread->joinable()) {
+            thread->join();
+        }
+    }
 
     fmt::print("I'll be back!\n");
-    return 0;
+    return exit_code;
 }
@@ -0,0 +1,249 @@
+#include "meal_plan.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+
+#include "fmt/format.h"
+#include "util/thread_pool.h"
+
+namespace foodculator {
+
+namespace {
+
+// Plans this close to the target in kcal are not worth improving, so the search stops there.
+constexpr double kCloseEnough = 0.5;
+// Nutrient totals may leave their ranges by this many grams, so that rounding doesn't reject
+// a plan that is exactly on the border.
+constexpr double kRangeSlack = 1e-4;
+// The deadline is checked every this many search nodes.
+constexpr uint64_t kDeadlineCheck = 1024;
+
+constexpr size_t kLanes = NutrientProfile::kLanes;
+using Lanes = std::array<double, kLanes>;
+
+// What all workers share: the items in search order with the precomputed bounds.
+struct Problem {
+    double target;
+    // Per item: the portions to try, and kcal and nutrients per gram.
+    std::vector<std::vector<uint32_t>> values;
+    std::vector<Lanes> per_gram;
+    // Sums of the lanes of items [idx, end) at their minimum and maximum portions. Has an extra
+    // all-zero entry for the end.
+    std::vector<Lanes> rest_min;
+    std::vector<Lanes> rest_max;
+    // The range of every lane; kcal (lane 0) and nutrients without a range are unbounded.
+    Lanes lo;
+    Lanes hi;
+    std::chrono::steady_clock::time_point deadline;
+
+    // The distance of the best plan so far from the target, for pruning by all workers.
+    std::atomic<double> best = std::numeric_limits<double>::infinity();
+    std::atomic<bool> stop = false;
+    std::atomic<bool> timed_out = false;
+
+    // Returns the order in which the portions of item `idx` are tried: from the one that lands
+    // the remaining items in the middle of their kcal range on the target outwards.
+    std::vector<uint32_t> Order(size_t idx, double kcal) const {
+        const auto& v = values[idx];
+        const double rest = (rest_min[idx + 1][0] + rest_max[idx + 1][0]) / 2;
+        double ideal = per_gram[idx][0] > 0 ? (target - kcal - rest) / per_gram[idx][0] : 0;
+        size_t mid = std::lower_bound(v.begin(), v.end(), ideal) - v.begin();
+        mid = std::min(mid, v.size() - 1);
+
+        std::vector<uint32_t> ret = {v[mid]};
+        for (size_t step = 1; ret.size() < v.size(); ++step) {
+            if (mid + step < v.size()) {
+                ret.push_back(v[mid + step]);
+            }
+            if (step <= mid) {
+                ret.push_back(v[mid - step]);
+            }
+        }
+        return ret;
+    }
+};
+
+// Searches subtrees of the problem on one thread and keeps the best plan it has seen.
+class Worker {
+   public:
+    explicit Worker(Problem* problem)
+        : p_(*problem), weights_(problem->values.size()), best_(problem->values.size()) {}
+
+    // Searches all plans with `weight` for the first item.
+    void SearchFirst(uint32_t weight) {
+        Lanes totals = {};
+        Try(0, weight, &totals);
+    }
+
+    double best_distance() const { return best_distance_; }
+    const std::vector<uint32_t>& best() const { return best_; }
+
+   private:
+    void Search(size_t idx, Lanes* totals) {
+        if (p_.stop.load(std::memory_order_relaxed)) {
+            return;
+        }
+        if (++nodes_ % kDeadlineCheck == 0 && std::chrono::steady_clock::now() > p_.deadline) {
+            p_.timed_out = true;
+            p_.stop = true;
+            return;
+        }
+
+        for (size_t lane = 1; lane < kLanes; ++lane) {
+            if ((*totals)[lane] + p_.rest_min[idx][lane] > p_.hi[lane] + kRangeSlack ||
+                (*totals)[lane] + p_.rest_max[idx][lane] < p_.lo[lane] - kRangeSlack) {
+                return;
+            }
+        }
+        const double lowest = (*totals)[0] + p_.rest_min[idx][0];
+        const double highest = (*totals)[0] + p_.rest_max[idx][0];
+        const double bound = std::max({lowest - p_.target, p_.target - highest, 0.0});
+        if (bound >= p_.best.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        if (idx == weights_.size()) {
+            Found(std::abs((*totals)[0] - p_.target));
+            return;
+        }
+        for (uint32_t weight : p_.Order(idx, (*totals)[0])) {
+            Try(idx, weight, totals);
+            if (p_.stop.load(std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+    void Try(size_t idx, uint32_t weight, Lanes* totals) {
+        weights_[idx] = weight;
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+            (*totals)[lane] += p_.per_gram[idx][lane] * weight;
+        }
+        Search(idx + 1, totals);
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+            (*totals)[lane] -= p_.per_gram[idx][lane] * weight;
+        }
+    }
+
+    void Found(double distance) {
+        if (distance >= best_distance_) {
+            return;
+        }
+        best_distance_ = distance;
+        best_ = weights_;
+
+        double best = p_.best.load();
+        while (distance < best && !p_.best.compare_exchange_weak(best, distance)) {
+        }
+        if (distance <= kCloseEnough) {
+            p_.stop = true;
+        }
+    }
+
+    Problem& p_;
+    std::vector<uint32_t> weights_;
+    std::vector<uint32_t> best_;
+    double best_distance_ = std::numeric_limits<double>::infinity();
+    uint64_t nodes_ = 0;
+};
+
+}  // namespace
+
+StatusOr<MealPlan> SolveMealPlan(const PlanRequest& request) {
+    if (request.items.empty() || request.step == 0) {
+        return {StatusCode::INVALID_ARGUMENT, "A plan needs recipes and a positive step."};
+    }
+    for (const auto& v : request.items) {
+        if (v.min_weight > v.max_weight) {
+            return {StatusCode::INVALID_ARGUMENT,
+                    fmt::format("The portion of recipe {} can't be between {}g and {}g.", v.id,
+                                v.min_weight, v.max_weight)};
+        }
+    }
+
+    // Items with the widest kcal range go first, as they split the search best.
+    const size_t count = request.items.size();
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    auto kcal_range = [&request](size_t idx) {
+        const auto& v = request.items[idx];
+        return v.per_100g.kcal() * (v.max_weight - v.min_weight);
+    };
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t lhs, size_t rhs) { return kcal_range(lhs) > kcal_range(rhs); });
+
+    Problem problem;
+    problem.target = request.kcal;
+    problem.deadline = std::chrono::steady_clock::now() + request.deadline;
+    problem.lo.fill(-std::numeric_limits<double>::infinity());
+    problem.hi.fill(std::numeric_limits<double>::infinity());
+    for (const auto& range : request.ranges) {
+        const size_t lane = 1 + static_cast<size_t>(range.nutrient);
+        problem.lo[lane] = std::max<double>(problem.lo[lane], range.min);
+        problem.hi[lane] = std::min<double>(problem.hi[lane], range.max);
+    }
+    for (size_t idx : order) {
+        const auto& v = request.items[idx];
+        std::vector<uint32_t> values;
+        for (uint64_t weight = v.min_weight; weight < v.max_weight; weight += request.step) {
+            values.push_back(static_cast<uint32_t>(weight));
+        }
+        values.push_back(v.max_weight);
+        problem.values.push_back(std::move(values));
+
+        Lanes per_gram;
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+            per_gram[lane] = v.per_100g.lanes[lane] / 100.0;
+        }
+        problem.per_gram.push_back(per_gram);
+    }
+    problem.rest_min.assign(count + 1, Lanes{});
+    problem.rest_max.assign(count + 1, Lanes{});
+    for (size_t idx = count; idx-- > 0;) {
+        const auto& v = request.items[order[idx]];
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+            problem.rest_min[idx][lane] =
+                problem.rest_min[idx + 1][lane] + problem.per_gram[idx][lane] * v.min_weight;
+            problem.rest_max[idx][lane] =
+                problem.rest_max[idx + 1][lane] + problem.per_gram[idx][lane] * v.max_weight;
+        }
+    }
+
+    const size_t threads = std::max<size_t>(1, request.threads);
+    std::vector<Worker> workers(threads, Worker(&problem));
+    const std::vector<uint32_t> first = problem.Order(0, 0);
+    ParallelFor(request.pool, first.size(), threads,
+                [&](size_t worker, size_t idx) { workers[worker].SearchFirst(first[idx]); });
+
+    const Worker* best = nullptr;
+    for (const auto& worker : workers) {
+        if (best == nullptr || worker.best_distance() < best->best_distance()) {
+            best = &worker;
+        }
+    }
+    if (std::isinf(best->best_distance())) {
+        return {StatusCode::NOT_FOUND, problem.timed_out
+                                           ? "No plan was found before the deadline."
+                                           : "No portions keep the nutrients within the ranges."};
+    }
+
+    MealPlan ret;
+    ret.weights.resize(count);
+    for (size_t idx = 0; idx < count; ++idx) {
+        ret.weights[order[idx]] = best->best()[idx];
+    }
+    for (size_t idx = 0; idx < count; ++idx) {
+        const auto& v = request.items[idx];
+        ret.kcal += v.per_100g.kcal() * ret.weights[idx] / 100;
+        for (size_t n = 0; n < kNutrientCount; ++n) {
+            ret.nutrients[n] += v.per_100g.Get(static_cast<Nutrient>(n)) * ret.weights[idx] / 100;
+        }
+    }
+    ret.optimal = !problem.timed_out;
+    return StatusOr{std::move(ret)};
+}
+
+}  // namespace foodculator
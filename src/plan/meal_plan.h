@@ -0,0 +1,67 @@
+#ifndef __SRC_PLAN_MEAL_PLAN_H__
+#define __SRC_PLAN_MEAL_PLAN_H__
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "db/nutrients.h"
+#include "util/statusor.h"
+
+namespace foodculator {
+
+class ThreadPool;
+
+// A recipe that may be served, with the range of its portion in grams.
+struct PlanItem {
+    size_t id;
+    NutrientProfile per_100g;
+    uint32_t min_weight;
+    uint32_t max_weight;
+};
+
+// Grams of a nutrient the whole plan has to stay within.
+struct NutrientRange {
+    Nutrient nutrient;
+    float min = 0;
+    float max = std::numeric_limits<float>::infinity();
+};
+
+struct PlanRequest {
+    float kcal;
+    std::vector<NutrientRange> ranges;
+    std::vector<PlanItem> items;
+    // Portions are multiples of `step` grams above their minimum, or their maximum.
+    uint32_t step = 10;
+    // The search stops after this long and returns the best plan found so far.
+    std::chrono::milliseconds deadline{200};
+    size_t threads = 1;
+    // If set, the search runs on the calling thread and `threads` - 1 threads of this pool
+    // instead of on threads started for the request.
+    ThreadPool* pool = nullptr;
+};
+
+struct MealPlan {
+    // The portion of every item in grams, in the order of PlanRequest::items.
+    std::vector<uint32_t> weights;
+    float kcal = 0;
+    Nutrients nutrients = {};
+    // True if no portions on the grid come closer to the target (or the plan is within half a
+    // kcal of it), false if the deadline cut the search short.
+    bool optimal = false;
+};
+
+// Picks the portions whose kcal come closest to the target while all nutrients stay within
+// their ranges.
+//
+// Branch and bound over the portions: a partial plan is dropped as soon as the remaining items
+// can no longer bring a nutrient into its range or the kcal closer to the target than the best
+// plan so far. Subtrees by the portion of the item with the widest kcal range are searched in
+// parallel on `threads` threads, which share the best distance for pruning. Fails with
+// NOT_FOUND if no plan satisfies the ranges, or none was found before the deadline.
+StatusOr<MealPlan> SolveMealPlan(const PlanRequest& request);
+
+}  // namespace foodculator
+
+#endif
@@ -0,0 +1,134 @@
+#include "catalog_index.h"
+
+#include "fmt/format.h"
+
+namespace foodculator {
+
+namespace {
+
+// Reads the rows of both tables written after the given versions.
+StatusCode ReadDeltas(DB* db, uint64_t ingredients_since, uint64_t recipes_since,
+                      RowDelta<Ingredient>* ingredients, RowDelta<RecipeHeader>* recipes) {
+    auto products = db->GetProductsSince(ingredients_since);
+    if (!products.Ok()) {
+        return products.Code();
+    }
+    auto headers = db->GetRecipesSince(recipes_since);
+    if (!headers.Ok()) {
+        return headers.Code();
+    }
+    *ingredients = std::move(products.Value());
+    *recipes = std::move(headers.Value());
+    return StatusCode::OK;
+}
+
+void Apply(RowDelta<Ingredient>* ingredients, RowDelta<RecipeHeader>* recipes,
+           NameIndex* index) {
+    for (size_t id : ingredients->deleted) {
+        index->Remove(NameIndex::Kind::INGREDIENT, id);
+    }
+    for (auto& product : ingredients->changed) {
+        index->Add(NameIndex::Kind::INGREDIENT, product.id, std::move(product.name));
+    }
+    for (size_t id : recipes->deleted) {
+        index->Remove(NameIndex::Kind::RECIPE, id);
+    }
+    for (auto& recipe : recipes->changed) {
+        index->Add(NameIndex::Kind::RECIPE, recipe.id, std::move(recipe.name));
+    }
+}
+
+}  // namespace
+
+StatusOr<NameIndex::Match> CatalogIndex::Find(std::string_view query,
+                                              std::optional<NameIndex::Kind> kind) {
+    if (auto code = Update(); code != StatusCode::OK) {
+        return {code, "Failed to read the catalog. Try again later."};
+    }
+
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    auto match = index_.Find(query, kind);
+    if (!match) {
+        return {StatusCode::NOT_FOUND, fmt::format("Nothing like '{}' was found.", query)};
+    }
+    return StatusOr{std::move(*match)};
+}
+
+StatusCode CatalogIndex::Update() {
+    auto is_fresh = [this](uint64_t ingredients_generation, uint64_t recipes_generation) {
+        return built_ && ingredients_generation_ == ingredients_generation &&
+               recipes_generation_ == recipes_generation;
+    };
+
+    bool built = false;
+    {
+        std::shared_lock<std::shared_mutex> lock(mu_);
+        if (is_fresh(db_->Generation(DB::Table::INGREDIENTS),
+                     db_->Generation(DB::Table::RECIPE))) {
+            return StatusCode::OK;
+        }
+        built = built_;
+    }
+
+    std::unique_lock<std::mutex> update(update_mu_, std::defer_lock);
+    if (built) {
+        if (!update.try_lock()) {
+            // Somebody else is already patching the index, use it as it is meanwhile.
+            return StatusCode::OK;
+        }
+    } else {
+        update.lock();
+    }
+
+    // Generations are read before the tables, so a concurrent write triggers another update.
+    const uint64_t ingredients_generation = db_->Generation(DB::Table::INGREDIENTS);
+    const uint64_t recipes_generation = db_->Generation(DB::Table::RECIPE);
+    bool rebuild = false;
+    uint64_t ingredients_since = 0;
+    uint64_t recipes_since = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(mu_);
+        if (is_fresh(ingredients_generation, recipes_generation)) {
+            return StatusCode::OK;
+        }
+        rebuild = !built_ || index_.removed() > index_.size();
+        if (!rebuild) {
+            ingredients_since = ingredients_version_;
+            recipes_since = recipes_version_;
+        }
+    }
+
+    RowDelta<Ingredient> ingredients;
+    RowDelta<RecipeHeader> recipes;
+    if (auto code = ReadDeltas(db_, ingredients_since, recipes_since, &ingredients, &recipes);
+        code != StatusCode::OK) {
+        return code;
+    }
+    if (!rebuild && (ingredients.reset || recipes.reset)) {
+        // One of the tables is read whole, so the other one has to be too.
+        rebuild = true;
+        if (auto code = ReadDeltas(db_, 0, 0, &ingredients, &recipes); code != StatusCode::OK) {
+            return code;
+        }
+    }
+
+    // A new index is built without blocking the lookups, a delta is applied in place.
+    NameIndex fresh;
+    if (rebuild) {
+        Apply(&ingredients, &recipes, &fresh);
+    }
+    std::unique_lock<std::shared_mutex> lock(mu_);
+    if (rebuild) {
+        index_ = std::move(fresh);
+    } else {
+        Apply(&ingredients, &recipes, &index_);
+    }
+    built_ = true;
+    ingredients_generation_ = ingredients_generation;
+    recipes_generation_ = recipes_generation;
+    ingredients_version_ = ingredients.version;
+    recipes_version_ = recipes.version;
+    return StatusCode::OK;
+}
+
+}  // namespace foodculator
@@ -0,0 +1,54 @@
+#ifndef __SRC_SEARCH_CATALOG_INDEX_H__
+#define __SRC_SEARCH_CATALOG_INDEX_H__
+
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string_view>
+
+#include "db/db.h"
+#include "search/name_index.h"
+#include "util/statusor.h"
+
+namespace foodculator {
+
+// CatalogIndex keeps a NameIndex over ingredient and recipe names in sync with DB.
+//
+// When INGREDIENTS or RECIPE change, the index is patched with the rows written since it was
+// last brought up to date, read with DB::GetProductsSince() and DB::GetRecipesSince(), so a
+// write costs the next lookup only the rows it wrote. Lookups that come in while another one
+// patches the index are answered from the index as it is. The index is built from the whole
+// tables only on the first lookup, when a delta resets, or when removed names take up more
+// of it than the live ones.
+class CatalogIndex {
+   public:
+    explicit CatalogIndex(DB* db) : db_(db) {}
+
+    // Returns NOT_FOUND if nothing in the catalog resembles `query`.
+    StatusOr<NameIndex::Match> Find(std::string_view query,
+                                    std::optional<NameIndex::Kind> kind = std::nullopt);
+
+   private:
+    // Brings the index up to date, unless another lookup is already doing it.
+    StatusCode Update();
+
+    DB* db_;
+
+    // Guards the index and the fields below. Lookups hold it shared, only applying a delta
+    // takes it exclusively.
+    std::shared_mutex mu_;
+    NameIndex index_;
+    bool built_ = false;
+    uint64_t ingredients_generation_ = 0;
+    uint64_t recipes_generation_ = 0;
+    // The versions to read the next deltas from.
+    uint64_t ingredients_version_ = 0;
+    uint64_t recipes_version_ = 0;
+
+    // Held while the index is being updated.
+    std::mutex update_mu_;
+};
+
+}  // namespace foodculator
+
+#endif
@@ -0,0 +1,278 @@
+#include "duplicates.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+
+#include "search/normalize.h"
+#include "util/thread_pool.h"
+
+namespace foodculator {
+
+namespace {
+
+// Signatures are cut into kBands bands of kRows hashes; names whose signatures agree on a
+// whole band become a candidate pair. A pair with similarity s agrees on a band with
+// probability s^kRows, so it is found with probability 1 - (1 - s^kRows)^kBands: 0.99 for 0.7,
+// 0.34 for 0.4.
+constexpr size_t kBands = 16;
+constexpr size_t kRows = 4;
+constexpr size_t kHashes = kBands * kRows;
+static_assert(kHashes <= 64, "equal hashes are counted in a 64-bit mask");
+
+// The share of equal hashes estimates the similarity of two names with a standard deviation of
+// at most 0.06. Candidates whose estimate is lower than the threshold by more than this skip
+// the exact comparison.
+constexpr double kEstimateMargin = 0.15;
+
+// Names are normalized and hashed in chunks of this many.
+constexpr size_t kChunk = 1024;
+
+uint64_t Mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+size_t PopCount(uint64_t x) {
+    size_t ret = 0;
+    for (; x != 0; x &= x - 1) {
+        ++ret;
+    }
+    return ret;
+}
+
+// Jaccard similarity of two sorted sets.
+double Jaccard(const std::vector<uint64_t>& lhs, const std::vector<uint64_t>& rhs) {
+    if (lhs.empty() || rhs.empty()) {
+        return 0.0;
+    }
+    size_t common = 0;
+    auto l = lhs.begin();
+    auto r = rhs.begin();
+    while (l != lhs.end() && r != rhs.end()) {
+        if (*l < *r) {
+            ++l;
+        } else if (*r < *l) {
+            ++r;
+        } else {
+            ++common;
+            ++l;
+            ++r;
+        }
+    }
+    return static_cast<double>(common) / static_cast<double>(lhs.size() + rhs.size() - common);
+}
+
+// Clusters of products with the range of their kcal.
+class Clusters {
+   public:
+    explicit Clusters(const std::vector<Ingredient>& products) : parent_(products.size()) {
+        std::iota(parent_.begin(), parent_.end(), 0);
+        for (const auto& v : products) {
+            kcal_.emplace_back(v.kcal, v.kcal);
+        }
+    }
+
+    // Doesn't modify the clusters, so it can be called from several threads.
+    size_t Root(size_t idx) const {
+        while (parent_[idx] != idx) {
+            idx = parent_[idx];
+        }
+        return idx;
+    }
+
+    // Returns the kcal range of the union of the clusters of `lhs` and `rhs`.
+    std::pair<uint32_t, uint32_t> JointKcal(size_t lhs, size_t rhs) const {
+        const auto& l = kcal_[Root(lhs)];
+        const auto& r = kcal_[Root(rhs)];
+        return {std::min(l.first, r.first), std::max(l.second, r.second)};
+    }
+
+    void Join(size_t lhs, size_t rhs) {
+        const auto kcal = JointKcal(lhs, rhs);
+        lhs = Root(lhs);
+        rhs = Root(rhs);
+        parent_[lhs] = rhs;
+        kcal_[rhs] = kcal;
+    }
+
+    // Points every product to its root, so that Root() takes one step.
+    void Flatten() {
+        for (size_t idx = 0; idx < parent_.size(); ++idx) {
+            parent_[idx] = Root(parent_[idx]);
+        }
+    }
+
+   private:
+    std::vector<size_t> parent_;
+    std::vector<std::pair<uint32_t, uint32_t>> kcal_;
+};
+
+}  // namespace
+
+std::vector<std::vector<size_t>> FindDuplicateIngredients(const std::vector<Ingredient>& products,
+                                                          const DuplicateOptions& options) {
+    const size_t threads = std::max<size_t>(1, options.threads);
+    const size_t chunks = (products.size() + kChunk - 1) / kChunk;
+
+    std::vector<std::string> names(products.size());
+    ParallelFor(chunks, threads, [&](size_t, size_t chunk) {
+        for (size_t idx = chunk * kChunk; idx < std::min(products.size(), (chunk + 1) * kChunk);
+             ++idx) {
+            names[idx] = NormalizeName(products[idx].name);
+        }
+    });
+
+    auto close_kcal = [&options](uint32_t lower, uint32_t higher) {
+        return higher - lower <= std::max<double>(options.kcal_tolerance,
+                                                  options.kcal_tolerance_ratio * higher);
+    };
+    // Clusters are only joined if all of their kcal stay close, so that a chain of close pairs
+    // can't put 250 and 350 kcal together.
+    Clusters clusters(products);
+    auto join = [&](size_t lhs, size_t rhs) {
+        const auto [lower, higher] = clusters.JointKcal(lhs, rhs);
+        if (clusters.Root(lhs) != clusters.Root(rhs) && close_kcal(lower, higher)) {
+            clusters.Join(lhs, rhs);
+        }
+    };
+
+    // Products with equal names and kcal are joined up front, so that a popular name doesn't
+    // fill an LSH bucket with copies that would all be compared with each other.
+    std::vector<size_t> order(products.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto key = [&](size_t idx) { return std::tie(names[idx], products[idx].kcal); };
+    std::sort(order.begin(), order.end(),
+              [&](size_t lhs, size_t rhs) { return key(lhs) < key(rhs); });
+    // Indices of the products that represent the groups of equal ones.
+    std::vector<size_t> reps;
+    for (size_t idx = 0; idx < order.size(); ++idx) {
+        if (idx > 0 && key(order[idx]) == key(order[idx - 1])) {
+            join(order[idx], reps.back());
+        } else {
+            reps.push_back(order[idx]);
+        }
+    }
+    clusters.Flatten();
+
+    // MinHash signatures of the trigram sets of the names.
+    const size_t rep_chunks = (reps.size() + kChunk - 1) / kChunk;
+    std::vector<std::vector<uint64_t>> trigrams(reps.size());
+    std::vector<uint64_t> signatures(reps.size() * kHashes);
+    ParallelFor(rep_chunks, threads, [&](size_t, size_t chunk) {
+        for (size_t rep = chunk * kChunk; rep < std::min(reps.size(), (chunk + 1) * kChunk);
+             ++rep) {
+            trigrams[rep] = NameTrigrams(names[reps[rep]]);
+            uint64_t* signature = &signatures[rep * kHashes];
+            std::fill(signature, signature + kHashes, std::numeric_limits<uint64_t>::max());
+            for (uint64_t trigram : trigrams[rep]) {
+                for (size_t hash = 0; hash < kHashes; ++hash) {
+                    signature[hash] = std::min(signature[hash], Mix(trigram ^ Mix(hash + 1)));
+                }
+            }
+        }
+    });
+
+    // Returns a mask with a bit set for every equal hash of the signatures of `lhs` and `rhs`.
+    auto equal_hashes = [&signatures](size_t lhs, size_t rhs) {
+        uint64_t mask = 0;
+        for (size_t hash = 0; hash < kHashes; ++hash) {
+            mask |= uint64_t{signatures[lhs * kHashes + hash] == signatures[rhs * kHashes + hash]}
+                    << hash;
+        }
+        return mask;
+    };
+    constexpr uint64_t kBandMask = (uint64_t{1} << kRows) - 1;
+    const size_t min_equal_hashes = static_cast<size_t>(
+        std::max(0.0, (options.min_similarity - kEstimateMargin) * kHashes));
+    auto kcal = [&](size_t rep) { return products[reps[rep]].kcal; };
+
+    // Bands are taken one by one, so that pairs already clustered by the previous ones are
+    // skipped; the buckets of a band are compared in parallel.
+    std::vector<std::pair<uint64_t, size_t>> buckets(reps.size());
+    std::vector<std::pair<size_t, size_t>> ranges;
+    std::vector<std::vector<std::pair<size_t, size_t>>> similar(threads);
+    for (size_t band = 0; band < kBands; ++band) {
+        ParallelFor(rep_chunks, threads, [&](size_t, size_t chunk) {
+            for (size_t rep = chunk * kChunk; rep < std::min(reps.size(), (chunk + 1) * kChunk);
+                 ++rep) {
+                uint64_t hash = band;
+                for (size_t row = 0; row < kRows; ++row) {
+                    hash = Mix(hash ^ signatures[rep * kHashes + band * kRows + row]);
+                }
+                buckets[rep] = {hash, rep};
+            }
+        });
+        std::sort(buckets.begin(), buckets.end());
+
+        ranges.clear();
+        for (size_t start = 0, end = 0; start < buckets.size(); start = end) {
+            for (end = start + 1;
+                 end < buckets.size() && buckets[end].first == buckets[start].first; ++end) {
+            }
+            if (end - start > 1) {
+                ranges.emplace_back(start, end);
+            }
+        }
+
+        ParallelFor(ranges.size(), threads, [&](size_t worker, size_t range) {
+            std::vector<size_t> bucket;
+            for (size_t idx = ranges[range].first; idx < ranges[range].second; ++idx) {
+                bucket.push_back(buckets[idx].second);
+            }
+            // Sorted by kcal, each product is only compared with the next ones in kcal range.
+            std::sort(bucket.begin(), bucket.end(),
+                      [&](size_t lhs, size_t rhs) { return kcal(lhs) < kcal(rhs); });
+            for (size_t i = 0; i < bucket.size(); ++i) {
+                for (size_t j = i + 1;
+                     j < bucket.size() && close_kcal(kcal(bucket[i]), kcal(bucket[j])); ++j) {
+                    const size_t lhs = bucket[i];
+                    const size_t rhs = bucket[j];
+                    if (clusters.Root(reps[lhs]) == clusters.Root(reps[rhs])) {
+                        continue;
+                    }
+                    // Skips hash collisions of different bands, and pairs that share an
+                    // earlier band, which have been checked there.
+                    const uint64_t equal = equal_hashes(lhs, rhs);
+                    bool seen = ((equal >> (band * kRows)) & kBandMask) != kBandMask;
+                    for (size_t prev = 0; prev < band && !seen; ++prev) {
+                        seen = ((equal >> (prev * kRows)) & kBandMask) == kBandMask;
+                    }
+                    if (!seen && PopCount(equal) >= min_equal_hashes &&
+                        Jaccard(trigrams[lhs], trigrams[rhs]) >= options.min_similarity) {
+                        similar[worker].emplace_back(reps[lhs], reps[rhs]);
+                    }
+                }
+            }
+        });
+
+        for (auto& pairs : similar) {
+            for (const auto& [lhs, rhs] : pairs) {
+                join(lhs, rhs);
+            }
+            pairs.clear();
+        }
+        clusters.Flatten();
+    }
+
+    std::unordered_map<size_t, std::vector<size_t>> by_root;
+    for (size_t idx = 0; idx < products.size(); ++idx) {
+        by_root[clusters.Root(idx)].push_back(products[idx].id);
+    }
+    std::vector<std::vector<size_t>> ret;
+    for (auto& [root, ids] : by_root) {
+        if (ids.size() > 1) {
+            std::sort(ids.begin(), ids.end());
+            ret.push_back(std::move(ids));
+        }
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+}  // namespace foodculator
@@ -0,0 +1,36 @@
+#ifndef __SRC_SEARCH_DUPLICATES_H__
+#define __SRC_SEARCH_DUPLICATES_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "db/db.h"
+
+namespace foodculator {
+
+struct DuplicateOptions {
+    // The minimum Jaccard similarity of the trigram sets of two normalized names.
+    double min_similarity = 0.7;
+    // Two ingredients may differ in kcal by this much, or by this fraction of the larger value.
+    uint32_t kcal_tolerance = 5;
+    double kcal_tolerance_ratio = 0.1;
+    size_t threads = 1;
+};
+
+// Groups `products` into clusters of likely duplicates, e.g. "milk 3.2%" and "Milk 3,2 %" with
+// 52 and 54 kcal. Two ingredients are duplicates if their names are similar and their kcal
+// close, see DuplicateOptions. Clusters grow through chains of similar names, so their ends
+// may be less similar, but a pair never joins two clusters if the kcal of the result would
+// be too far apart. Returns the clusters of two or more ids, each sorted, ordered by the first
+// id.
+//
+// Candidate pairs come from locality-sensitive hashing of MinHash signatures of the names, so
+// the work grows with the number of similar pairs rather than with the square of the catalog.
+// Pairs at `min_similarity` are found with a probability of about 99%, more similar ones
+// almost surely.
+std::vector<std::vector<size_t>> FindDuplicateIngredients(const std::vector<Ingredient>& products,
+                                                          const DuplicateOptions& options);
+
+}  // namespace foodculator
+
+#endif
@@ -0,0 +1,96 @@
+#include "name_index.h"
+
+#include "normalize.h"
+
+namespace foodculator {
+
+void NameIndex::Add(Kind kind, size_t id, std::string name) {
+    Remove(kind, id);
+
+    const uint32_t idx = static_cast<uint32_t>(entries_.size());
+    std::string normalized = NormalizeName(name);
+    auto trigrams = NameTrigrams(normalized);
+
+    for (uint64_t trigram : trigrams) {
+        postings_[trigram].push_back(idx);
+    }
+    trigram_counts_.push_back(static_cast<uint32_t>(trigrams.size()));
+    live_.push_back(true);
+    by_id_.emplace(Key(kind, id), idx);
+    exact_.emplace(std::move(normalized), idx);
+    entries_.push_back(Entry{kind, id, std::move(name)});
+}
+
+void NameIndex::Remove(Kind kind, size_t id) {
+    auto it = by_id_.find(Key(kind, id));
+    if (it == by_id_.end()) {
+        return;
+    }
+    const uint32_t idx = it->second;
+    by_id_.erase(it);
+    live_[idx] = false;
+
+    auto [exact_begin, exact_end] = exact_.equal_range(NormalizeName(entries_[idx].name));
+    for (auto exact = exact_begin; exact != exact_end; ++exact) {
+        if (exact->second == idx) {
+            exact_.erase(exact);
+            break;
+        }
+    }
+}
+
+std::optional<NameIndex::Match> NameIndex::Find(std::string_view query, std::optional<Kind> kind,
+                                                double min_score) const {
+    std::string normalized = NormalizeName(query);
+    if (normalized.empty()) {
+        return std::nullopt;
+    }
+
+    auto matches_kind = [this, kind](uint32_t idx) {
+        return !kind || entries_[idx].kind == *kind;
+    };
+
+    auto [exact_begin, exact_end] = exact_.equal_range(normalized);
+    for (auto it = exact_begin; it != exact_end; ++it) {
+        if (matches_kind(it->second)) {
+            return Match{entries_[it->second], 1.0};
+        }
+    }
+
+    const auto trigrams = NameTrigrams(normalized);
+    // The counters are kept between lookups, so that a lookup costs the postings it touches
+    // rather than the size of the index. Only the touched ones are set back to zero.
+    thread_local std::vector<uint32_t> hits;
+    thread_local std::vector<uint32_t> touched;
+    if (hits.size() < entries_.size()) {
+        hits.resize(entries_.size());
+    }
+    touched.clear();
+    for (uint64_t trigram : trigrams) {
+        auto it = postings_.find(trigram);
+        if (it == postings_.end()) {
+            continue;
+        }
+        for (uint32_t idx : it->second) {
+            if (hits[idx]++ == 0) {
+                touched.push_back(idx);
+            }
+        }
+    }
+
+    std::optional<Match> best;
+    for (uint32_t idx : touched) {
+        double score = 2.0 * hits[idx] / (trigrams.size() + trigram_counts_[idx]);
+        hits[idx] = 0;
+        if (score < min_score || !live_[idx] || !matches_kind(idx)) {
+            continue;
+        }
+        if (!best || score > best->score ||
+            (score == best->score && entries_[idx].name.size() < best->entry.name.size())) {
+            best = Match{entries_[idx], score};
+        }
+    }
+    return best;
+}
+
+}  // namespace foodculator
@@ -0,0 +1,62 @@
+#ifndef __SRC_SEARCH_NAME_INDEX_H__
+#define __SRC_SEARCH_NAME_INDEX_H__
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace foodculator {
+
+// NameIndex finds ingredients and recipes by a fuzzy match of their names. Names are
+// normalized with NormalizeName() and matched by the Dice coefficient of their trigram sets
+// through an inverted index, so a lookup only touches names sharing a trigram with the query.
+class NameIndex {
+   public:
+    enum class Kind { INGREDIENT, RECIPE };
+
+    struct Entry {
+        Kind kind;
+        size_t id;
+        std::string name;
+    };
+
+    struct Match {
+        Entry entry;
+        // 1.0 for names equal after normalization.
+        double score;
+    };
+
+    // Adds an entry, replacing the one of the same kind and id if there is one.
+    void Add(Kind kind, size_t id, std::string name);
+    // Does nothing if there is no such entry.
+    void Remove(Kind kind, size_t id);
+    size_t size() const { return by_id_.size(); }
+    // The number of removed entries whose space isn't reclaimed: they stay in the postings
+    // and are skipped by lookups, until the index is built anew.
+    size_t removed() const { return entries_.size() - by_id_.size(); }
+
+    // Returns the best match for `query` whose score is at least `min_score`, optionally only
+    // among entries of the given kind. Among equally scored entries the shortest name wins.
+    std::optional<Match> Find(std::string_view query, std::optional<Kind> kind = std::nullopt,
+                              double min_score = 0.4) const;
+
+   private:
+    static uint64_t Key(Kind kind, size_t id) {
+        return (static_cast<uint64_t>(id) << 1) | static_cast<uint64_t>(kind);
+    }
+
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> trigram_counts_;
+    std::vector<bool> live_;
+    // Maps Key() of the live entries to their index in `entries_`.
+    std::unordered_map<uint64_t, uint32_t> by_id_;
+    std::unordered_multimap<std::string, uint32_t> exact_;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> postings_;
+};
+
+}  // namespace foodculator
+
+#endif
@@ -0,0 +1,131 @@
+#include "normalize.h"
+
+#include <algorithm>
+
+namespace foodculator {
+
+namespace {
+
+// Decodes one UTF-8 code point from the front of `s`. Returns 0 for invalid sequences.
+char32_t NextCodePoint(std::string_view* s) {
+    auto byte = [s](size_t idx) { return static_cast<unsigned char>((*s)[idx]); };
+
+    const unsigned char lead = byte(0);
+    size_t len = 1;
+    char32_t cp = lead;
+    if (lead >= 0xF0 && lead < 0xF8) {
+        len = 4;
+        cp = lead & 0x07;
+    } else if (lead >= 0xE0) {
+        len = 3;
+        cp = lead & 0x0F;
+    } else if (lead >= 0xC0) {
+        len = 2;
+        cp = lead & 0x1F;
+    } else if (lead >= 0x80) {
+        s->remove_prefix(1);
+        return 0;
+    }
+
+    if (s->size() < len) {
+        s->remove_prefix(s->size());
+        return 0;
+    }
+    for (size_t i = 1; i < len; ++i) {
+        if ((byte(i) & 0xC0) != 0x80) {
+            s->remove_prefix(i);
+            return 0;
+        }
+        cp = (cp << 6) | (byte(i) & 0x3F);
+    }
+    s->remove_prefix(len);
+    return cp;
+}
+
+void AppendUtf8(char32_t cp, std::string* out) {
+    if (cp < 0x80) {
+        out->push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out->push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out->push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out->push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out->push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+char32_t FoldCase(char32_t cp) {
+    if (cp >= 'A' && cp <= 'Z') {
+        return cp + ('a' - 'A');
+    }
+    if (cp >= 0x0410 && cp <= 0x042F) {  // А..Я
+        return cp + 0x20;
+    }
+    if (cp == 0x0401 || cp == 0x0451) {  // Ё, ё
+        return 0x0435;
+    }
+    return cp;
+}
+
+bool IsWordChar(char32_t cp) {
+    if (cp < 0x80) {
+        return (cp >= 'a' && cp <= 'z') || (cp >= '0' && cp <= '9');
+    }
+    // Latin-1 punctuation and the General Punctuation block separate words, everything
+    // else outside of ASCII is treated as a letter.
+    return !(cp < 0xC0 || (cp >= 0x2000 && cp <= 0x206F));
+}
+
+}  // namespace
+
+std::string NormalizeName(std::string_view name) {
+    std::string ret;
+    ret.reserve(name.size());
+
+    bool pending_space = false;
+    while (!name.empty()) {
+        char32_t cp = FoldCase(NextCodePoint(&name));
+        if (cp == 0) {
+            continue;
+        }
+
+        if (!IsWordChar(cp)) {
+            pending_space = !ret.empty();
+            continue;
+        }
+
+        if (pending_space) {
+            ret.push_back(' ');
+            pending_space = false;
+        }
+        AppendUtf8(cp, &ret);
+    }
+    return ret;
+}
+
+std::vector<uint64_t> NameTrigrams(std::string_view normalized) {
+    std::u32string padded = U" ";
+    while (!normalized.empty()) {
+        if (char32_t cp = NextCodePoint(&normalized); cp != 0) {
+            padded.push_back(cp);
+        }
+    }
+    padded.push_back(U' ');
+
+    std::vector<uint64_t> ret;
+    for (size_t i = 0; i + 2 < padded.size(); ++i) {
+        ret.push_back((uint64_t{padded[i]} << 42) | (uint64_t{padded[i + 1]} << 21) |
+                      uint64_t{padded[i + 2]});
+    }
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+}
+
+}  // namespace foodculator
@@ -0,0 +1,22 @@
+#ifndef __SRC_SEARCH_NORMALIZE_H__
+#define __SRC_SEARCH_NORMALIZE_H__
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace foodculator {
+
+// Returns `name` case-folded for Latin and Cyrillic letters (with 'ё' folded to 'е'),
+// with every run of punctuation and whitespace replaced by a single space and no leading
+// or trailing spaces. The input and the result are UTF-8; invalid bytes are dropped.
+std::string NormalizeName(std::string_view name);
+
+// Returns the sorted distinct character trigrams of a normalized name. The name is padded
+// with a space on both sides, so names shorter than three characters still have trigrams.
+std::vector<uint64_t> NameTrigrams(std::string_view normalized);
+
+}  // namespace foodculator
+
+#endif
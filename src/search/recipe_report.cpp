@@ -0,0 +1,417 @@
+#include "recipe_report.h"
+
+#include <algorithm>
+#include <string>
+
+#include "fmt/format.h"
+#include "util/thread_pool.h"
+
+namespace foodculator {
+
+namespace {
+
+// Recipes are evaluated and scanned in chunks of this many.
+constexpr size_t kChunk = 4096;
+
+// A recipe matching a query with the value it is ranked by.
+struct Candidate {
+    float key;
+    size_t id;
+    uint32_t idx;
+};
+
+}  // namespace
+
+std::optional<ReportKey> ParseReportKey(std::string_view key) {
+    if (key == "kcal") {
+        return ReportKey::KCAL;
+    }
+    if (key == "weight") {
+        return ReportKey::WEIGHT;
+    }
+    if (key == "share") {
+        return ReportKey::SHARE;
+    }
+    for (size_t idx = 0; idx < kNutrientCount; ++idx) {
+        if (key == ToString(static_cast<Nutrient>(idx))) {
+            return static_cast<ReportKey>(1 + idx);
+        }
+    }
+    return std::nullopt;
+}
+
+json11::Json RecipeReportRow::to_json() const {
+    return json11::Json::object{{"id", std::to_string(id)},
+                                {"name", name},
+                                {"weight", fmt::format("{}", weight)},
+                                {"share", fmt::format("{:.2f}", share)},
+                                {"per_100g", per_100g}};
+}
+
+RecipeReportIndex::RecipeReportIndex(DB* db, ThreadPool* pool)
+    : db_(db), pool_(pool), threads_(pool->size() + 1) {}
+
+StatusOr<RecipeReport> RecipeReportIndex::Query(const RecipeReportQuery& query) {
+    if (query.sort == ReportKey::SHARE && !query.ingredient) {
+        return {StatusCode::INVALID_ARGUMENT, "Recipes can only be sorted by the share of a "
+                                              "given ingredient."};
+    }
+
+    auto current = Current();
+    if (!current.Ok()) {
+        return {current.Code(), std::move(current.Error())};
+    }
+    const Snapshot& s = *current.Value();
+
+    std::optional<uint32_t> ingredient;
+    if (query.ingredient) {
+        auto it = s.ingredient_index.find(*query.ingredient);
+        if (it == s.ingredient_index.end()) {
+            return StatusOr{RecipeReport{}};
+        }
+        ingredient = it->second;
+    }
+    // Grams of the ingredient per 100g of recipe `idx`, or nothing if it doesn't list it.
+    auto share = [&s, &ingredient](uint32_t idx) -> std::optional<float> {
+        for (uint32_t pos = s.ingredient_offsets[idx]; pos < s.ingredient_offsets[idx + 1];
+             ++pos) {
+            if (s.ingredients[pos] == *ingredient) {
+                return s.weights[idx] > 0 ? s.ingredient_weights[pos] * 100 / s.weights[idx] : 0;
+            }
+        }
+        return std::nullopt;
+    };
+
+    auto before = [&query](const Candidate& lhs, const Candidate& rhs) {
+        if (lhs.key != rhs.key) {
+            return query.descending ? lhs.key > rhs.key : lhs.key < rhs.key;
+        }
+        return lhs.id < rhs.id;
+    };
+    // Keeps the first `limit` candidates in order.
+    auto keep_first = [&query, &before](std::vector<Candidate>* candidates) {
+        if (candidates->size() > query.limit) {
+            std::nth_element(candidates->begin(), candidates->begin() + query.limit,
+                             candidates->end(), before);
+            candidates->resize(query.limit);
+        }
+        std::sort(candidates->begin(), candidates->end(), before);
+    };
+
+    const size_t count = s.recipe_ids.size();
+    const size_t chunks = (count + kChunk - 1) / kChunk;
+    std::vector<std::vector<Candidate>> found(chunks);
+    std::vector<size_t> matched(chunks);
+    ParallelFor(pool_, chunks, threads_, [&](size_t, size_t chunk) {
+        for (size_t idx = chunk * kChunk; idx < std::min(count, (chunk + 1) * kChunk); ++idx) {
+            if (!s.live[idx]) {
+                continue;
+            }
+            const NutrientProfile& profile = s.per_100g[idx];
+            if (profile.kcal() < query.min_kcal || profile.kcal() > query.max_kcal) {
+                continue;
+            }
+            float grams = 0;
+            if (ingredient) {
+                auto value = share(idx);
+                if (!value) {
+                    continue;
+                }
+                grams = *value;
+            }
+
+            float key = grams;
+            if (query.sort == ReportKey::WEIGHT) {
+                key = s.weights[idx];
+            } else if (query.sort != ReportKey::SHARE) {
+                key = profile.lanes[static_cast<size_t>(query.sort)];
+            }
+            found[chunk].push_back({key, s.recipe_ids[idx], static_cast<uint32_t>(idx)});
+        }
+        matched[chunk] = found[chunk].size();
+        keep_first(&found[chunk]);
+    });
+
+    std::vector<Candidate> all;
+    RecipeReport ret;
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        all.insert(all.end(), found[chunk].begin(), found[chunk].end());
+        ret.total += matched[chunk];
+    }
+    keep_first(&all);
+
+    for (const auto& v : all) {
+        ret.recipes.push_back({v.id, s.recipe_names[v.idx], s.weights[v.idx],
+                               ingredient ? *share(v.idx) : 0, s.per_100g[v.idx]});
+    }
+    return StatusOr{std::move(ret)};
+}
+
+StatusOr<std::shared_ptr<const RecipeReportIndex::Snapshot>> RecipeReportIndex::Current() {
+    auto is_fresh = [this](const Snapshot& snapshot) {
+        return snapshot.ingredients_generation == db_->Generation(DB::Table::INGREDIENTS) &&
+               snapshot.recipes_generation == db_->Generation(DB::Table::RECIPE);
+    };
+
+    std::shared_ptr<const Snapshot> current;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        current = snapshot_;
+    }
+    if (current && is_fresh(*current)) {
+        return StatusOr{std::move(current)};
+    }
+
+    std::unique_lock<std::mutex> update(update_mu_, std::defer_lock);
+    if (current) {
+        if (!update.try_lock()) {
+            // Somebody else is already updating the index, use the stale one meanwhile.
+            return StatusOr{std::move(current)};
+        }
+    } else {
+        update.lock();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        current = snapshot_;
+    }
+    if (current && is_fresh(*current)) {
+        return StatusOr{std::move(current)};
+    }
+
+    auto updated = Update(current.get());
+    if (!updated.Ok()) {
+        return updated;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    snapshot_ = updated.Value();
+    return updated;
+}
+
+StatusOr<std::shared_ptr<const RecipeReportIndex::Snapshot>> RecipeReportIndex::Update(
+    const Snapshot* previous) {
+    // Generations are read before the tables, so a concurrent write triggers another update.
+    const uint64_t ingredients_generation = db_->Generation(DB::Table::INGREDIENTS);
+    const uint64_t recipes_generation = db_->Generation(DB::Table::RECIPE);
+
+    if (previous != nullptr && previous->dead > previous->recipe_index.size()) {
+        previous = nullptr;
+    }
+    // All tables are read at one version, so the recipes don't refer to ingredients the
+    // snapshot doesn't have yet.
+    auto batch = db_->GetReplicationBatch(previous ? previous->version : 0);
+    if (!batch.Ok()) {
+        return {batch.Code(), std::move(batch.Error())};
+    }
+
+    auto snapshot = Patch(previous && !batch.Value().reset() ? *previous : Snapshot(),
+                          &batch.Value());
+    snapshot->ingredients_generation = ingredients_generation;
+    snapshot->recipes_generation = recipes_generation;
+    snapshot->version = batch.Value().version();
+    return StatusOr{std::shared_ptr<const Snapshot>(std::move(snapshot))};
+}
+
+std::shared_ptr<RecipeReportIndex::Snapshot> RecipeReportIndex::Patch(
+    const Snapshot& previous, ReplicationBatch* batch) const {
+    auto snapshot = std::make_shared<Snapshot>();
+    Snapshot& s = *snapshot;
+    // The rows are rewritten below, everything else is copied.
+    s.dead = previous.dead;
+    s.ingredient_profiles = previous.ingredient_profiles;
+    s.ingredient_index = previous.ingredient_index;
+    s.recipe_ids = previous.recipe_ids;
+    s.recipe_names = previous.recipe_names;
+    s.live = previous.live;
+    s.recipe_index = previous.recipe_index;
+    s.per_100g = previous.per_100g;
+    s.weights = previous.weights;
+
+    for (size_t id : batch->ingredients.deleted) {
+        s.dead += s.ingredient_index.erase(id);
+    }
+    // Only the ingredients that were there before can be used by the recipes that didn't change.
+    std::vector<bool> changed_ingredients(s.ingredient_profiles.size());
+    bool any_ingredient_changed = false;
+    for (const auto& v : batch->ingredients.changed) {
+        const NutrientProfile profile(static_cast<float>(v.kcal), v.nutrients);
+        auto [it, added] = s.ingredient_index.emplace(
+            v.id, static_cast<uint32_t>(s.ingredient_profiles.size()));
+        if (added) {
+            s.ingredient_profiles.push_back(profile);
+        } else if (!(s.ingredient_profiles[it->second] == profile)) {
+            s.ingredient_profiles[it->second] = profile;
+            changed_ingredients[it->second] = true;
+            any_ingredient_changed = true;
+        }
+    }
+
+    for (size_t id : batch->recipes.deleted) {
+        if (auto it = s.recipe_index.find(id); it != s.recipe_index.end()) {
+            s.live[it->second] = false;
+            s.recipe_index.erase(it);
+            ++s.dead;
+        }
+    }
+    std::vector<const FullRecipe*> rows(s.recipe_ids.size());
+    for (auto& recipe : batch->recipes.changed) {
+        auto [it, added] = s.recipe_index.emplace(recipe.header.id,
+                                                  static_cast<uint32_t>(s.recipe_ids.size()));
+        if (added) {
+            s.recipe_ids.push_back(recipe.header.id);
+            s.recipe_names.push_back(std::move(recipe.header.name));
+            s.live.push_back(true);
+            rows.push_back(&recipe);
+        } else {
+            s.recipe_names[it->second] = std::move(recipe.header.name);
+            rows[it->second] = &recipe;
+        }
+    }
+
+    // Unchanged rows are copied, and the changed ones are read from the batch once all new
+    // ingredients and recipes have their indices.
+    const size_t count = s.recipe_ids.size();
+    std::vector<bool> dirty(count);
+    s.ingredient_offsets.reserve(count + 1);
+    s.subrecipe_offsets.reserve(count + 1);
+    s.ingredient_offsets.push_back(0);
+    s.subrecipe_offsets.push_back(0);
+    for (uint32_t idx = 0; idx < count; ++idx) {
+        if (const FullRecipe* recipe = rows[idx]) {
+            dirty[idx] = true;
+            for (const auto& v : recipe->ingredients) {
+                auto it = s.ingredient_index.find(v.ingredient_id);
+                if (it != s.ingredient_index.end()) {
+                    s.ingredients.push_back(it->second);
+                    s.ingredient_weights.push_back(static_cast<float>(v.weight));
+                }
+            }
+            for (const auto& v : recipe->subrecipes) {
+                if (auto it = s.recipe_index.find(v.ingredient_id); it != s.recipe_index.end()) {
+                    s.subrecipes.push_back(it->second);
+                    s.subrecipe_weights.push_back(static_cast<float>(v.weight));
+                }
+            }
+        } else {
+            const uint32_t begin = previous.ingredient_offsets[idx];
+            const uint32_t end = previous.ingredient_offsets[idx + 1];
+            for (uint32_t pos = begin; any_ingredient_changed && s.live[idx] && pos < end; ++pos) {
+                dirty[idx] = dirty[idx] || changed_ingredients[previous.ingredients[pos]];
+            }
+            s.ingredients.insert(s.ingredients.end(), previous.ingredients.begin() + begin,
+                                 previous.ingredients.begin() + end);
+            s.ingredient_weights.insert(s.ingredient_weights.end(),
+                                        previous.ingredient_weights.begin() + begin,
+                                        previous.ingredient_weights.begin() + end);
+            s.subrecipes.insert(s.subrecipes.end(),
+                                previous.subrecipes.begin() + previous.subrecipe_offsets[idx],
+                                previous.subrecipes.begin() + previous.subrecipe_offsets[idx + 1]);
+            s.subrecipe_weights.insert(
+                s.subrecipe_weights.end(),
+                previous.subrecipe_weights.begin() + previous.subrecipe_offsets[idx],
+                previous.subrecipe_weights.begin() + previous.subrecipe_offsets[idx + 1]);
+        }
+        s.ingredient_offsets.push_back(static_cast<uint32_t>(s.ingredients.size()));
+        s.subrecipe_offsets.push_back(static_cast<uint32_t>(s.subrecipes.size()));
+    }
+
+    Evaluate(std::move(dirty), &s);
+    return snapshot;
+}
+
+void RecipeReportIndex::Evaluate(std::vector<bool> dirty, Snapshot* snapshot) const {
+    Snapshot& s = *snapshot;
+    const size_t count = s.recipe_ids.size();
+    s.per_100g.resize(count);
+    s.weights.resize(count);
+
+    std::vector<std::vector<uint32_t>> users(count);
+    std::vector<uint32_t> level;
+    for (uint32_t idx = 0; idx < count; ++idx) {
+        for (uint32_t pos = s.subrecipe_offsets[idx]; pos < s.subrecipe_offsets[idx + 1]; ++pos) {
+            users[s.subrecipes[pos]].push_back(idx);
+        }
+        if (dirty[idx]) {
+            level.push_back(idx);
+        }
+    }
+    // Whatever uses a dirty recipe is dirty too.
+    while (!level.empty()) {
+        const uint32_t idx = level.back();
+        level.pop_back();
+        for (uint32_t user : users[idx]) {
+            if (!dirty[user]) {
+                dirty[user] = true;
+                level.push_back(user);
+            }
+        }
+    }
+
+    // A recipe can be evaluated once all of its dirty sub-recipes are. The recipes of a level
+    // only depend on the previous levels and on clean recipes, so every level is evaluated in
+    // parallel.
+    std::vector<uint32_t> pending(count);
+    for (uint32_t idx = 0; idx < count; ++idx) {
+        if (!dirty[idx]) {
+            continue;
+        }
+        s.per_100g[idx] = NutrientProfile();
+        s.weights[idx] = 0;
+        for (uint32_t pos = s.subrecipe_offsets[idx]; pos < s.subrecipe_offsets[idx + 1]; ++pos) {
+            pending[idx] += dirty[s.subrecipes[pos]];
+        }
+        if (pending[idx] == 0) {
+            level.push_back(idx);
+        }
+    }
+
+    // Profiles and weights of the parts of a recipe, gathered for MixPer100g().
+    struct Parts {
+        std::vector<NutrientProfile> profiles;
+        std::vector<float> weights;
+    };
+    std::vector<Parts> parts(std::max<size_t>(1, threads_));
+    std::vector<uint32_t> next;
+    while (!level.empty()) {
+        const size_t chunks = (level.size() + kChunk - 1) / kChunk;
+        ParallelFor(pool_, chunks, threads_, [&](size_t worker, size_t chunk) {
+            Parts& p = parts[worker];
+            for (size_t pos = chunk * kChunk; pos < std::min(level.size(), (chunk + 1) * kChunk);
+                 ++pos) {
+                const uint32_t idx = level[pos];
+                p.profiles.clear();
+                p.weights.clear();
+                for (uint32_t i = s.ingredient_offsets[idx]; i < s.ingredient_offsets[idx + 1];
+                     ++i) {
+                    p.profiles.push_back(s.ingredient_profiles[s.ingredients[i]]);
+                    p.weights.push_back(s.ingredient_weights[i]);
+                }
+                for (uint32_t i = s.subrecipe_offsets[idx]; i < s.subrecipe_offsets[idx + 1];
+                     ++i) {
+                    p.profiles.push_back(s.per_100g[s.subrecipes[i]]);
+                    p.weights.push_back(s.subrecipe_weights[i]);
+                }
+                s.per_100g[idx] =
+                    MixPer100g(p.profiles.data(), p.weights.data(), p.profiles.size());
+                for (float weight : p.weights) {
+                    s.weights[idx] += weight;
+                }
+            }
+        });
+
+        next.clear();
+        for (uint32_t idx : level) {
+            for (uint32_t user : users[idx]) {
+                if (--pending[user] == 0) {
+                    next.push_back(user);
+                }
+            }
+        }
+        level.swap(next);
+    }
+    // DB refuses cycles of sub-recipes; if one slipped in anyway, its recipes stay all zero.
+}
+
+}  // namespace foodculator
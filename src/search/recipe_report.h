@@ -0,0 +1,142 @@
+#ifndef __SRC_SEARCH_RECIPE_REPORT_H__
+#define __SRC_SEARCH_RECIPE_REPORT_H__
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "db/db.h"
+#include "db/nutrients.h"
+#include "json11/json11.hpp"
+#include "util/statusor.h"
+
+namespace foodculator {
+
+class ThreadPool;
+
+// What the recipes of a report are ranked by. KCAL to SUGAR are values per 100g of the recipe,
+// in the order of the lanes of NutrientProfile. WEIGHT is the weight of the whole recipe, and
+// SHARE the grams of RecipeReportQuery::ingredient in 100g of it.
+enum class ReportKey { KCAL = 0, PROTEIN, FAT, CARBOHYDRATE, FIBRE, SALT, SUGAR, WEIGHT, SHARE };
+
+// Accepts "kcal", the names of the nutrients, "weight" and "share".
+std::optional<ReportKey> ParseReportKey(std::string_view key);
+
+struct RecipeReportQuery {
+    // Only recipes with kcal per 100g within [min_kcal, max_kcal].
+    float min_kcal = 0;
+    float max_kcal = std::numeric_limits<float>::infinity();
+    // Only recipes that list this ingredient, not counting their sub-recipes.
+    std::optional<size_t> ingredient;
+
+    ReportKey sort = ReportKey::KCAL;
+    bool descending = false;
+    size_t limit = 20;
+};
+
+struct RecipeReportRow {
+    size_t id;
+    std::string name;
+    float weight;
+    // Grams of the queried ingredient per 100g, 0 if the query has none.
+    float share;
+    NutrientProfile per_100g;
+
+    json11::Json to_json() const;
+};
+
+struct RecipeReport {
+    // The first `limit` matching recipes in the requested order; ties go by id.
+    std::vector<RecipeReportRow> recipes;
+    // The number of all matching recipes.
+    size_t total = 0;
+
+    json11::Json to_json() const {
+        return json11::Json::object{{"recipes", recipes}, {"total", std::to_string(total)}};
+    }
+};
+
+// RecipeReportIndex answers filtered and ranked queries over the nutrition of all recipes,
+// e.g. "recipes under 150 kcal per 100g" or "recipes with the most of this ingredient".
+//
+// The catalog is kept in memory as a structure of arrays: recipe rows in CSR form (offsets
+// into contiguous ingredient indices and weights) next to dense columns of ingredient
+// profiles and of computed recipe profiles. Recipes are evaluated in parallel, level by level
+// of sub-recipe nesting, and queries scan the columns in parallel chunks.
+//
+// After writes to INGREDIENTS or RECIPE, the next query reads the rows written since the
+// snapshot was taken and applies them to a copy of it: the rows of the changed recipes are
+// replaced, and only they and the recipes that use them, directly or through other
+// sub-recipes, are evaluated again. Deleted recipes keep their slots until they outnumber
+// the live ones, and the snapshot is then built from scratch. Queries that come in while a
+// snapshot is being updated are answered from the previous one.
+class RecipeReportIndex {
+   public:
+    // Builds and queries run on the calling thread and the threads of `pool`, which is shared
+    // with other work, e.g. with the other servers of the process.
+    RecipeReportIndex(DB* db, ThreadPool* pool);
+
+    StatusOr<RecipeReport> Query(const RecipeReportQuery& query);
+
+   private:
+    struct Snapshot {
+        uint64_t ingredients_generation = 0;
+        uint64_t recipes_generation = 0;
+        // The sync version of DB the snapshot is at, see DB::GetReplicationBatch().
+        uint64_t version = 0;
+        // Slots of deleted ingredients and recipes.
+        size_t dead = 0;
+
+        std::vector<NutrientProfile> ingredient_profiles;
+        std::unordered_map<size_t, uint32_t> ingredient_index;
+
+        std::vector<size_t> recipe_ids;
+        std::vector<std::string> recipe_names;
+        // False for the slots of deleted recipes.
+        std::vector<bool> live;
+        std::unordered_map<size_t, uint32_t> recipe_index;
+        // The ingredients of recipe `idx` are at [ingredient_offsets[idx],
+        // ingredient_offsets[idx + 1]) of `ingredients` and `ingredient_weights`.
+        std::vector<uint32_t> ingredient_offsets;
+        std::vector<uint32_t> ingredients;
+        std::vector<float> ingredient_weights;
+        // The same for sub-recipes, as indices of recipes.
+        std::vector<uint32_t> subrecipe_offsets;
+        std::vector<uint32_t> subrecipes;
+        std::vector<float> subrecipe_weights;
+
+        std::vector<NutrientProfile> per_100g;
+        std::vector<float> weights;
+    };
+
+    StatusOr<std::shared_ptr<const Snapshot>> Current();
+    // Reads the writes made after `previous` and returns a snapshot with them, or builds a new
+    // one if `previous` is null or has too many dead slots.
+    StatusOr<std::shared_ptr<const Snapshot>> Update(const Snapshot* previous);
+    // Returns a copy of `previous` with the rows of `batch`.
+    std::shared_ptr<Snapshot> Patch(const Snapshot& previous, ReplicationBatch* batch) const;
+    // Recomputes the recipes marked in `dirty` and all recipes that use them.
+    void Evaluate(std::vector<bool> dirty, Snapshot* snapshot) const;
+
+    DB* db_;
+    ThreadPool* const pool_;
+    // The calling thread and the threads of `pool_`.
+    const size_t threads_;
+
+    // Guards `snapshot_`.
+    std::mutex mu_;
+    std::shared_ptr<const Snapshot> snapshot_;
+
+    // Held while the snapshot is being updated.
+    std::mutex update_mu_;
+};
+
+}  // namespace foodculator
+
+#endif
@@ -0,0 +1,164 @@
+#include "capture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+
+#include "fmt/format.h"
+
+namespace foodculator {
+
+namespace {
+
+// The log starts with kMagic followed by the wall clock time of the start of the capture in
+// microseconds (8 bytes, little endian). Every record is a sequence of varints:
+//   arrival_us, method size, method, target size, target, body size, body,
+//   status, response_size, response_hash
+// where strings are written as is after their size.
+constexpr std::string_view kMagic = "FCAP\x01";
+
+uint64_t MonotonicUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void PutVarint(uint64_t v, std::string* out) {
+    while (v >= 0x80) {
+        out->push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out->push_back(static_cast<char>(v));
+}
+
+void PutString(std::string_view s, std::string* out) {
+    PutVarint(s.size(), out);
+    out->append(s);
+}
+
+// Reads from the front of `in`. Returns false if `in` ends before the value does.
+bool GetVarint(std::string_view* in, uint64_t* v) {
+    *v = 0;
+    for (size_t shift = 0; shift < 64 && !in->empty(); shift += 7) {
+        const auto byte = static_cast<uint8_t>(in->front());
+        in->remove_prefix(1);
+        *v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GetString(std::string_view* in, std::string* s) {
+    uint64_t size = 0;
+    if (!GetVarint(in, &size) || size > in->size()) {
+        return false;
+    }
+    s->assign(in->substr(0, size));
+    in->remove_prefix(size);
+    return true;
+}
+
+bool GetRecord(std::string_view* in, CapturedRequest* r) {
+    uint64_t status = 0;
+    if (!GetVarint(in, &r->arrival_us) || !GetString(in, &r->method) ||
+        !GetString(in, &r->target) || !GetString(in, &r->body) || !GetVarint(in, &status) ||
+        !GetVarint(in, &r->response_size) || !GetVarint(in, &r->response_hash)) {
+        return false;
+    }
+    r->status = static_cast<int>(status);
+    return true;
+}
+
+}  // namespace
+
+uint64_t HashBody(std::string_view body) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : body) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+std::unique_ptr<CaptureWriter> CaptureWriter::Create(const std::string& path) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        fmt::print(stderr, "Can't create the capture log {}\n", path);
+        return nullptr;
+    }
+
+    std::string header(kMagic);
+    const uint64_t wall_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch())
+                                 .count();
+    for (size_t byte = 0; byte < 8; ++byte) {
+        header.push_back(static_cast<char>(wall_us >> (8 * byte)));
+    }
+    if (std::fwrite(header.data(), 1, header.size(), file) != header.size()) {
+        fmt::print(stderr, "Can't write to the capture log {}\n", path);
+        std::fclose(file);
+        return nullptr;
+    }
+    return std::unique_ptr<CaptureWriter>(new CaptureWriter(file, MonotonicUs()));
+}
+
+CaptureWriter::CaptureWriter(FILE* file, uint64_t start_us) : file_(file), start_us_(start_us) {
+    buffer_.reserve(kFlushSize + 4096);
+}
+
+CaptureWriter::~CaptureWriter() {
+    Flush();
+    std::fclose(file_);
+}
+
+uint64_t CaptureWriter::Now() const { return MonotonicUs() - start_us_; }
+
+void CaptureWriter::Append(const CapturedRequest& r) {
+    std::lock_guard<std::mutex> lock(mu_);
+    PutVarint(r.arrival_us, &buffer_);
+    PutString(r.method, &buffer_);
+    PutString(r.target, &buffer_);
+    PutString(r.body, &buffer_);
+    PutVarint(static_cast<uint64_t>(r.status), &buffer_);
+    PutVarint(r.response_size, &buffer_);
+    PutVarint(r.response_hash, &buffer_);
+    if (buffer_.size() >= kFlushSize) {
+        std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+        buffer_.clear();
+    }
+}
+
+void CaptureWriter::Flush() {
+    std::lock_guard<std::mutex> lock(mu_);
+    std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+    buffer_.clear();
+    std::fflush(file_);
+}
+
+StatusOr<std::vector<CapturedRequest>> ReadCapture(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return {StatusCode::NOT_FOUND, fmt::format("Can't open {}", path)};
+    }
+    const std::string data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    std::string_view in = data;
+    if (in.substr(0, kMagic.size()) != kMagic || in.size() < kMagic.size() + 8) {
+        return {StatusCode::INVALID_ARGUMENT, fmt::format("{} is not a capture log", path)};
+    }
+    in.remove_prefix(kMagic.size() + 8);
+
+    std::vector<CapturedRequest> ret;
+    CapturedRequest r;
+    while (!in.empty() && GetRecord(&in, &r)) {
+        ret.push_back(std::move(r));
+    }
+    std::stable_sort(ret.begin(), ret.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.arrival_us < rhs.arrival_us;
+    });
+    return StatusOr{std::move(ret)};
+}
+
+}  // namespace foodculator
@@ -0,0 +1,67 @@
+#ifndef __SRC_SERVER_CAPTURE_H__
+#define __SRC_SERVER_CAPTURE_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "util/statusor.h"
+
+namespace foodculator {
+
+// One API request and a fingerprint of the response the server gave to it.
+struct CapturedRequest {
+    // Microseconds since the capture started.
+    uint64_t arrival_us = 0;
+    std::string method;
+    // Path with the query string, e.g. "/get_ingredients?since=12".
+    std::string target;
+    std::string body;
+
+    int status = 0;
+    uint64_t response_size = 0;
+    uint64_t response_hash = 0;
+};
+
+// FNV-1a, used to compare response bodies without storing them.
+uint64_t HashBody(std::string_view body);
+
+// CaptureWriter appends requests to a binary log. Records are encoded with varints into an
+// in-memory buffer and written out in large chunks, so Append() is cheap enough to be called
+// from every request handler. Records are appended in the order the requests complete.
+class CaptureWriter {
+   public:
+    // Returns nullptr if `path` can't be created.
+    static std::unique_ptr<CaptureWriter> Create(const std::string& path);
+    ~CaptureWriter();
+
+    // Microseconds since Create(), to be stored in CapturedRequest::arrival_us.
+    uint64_t Now() const;
+
+    void Append(const CapturedRequest& request);
+    void Flush();
+
+   private:
+    CaptureWriter(FILE* file, uint64_t start_us);
+
+    // Buffered bytes are written out once there are this many of them.
+    static constexpr size_t kFlushSize = 256 * 1024;
+
+    FILE* file_;
+    const uint64_t start_us_;
+    std::mutex mu_;
+    std::string buffer_;
+};
+
+// Reads the whole log written by CaptureWriter, sorted by arrival time. Fails with
+// INVALID_ARGUMENT if the file is not a capture log. A truncated last record, e.g. left by a
+// crashed server, is dropped.
+StatusOr<std::vector<CapturedRequest>> ReadCapture(const std::string& path);
+
+}  // namespace foodculator
+
+#endif
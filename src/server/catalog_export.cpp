@@ -0,0 +1,135 @@
+#include "catalog_export.h"
+
+#include <string>
+#include <variant>
+
+#include "fmt/format.h"
+#include "json11/json11.hpp"
+
+namespace foodculator {
+
+namespace {
+
+void AppendNdjson(json11::Json row, const char* type, std::string* out) {
+    json11::Json::object fields = row.object_items();
+    fields.emplace("type", type);
+    *out += json11::Json(std::move(fields)).dump();
+    out->push_back('\n');
+}
+
+// Appends `value` as a CSV field, quoted if it has to be.
+void AppendCsvField(std::string_view value, std::string* out) {
+    if (value.find_first_of(",\"\r\n") == std::string_view::npos) {
+        *out += value;
+        return;
+    }
+    out->push_back('"');
+    for (char c : value) {
+        if (c == '"') {
+            out->push_back('"');
+        }
+        out->push_back(c);
+    }
+    out->push_back('"');
+}
+
+// Appends a CSV row of the columns before the nutrients. Empty values stand for columns the
+// type of row doesn't have.
+void AppendCsvRow(std::string_view type, size_t id, std::string_view recipe_id,
+                  std::string_view name, std::string_view kcal, std::string_view weight,
+                  std::string_view description, std::string* out) {
+    *out += fmt::format("{},{},{},", type, id, recipe_id);
+    AppendCsvField(name, out);
+    *out += fmt::format(",{},{},", kcal, weight);
+    AppendCsvField(description, out);
+}
+
+void AppendCsv(const CatalogRow& row, std::string* out) {
+    // The nutrients are the last columns, so the other rows simply end early.
+    const std::string empty_nutrients(kNutrientCount, ',');
+    if (const auto* v = std::get_if<Ingredient>(&row)) {
+        AppendCsvRow("ingredient", v->id, "", v->name, std::to_string(v->kcal), "", "", out);
+        for (float grams : v->nutrients) {
+            *out += fmt::format(",{}", grams);
+        }
+        *out += "\r\n";
+    } else if (const auto* v = std::get_if<Tableware>(&row)) {
+        AppendCsvRow("tableware", v->id, "", v->name, "", std::to_string(v->weight), "", out);
+        *out += empty_nutrients + "\r\n";
+    } else if (const auto* v = std::get_if<FullRecipe>(&row)) {
+        AppendCsvRow("recipe", v->header.id, "", v->header.name, "", "", v->description, out);
+        *out += empty_nutrients + "\r\n";
+        const std::string recipe_id = std::to_string(v->header.id);
+        for (const auto& ingredient : v->ingredients) {
+            AppendCsvRow("recipe_ingredient", ingredient.ingredient_id, recipe_id, "", "",
+                         std::to_string(ingredient.weight), "", out);
+            *out += empty_nutrients + "\r\n";
+        }
+        for (const auto& subrecipe : v->subrecipes) {
+            AppendCsvRow("recipe_subrecipe", subrecipe.ingredient_id, recipe_id, "", "",
+                         std::to_string(subrecipe.weight), "", out);
+            *out += empty_nutrients + "\r\n";
+        }
+    }
+}
+
+void AppendRow(ExportFormat format, const CatalogRow& row, std::string* out) {
+    if (format == ExportFormat::CSV) {
+        AppendCsv(row, out);
+    } else if (const auto* v = std::get_if<Ingredient>(&row)) {
+        AppendNdjson(*v, "ingredient", out);
+    } else if (const auto* v = std::get_if<Tableware>(&row)) {
+        AppendNdjson(*v, "tableware", out);
+    } else if (const auto* v = std::get_if<FullRecipe>(&row)) {
+        AppendNdjson(*v, "recipe", out);
+    }
+}
+
+}  // namespace
+
+std::optional<ExportFormat> ParseExportFormat(std::string_view name) {
+    if (name == "ndjson") {
+        return ExportFormat::NDJSON;
+    }
+    if (name == "csv") {
+        return ExportFormat::CSV;
+    }
+    return std::nullopt;
+}
+
+const char* ExportContentType(ExportFormat format) {
+    return format == ExportFormat::CSV ? "text/csv" : "application/x-ndjson";
+}
+
+StatusCode WriteCatalog(DB* db, ExportFormat format,
+                        const std::function<bool(std::string_view)>& write) {
+    std::string chunk;
+    chunk.reserve(kExportChunkSize);
+    if (format == ExportFormat::CSV) {
+        chunk += "type,id,recipe_id,name,kcal,weight,description";
+        for (size_t idx = 0; idx < kNutrientCount; ++idx) {
+            chunk += fmt::format(",{}", ToString(static_cast<Nutrient>(idx)));
+        }
+        chunk += "\r\n";
+    }
+
+    bool written = true;
+    auto code = db->ExportCatalog([&](const CatalogRow& row) {
+        AppendRow(format, row, &chunk);
+        if (chunk.size() < kExportChunkSize) {
+            return true;
+        }
+        written = write(chunk);
+        chunk.clear();
+        return written;
+    });
+    if (code != StatusCode::OK) {
+        return code;
+    }
+    if (!written || (!chunk.empty() && !write(chunk))) {
+        return StatusCode::INTERNAL_ERROR;
+    }
+    return StatusCode::OK;
+}
+
+}  // namespace foodculator
@@ -0,0 +1,39 @@
+#ifndef __SRC_SERVER_CATALOG_EXPORT_H__
+#define __SRC_SERVER_CATALOG_EXPORT_H__
+
+#include <functional>
+#include <optional>
+#include <string_view>
+
+#include "db/db.h"
+#include "util/statusor.h"
+
+namespace foodculator {
+
+// The formats of GET /export.
+//
+// NDJSON has one json object per line: the object of /ingredient/<id>, of /get_tableware or of
+// /recipe/<id> (without `per_100g`), with a "type" field of "ingredient", "tableware" or
+// "recipe".
+//
+// CSV has one table with the columns type, id, recipe_id, name, kcal, weight, description and
+// one column per nutrient. Ingredients, tableware and recipes are rows of type "ingredient",
+// "tableware" and "recipe". Every recipe is followed by its "recipe_ingredient" and
+// "recipe_subrecipe" rows with the id of the ingredient or sub-recipe, its weight and the
+// recipe_id of the recipe.
+enum class ExportFormat { NDJSON, CSV };
+
+// Returns the format called `name`, "ndjson" or "csv".
+std::optional<ExportFormat> ParseExportFormat(std::string_view name);
+const char* ExportContentType(ExportFormat format);
+
+// Writes the whole catalog of `db` in `format`, passing it to `write` in chunks of about
+// kExportChunkSize bytes as DB::ExportCatalog() reads it. Fails with INTERNAL_ERROR if `write`
+// returns false, e.g. because the client has gone.
+StatusCode WriteCatalog(DB* db, ExportFormat format,
+                        const std::function<bool(std::string_view)>& write);
+constexpr size_t kExportChunkSize = 64 * 1024;
+
+}  // namespace foodculator
+
+#endif
@@ -0,0 +1,760 @@
+#include "event_server.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "fmt/format.h"
+
+namespace foodculator {
+
+namespace {
+
+// Ids of the epoll entries that are not connections.
+constexpr uint64_t kListenerId = 0;
+constexpr uint64_t kWakeupId = 1;
+
+constexpr size_t kReadChunk = 16 * 1024;
+constexpr int kMaxEvents = 256;
+
+bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs) {
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(lhs[i])) !=
+            std::tolower(static_cast<unsigned char>(rhs[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view Trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+// Decodes %XX escapes, and '+' as a space in query strings.
+std::string DecodeUrl(std::string_view s, bool query) {
+    std::string ret;
+    ret.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '%' && i + 2 < s.size()) {
+            uint8_t value = 0;
+            auto [ptr, ec] = std::from_chars(s.data() + i + 1, s.data() + i + 3, value, 16);
+            if (ec == std::errc() && ptr == s.data() + i + 3) {
+                ret.push_back(static_cast<char>(value));
+                i += 2;
+                continue;
+            }
+        }
+        ret.push_back(query && s[i] == '+' ? ' ' : s[i]);
+    }
+    return ret;
+}
+
+void ParseQuery(std::string_view query, httplib::Params* params) {
+    while (!query.empty()) {
+        size_t end = query.find('&');
+        std::string_view pair = query.substr(0, end);
+        query = end == std::string_view::npos ? std::string_view() : query.substr(end + 1);
+        if (pair.empty()) {
+            continue;
+        }
+        size_t eq = pair.find('=');
+        std::string_view value = eq == std::string_view::npos ? "" : pair.substr(eq + 1);
+        params->emplace(DecodeUrl(pair.substr(0, eq), true), DecodeUrl(value, true));
+    }
+}
+
+std::string_view StatusMessage(int status) {
+    switch (status) {
+        case 200:
+            return "OK";
+        case 204:
+            return "No Content";
+        case 400:
+            return "Bad Request";
+        case 404:
+            return "Not Found";
+        case 409:
+            return "Conflict";
+        case 413:
+            return "Payload Too Large";
+        case 422:
+            return "Unprocessable Entity";
+        case 431:
+            return "Request Header Fields Too Large";
+        case 500:
+            return "Internal Server Error";
+        case 501:
+            return "Not Implemented";
+        default:
+            return "Unknown";
+    }
+}
+
+// The port a listening socket is bound to, or -1.
+int ListeningPort(int fd) {
+    sockaddr_in bound = {};
+    socklen_t size = sizeof(bound);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&bound), &size) != 0) {
+        return -1;
+    }
+    return ntohs(bound.sin_port);
+}
+
+// The status line and the headers of `res`. The body follows in chunks if `chunked`, and is
+// `res.body` otherwise.
+std::string SerializeHead(const httplib::Response& res, bool keep_alive, bool chunked) {
+    std::string ret = fmt::format("HTTP/1.1 {} {}\r\n", res.status, StatusMessage(res.status));
+    for (const auto& [name, value] : res.headers) {
+        if (!EqualsIgnoreCase(name, "Content-Length") && !EqualsIgnoreCase(name, "Connection") &&
+            !EqualsIgnoreCase(name, "Transfer-Encoding")) {
+            ret += fmt::format("{}: {}\r\n", name, value);
+        }
+    }
+    if (chunked) {
+        ret += "Transfer-Encoding: chunked\r\n";
+    } else {
+        ret += fmt::format("Content-Length: {}\r\n", res.body.size());
+    }
+    ret += fmt::format("Connection: {}\r\n\r\n", keep_alive ? "keep-alive" : "close");
+    return ret;
+}
+
+std::string Serialize(const httplib::Response& res, bool keep_alive) {
+    return SerializeHead(res, keep_alive, /*chunked=*/false) + res.body;
+}
+
+// A response to a request that can't be parsed. The connection is closed after it.
+std::string ErrorResponse(int status) {
+    httplib::Response res;
+    res.status = status;
+    res.body = StatusMessage(status);
+    return Serialize(res, false);
+}
+
+}  // namespace
+
+thread_local EventServer::Handling* EventServer::handling_ = nullptr;
+
+EventServer::EventServer(Handler handler, size_t workers)
+    : handler_(std::move(handler)),
+      epoll_(epoll_create1(EPOLL_CLOEXEC)),
+      wakeup_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      workers_(std::make_unique<ThreadPool>(workers)) {}
+
+EventServer::~EventServer() {
+    // The workers write to `wakeup_` until they are done.
+    workers_.reset();
+    for (const auto& [id, conn] : connections_) {
+        close(conn->fd);
+    }
+    for (int fd : {listener_, epoll_, wakeup_}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+int EventServer::Bind(const std::string& host, int port) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) {
+        return -1;
+    }
+    std::unique_ptr<addrinfo, decltype(&freeaddrinfo)> cleanup(addresses, freeaddrinfo);
+
+    listener_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener_ < 0) {
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (bind(listener_, addresses->ai_addr, addresses->ai_addrlen) != 0 ||
+        listen(listener_, SOMAXCONN) != 0) {
+        close(listener_);
+        listener_ = -1;
+        return -1;
+    }
+
+    return ListeningPort(listener_);
+}
+
+int EventServer::Adopt(int fd) {
+    int listening = 0;
+    socklen_t size = sizeof(listening);
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &size) != 0 || !listening) {
+        return -1;
+    }
+    // Another process may take a connection between the wakeup and accept4(), so accepting
+    // must not block. The flag is shared by every process that has the socket.
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    listener_ = fd;
+    return ListeningPort(listener_);
+}
+
+bool EventServer::Listen() {
+    if (listener_ < 0 || epoll_ < 0 || wakeup_ < 0) {
+        return false;
+    }
+    for (auto [fd, id] : {std::pair{listener_, kListenerId}, std::pair{wakeup_, kWakeupId}}) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = id;
+        if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            return false;
+        }
+    }
+    next_id_ = kWakeupId + 1;
+
+    std::vector<epoll_event> events(kMaxEvents);
+    while (!stopping_) {
+        int count = epoll_wait(epoll_, events.data(), kMaxEvents, Expire());
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fmt::print(stderr, "epoll_wait failed: {}\n", errno);
+            return false;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            const uint64_t id = events[i].data.u64;
+            if (id == kListenerId) {
+                // A stopping server leaves the connections in the queue to the other processes.
+                if (!stopping_) {
+                    Accept();
+                }
+                continue;
+            }
+            if (id == kWakeupId) {
+                Complete();
+                continue;
+            }
+
+            auto it = connections_.find(id);
+            if (it == connections_.end()) {
+                continue;
+            }
+            Connection* conn = it->second.get();
+            if (events[i].events & EPOLLERR) {
+                Close(id);
+            } else if (conn->written < conn->out.size()) {
+                Write(id, conn);
+            } else if (!conn->busy) {
+                Read(id, conn);
+            } else if (events[i].events & EPOLLHUP) {
+                // The client is gone; the response of its last request is dropped.
+                Close(id);
+            }
+        }
+    }
+
+    // Stops the workers that stream to the connections, and those whose responses were not
+    // picked up yet.
+    while (!connections_.empty()) {
+        Close(connections_.begin()->first);
+    }
+    std::deque<Completion> completions;
+    std::vector<std::shared_ptr<Parked>> resumed;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        exited_ = true;
+        completions.swap(completions_);
+        resumed.swap(resumed_);
+    }
+    for (auto& v : completions) {
+        if (v.stream) {
+            v.stream->Close();
+        }
+        if (v.parked) {
+            deadlines_.emplace(v.parked->deadline, std::move(v.parked));
+        }
+    }
+    // The parked requests let go of what they wait for.
+    for (auto& [deadline, parked] : deadlines_) {
+        if (!parked->resumed.exchange(true)) {
+            resumed.push_back(std::move(parked));
+        }
+    }
+    deadlines_.clear();
+    for (const auto& parked : resumed) {
+        httplib::Response dropped;
+        parked->respond(&dropped);
+    }
+    return true;
+}
+
+void EventServer::Stop() {
+    stopping_ = true;
+    if (wakeup_ >= 0) {
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = write(wakeup_, &one, sizeof(one));
+    }
+}
+
+void EventServer::Accept() {
+    for (;;) {
+        sockaddr_in addr = {};
+        socklen_t size = sizeof(addr);
+        int fd = accept4(listener_, reinterpret_cast<sockaddr*>(&addr), &size,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // EAGAIN once the backlog is empty; on other errors, e.g. out of descriptors, the
+            // remaining clients wait for the next round.
+            return;
+        }
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        auto conn = std::make_unique<Connection>();
+        conn->fd = fd;
+        char ip[INET_ADDRSTRLEN] = {};
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        conn->remote_addr = ip;
+        conn->remote_port = ntohs(addr.sin_port);
+
+        const uint64_t id = next_id_++;
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = id;
+        if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            continue;
+        }
+        connections_.emplace(id, std::move(conn));
+    }
+}
+
+void EventServer::Read(uint64_t id, Connection* conn) {
+    char buffer[kReadChunk];
+    for (;;) {
+        ssize_t size = recv(conn->fd, buffer, sizeof(buffer), 0);
+        if (size > 0) {
+            conn->in.append(buffer, size);
+            continue;
+        }
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        // Closed by the client, or failed.
+        Close(id);
+        return;
+    }
+    Parse(id, conn);
+}
+
+void EventServer::Parse(uint64_t id, Connection* conn) {
+    const size_t head_end = conn->in.find("\r\n\r\n");
+    if (head_end == std::string::npos) {
+        if (conn->in.size() > kMaxHeaderSize) {
+            Reply(id, conn, ErrorResponse(431), false);
+        }
+        return;
+    }
+
+    auto req = std::make_shared<httplib::Request>();
+    std::string_view head(conn->in.data(), head_end);
+    size_t line_end = head.find("\r\n");
+    std::string_view line = head.substr(0, line_end);
+    head = line_end == std::string_view::npos ? std::string_view() : head.substr(line_end + 2);
+
+    const size_t method_end = line.find(' ');
+    const size_t target_end = line.rfind(' ');
+    if (method_end == std::string_view::npos || target_end <= method_end ||
+        line.substr(target_end + 1).substr(0, 7) != "HTTP/1.") {
+        Reply(id, conn, ErrorResponse(400), false);
+        return;
+    }
+    req->method = line.substr(0, method_end);
+    req->version = line.substr(target_end + 1);
+    std::string_view target = line.substr(method_end + 1, target_end - method_end - 1);
+    const size_t query = target.find('?');
+    req->path = DecodeUrl(target.substr(0, query), false);
+    if (query != std::string_view::npos) {
+        ParseQuery(target.substr(query + 1), &req->params);
+    }
+
+    size_t body_size = 0;
+    bool keep_alive = req->version == "HTTP/1.1";
+    while (!head.empty()) {
+        line_end = head.find("\r\n");
+        line = head.substr(0, line_end);
+        head = line_end == std::string_view::npos ? std::string_view() : head.substr(line_end + 2);
+
+        const size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            Reply(id, conn, ErrorResponse(400), false);
+            return;
+        }
+        std::string_view name = Trim(line.substr(0, colon));
+        std::string_view value = Trim(line.substr(colon + 1));
+        if (EqualsIgnoreCase(name, "Content-Length")) {
+            auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), body_size);
+            if (ec != std::errc() || ptr != value.data() + value.size()) {
+                Reply(id, conn, ErrorResponse(400), false);
+                return;
+            }
+        } else if (EqualsIgnoreCase(name, "Transfer-Encoding")) {
+            Reply(id, conn, ErrorResponse(501), false);
+            return;
+        } else if (EqualsIgnoreCase(name, "Connection")) {
+            keep_alive = EqualsIgnoreCase(value, "keep-alive") ||
+                         (keep_alive && !EqualsIgnoreCase(value, "close"));
+        }
+        req->headers.emplace(name, value);
+    }
+    if (body_size > kMaxBodySize) {
+        Reply(id, conn, ErrorResponse(413), false);
+        return;
+    }
+    if (conn->in.size() < head_end + 4 + body_size) {
+        return;
+    }
+    req->body = conn->in.substr(head_end + 4, body_size);
+    conn->in.erase(0, head_end + 4 + body_size);
+    req->remote_addr = conn->remote_addr;
+    req->remote_port = conn->remote_port;
+
+    // Nothing is read from the connection until the response is written.
+    conn->busy = true;
+    Watch(id, conn, 0);
+    workers_->Submit([this, id, req, keep_alive] {
+        Handling handling{this, id, req, keep_alive, nullptr};
+        handling_ = &handling;
+        httplib::Response res;
+        handler_(*req, &res);
+        handling_ = nullptr;
+        if (!handling.parked) {
+            Finish(id, *req, &res, keep_alive);
+            return;
+        }
+
+        // The loop starts the clock of the parked request.
+        bool exited;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            exited = exited_;
+            if (!exited) {
+                completions_.push_back({id, "", keep_alive, nullptr, handling.parked});
+            }
+        }
+        if (exited) {
+            if (!handling.parked->resumed.exchange(true)) {
+                httplib::Response dropped;
+                handling.parked->respond(&dropped);
+            }
+            return;
+        }
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = write(wakeup_, &one, sizeof(one));
+    });
+}
+
+void EventServer::Finish(uint64_t id, const httplib::Request& req, httplib::Response* res,
+                         bool keep_alive) {
+    if (res->status == -1) {
+        res->status = 200;
+    }
+    std::shared_ptr<Stream> stream;
+    if (res->content_provider_ && res->is_chunked_content_provider_) {
+        stream = std::make_shared<Stream>();
+    }
+    std::string response = stream ? SerializeHead(*res, keep_alive, /*chunked=*/true)
+                                  : Serialize(*res, keep_alive);
+    if (logger_ && !stream) {
+        logger_(req, *res);
+    }
+
+    bool exited;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        exited = exited_;
+        completions_.push_back({id, std::move(response), keep_alive, stream});
+    }
+    uint64_t one = 1;
+    [[maybe_unused]] auto written = write(wakeup_, &one, sizeof(one));
+
+    if (stream) {
+        if (exited) {
+            stream->Close();
+        }
+        StreamBody(id, res, stream.get());
+        if (logger_) {
+            logger_(req, *res);
+        }
+    }
+}
+
+std::function<void()> EventServer::Park(std::chrono::milliseconds timeout, Respond respond) {
+    if (handling_ == nullptr || handling_->parked) {
+        return nullptr;
+    }
+    auto parked = std::make_shared<Parked>();
+    parked->server = handling_->server;
+    parked->connection = handling_->connection;
+    parked->req = handling_->req;
+    parked->keep_alive = handling_->keep_alive;
+    parked->deadline = std::chrono::steady_clock::now() + timeout;
+    parked->respond = std::move(respond);
+    handling_->parked = parked;
+    return [parked] {
+        if (!parked->resumed.exchange(true)) {
+            parked->server->Resume(parked);
+        }
+    };
+}
+
+void EventServer::Resume(std::shared_ptr<Parked> parked) {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (exited_) {
+            return;
+        }
+        resumed_.push_back(std::move(parked));
+    }
+    uint64_t one = 1;
+    [[maybe_unused]] auto written = write(wakeup_, &one, sizeof(one));
+}
+
+void EventServer::Unpark(std::shared_ptr<Parked> parked) {
+    workers_->Submit([this, parked] {
+        httplib::Response res;
+        parked->respond(&res);
+        Finish(parked->connection, *parked->req, &res, parked->keep_alive);
+    });
+}
+
+int EventServer::Expire() {
+    const auto now = std::chrono::steady_clock::now();
+    while (!deadlines_.empty() && deadlines_.begin()->first <= now) {
+        auto parked = std::move(deadlines_.begin()->second);
+        deadlines_.erase(deadlines_.begin());
+        if (!parked->resumed.exchange(true)) {
+            Unpark(std::move(parked));
+        }
+    }
+    if (deadlines_.empty()) {
+        return -1;
+    }
+    return std::chrono::ceil<std::chrono::milliseconds>(deadlines_.begin()->first - now).count();
+}
+
+void EventServer::StreamBody(uint64_t id, httplib::Response* res, Stream* stream) {
+    size_t offset = 0;
+    bool done = false;
+    httplib::DataSink sink;
+    sink.write = [this, id, stream, &offset](const char* data, size_t size) {
+        std::unique_lock<std::mutex> lock(stream->mu);
+        stream->drained.wait(lock, [stream] {
+            return stream->closed || stream->pending.size() < kMaxPendingChunks;
+        });
+        if (stream->closed) {
+            return false;
+        }
+        // An empty chunk would end the body.
+        if (size > 0) {
+            stream->pending += fmt::format("{:x}\r\n", size);
+            stream->pending.append(data, size);
+            stream->pending += "\r\n";
+            offset += size;
+            Notify(id, stream);
+        }
+        return true;
+    };
+    sink.is_writable = [stream] {
+        std::lock_guard<std::mutex> lock(stream->mu);
+        return !stream->closed;
+    };
+    sink.done = [&done] { done = true; };
+
+    // Like httplib, calls the provider until it is done; it may send only part of the body at
+    // a time.
+    while (!done && sink.is_writable()) {
+        if (!res->content_provider_(offset, 0, sink)) {
+            break;
+        }
+    }
+    res->content_provider_success_ = done;
+
+    std::lock_guard<std::mutex> lock(stream->mu);
+    if (done) {
+        stream->pending += "0\r\n\r\n";
+    }
+    stream->finished = true;
+    stream->failed = !done;
+    Notify(id, stream);
+}
+
+void EventServer::Notify(uint64_t id, Stream* stream) {
+    if (!stream->waiting) {
+        return;
+    }
+    stream->waiting = false;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        streaming_.push_back(id);
+    }
+    uint64_t one = 1;
+    [[maybe_unused]] auto written = write(wakeup_, &one, sizeof(one));
+}
+
+bool EventServer::Refill(Connection* conn) {
+    Stream* stream = conn->stream.get();
+    std::lock_guard<std::mutex> lock(stream->mu);
+    conn->out.clear();
+    conn->written = 0;
+    conn->out.swap(stream->pending);
+    stream->drained.notify_one();
+    if (conn->out.empty() && !stream->finished) {
+        stream->waiting = true;
+        return false;
+    }
+    return true;
+}
+
+void EventServer::Write(uint64_t id, Connection* conn) {
+    for (;;) {
+        while (conn->written < conn->out.size()) {
+            ssize_t size = send(conn->fd, conn->out.data() + conn->written,
+                                conn->out.size() - conn->written, MSG_NOSIGNAL);
+            if (size >= 0) {
+                conn->written += size;
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                Watch(id, conn, EPOLLOUT);
+                return;
+            }
+            if (errno != EINTR) {
+                Close(id);
+                return;
+            }
+        }
+        if (!conn->stream) {
+            break;
+        }
+        if (!Refill(conn)) {
+            // The worker wakes the loop up when it has more.
+            Watch(id, conn, 0);
+            return;
+        }
+        if (conn->out.empty()) {
+            const bool failed = conn->stream->failed;
+            conn->stream.reset();
+            conn->busy = false;
+            if (failed) {
+                // Without the terminating chunk the client sees the reply as truncated.
+                Close(id);
+                return;
+            }
+            break;
+        }
+    }
+
+    if (conn->close_after_write) {
+        Close(id);
+        return;
+    }
+    conn->out.clear();
+    conn->written = 0;
+    Watch(id, conn, EPOLLIN);
+    // The client might have sent the next request already.
+    Parse(id, conn);
+}
+
+void EventServer::Reply(uint64_t id, Connection* conn, std::string response, bool keep_alive) {
+    conn->out = std::move(response);
+    conn->written = 0;
+    conn->close_after_write = !keep_alive;
+    Write(id, conn);
+}
+
+void EventServer::Close(uint64_t id) {
+    auto it = connections_.find(id);
+    if (it->second->stream) {
+        it->second->stream->Close();
+    }
+    // Closing the descriptor removes it from the epoll set.
+    close(it->second->fd);
+    connections_.erase(it);
+}
+
+void EventServer::Watch(uint64_t id, Connection* conn, uint32_t events) {
+    epoll_event event = {};
+    event.events = events;
+    event.data.u64 = id;
+    epoll_ctl(epoll_, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+void EventServer::Complete() {
+    uint64_t value = 0;
+    [[maybe_unused]] auto read_size = read(wakeup_, &value, sizeof(value));
+
+    std::deque<Completion> completions;
+    std::vector<uint64_t> streaming;
+    std::vector<std::shared_ptr<Parked>> resumed;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        completions.swap(completions_);
+        streaming.swap(streaming_);
+        resumed.swap(resumed_);
+    }
+    for (auto& parked : resumed) {
+        Unpark(std::move(parked));
+    }
+    for (auto& v : completions) {
+        if (v.parked) {
+            // The connection stays busy until the reply comes.
+            deadlines_.emplace(v.parked->deadline, std::move(v.parked));
+            continue;
+        }
+        auto it = connections_.find(v.connection);
+        if (it == connections_.end()) {
+            if (v.stream) {
+                v.stream->Close();
+            }
+            continue;
+        }
+        // A streamed response keeps its worker busy until the last chunk.
+        it->second->busy = v.stream != nullptr;
+        it->second->stream = std::move(v.stream);
+        Reply(v.connection, it->second.get(), std::move(v.response), v.keep_alive);
+    }
+    for (uint64_t id : streaming) {
+        auto it = connections_.find(id);
+        if (it != connections_.end() && it->second->stream) {
+            Write(id, it->second.get());
+        }
+    }
+}
+
+}  // namespace foodculator
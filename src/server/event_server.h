@@ -0,0 +1,208 @@
+#ifndef __SRC_SERVER_EVENT_SERVER_H__
+#define __SRC_SERVER_EVENT_SERVER_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "httplib.h"
+#include "util/thread_pool.h"
+
+namespace foodculator {
+
+// EventServer is an HTTP/1.1 front-end that keeps all connections on one epoll thread, so an
+// idle keep-alive connection costs a few hundred bytes instead of a thread.
+//
+// Every connection is a small state machine: it reads until a whole request is buffered, hands
+// the request to one of the `workers` threads and stops reading, then writes the response and
+// goes back to reading. Pipelined requests are answered one by one. Bodies need a
+// Content-Length; chunked requests are refused with 501.
+//
+// Responses with a chunked content provider are streamed: the worker runs the provider and
+// stays with the request until it is done, while the loop sends the chunks as the socket takes
+// them. The worker waits whenever kMaxPendingChunks bytes are not sent yet, so a slow client
+// holds up its worker instead of growing the buffer.
+//
+// A handler can park its request with Park(), e.g. a long poll: the request then waits in the
+// loop without a worker until something resumes it.
+class EventServer {
+   public:
+    using Handler = std::function<void(const httplib::Request&, httplib::Response*)>;
+    using Logger = std::function<void(const httplib::Request&, const httplib::Response&)>;
+
+    EventServer(Handler handler, size_t workers);
+    ~EventServer();
+
+    EventServer(const EventServer&) = delete;
+    EventServer& operator=(const EventServer&) = delete;
+
+    // Called on the worker thread after every request.
+    void SetLogger(Logger logger) { logger_ = std::move(logger); }
+
+    // Binds the listening socket. Port 0 picks any free port.
+    // Returns the bound port, or -1 on failure.
+    int Bind(const std::string& host, int port);
+    // Accepts the connections of `fd`, a listening socket bound by another process, instead of
+    // binding one. Processes that accept from the same socket share its queue of connections.
+    // Returns the bound port, or -1 if `fd` is not a listening socket.
+    int Adopt(int fd);
+
+    // Serves connections until Stop() is called. Returns false if the server failed.
+    bool Listen();
+
+    // Can be called from any thread, including a signal handler.
+    void Stop();
+
+    // Lets the handler running on this thread leave the reply to its request for later: the
+    // response it leaves is dropped, and the connection waits without a worker. The returned
+    // function resumes the request and may be called from any thread, but shouldn't block;
+    // `respond` then makes the reply on a worker. A request that isn't resumed within
+    // `timeout` resumes by itself. `respond` also runs, with a response that is dropped, if the
+    // server exits first. Returns null if the thread isn't running a handler of an EventServer.
+    using Respond = std::function<void(httplib::Response*)>;
+    static std::function<void()> Park(std::chrono::milliseconds timeout, Respond respond);
+
+    // Requests larger than these are refused and their connections closed.
+    static constexpr size_t kMaxHeaderSize = 64 * 1024;
+    static constexpr size_t kMaxBodySize = 64 * 1024 * 1024;
+    static constexpr size_t kMaxPendingChunks = 256 * 1024;
+
+   private:
+    // The chunks of a streamed response, passed from its worker to the loop.
+    struct Stream {
+        std::mutex mu;
+        // Signalled when the loop takes the pending chunks or the connection is closed.
+        std::condition_variable drained;
+        // Chunk-encoded bytes that the loop has not taken yet.
+        std::string pending;
+        // The loop ran out of chunks and waits for the worker to wake it up.
+        bool waiting = false;
+        // The provider returned; `failed` if it didn't send the terminating chunk.
+        bool finished = false;
+        bool failed = false;
+        // The connection is gone, the provider should stop.
+        bool closed = false;
+
+        void Close() {
+            std::lock_guard<std::mutex> lock(mu);
+            closed = true;
+            drained.notify_all();
+        }
+    };
+
+    // A request parked by its handler.
+    struct Parked {
+        EventServer* server;
+        uint64_t connection;
+        std::shared_ptr<httplib::Request> req;
+        bool keep_alive;
+        std::chrono::steady_clock::time_point deadline;
+        Respond respond;
+        // Only the first of the resumption, the timeout and the exit runs `respond`.
+        std::atomic<bool> resumed = false;
+    };
+
+    // The request of the handler running on a worker, for Park().
+    struct Handling {
+        EventServer* server;
+        uint64_t connection;
+        std::shared_ptr<httplib::Request> req;
+        bool keep_alive;
+        // Set by Park().
+        std::shared_ptr<Parked> parked;
+    };
+    static thread_local Handling* handling_;
+
+    struct Connection {
+        int fd;
+        std::string remote_addr;
+        int remote_port;
+        // Bytes read and not parsed yet.
+        std::string in;
+        // The response being written.
+        std::string out;
+        size_t written = 0;
+        // A worker is handling a request of the connection.
+        bool busy = false;
+        bool close_after_write = false;
+        // Set while the response is streamed; `out` is refilled from it.
+        std::shared_ptr<Stream> stream;
+    };
+
+    // A response made by a worker for the loop to write.
+    struct Completion {
+        uint64_t connection;
+        std::string response;
+        bool keep_alive;
+        // Set if the body follows in chunks.
+        std::shared_ptr<Stream> stream;
+        // Set instead of the response if the handler parked the request.
+        std::shared_ptr<Parked> parked;
+    };
+
+    void Accept();
+    void Read(uint64_t id, Connection* conn);
+    // Starts handling the next buffered request of the connection, if it has a whole one.
+    void Parse(uint64_t id, Connection* conn);
+    void Write(uint64_t id, Connection* conn);
+    // Runs the content provider of `res` on the worker thread, passing its chunks to the loop.
+    void StreamBody(uint64_t id, httplib::Response* res, Stream* stream);
+    // Passes the response a worker made to the loop, and streams its body if it has one.
+    void Finish(uint64_t id, const httplib::Request& req, httplib::Response* res,
+                bool keep_alive);
+    // Called by the function Park() returns.
+    void Resume(std::shared_ptr<Parked> parked);
+    // Runs `respond` of a resumed request on a worker.
+    void Unpark(std::shared_ptr<Parked> parked);
+    // Resumes the parked requests whose deadline has passed. Returns the milliseconds until the
+    // next deadline, or -1 if no request is parked.
+    int Expire();
+    // Moves the pending chunks to `out`. Returns false if there are none yet.
+    bool Refill(Connection* conn);
+    // Wakes the loop up to send what the worker has streamed. Called with `stream->mu` held.
+    void Notify(uint64_t id, Stream* stream);
+    void Reply(uint64_t id, Connection* conn, std::string response, bool keep_alive);
+    void Close(uint64_t id);
+    void Watch(uint64_t id, Connection* conn, uint32_t events);
+    void Complete();
+
+    Handler handler_;
+    Logger logger_;
+
+    int listener_ = -1;
+    const int epoll_;
+    // Wakes the loop up when a worker completes a request or Stop() is called.
+    const int wakeup_;
+    std::atomic<bool> stopping_ = false;
+
+    // Owned by the loop thread.
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections_;
+    uint64_t next_id_;
+    // Parked requests by deadline, including resumed ones until their deadline passes.
+    std::multimap<std::chrono::steady_clock::time_point, std::shared_ptr<Parked>> deadlines_;
+
+    std::mutex mu_;
+    std::deque<Completion> completions_;
+    // Connections whose streams have chunks for the loop that waits for them.
+    std::vector<uint64_t> streaming_;
+    // Parked requests that were resumed.
+    std::vector<std::shared_ptr<Parked>> resumed_;
+    // Listen() returned; nothing is streamed or resumed anymore.
+    bool exited_ = false;
+
+    // Declared last, so that it is destroyed first and waits for the requests in flight.
+    std::unique_ptr<ThreadPool> workers_;
+};
+
+}  // namespace foodculator
+
+#endif
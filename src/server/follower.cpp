@@ -0,0 +1,223 @@
+#include "follower.h"
+
+#include <algorithm>
+#include <charconv>
+#include <optional>
+#include <utility>
+
+#include "fmt/format.h"
+#include "httplib.h"
+
+namespace foodculator {
+
+namespace {
+
+// Reads a number the leader sent as a string, like all numbers in the API.
+template <class T>
+bool ParseNumber(const json11::Json& value, T* out) {
+    const std::string& str = value.string_value();
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), *out);
+    return !str.empty() && ec == std::errc() && ptr == str.data() + str.size();
+}
+
+std::optional<Ingredient> ParseIngredient(const json11::Json& json) {
+    Ingredient ret(json["name"].string_value(), 0);
+    if (!ParseNumber(json["kcal"], &ret.kcal) || !ParseNumber(json["id"], &ret.id)) {
+        return std::nullopt;
+    }
+    for (size_t idx = 0; idx < kNutrientCount; ++idx) {
+        const auto& value = json["nutrients"][std::string(ToString(static_cast<Nutrient>(idx)))];
+        if (!ParseNumber(value, &ret.nutrients[idx])) {
+            return std::nullopt;
+        }
+    }
+    return ret;
+}
+
+std::optional<Tableware> ParseTableware(const json11::Json& json) {
+    Tableware ret(json["name"].string_value(), 0);
+    if (!ParseNumber(json["weight"], &ret.weight) || !ParseNumber(json["id"], &ret.id)) {
+        return std::nullopt;
+    }
+    return ret;
+}
+
+bool ParseWeights(const json11::Json& json, std::vector<RecipeIngredient>* out) {
+    for (const auto& v : json.array_items()) {
+        RecipeIngredient& row = out->emplace_back(0, 0);
+        if (!ParseNumber(v["id"], &row.ingredient_id) || !ParseNumber(v["weight"], &row.weight)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::optional<FullRecipe> ParseRecipe(const json11::Json& json) {
+    FullRecipe ret;
+    ret.header.name = json["header"]["name"].string_value();
+    ret.description = json["description"].string_value();
+    if (!ParseNumber(json["header"]["id"], &ret.header.id) ||
+        !ParseNumber(json["version"], &ret.version) ||
+        !ParseWeights(json["ingredients"], &ret.ingredients) ||
+        !ParseWeights(json["subrecipes"], &ret.subrecipes)) {
+        return std::nullopt;
+    }
+    return ret;
+}
+
+template <class T, class ParseRow>
+bool ParseDelta(const json11::Json& json, ParseRow parse_row, RowDelta<T>* out) {
+    if (!ParseNumber(json["version"], &out->version) || !json["reset"].is_bool()) {
+        return false;
+    }
+    out->reset = json["reset"].bool_value();
+    for (const auto& v : json["changed"].array_items()) {
+        std::optional<T> row = parse_row(v);
+        if (!row) {
+            return false;
+        }
+        out->changed.push_back(std::move(*row));
+    }
+    for (const auto& v : json["deleted"].array_items()) {
+        if (!ParseNumber(v, &out->deleted.emplace_back())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+class HttpLeaderApi : public LeaderApi {
+   public:
+    explicit HttpLeaderApi(const std::string& url) : cli_(url) {}
+
+    StatusOr<ReplicationBatch> Fetch(const ReplicationCursor& after,
+                                     std::chrono::seconds timeout) override {
+        // The leader answers within `timeout`, unless it's gone.
+        cli_.set_read_timeout(timeout.count() + 10);
+        auto res = cli_.Get(fmt::format("/replication?since={}&kind={}&id={}&timeout={}",
+                                        after.version, after.kind, after.id, timeout.count())
+                                .c_str());
+        if (!res) {
+            return {StatusCode::INTERNAL_ERROR, "The leader can't be reached."};
+        }
+        if (res->status != 200) {
+            return {StatusCode::INTERNAL_ERROR,
+                    fmt::format("The leader replied with {}: {}", res->status, res->body)};
+        }
+
+        std::string err;
+        const auto json = json11::Json::parse(res->body, err);
+        if (!err.empty()) {
+            return {StatusCode::INTERNAL_ERROR, "The leader replied with bad json: " + err};
+        }
+        return ParseReplicationBatch(json);
+    }
+
+   private:
+    httplib::Client cli_;
+};
+
+}  // namespace
+
+std::unique_ptr<LeaderApi> CreateHttpLeaderApi(const std::string& url) {
+    return std::make_unique<HttpLeaderApi>(url);
+}
+
+StatusOr<ReplicationBatch> ParseReplicationBatch(const json11::Json& json) {
+    ReplicationBatch ret;
+    if (!ParseDelta(json["ingredients"], ParseIngredient, &ret.ingredients) ||
+        !ParseDelta(json["tableware"], ParseTableware, &ret.tableware) ||
+        !ParseDelta(json["recipes"], ParseRecipe, &ret.recipes)) {
+        return {StatusCode::INVALID_ARGUMENT, "Malformed replication batch."};
+    }
+    ret.more = json["more"].bool_value();
+    const auto& next = json["next"];
+    if (ret.more && (!ParseNumber(next["version"], &ret.next.version) ||
+                     !ParseNumber(next["kind"], &ret.next.kind) ||
+                     !ParseNumber(next["id"], &ret.next.id))) {
+        return {StatusCode::INVALID_ARGUMENT, "Malformed replication batch."};
+    }
+    return StatusOr{std::move(ret)};
+}
+
+Follower::Follower(DB* db, LeaderApi* leader, std::chrono::seconds max_staleness)
+    : db_(db),
+      leader_(leader),
+      max_staleness_(max_staleness) {
+    auto version = db_->ReplicatedVersion();
+    if (version.Ok()) {
+        version_ = version.Value();
+    }
+}
+
+StatusCode Follower::SyncOnce(std::chrono::seconds timeout) {
+    const auto started = std::chrono::steady_clock::now();
+    auto batch = leader_->Fetch(ReplicationCursor{reload_ ? 0 : version_.load()}, timeout);
+    if (!batch.Ok()) {
+        fmt::print(stderr, "[follower] {}\n", batch.Error());
+        return batch.Code();
+    }
+
+    // The batches after the first one are read inside the transaction, so they don't wait.
+    uint64_t version = batch.Value().version();
+    bool fetched = true;
+    auto next = [this, &version, &fetched](const ReplicationCursor& after) {
+        auto ret = leader_->Fetch(after, std::chrono::seconds(0));
+        if (ret.Ok()) {
+            version = ret.Value().version();
+        } else {
+            fmt::print(stderr, "[follower] {}\n", ret.Error());
+            fetched = false;
+        }
+        return ret;
+    };
+    if (!batch.Value().empty()) {
+        if (auto code = db_->ApplyReplication(batch.Value(), next); code != StatusCode::OK) {
+            // A leader that went away mid-way is asked for the same writes again.
+            if (fetched) {
+                fmt::print(stderr, "[follower] Can't apply the writes after version {}\n",
+                           version_.load());
+                reload_ = true;
+            }
+            return code;
+        }
+    }
+    reload_ = false;
+    version_ = version;
+    synced_at_ = started.time_since_epoch().count();
+    return StatusCode::OK;
+}
+
+void Follower::Run() {
+    // Long polls shorter than the staleness bound keep the copy fresh while nothing is written.
+    const auto timeout = std::max(std::chrono::seconds(1), max_staleness_ / 2);
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!stopping_) {
+        lock.unlock();
+        const bool ok = SyncOnce(timeout) == StatusCode::OK;
+        lock.lock();
+        if (!ok) {
+            cv_.wait_for(lock, std::chrono::seconds(1), [this] { return stopping_; });
+        }
+    }
+}
+
+void Follower::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+}
+
+bool Follower::IsFresh() const {
+    const int64_t ticks = synced_at_.load();
+    if (ticks == kNever) {
+        return false;
+    }
+    const auto synced_at =
+        std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(ticks));
+    return std::chrono::steady_clock::now() - synced_at <= max_staleness_;
+}
+
+}  // namespace foodculator
@@ -0,0 +1,81 @@
+#ifndef __SRC_SERVER_FOLLOWER_H__
+#define __SRC_SERVER_FOLLOWER_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "db/db.h"
+#include "json11/json11.hpp"
+#include "util/statusor.h"
+
+namespace foodculator {
+
+// LeaderApi is the replication endpoint of the leader, GET /replication.
+class LeaderApi {
+   public:
+    virtual ~LeaderApi() = default;
+
+    // Returns the writes after `after`, or the first of them with `more` set. If there are
+    // none, the leader waits up to `timeout` for one.
+    virtual StatusOr<ReplicationBatch> Fetch(const ReplicationCursor& after,
+                                             std::chrono::seconds timeout) = 0;
+};
+
+// Returns LeaderApi talking to the server at `url`, e.g. "http://10.0.0.1:1234".
+std::unique_ptr<LeaderApi> CreateHttpLeaderApi(const std::string& url);
+
+// Reads the reply of GET /replication, see ReplicationBatch::to_json().
+StatusOr<ReplicationBatch> ParseReplicationBatch(const json11::Json& json);
+
+// Follower keeps `db` a read-only copy of the leader's database by tailing its writes.
+//
+// Every batch is applied in one transaction together with the leader's version it brings the
+// copy to, so a restarted follower picks up where it stopped. The leader splits a long
+// backlog into several batches; they are fetched one after another and go in the same
+// transaction, so only one of them is held in memory at a time. A batch that fails to apply,
+// e.g. because of a conflict with rows written to the copy directly, is retried by reloading
+// the whole tables.
+class Follower {
+   public:
+    // The copy counts as fresh while it has everything the leader had `max_staleness` ago.
+    Follower(DB* db, LeaderApi* leader, std::chrono::seconds max_staleness);
+
+    // Fetches and applies one batch, waiting up to `timeout` for the leader to have one.
+    StatusCode SyncOnce(std::chrono::seconds timeout);
+
+    // Syncs until Stop() is called, retrying every second while the leader is down.
+    void Run();
+    void Stop();
+
+    // True if the copy has everything the leader had `max_staleness` ago.
+    bool IsFresh() const;
+    // The leader's version the copy is at.
+    uint64_t version() const { return version_.load(); }
+
+   private:
+    DB* const db_;
+    LeaderApi* const leader_;
+    const std::chrono::seconds max_staleness_;
+
+    std::atomic<uint64_t> version_ = 0;
+    // Set when a batch failed to apply, so that the next request reloads everything.
+    bool reload_ = false;
+    // When the last successful request to the leader was sent, in steady_clock ticks. The copy
+    // has everything the leader had then.
+    static constexpr int64_t kNever = std::numeric_limits<int64_t>::min();
+    std::atomic<int64_t> synced_at_ = kNever;
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+};
+
+}  // namespace foodculator
+
+#endif
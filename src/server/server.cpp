@@ -0,0 +1,1162 @@
+#include "server.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "db/changelog.h"
+#include "fmt/format.h"
+#include "json11/json11.hpp"
+#include "plan/meal_plan.h"
+#include "server/catalog_export.h"
+#include "util/timing.h"
+
+namespace foodculator {
+
+namespace {
+std::string ReadHtml(const std::string& path) {
+    std::ifstream in(path);
+    std::string str{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    in.close();
+    return str;
+}
+
+// The content type of a static file by its extension.
+const char* StaticContentType(std::string_view path) {
+    const std::string_view extension = path.substr(std::min(path.size(), path.rfind('.') + 1));
+    if (extension == "html") {
+        return "text/html";
+    }
+    if (extension == "js") {
+        return "text/javascript";
+    }
+    if (extension == "css") {
+        return "text/css";
+    }
+    if (extension == "svg") {
+        return "image/svg+xml";
+    }
+    if (extension == "png") {
+        return "image/png";
+    }
+    if (extension == "json") {
+        return "application/json";
+    }
+    return "application/octet-stream";
+}
+
+void ReplyErr(std::string msg, int status, httplib::Response* res) {
+    res->set_content(std::move(msg), "text/plain");
+    res->status = status;
+}
+
+json11::Json ParseBody(const httplib::Request& req, std::string* err) {
+    TimingSpan span("parse");
+    return json11::Json::parse(req.body, *err);
+}
+
+// Replies with `value` converted to json.
+template <class T>
+void ReplyJson(T&& value, httplib::Response* res) {
+    TimingSpan span("serialize");
+    res->set_content(json11::Json(std::forward<T>(value)).dump(), "text/json");
+}
+
+// Parses a non-negative integer query parameter. Returns `def` if the parameter is absent.
+std::optional<uint64_t> ParseUintParam(const httplib::Request& req, const char* name,
+                                       uint64_t def) {
+    if (!req.has_param(name)) {
+        return def;
+    }
+
+    const std::string value = req.get_param_value(name);
+    uint64_t ret = 0;
+    auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), ret);
+    if (ec != std::errc() || ptr != value.data() + value.size()) {
+        return std::nullopt;
+    }
+    return ret;
+}
+
+// Parses a number query parameter. Returns `def` if the parameter is absent.
+std::optional<float> ParseFloatParam(const httplib::Request& req, const char* name, float def) {
+    if (!req.has_param(name)) {
+        return def;
+    }
+
+    const std::string value = req.get_param_value(name);
+    float ret = 0;
+    auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), ret);
+    if (ec != std::errc() || ptr != value.data() + value.size()) {
+        return std::nullopt;
+    }
+    return ret;
+}
+
+// Reads a list of {"id": <number>, "weight": <number>} objects into `out`. Returns the error to
+// reply with, or an empty string.
+std::string ParseWeights(const json11::Json& list, std::map<size_t, uint32_t>* out) {
+    std::string err;
+    for (const auto& v : list.array_items()) {
+        if (!v.has_shape({{"id", json11::Json::NUMBER}, {"weight", json11::Json::NUMBER}}, err)) {
+            return "Each ingredient and sub-recipe should have id and weight number fields.";
+        }
+
+        double id = v["id"].number_value();
+        double weight = v["weight"].number_value();
+        if (id < 0.0 || weight < 0.0) {
+            return "id and weight must be >= 0.";
+        }
+
+        (*out)[static_cast<size_t>(id)] = static_cast<uint32_t>(weight);
+    }
+    return "";
+}
+
+// Reads the name, description, ingredients and sub-recipes of a recipe from the body of
+// /create_recipe or PUT /recipe/<id>. Returns the error to reply with, or an empty string.
+std::string ParseRecipe(const json11::Json& input, std::string* name, std::string* description,
+                        std::map<size_t, uint32_t>* ingredients,
+                        std::map<size_t, uint32_t>* subrecipes) {
+    *name = input["header"]["name"].string_value();
+    if (name->empty()) {
+        return "Recipe name should not be empty.";
+    }
+
+    if (auto err = ParseWeights(input["ingredients"], ingredients); !err.empty()) {
+        return err;
+    }
+    if (auto err = ParseWeights(input["subrecipes"], subrecipes); !err.empty()) {
+        return err;
+    }
+
+    *description = input["description"].string_value();
+    return "";
+}
+
+void AppendQueryParam(std::string_view value, std::string* out) {
+    for (char c : value) {
+        if (std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '.' || c == '_' ||
+            c == '~') {
+            out->push_back(c);
+        } else {
+            *out += fmt::format("%{:02X}", static_cast<unsigned char>(c));
+        }
+    }
+}
+
+// Returns the path of `req` with its query string, which httplib has already split into params.
+std::string RequestTarget(const httplib::Request& req) {
+    std::string ret = req.path;
+    char sep = '?';
+    for (const auto& [key, value] : req.params) {
+        ret += sep;
+        AppendQueryParam(key, &ret);
+        ret += '=';
+        AppendQueryParam(value, &ret);
+        sep = '&';
+    }
+    return ret;
+}
+
+// The kitchen whose server handles the request on this thread. Replies streamed after the
+// handler returns hold on to it, so that the pool doesn't close its database under them.
+thread_local std::shared_ptr<Tenant> dispatched_tenant;
+
+// The timing of the last request handled on this thread, for the logger.
+thread_local std::string logged_timing;
+
+// Parks the request in the event loop until `changes` has changes after `since` or `timeout`
+// passes, and then replies with `respond` on a worker. Returns false if the request can't be
+// parked, i.e. under httplib.
+bool ParkUntilChange(const ChangeLog& changes, uint64_t since, std::chrono::milliseconds timeout,
+                     EventServer::Respond respond) {
+    auto subscription = std::make_shared<std::atomic<uint64_t>>(0);
+    auto resume = EventServer::Park(timeout, [&changes, subscription, respond = std::move(respond),
+                                              tenant = dispatched_tenant](httplib::Response* res) {
+        changes.Unsubscribe(*subscription);
+        // The reply is made and logged on a thread that may have timed another request.
+        logged_timing.clear();
+        respond(res);
+    });
+    if (!resume) {
+        return false;
+    }
+    *subscription = changes.Subscribe(since, std::move(resume));
+    return true;
+}
+
+CapturedRequest Capture(uint64_t arrival_us, const httplib::Request& req,
+                        const httplib::Response& res) {
+    CapturedRequest ret;
+    ret.arrival_us = arrival_us;
+    ret.method = req.method;
+    ret.target = RequestTarget(req);
+    ret.body = req.body;
+    // httplib replaces the default status with 200 only after the handler returns.
+    ret.status = res.status == -1 ? 200 : res.status;
+    ret.response_size = res.body.size();
+    ret.response_hash = HashBody(res.body);
+    return ret;
+}
+
+// Replies to a `?since=<version>` request to one of the list endpoints with the rows written
+// after that version.
+template <class GetSince>
+void ReplyDelta(const httplib::Request& req, GetSince get_since, httplib::Response* res) {
+    auto since = ParseUintParam(req, "since", 0);
+    if (!since) {
+        ReplyErr("`since` should be a non-negative integer.", 400, res);
+        return;
+    }
+
+    auto delta = get_since(*since);
+    if (!delta.Ok()) {
+        ReplyErr(std::move(delta.Error()), 500, res);
+        return;
+    }
+    ReplyJson(delta.Value(), res);
+}
+
+}  // namespace
+
+ThreadPool* Server::SolverPool() {
+    // With the thread of the request, every core gets a thread.
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return &pool;
+}
+
+Server::Server(DB* db, std::string path_to_static, std::string version)
+    : Server(db, nullptr, std::move(path_to_static), std::move(version)) {}
+
+Server::Server(TenantPool* tenants, std::string path_to_static, std::string version)
+    : Server(nullptr, tenants, std::move(path_to_static), std::move(version)) {}
+
+Server::Server(DB* db, TenantPool* tenants, std::string path_to_static, std::string version)
+    : db_(db),
+      path_to_static_(std::move(path_to_static)),
+      version_(std::move(version)),
+      dialogflow_(db),
+      report_(db, SolverPool()),
+      tenants_(tenants) {
+    AddRoutes();
+
+    // All API routes are dispatched by `router_`. A request without a body is dispatched before
+    // httplib routes it, so that it isn't matched against a regex, unless it is for the static
+    // files of the mount point. httplib reads the body only before it runs its regex-based
+    // handlers, so the other requests come from catch-all handlers.
+    srv_.set_mount_point("/static", path_to_static_.c_str());
+    const auto dispatch = [this](const httplib::Request& req, httplib::Response& res) {
+        if (!Dispatch(req, &res)) {
+            ReplyErr("Not found.", 404, &res);
+        }
+    };
+    srv_.set_pre_routing_handler([dispatch](const httplib::Request& req, httplib::Response& res) {
+        constexpr std::string_view kStatic = "/static/";
+        const bool has_body = req.method == "POST" || req.method == "PUT" ||
+                              req.method == "PATCH" || req.has_header("Content-Length") ||
+                              req.has_header("Transfer-Encoding");
+        if (has_body || std::string_view(req.path).substr(0, kStatic.size()) == kStatic) {
+            return httplib::Server::HandlerResponse::Unhandled;
+        }
+        dispatch(req, res);
+        return httplib::Server::HandlerResponse::Handled;
+    });
+    srv_.Get(".*", dispatch);
+    srv_.Post(".*", dispatch);
+    srv_.Put(".*", dispatch);
+    srv_.Delete(".*", dispatch);
+}
+
+bool Server::Dispatch(const httplib::Request& req, httplib::Response* res) {
+    // A parked request leaves its timing behind without being logged.
+    logged_timing.clear();
+    if (tenants_ != nullptr && DispatchToTenant(req, res)) {
+        return true;
+    }
+
+    RouteParams params;
+    const Handler* handler = router_.Match(req.method, req.path, &params);
+    if (handler == nullptr) {
+        return false;
+    }
+
+    if (follower_ != nullptr) {
+        // POST routes that only compute something from the tables are reads too.
+        const bool read = req.method == "GET" || req.path == "/calculate" ||
+                          req.path == "/plan" || req.path == "/dialogflow";
+        if (!read) {
+            ReplyErr("This is a read-only copy. Send writes to the leader.", 403, res);
+            return true;
+        }
+        if (!follower_->IsFresh()) {
+            ReplyErr("This copy has fallen behind the leader. Try the leader.", 503, res);
+            return true;
+        }
+    }
+
+    std::optional<RequestTiming> timing;
+    if (req.has_header(kTimingHeader) ||
+        (timing_sample_ > 0 && timed_requests_.fetch_add(1) % timing_sample_ == 0)) {
+        timing.emplace();
+    }
+    const uint64_t arrival_us = capture_ != nullptr ? capture_->Now() : 0;
+    {
+        TimingSpan span("total");
+        (*handler)(req, *res, params);
+    }
+
+    if (timing) {
+        logged_timing = timing->ToHeader();
+        if (req.has_header(kTimingHeader)) {
+            res->set_header("Server-Timing", logged_timing);
+        }
+    }
+    if (capture_ != nullptr) {
+        capture_->Append(Capture(arrival_us, req, *res));
+    }
+    return true;
+}
+
+bool Server::DispatchToTenant(const httplib::Request& req, httplib::Response* res) {
+    constexpr std::string_view kPrefix = "/t/";
+    const std::string_view path = req.path;
+    std::string name;
+    // Only a prefixed request has to be copied, to strip the prefix from its path.
+    std::optional<httplib::Request> stripped;
+    if (path.substr(0, kPrefix.size()) == kPrefix) {
+        const size_t end = std::min(path.find('/', kPrefix.size()), path.size());
+        name = path.substr(kPrefix.size(), end - kPrefix.size());
+        stripped.emplace(req);
+        stripped->path = end < path.size() ? path.substr(end) : "/";
+    } else if (req.has_header(kTenantHeader)) {
+        name = req.get_header_value(kTenantHeader);
+    } else {
+        return false;
+    }
+
+    auto tenant = tenants_->Acquire(name);
+    if (!tenant.Ok()) {
+        const int code = tenant.Code() == StatusCode::INVALID_ARGUMENT ? 400
+                         : tenant.Code() == StatusCode::NOT_FOUND      ? 404
+                                                                       : 500;
+        ReplyErr(std::move(tenant.Error()), code, res);
+        return true;
+    }
+    dispatched_tenant = tenant.Value();
+    const bool handled = tenant.Value()->server->Dispatch(stripped ? *stripped : req, res);
+    dispatched_tenant.reset();
+    return handled;
+}
+
+void Server::Handle(const httplib::Request& req, httplib::Response* res) {
+    if (Dispatch(req, res)) {
+        return;
+    }
+
+    constexpr std::string_view kStatic = "/static/";
+    std::string_view path = req.path;
+    if (req.method == "GET" && path.substr(0, kStatic.size()) == kStatic &&
+        path.find("..") == std::string_view::npos) {
+        std::ifstream in(path_to_static_ + std::string(path.substr(kStatic.size() - 1)),
+                         std::ios::binary);
+        if (in) {
+            const std::string content{std::istreambuf_iterator<char>(in),
+                                      std::istreambuf_iterator<char>()};
+            res->set_content(content, StaticContentType(path));
+            return;
+        }
+    }
+    ReplyErr("Not found.", 404, res);
+}
+
+void Server::UseEventLoop(size_t workers) {
+    // Long polls are parked in the loop, so they don't take workers.
+    event_server_ = std::make_unique<EventServer>(
+        [this](const httplib::Request& req, httplib::Response* res) { Handle(req, res); },
+        workers);
+}
+
+void Server::SetLogger(Logger logger) {
+    // Both servers call the logger on the thread that ran the handler.
+    auto log = [logger = std::move(logger)](const httplib::Request& req,
+                                            const httplib::Response& res) {
+        logger(req, res, logged_timing);
+        logged_timing.clear();
+    };
+    if (event_server_) {
+        event_server_->SetLogger(log);
+    }
+    srv_.set_logger(std::move(log));
+}
+
+int Server::Bind(const std::string& host, int port) {
+    if (event_server_) {
+        return event_server_->Bind(host, port);
+    }
+    if (port == 0) {
+        return srv_.bind_to_any_port(host.c_str());
+    }
+    return srv_.bind_to_port(host.c_str(), port) ? port : -1;
+}
+
+int Server::Adopt(int fd) { return event_server_ ? event_server_->Adopt(fd) : -1; }
+
+bool Server::Listen() { return event_server_ ? event_server_->Listen() : srv_.listen_after_bind(); }
+
+void Server::Stop() {
+    if (event_server_) {
+        event_server_->Stop();
+        return;
+    }
+    srv_.stop();
+}
+
+void Server::AddRoutes() {
+    router_.Add("GET", "/version", [this](const httplib::Request& req, httplib::Response& res,
+                                          const RouteParams& params) {
+        res.set_content("Foodculator version: " + version_, "text/plain");
+    });
+
+    // The rest are served by the servers of the tenants.
+    if (tenants_ != nullptr) {
+        return;
+    }
+
+    DB* db = db_;
+
+    std::vector<std::pair<const char*, const char*>> html_pages = {
+        {"/", "/index.html"},
+        {"/ingredients", "/ingredients.html"},
+        {"/tableware", "/tableware.html"},
+        {"/recipe", "/recipe.html"},
+    };
+
+    for (const auto& [page, path] : html_pages) {
+        router_.Add("GET", page,
+                   [abs_path = (path_to_static_ + path)](const httplib::Request& req,
+                                                        httplib::Response& res,
+                                                        const RouteParams& params) {
+                       res.set_content(ReadHtml(abs_path), "text/html");
+                   });
+    }
+
+    router_.Add("GET", "/get_ingredients", [this, db](const httplib::Request& req,
+                                                      httplib::Response& res,
+                                                      const RouteParams& params) {
+        if (req.has_param("since")) {
+            ReplyDelta(req, [db](uint64_t since) { return db->GetProductsSince(since); }, &res);
+            return;
+        }
+
+        if (auto cached = snapshot_ ? snapshot_->GetProducts() : std::nullopt) {
+            ReplyJson(std::move(*cached), &res);
+            return;
+        }
+        auto products = db->GetProducts();
+        if (!products.Ok()) {
+            ReplyErr(std::move(products.Error()), 500, &res);
+            return;
+        }
+        ReplyJson(std::move(products.Value()), &res);
+    });
+
+    router_.Add("POST", "/add_ingredient", [db](const httplib::Request& req, httplib::Response& res,
+                                                const RouteParams& params) {
+        std::string err;
+        json11::Json input = ParseBody(req, &err);
+        if (!err.empty()) {
+            ReplyErr("Failed to parse the request: " + err, 400, &res);
+            return;
+        }
+
+        std::string name = input["product"].string_value();
+        if (name.empty() || !input.has_shape({{"kcal", json11::Json::NUMBER}}, err)) {
+            ReplyErr("Ingredient should have `product` (string) and `kcal` (number) fields.", 400,
+                     &res);
+            return;
+        }
+
+        double kcal = input["kcal"].number_value();
+        if (kcal < 0.0) {
+            ReplyErr("Ingredient cannot have negative `kcal` value.", 400, &res);
+            return;
+        }
+
+        // Nutrients are optional, e.g. {"protein": 3.2, "fat": 2.5}, in grams per 100g.
+        Nutrients nutrients = {};
+        for (size_t idx = 0; idx < kNutrientCount; ++idx) {
+            const auto& value = input[std::string(ToString(static_cast<Nutrient>(idx)))];
+            if (value.is_null()) {
+                continue;
+            }
+            if (!value.is_number() || value.number_value() < 0.0) {
+                ReplyErr("Nutrients of an ingredient should be non-negative numbers.", 400, &res);
+                return;
+            }
+            nutrients[idx] = static_cast<float>(value.number_value());
+        }
+
+        auto st = db->AddProduct(std::move(name), static_cast<uint32_t>(kcal), nutrients);
+        if (!st.Ok()) {
+            ReplyErr(std::move(st.Error()), 500, &res);
+            return;
+        }
+        res.set_content(std::to_string(st.Value()), "text/plain");
+    });
+
+    router_.Add("GET", "/ingredient/:id", [this, db](const httplib::Request& req,
+                                                     httplib::Response& res,
+                                                     const RouteParams& params) {
+        size_t id = params[0];
+        if (auto cached = snapshot_ ? snapshot_->GetProduct(id) : std::nullopt) {
+            ReplyJson(std::move(*cached), &res);
+            return;
+        }
+        auto product = db->GetProduct(id);
+        if (!product.Ok()) {
+            int code = (product.Code() == StatusCode::NOT_FOUND) ? 404 : 500;
+            ReplyErr(std::move(product.Error()), code, &res);
+            return;
+        }
+        ReplyJson(std::move(product.Value()), &res);
+    });
+
+    router_.Add("DELETE", "/ingredient/:id", [db](const httplib::Request& req,
+                                                  httplib::Response& res,
+                                                  const RouteParams& params) {
+        if (!db->DeleteProduct(params[0])) {
+            ReplyErr("DB request failed. Try again later.", 500, &res);
+        }
+    });
+
+    router_.Add("GET", "/get_tableware", [this, db](const httplib::Request& req,
+                                                    httplib::Response& res,
+                                                    const RouteParams& params) {
+        if (req.has_param("since")) {
+            ReplyDelta(req, [db](uint64_t since) { return db->GetTablewareSince(since); }, &res);
+            return;
+        }
+
+        if (auto cached = snapshot_ ? snapshot_->GetTableware() : std::nullopt) {
+            ReplyJson(std::move(*cached), &res);
+            return;
+        }
+
+        auto tw = db->GetTableware();
+        if (!tw.Ok()) {
+            ReplyErr(std::move(tw.Error()), 500, &res);
+            return;
+        }
+        ReplyJson(std::move(tw.Value()), &res);
+    });
+
+    router_.Add("POST", "/add_tableware", [db](const httplib::Request& req, httplib::Response& res,
+                                               const RouteParams& params) {
+        std::string err;
+        json11::Json input = ParseBody(req, &err);
+        if (!err.empty()) {
+            ReplyErr("Failed to parse the request: " + err, 400, &res);
+            return;
+        }
+
+        std::string name = input["name"].string_value();
+        if (name.empty() || !input.has_shape({{"weight", json11::Json::NUMBER}}, err)) {
+            ReplyErr("The pot should have `name` (string) and `weight` (number) fields.", 400,
+                     &res);
+            return;
+        }
+        double weight_double = input["weight"].number_value();
+        if (weight_double < 0.0) {
+            ReplyErr("The weight couldn't be negative.", 400, &res);
+            return;
+        }
+
+        uint32_t weight = static_cast<uint32_t>(weight_double);
+        auto st = db->AddTableware(std::move(name), weight);
+        if (!st.Ok()) {
+            ReplyErr(std::move(st.Error()), 500, &res);
+            return;
+        }
+        res.set_content(std::to_string(st.Value()), "text/plain");
+    });
+
+    router_.Add("DELETE", "/tableware/:id", [db](const httplib::Request& req,
+                                                 httplib::Response& res,
+                                                 const RouteParams& params) {
+        if (!db->DeleteTableware(params[0])) {
+            ReplyErr("A pot wasn't deleted. Some SQL error occured.", 500, &res);
+        }
+    });
+
+    router_.Add("GET", "/get_recipes", [this, db](const httplib::Request& req,
+                                                  httplib::Response& res,
+                                                  const RouteParams& params) {
+        if (req.has_param("since")) {
+            ReplyDelta(req, [db](uint64_t since) { return db->GetRecipesSince(since); }, &res);
+            return;
+        }
+
+        if (auto cached = snapshot_ ? snapshot_->GetRecipes() : std::nullopt) {
+            ReplyJson(std::move(*cached), &res);
+            return;
+        }
+
+        auto recipes = db->GetRecipes();
+        if (!recipes.Ok()) {
+            ReplyErr(std::move(recipes.Error()), 500, &res);
+            return;
+        }
+        ReplyJson(std::move(recipes.Value()), &res);
+    });
+
+    router_.Add("GET", "/search_recipes", [db](const httplib::Request& req,
+                                               httplib::Response& res,
+                                               const RouteParams& params) {
+        auto offset = ParseUintParam(req, "offset", 0);
+        auto limit = ParseUintParam(req, "limit", kSearchPageSize);
+        if (!offset || *offset > UINT32_MAX || !limit || *limit == 0 ||
+            *limit > kMaxSearchPageSize) {
+            ReplyErr(fmt::format("`offset` should be a non-negative integer and `limit` a number "
+                                 "from 1 to {}.",
+                                 kMaxSearchPageSize),
+                     400, &res);
+            return;
+        }
+
+        // One more recipe tells if there is a next page.
+        auto found = db->SearchRecipes(req.get_param_value("q"), static_cast<uint32_t>(*offset),
+                                       static_cast<uint32_t>(*limit) + 1);
+        if (!found.Ok()) {
+            int code = (found.Code() == StatusCode::INVALID_ARGUMENT) ? 400 : 500;
+            ReplyErr(std::move(found.Error()), code, &res);
+            return;
+        }
+
+        auto& recipes = found.Value();
+        json11::Json next_offset;
+        if (recipes.size() > *limit) {
+            recipes.pop_back();
+            next_offset = std::to_string(*offset + *limit);
+        }
+        ReplyJson(json11::Json::object{{"recipes", std::move(recipes)},
+                                       {"next_offset", std::move(next_offset)}},
+                  &res);
+    });
+
+    // Ranks all recipes by their nutrition, e.g.
+    //   /report/recipes?max_kcal=150&sort=protein&order=desc
+    //   /report/recipes?ingredient=42&sort=share&order=desc&limit=10
+    router_.Add("GET", "/report/recipes", [this](const httplib::Request& req,
+                                                 httplib::Response& res,
+                                                 const RouteParams& params) {
+        RecipeReportQuery query;
+        auto min_kcal = ParseFloatParam(req, "min_kcal", query.min_kcal);
+        auto max_kcal = ParseFloatParam(req, "max_kcal", query.max_kcal);
+        if (!min_kcal || !max_kcal) {
+            ReplyErr("`min_kcal` and `max_kcal` should be numbers.", 400, &res);
+            return;
+        }
+        query.min_kcal = *min_kcal;
+        query.max_kcal = *max_kcal;
+
+        if (req.has_param("ingredient")) {
+            auto ingredient = ParseUintParam(req, "ingredient", 0);
+            if (!ingredient) {
+                ReplyErr("`ingredient` should be the id of an ingredient.", 400, &res);
+                return;
+            }
+            query.ingredient = *ingredient;
+        }
+
+        auto sort = ParseReportKey(req.has_param("sort") ? req.get_param_value("sort") : "kcal");
+        const std::string order = req.has_param("order") ? req.get_param_value("order") : "asc";
+        if (!sort || (order != "asc" && order != "desc")) {
+            ReplyErr("`sort` should be kcal, a nutrient, weight or share, and `order` asc or desc.",
+                     400, &res);
+            return;
+        }
+        query.sort = *sort;
+        query.descending = order == "desc";
+
+        auto limit = ParseUintParam(req, "limit", kReportSize);
+        if (!limit || *limit == 0 || *limit > kMaxReportSize) {
+            ReplyErr(fmt::format("`limit` should be a number from 1 to {}.", kMaxReportSize), 400,
+                     &res);
+            return;
+        }
+        query.limit = *limit;
+
+        auto report = report_.Query(query);
+        if (!report.Ok()) {
+            int code = (report.Code() == StatusCode::INVALID_ARGUMENT) ? 400 : 500;
+            ReplyErr(std::move(report.Error()), code, &res);
+            return;
+        }
+        ReplyJson(std::move(report.Value()), &res);
+    });
+
+    router_.Add("POST", "/create_recipe", [db](const httplib::Request& req, httplib::Response& res,
+                                               const RouteParams& params) {
+        std::string err;
+        json11::Json input = ParseBody(req, &err);
+        if (!err.empty()) {
+            ReplyErr("Failed to parse the request: " + err, 400, &res);
+            return;
+        }
+
+        std::string name;
+        std::string description;
+        std::map<size_t, uint32_t> ingredients;
+        std::map<size_t, uint32_t> subrecipes;
+        if (err = ParseRecipe(input, &name, &description, &ingredients, &subrecipes);
+            !err.empty()) {
+            ReplyErr(std::move(err), 400, &res);
+            return;
+        }
+
+        auto st = db->CreateRecipe(name, description, ingredients, subrecipes);
+        if (!st.Ok()) {
+            ReplyErr(std::move(st.Error()), 500, &res);
+            return;
+        }
+        res.set_content(std::to_string(st.Value()), "text/plain");
+    });
+
+    router_.Add("GET", "/recipe/:id", [this, db](const httplib::Request& req,
+                                                 httplib::Response& res,
+                                                 const RouteParams& params) {
+        size_t id = params[0];
+        // ?expand=ingredients inlines the names and kcal of the ingredients, so that a client
+        // doesn't need the whole catalog to show one recipe.
+        const bool expand = req.has_param("expand");
+        if (expand && req.get_param_value("expand") != "ingredients") {
+            ReplyErr("`expand` can only be ingredients.", 400, &res);
+            return;
+        }
+
+        // The details come from the join in GetRecipeInfo, the snapshot only has the rows.
+        std::vector<Ingredient> details;
+        auto recipe = snapshot_ && !expand ? snapshot_->GetRecipeInfo(id) : std::nullopt;
+        if (!recipe) {
+            auto st = db->GetRecipeInfo(id, expand ? &details : nullptr);
+            if (!st.Ok()) {
+                int code = (st.Code() == StatusCode::NOT_FOUND) ? 404 : 500;
+                ReplyErr(std::move(st.Error()), code, &res);
+                return;
+            }
+            recipe = std::move(st.Value());
+        }
+
+        // Memoized, so it rarely touches the database even when the recipe comes from the
+        // snapshot.
+        auto per_100g = db->GetRecipeNutrientsPer100g(id);
+        if (!per_100g.Ok()) {
+            int code = (per_100g.Code() == StatusCode::NOT_FOUND) ? 404 : 500;
+            ReplyErr(std::move(per_100g.Error()), code, &res);
+            return;
+        }
+
+        json11::Json::object reply = recipe->to_json().object_items();
+        reply.emplace("per_100g", per_100g.Value());
+        if (expand) {
+            json11::Json::array ingredients;
+            uint64_t weight = 0;
+            for (size_t idx = 0; idx < recipe->ingredients.size(); ++idx) {
+                json11::Json::object ingredient = recipe->ingredients[idx].to_json().object_items();
+                ingredient.emplace("name", details[idx].name);
+                ingredient.emplace("kcal", std::to_string(details[idx].kcal));
+                ingredients.push_back(std::move(ingredient));
+                weight += recipe->ingredients[idx].weight;
+            }
+            for (const auto& subrecipe : recipe->subrecipes) {
+                weight += subrecipe.weight;
+            }
+            reply["ingredients"] = std::move(ingredients);
+            reply.emplace("weight", std::to_string(weight));
+            reply.emplace("total_kcal",
+                          fmt::format("{:.2f}", per_100g.Value().kcal() * weight / 100));
+        }
+        ReplyJson(std::move(reply), &res);
+    });
+
+    // Computes the energy and nutrients of an unsaved recipe, e.g. while it is being edited. The
+    // body has the "ingredients" and "subrecipes" of /create_recipe.
+    router_.Add("POST", "/calculate", [db](const httplib::Request& req, httplib::Response& res,
+                                           const RouteParams& params) {
+        std::string err;
+        json11::Json input = ParseBody(req, &err);
+        if (!err.empty()) {
+            ReplyErr("Failed to parse the request: " + err, 400, &res);
+            return;
+        }
+
+        std::map<size_t, uint32_t> ingredients;
+        std::map<size_t, uint32_t> subrecipes;
+        if (err = ParseWeights(input["ingredients"], &ingredients); err.empty()) {
+            err = ParseWeights(input["subrecipes"], &subrecipes);
+        }
+        if (!err.empty()) {
+            ReplyErr(std::move(err), 400, &res);
+            return;
+        }
+
+        auto per_100g = db->CalculateNutrients(ingredients, subrecipes);
+        if (!per_100g.Ok()) {
+            int code = (per_100g.Code() == StatusCode::NOT_FOUND) ? 404 : 500;
+            ReplyErr(std::move(per_100g.Error()), code, &res);
+            return;
+        }
+
+        uint64_t weight = 0;
+        for (const auto& [id, grams] : ingredients) {
+            weight += grams;
+        }
+        for (const auto& [id, grams] : subrecipes) {
+            weight += grams;
+        }
+        ReplyJson(json11::Json::object{{"per_100g", per_100g.Value()},
+                                       {"weight", std::to_string(weight)}},
+                  &res);
+    });
+
+    // Replaces the recipe with the body, which has the fields of /create_recipe and the
+    // "version" of the recipe the client has edited. Replies with the new version, or with 409
+    // if the recipe has been changed since.
+    router_.Add("PUT", "/recipe/:id", [db](const httplib::Request& req, httplib::Response& res,
+                                           const RouteParams& params) {
+        std::string err;
+        json11::Json input = ParseBody(req, &err);
+        if (!err.empty()) {
+            ReplyErr("Failed to parse the request: " + err, 400, &res);
+            return;
+        }
+
+        std::string name;
+        std::string description;
+        std::map<size_t, uint32_t> ingredients;
+        std::map<size_t, uint32_t> subrecipes;
+        if (err = ParseRecipe(input, &name, &description, &ingredients, &subrecipes);
+            !err.empty()) {
+            ReplyErr(std::move(err), 400, &res);
+            return;
+        }
+
+        // Versions are sent as strings, like in the replies, since they may not fit a double.
+        const std::string& value = input["version"].string_value();
+        uint64_t version = 0;
+        auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), version);
+        if (value.empty() || ec != std::errc() || ptr != value.data() + value.size()) {
+            ReplyErr("`version` should be the version of the recipe from /recipe/<id>.", 400,
+                     &res);
+            return;
+        }
+
+        auto st =
+            db->UpdateRecipe(params[0], version, name, description, ingredients, subrecipes);
+        if (!st.Ok()) {
+            int code = 500;
+            switch (st.Code()) {
+                case StatusCode::INVALID_ARGUMENT:
+                    code = 400;
+                    break;
+                case StatusCode::NOT_FOUND:
+                    code = 404;
+                    break;
+                case StatusCode::CONFLICT:
+                    code = 409;
+                    break;
+                default:
+                    break;
+            }
+            ReplyErr(std::move(st.Error()), code, &res);
+            return;
+        }
+        res.set_content(std::to_string(st.Value()), "text/plain");
+    });
+
+    // Picks portions of the given recipes that add up to the target kcal, e.g.
+    //   {"kcal": 2000, "recipes": [{"id": 1, "min": 100, "max": 400}, {"id": 2, "max": 300}],
+    //    "nutrients": {"protein": {"min": 60}, "salt": {"max": 6}}, "step": 10,
+    //    "deadline_ms": 500}
+    // Weights are in grams, and nutrient ranges are for the whole plan. Replies with the best
+    // plan found before the deadline, and whether it is optimal.
+    router_.Add("POST", "/plan", [db](const httplib::Request& req, httplib::Response& res,
+                                      const RouteParams& params) {
+        std::string err;
+        json11::Json input = ParseBody(req, &err);
+        if (!err.empty()) {
+            ReplyErr("Failed to parse the request: " + err, 400, &res);
+            return;
+        }
+
+        PlanRequest plan;
+        plan.pool = SolverPool();
+        plan.threads = plan.pool->size() + 1;
+        if (!input["kcal"].is_number() || input["kcal"].number_value() < 0.0) {
+            ReplyErr("A plan should have a non-negative `kcal` target.", 400, &res);
+            return;
+        }
+        plan.kcal = static_cast<float>(input["kcal"].number_value());
+
+        const auto& recipes = input["recipes"].array_items();
+        if (recipes.empty() || recipes.size() > kMaxPlanRecipes) {
+            ReplyErr(fmt::format("A plan should have from 1 to {} `recipes`.", kMaxPlanRecipes),
+                     400, &res);
+            return;
+        }
+        for (const auto& v : recipes) {
+            const double id = v["id"].number_value();
+            const double min = v["min"].number_value();
+            const double max = v["max"].is_null() ? 1000.0 : v["max"].number_value();
+            if (!v["id"].is_number() || id < 0.0 || min < 0.0 || max < min || max > 10000.0) {
+                ReplyErr("Each recipe should have an id and portion limits `min` <= `max` of at "
+                         "most 10000 grams.",
+                         400, &res);
+                return;
+            }
+            auto per_100g = db->GetRecipeNutrientsPer100g(static_cast<size_t>(id));
+            if (!per_100g.Ok()) {
+                int code = (per_100g.Code() == StatusCode::NOT_FOUND) ? 404 : 500;
+                ReplyErr(std::move(per_100g.Error()), code, &res);
+                return;
+            }
+            plan.items.push_back({static_cast<size_t>(id), per_100g.Value(),
+                                  static_cast<uint32_t>(min), static_cast<uint32_t>(max)});
+        }
+
+        for (const auto& [name, range] : input["nutrients"].object_items()) {
+            std::optional<Nutrient> nutrient;
+            for (size_t idx = 0; idx < kNutrientCount; ++idx) {
+                if (name == ToString(static_cast<Nutrient>(idx))) {
+                    nutrient = static_cast<Nutrient>(idx);
+                }
+            }
+            NutrientRange limits;
+            if (range["min"].is_number()) {
+                limits.min = static_cast<float>(range["min"].number_value());
+            }
+            if (range["max"].is_number()) {
+                limits.max = static_cast<float>(range["max"].number_value());
+            }
+            if (!nutrient || !range.is_object() || limits.min > limits.max) {
+                ReplyErr("`nutrients` should map nutrient names to {\"min\", \"max\"} grams.",
+                         400, &res);
+                return;
+            }
+            limits.nutrient = *nutrient;
+            plan.ranges.push_back(limits);
+        }
+
+        const double step = input["step"].is_null() ? 10.0 : input["step"].number_value();
+        const double deadline_ms =
+            input["deadline_ms"].is_null() ? kPlanDeadlineMs : input["deadline_ms"].number_value();
+        if (step < 1.0 || deadline_ms < 1.0 || deadline_ms > kMaxPlanDeadlineMs) {
+            ReplyErr(fmt::format("`step` should be at least 1 gram and `deadline_ms` from 1 to {}.",
+                                 kMaxPlanDeadlineMs),
+                     400, &res);
+            return;
+        }
+        plan.step = static_cast<uint32_t>(step);
+        plan.deadline = std::chrono::milliseconds(static_cast<int64_t>(deadline_ms));
+
+        auto solved = SolveMealPlan(plan);
+        if (!solved.Ok()) {
+            int code = (solved.Code() == StatusCode::NOT_FOUND) ? 422 : 400;
+            ReplyErr(std::move(solved.Error()), code, &res);
+            return;
+        }
+
+        const MealPlan& meal = solved.Value();
+        json11::Json::array portions;
+        for (size_t idx = 0; idx < plan.items.size(); ++idx) {
+            portions.push_back(RecipeIngredient(plan.items[idx].id, meal.weights[idx]));
+        }
+        json11::Json::object nutrients;
+        for (size_t idx = 0; idx < kNutrientCount; ++idx) {
+            nutrients.emplace(ToString(static_cast<Nutrient>(idx)),
+                              fmt::format("{:.2f}", meal.nutrients[idx]));
+        }
+        ReplyJson(json11::Json::object{{"portions", std::move(portions)},
+                                       {"kcal", fmt::format("{:.2f}", meal.kcal)},
+                                       {"nutrients", std::move(nutrients)},
+                                       {"optimal", meal.optimal}},
+                  &res);
+    });
+
+    router_.Add("DELETE", "/recipe/:id", [db](const httplib::Request& req, httplib::Response& res,
+                                              const RouteParams& params) {
+        if (!db->DeleteRecipe(params[0])) {
+            ReplyErr("DB request failed. Try again later.", 500, &res);
+            return;
+        }
+    });
+
+    router_.Add("GET", "/changes", [this](const httplib::Request& req, httplib::Response& res,
+                                          const RouteParams& params) {
+        const auto& changes = db_->Changes();
+        if (!req.has_param("since")) {
+            ChangeDelta delta{changes.LastSeq(), changes.Epoch(), false, {}};
+            ReplyJson(delta, &res);
+            return;
+        }
+
+        // A `since` without the `epoch` that came with it can't be trusted, so it gets a reset.
+        auto since = ParseUintParam(req, "since", 0);
+        auto epoch = ParseUintParam(req, "epoch", 0);
+        auto timeout_sec = ParseUintParam(req, "timeout", 25);
+        if (!since || !epoch || !timeout_sec) {
+            ReplyErr("`since`, `epoch` and `timeout` should be non-negative integers.", 400,
+                     &res);
+            return;
+        }
+
+        auto delta = changes.Wait(*epoch, *since, std::chrono::milliseconds(0));
+        std::chrono::milliseconds timeout =
+            std::chrono::seconds(std::min<uint64_t>(*timeout_sec, 60));
+        if (delta.reset || !delta.changes.empty() || timeout.count() == 0) {
+            ReplyJson(delta, &res);
+            return;
+        }
+        if (ParkUntilChange(changes, *since, timeout,
+                            [&changes, since = *since](httplib::Response* res) {
+                                ReplyJson(changes.Wait(since, std::chrono::milliseconds(0)), res);
+                            })) {
+            return;
+        }
+
+        if (long_polls_.fetch_add(1) >= kMaxLongPolls) {
+            timeout = std::chrono::milliseconds(0);
+        }
+        delta = changes.Wait(*epoch, *since, timeout);
+        long_polls_.fetch_sub(1);
+        ReplyJson(delta, &res);
+    });
+
+    // Streams the whole catalog as NDJSON or CSV, e.g. /export?format=csv, see ExportFormat.
+    router_.Add("GET", "/export", [this, db](const httplib::Request& req, httplib::Response& res,
+                                             const RouteParams& params) {
+        auto format =
+            ParseExportFormat(req.has_param("format") ? req.get_param_value("format") : "ndjson");
+        if (!format) {
+            ReplyErr("`format` should be ndjson or csv.", 400, &res);
+            return;
+        }
+
+        // The rows are read and sent a page at a time while the reply is written, after the
+        // handler returns. A failure then can only drop the connection, which the client sees as
+        // a truncated reply without the terminating chunk.
+        res.set_chunked_content_provider(
+            ExportContentType(*format),
+            [db, format = *format, tenant = dispatched_tenant](size_t offset,
+                                                               httplib::DataSink& sink) {
+                auto code = WriteCatalog(db, format, [&sink](std::string_view chunk) {
+                    return sink.write(chunk.data(), chunk.size());
+                });
+                if (code != StatusCode::OK) {
+                    return false;
+                }
+                sink.done();
+                return true;
+            });
+    });
+
+    // The writes after version `since` for followers, see Follower, at most `limit` rows at a
+    // time. A batch with `more` continues with the `kind` and `id` of its `next` write. Like
+    // /changes, waits up to `timeout` seconds for a write if there are none.
+    router_.Add("GET", "/replication", [this](const httplib::Request& req, httplib::Response& res,
+                                              const RouteParams& params) {
+        auto since = ParseUintParam(req, "since", 0);
+        auto kind = ParseUintParam(req, "kind", ReplicationCursor::kVersionEnd);
+        auto id = ParseUintParam(req, "id", 0);
+        auto timeout_sec = ParseUintParam(req, "timeout", 0);
+        if (!since || !kind || !id || !timeout_sec) {
+            ReplyErr("`since`, `kind`, `id` and `timeout` should be non-negative integers.", 400,
+                     &res);
+            return;
+        }
+        if (*kind > ReplicationCursor::kVersionEnd) {
+            ReplyErr(fmt::format("`kind` should be at most {}.", ReplicationCursor::kVersionEnd),
+                     400, &res);
+            return;
+        }
+        const ReplicationCursor after{*since, static_cast<uint32_t>(*kind),
+                                      static_cast<size_t>(*id)};
+        auto limit = ParseUintParam(req, "limit", kReplicationBatchSize);
+        if (!limit || *limit == 0 || *limit > kMaxReplicationBatchSize) {
+            ReplyErr(fmt::format("`limit` should be a number from 1 to {}.",
+                                 kMaxReplicationBatchSize),
+                     400, &res);
+            return;
+        }
+
+        // The log is read before the tables, so a write in between ends the wait right away.
+        const uint64_t seq = db_->Changes().LastSeq();
+        auto batch = db_->GetReplicationBatch(after, *limit);
+        if (batch.Ok() && batch.Value().empty() && *timeout_sec > 0) {
+            const auto timeout = std::chrono::seconds(std::min<uint64_t>(*timeout_sec, 60));
+            if (ParkUntilChange(db_->Changes(), seq, timeout,
+                                [db = db_, after, limit = *limit](httplib::Response* res) {
+                                    auto batch = db->GetReplicationBatch(after, limit);
+                                    if (!batch.Ok()) {
+                                        ReplyErr(std::move(batch.Error()), 500, res);
+                                        return;
+                                    }
+                                    ReplyJson(batch.Value(), res);
+                                })) {
+                return;
+            }
+            if (long_polls_.fetch_add(1) < kMaxLongPolls) {
+                db_->Changes().Wait(seq, timeout);
+            }
+            long_polls_.fetch_sub(1);
+            batch = db_->GetReplicationBatch(after, *limit);
+        }
+        if (!batch.Ok()) {
+            ReplyErr(std::move(batch.Error()), 500, &res);
+            return;
+        }
+        ReplyJson(batch.Value(), &res);
+    });
+
+    router_.Add("POST", "/dialogflow", [this](const httplib::Request& req, httplib::Response& res,
+                                              const RouteParams& params) {
+        std::string err;
+        const json11::Json in = ParseBody(req, &err);
+        if (!err.empty()) {
+            ReplyErr("Failed to parse input as json: " + err, 400, &res);
+            return;
+        }
+
+        const std::string& resp_id = in["responseId"].string_value();
+        const std::string& session = in["session"].string_value();
+        const auto& query = in["queryResult"];
+        const std::string& query_text = query["queryText"].string_value();
+        const std::string& intent_name = query["intent"]["displayName"].string_value();
+
+        fmt::print("[dialogflow] id={} session={} query={} intent={}\n", resp_id, session,
+                   query_text, intent_name);
+
+        auto response = dialogflow_.Handle(in);
+        if (!response.Ok()) {
+            if (response.Code() != StatusCode::NOT_FOUND) {
+                ReplyErr(std::move(response.Error()), 500, &res);
+            }
+            // Unsupported intents get an empty response.
+            return;
+        }
+        res.set_content(std::move(response.Value()), "text/json; charset=utf-8");
+    });
+}
+
+}  // namespace foodculator
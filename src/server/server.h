@@ -0,0 +1,147 @@
+#ifndef __SRC_SERVER_SERVER_H__
+#define __SRC_SERVER_SERVER_H__
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "db/db.h"
+#include "dialogflow/dialogflow.h"
+#include "httplib.h"
+#include "search/recipe_report.h"
+#include "server/capture.h"
+#include "server/event_server.h"
+#include "server/follower.h"
+#include "server/tenant_pool.h"
+#include "snapshot/catalog_snapshot.h"
+#include "util/router.h"
+#include "util/thread_pool.h"
+
+namespace foodculator {
+
+// Server serves the web UI from `path_to_static` and the JSON API on top of `db`.
+class Server {
+   public:
+    Server(DB* db, std::string path_to_static, std::string version);
+
+    // Serves the kitchens of `tenants`, which has to outlive the server. A request picks its
+    // kitchen with a /t/<name> path prefix, e.g. /t/bistro/get_recipes, or with the
+    // kTenantHeader header, and is handled by the server of that kitchen.
+    static constexpr char kTenantHeader[] = "X-Tenant";
+    Server(TenantPool* tenants, std::string path_to_static, std::string version);
+
+    // Serves all connections from one epoll thread instead of a thread per connection, and
+    // runs the handlers on `workers` threads, see EventServer. Long polls of /changes and
+    // /replication are parked in the loop instead of holding a worker. Must be called before
+    // Bind().
+    void UseEventLoop(size_t workers);
+
+    // Binds the listening socket. Port 0 picks any free port.
+    // Returns the bound port, or -1 on failure.
+    int Bind(const std::string& host, int port);
+
+    // Accepts the connections of `fd`, the listening socket of the Supervisor, instead of
+    // binding one. Only the event loop can: httplib binds its own socket, and shuts it down
+    // when it stops, which would stop it for every process. Call instead of Bind().
+    // Returns the bound port, or -1 on failure.
+    int Adopt(int fd);
+
+    // Serves requests until Stop() is called. Returns false if the server failed.
+    bool Listen();
+
+    // Can be called from any thread, including a signal handler.
+    void Stop();
+
+    // Records every API request and a fingerprint of its response to `capture`, which has to
+    // outlive the server. Static files are not recorded. Must be called before Listen().
+    void SetCapture(CaptureWriter* capture) { capture_ = capture; }
+
+    // Serves catalog reads from `snapshot` while it is current, see CatalogSnapshot. It has to
+    // outlive the server. Must be called before Listen().
+    void SetSnapshot(const CatalogSnapshot* snapshot) { snapshot_ = snapshot; }
+
+    // Makes the server a read-only copy of the leader `follower` replicates: writes are refused
+    // with 403, and while the copy is stale all requests get 503, so that a load balancer
+    // sends them to the leader. `follower` has to outlive the server.
+    void SetFollower(const Follower* follower) { follower_ = follower; }
+
+    // Requests with the kTimingHeader header get a Server-Timing header listing the time spent
+    // parsing json, waiting for and running DB statements, and serializing the reply. With
+    // `every` > 0, every `every`-th request is timed too, for the logger only.
+    static constexpr char kTimingHeader[] = "X-Debug-Timing";
+    void SetTimingSample(uint32_t every) { timing_sample_ = every; }
+
+    // Called after every request, in both modes. `timing` lists the phases of a timed request
+    // in the format of the Server-Timing header, and is empty for the others.
+    using Logger = std::function<void(const httplib::Request& req, const httplib::Response& res,
+                                      std::string_view timing)>;
+    void SetLogger(Logger logger);
+
+    // The underlying server, for process-wide settings. Unused with UseEventLoop().
+    httplib::Server& http() { return srv_; }
+
+   private:
+    using Handler =
+        std::function<void(const httplib::Request&, httplib::Response&, const RouteParams&)>;
+
+    Server(DB* db, TenantPool* tenants, std::string path_to_static, std::string version);
+
+    void AddRoutes();
+    // Runs the handler of the route of `req`. Returns false if there is none.
+    bool Dispatch(const httplib::Request& req, httplib::Response* res);
+    // Passes `req` to the server of its kitchen. Returns false if it names no kitchen or the
+    // kitchen has no such route.
+    bool DispatchToTenant(const httplib::Request& req, httplib::Response* res);
+    // Serves API routes and static files in the event loop mode, where httplib's mount points
+    // don't apply.
+    void Handle(const httplib::Request& req, httplib::Response* res);
+
+    // Under httplib, long polls hold one of its worker threads each, so only a few of them are
+    // allowed to wait at a time. The rest are answered right away and poll again. The count is
+    // shared by all servers of the process, as the servers of tenants share the threads of one
+    // front. The event loop parks them instead, see EventServer::Park().
+    static constexpr int kMaxLongPolls = 4;
+    static inline std::atomic<int> long_polls_ = 0;
+
+    // The threads /plan and /report/recipes run on besides the thread of the request. They are
+    // started on first use and shared by all servers of the process, so kitchens don't add
+    // threads.
+    static ThreadPool* SolverPool();
+
+    // The number of recipes on a page of /search_recipes, unless `limit` says otherwise.
+    static constexpr uint64_t kSearchPageSize = 20;
+    static constexpr uint64_t kMaxSearchPageSize = 100;
+    // The number of recipes in /report/recipes, unless `limit` says otherwise.
+    static constexpr uint64_t kReportSize = 20;
+    static constexpr uint64_t kMaxReportSize = 1000;
+    // The number of rows in a batch of /replication, unless `limit` says otherwise.
+    static constexpr uint64_t kReplicationBatchSize = 1000;
+    static constexpr uint64_t kMaxReplicationBatchSize = 100000;
+    // Limits of /plan: the number of recipes, and the time the solver may take by default and
+    // at most.
+    static constexpr size_t kMaxPlanRecipes = 20;
+    static constexpr uint64_t kPlanDeadlineMs = 200;
+    static constexpr uint64_t kMaxPlanDeadlineMs = 2000;
+
+    DB* db_;
+    const std::string path_to_static_;
+    const std::string version_;
+    Dialogflow dialogflow_;
+    RecipeReportIndex report_;
+    Router<Handler> router_;
+    TenantPool* tenants_ = nullptr;
+    CaptureWriter* capture_ = nullptr;
+    const CatalogSnapshot* snapshot_ = nullptr;
+    const Follower* follower_ = nullptr;
+    uint32_t timing_sample_ = 0;
+    std::atomic<uint32_t> timed_requests_ = 0;
+    httplib::Server srv_;
+    std::unique_ptr<EventServer> event_server_;
+};
+
+}  // namespace foodculator
+
+#endif
@@ -0,0 +1,242 @@
+#include "supervisor.h"
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+
+#include "fmt/format.h"
+
+namespace foodculator {
+
+namespace {
+
+// Set by Supervisor in the environment of the workers.
+constexpr char kIndexEnv[] = "FOODCULATOR_WORKER_INDEX";
+constexpr char kReadyFdEnv[] = "FOODCULATOR_READY_FD";
+constexpr char kListenFdEnv[] = "FOODCULATOR_LISTEN_FD";
+
+sigset_t HandledSignals() {
+    sigset_t set;
+    sigemptyset(&set);
+    for (int sig : {SIGCHLD, SIGHUP, SIGINT, SIGTERM}) {
+        sigaddset(&set, sig);
+    }
+    return set;
+}
+
+// Returns a socket listening on all addresses, without FD_CLOEXEC so that the workers inherit
+// it, or -1.
+int BindListeningSocket(int port) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void StopWorker(pid_t pid) {
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+}
+
+}  // namespace
+
+Supervisor::Supervisor(int argc, char** argv, size_t workers, int port)
+    : port_(port), args_(argv, argv + argc), workers_(workers, -1), started_(workers) {
+    // Resolved now: once a new build replaces the file, /proc/self/exe points to the old one.
+    std::error_code ec;
+    binary_ = std::filesystem::read_symlink("/proc/self/exe", ec).string();
+    if (ec) {
+        binary_ = args_[0];
+    }
+}
+
+pid_t Supervisor::Start(size_t index) {
+    started_[index] = std::chrono::steady_clock::now();
+    int ready[2];
+    if (pipe(ready) != 0) {
+        fmt::print(stderr, "[supervisor] pipe failed\n");
+        return -1;
+    }
+    fcntl(ready[0], F_SETFD, FD_CLOEXEC);
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+        close(ready[0]);
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, nullptr);
+        setenv(kIndexEnv, std::to_string(index).c_str(), 1);
+        setenv(kReadyFdEnv, std::to_string(ready[1]).c_str(), 1);
+        setenv(kListenFdEnv, std::to_string(listener_).c_str(), 1);
+
+        std::vector<char*> argv;
+        for (auto& arg : args_) {
+            argv.push_back(arg.data());
+        }
+        argv.push_back(nullptr);
+        execv(binary_.c_str(), argv.data());
+        _exit(127);
+    }
+    close(ready[1]);
+    if (pid < 0) {
+        close(ready[0]);
+        fmt::print(stderr, "[supervisor] fork failed\n");
+        return -1;
+    }
+
+    // The worker writes a byte once it listens. EOF means it died before that.
+    pollfd fd = {ready[0], POLLIN, 0};
+    char byte = 0;
+    const bool started = poll(&fd, 1, kStartTimeoutMs) == 1 && read(ready[0], &byte, 1) == 1;
+    close(ready[0]);
+    if (!started) {
+        fmt::print(stderr, "[supervisor] worker #{} (pid {}) failed to start\n", index, pid);
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        return -1;
+    }
+
+    fmt::print("[supervisor] worker #{} (pid {}) is listening\n", index, pid);
+    return pid;
+}
+
+void Supervisor::RestartAll() {
+    fmt::print("[supervisor] restarting {} workers\n", workers_.size());
+    for (size_t index = 0; index < workers_.size(); ++index) {
+        const pid_t pid = Start(index);
+        if (pid < 0) {
+            fmt::print(stderr, "[supervisor] restart aborted, the old workers keep running\n");
+            return;
+        }
+
+        const pid_t old = workers_[index];
+        workers_[index] = pid;
+        if (old > 0) {
+            // Returns once the old worker has answered the requests it had accepted.
+            StopWorker(old);
+        }
+    }
+    fmt::print("[supervisor] restart complete\n");
+}
+
+void Supervisor::Maintain() {
+    int status = 0;
+    for (pid_t pid = waitpid(-1, &status, WNOHANG); pid > 0;
+         pid = waitpid(-1, &status, WNOHANG)) {
+        for (size_t index = 0; index < workers_.size(); ++index) {
+            if (workers_[index] == pid) {
+                fmt::print(stderr, "[supervisor] worker #{} (pid {}) exited with status {}\n",
+                           index, pid, status);
+                workers_[index] = -1;
+            }
+        }
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    for (size_t index = 0; index < workers_.size(); ++index) {
+        if (workers_[index] < 0 && now - started_[index] >= kRestartDelay) {
+            workers_[index] = Start(index);
+        }
+    }
+}
+
+void Supervisor::StopAll() {
+    for (pid_t pid : workers_) {
+        if (pid > 0) {
+            kill(pid, SIGTERM);
+        }
+    }
+    for (pid_t& pid : workers_) {
+        if (pid > 0) {
+            waitpid(pid, nullptr, 0);
+            pid = -1;
+        }
+    }
+}
+
+int Supervisor::Run() {
+    // Signals are handled synchronously below, so the workers can be managed from one thread.
+    const sigset_t signals = HandledSignals();
+    sigprocmask(SIG_BLOCK, &signals, nullptr);
+
+    listener_ = BindListeningSocket(port_);
+    if (listener_ < 0) {
+        fmt::print(stderr, "[supervisor] can't listen on port {}\n", port_);
+        return 1;
+    }
+    for (size_t index = 0; index < workers_.size(); ++index) {
+        workers_[index] = Start(index);
+        if (workers_[index] < 0) {
+            StopAll();
+            return 1;
+        }
+    }
+    fmt::print("[supervisor] {} workers are running, SIGHUP restarts them\n", workers_.size());
+
+    // Wakes up at least once a second, to restart the workers whose kRestartDelay has passed.
+    const timespec period = {1, 0};
+    while (true) {
+        const int sig = sigtimedwait(&signals, nullptr, &period);
+        if (sig == SIGTERM || sig == SIGINT) {
+            fmt::print("[supervisor] stopping the workers\n");
+            StopAll();
+            return 0;
+        }
+        if (sig == SIGHUP) {
+            RestartAll();
+        }
+        Maintain();
+    }
+}
+
+std::optional<size_t> SupervisedWorkerIndex() {
+    const char* index = std::getenv(kIndexEnv);
+    if (index == nullptr) {
+        return std::nullopt;
+    }
+    return std::stoul(index);
+}
+
+std::optional<int> SupervisedListeningSocket() {
+    const char* fd = std::getenv(kListenFdEnv);
+    if (fd == nullptr) {
+        return std::nullopt;
+    }
+    return std::stoi(fd);
+}
+
+void NotifySupervisor() {
+    const char* fd = std::getenv(kReadyFdEnv);
+    if (fd == nullptr) {
+        return;
+    }
+    const int ready = std::stoi(fd);
+    const char byte = 1;
+    if (write(ready, &byte, 1) != 1) {
+        fmt::print(stderr, "Can't notify the supervisor\n");
+    }
+    close(ready);
+    unsetenv(kReadyFdEnv);
+}
+
+}  // namespace foodculator
@@ -0,0 +1,70 @@
+#ifndef __SRC_SERVER_SUPERVISOR_H__
+#define __SRC_SERVER_SUPERVISOR_H__
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace foodculator {
+
+// Supervisor runs `workers` copies of the current binary with the same command line. It binds
+// the listening socket of `port` once and the workers inherit it, so they accept connections
+// from one queue.
+//
+// SIGHUP replaces the workers one by one: a new worker is started and the old one is only
+// stopped once the new one accepts connections. The socket stays open all along, so the
+// connections that a stopping worker hasn't accepted wait for the others instead of being
+// reset. Old workers finish the requests they are serving before exiting. The binary is
+// executed again by path, so a restart picks up a new build installed in its place. Workers
+// that crash are restarted; SIGTERM and SIGINT stop all of them.
+class Supervisor {
+   public:
+    Supervisor(int argc, char** argv, size_t workers, int port);
+
+    // Runs until SIGTERM or SIGINT. Returns the exit code of the process.
+    int Run();
+
+   private:
+    // Starts worker `index` and waits until it reports that it accepts connections.
+    // Returns its pid, or -1 if it failed to start.
+    pid_t Start(size_t index);
+    void RestartAll();
+    // Reaps exited workers and starts the missing ones.
+    void Maintain();
+    void StopAll();
+
+    // A worker that doesn't report readiness in time is killed.
+    static constexpr int kStartTimeoutMs = 60000;
+    // A worker that crashed is started again no sooner than this after its last start, so
+    // that one that crashes right away doesn't keep the supervisor forking.
+    static constexpr std::chrono::seconds kRestartDelay{1};
+
+    int port_;
+    // The listening socket, -1 until Run() binds it.
+    int listener_ = -1;
+    std::string binary_;
+    std::vector<std::string> args_;
+    // Pids of the workers by index, -1 for the ones that are not running.
+    std::vector<pid_t> workers_;
+    // When Start() was last called for each index.
+    std::vector<std::chrono::steady_clock::time_point> started_;
+};
+
+// For a process started by Supervisor, returns its index among the workers. Exactly one
+// worker has index 0 at a time except during restarts, so process-wide singletons such as
+// background jobs run there.
+std::optional<size_t> SupervisedWorkerIndex();
+
+// For a process started by Supervisor, returns the listening socket it inherited.
+std::optional<int> SupervisedListeningSocket();
+
+// Tells the supervisor that this worker accepts connections. Does nothing if the process is
+// not supervised.
+void NotifySupervisor();
+
+}  // namespace foodculator
+
+#endif
@@ -0,0 +1,150 @@
+#include "tenant_pool.h"
+
+#include <filesystem>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "fmt/format.h"
+#include "server/server.h"
+
+namespace foodculator {
+
+TenantPool::TenantPool(TenantOptions options, ServerFactory make_server)
+    : options_(std::move(options)), make_server_(std::move(make_server)) {
+    DB::SetMemoryLimit(options_.memory_limit);
+}
+
+TenantPool::~TenantPool() = default;
+
+bool TenantPool::IsValidName(std::string_view name) {
+    if (name.empty() || name.size() > 64) {
+        return false;
+    }
+    for (char c : name) {
+        if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+StatusOr<std::shared_ptr<Tenant>> TenantPool::Acquire(std::string_view name) {
+    if (!IsValidName(name)) {
+        return {StatusCode::INVALID_ARGUMENT, fmt::format("Bad kitchen name: {}.", name)};
+    }
+    const std::string key(name);
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (auto tenant = Touch(key); tenant) {
+            return StatusOr{std::move(tenant)};
+        }
+    }
+
+    std::lock_guard<std::mutex> open_lock(open_mu_);
+    {
+        // Another request may have opened it while this one waited.
+        std::lock_guard<std::mutex> lock(mu_);
+        if (auto tenant = Touch(key); tenant) {
+            return StatusOr{std::move(tenant)};
+        }
+    }
+
+    const std::string path = fmt::format("{}/{}.db", options_.dir, key);
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path, ec)) {
+        return {StatusCode::NOT_FOUND, fmt::format("Unknown kitchen: {}.", key)};
+    }
+    auto tenant = std::make_shared<Tenant>();
+    tenant->name = key;
+    tenant->db = DB::Create(path);
+    if (!tenant->db) {
+        return {StatusCode::INTERNAL_ERROR, fmt::format("Can't open kitchen {}.", key)};
+    }
+    tenant->server = make_server_(tenant->db.get());
+
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        lru_.push_front(key);
+        tenants_.emplace(key, Entry{tenant, std::chrono::steady_clock::now(), lru_.begin()});
+    }
+    Evict(key);
+    return StatusOr{std::move(tenant)};
+}
+
+size_t TenantPool::CloseIdle() {
+    const auto deadline = std::chrono::steady_clock::now() - options_.idle_timeout;
+    std::vector<std::shared_ptr<Tenant>> closed;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        // The least recently used are at the back, so the scan can stop at the first recent one.
+        // `end` is the one after the tenant being looked at; dropping that tenant keeps it valid.
+        auto end = lru_.end();
+        while (end != lru_.begin()) {
+            const auto it = std::prev(end);
+            const Entry& entry = tenants_.at(*it);
+            if (entry.last_used > deadline) {
+                break;
+            }
+            if (entry.tenant.use_count() == 1) {
+                closed.push_back(Drop(*it));
+            } else {
+                end = it;
+            }
+        }
+    }
+    // The databases are closed here, without `mu_` held.
+    return closed.size();
+}
+
+size_t TenantPool::Size() {
+    std::lock_guard<std::mutex> lock(mu_);
+    return tenants_.size();
+}
+
+std::shared_ptr<Tenant> TenantPool::Touch(const std::string& name) {
+    auto it = tenants_.find(name);
+    if (it == tenants_.end()) {
+        return nullptr;
+    }
+    it->second.last_used = std::chrono::steady_clock::now();
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return it->second.tenant;
+}
+
+void TenantPool::Evict(const std::string& keep) {
+    while (true) {
+        std::shared_ptr<Tenant> victim;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            const bool over =
+                tenants_.size() > options_.max_open ||
+                (options_.memory_limit > 0 && DB::MemoryUsed() > options_.memory_limit);
+            if (!over) {
+                return;
+            }
+            for (auto it = lru_.rbegin(); it != lru_.rend(); ++it) {
+                if (*it != keep && tenants_.at(*it).tenant.use_count() == 1) {
+                    victim = Drop(*it);
+                    break;
+                }
+            }
+        }
+        if (!victim) {
+            // All the other tenants are busy.
+            return;
+        }
+        // Closed before the memory is checked again.
+        victim.reset();
+    }
+}
+
+std::shared_ptr<Tenant> TenantPool::Drop(std::string name) {
+    auto it = tenants_.find(name);
+    std::shared_ptr<Tenant> ret = std::move(it->second.tenant);
+    lru_.erase(it->second.lru);
+    tenants_.erase(it);
+    return ret;
+}
+
+}  // namespace foodculator
@@ -0,0 +1,100 @@
+#ifndef __SRC_SERVER_TENANT_POOL_H__
+#define __SRC_SERVER_TENANT_POOL_H__
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "db/db.h"
+#include "util/statusor.h"
+
+namespace foodculator {
+
+class Server;
+
+struct TenantOptions {
+    // Tenant `name` is served from `<dir>/<name>.db`. A tenant is added by creating the file,
+    // even an empty one: it's migrated when first opened.
+    std::string dir;
+    // Tenants used least recently are closed when more are open.
+    size_t max_open = 64;
+    // Tenants nobody has used for this long are closed by CloseIdle().
+    std::chrono::seconds idle_timeout{300};
+    // Memory SQLite may hold for all tenants together, see DB::SetMemoryLimit(). Idle tenants
+    // are closed while it's exceeded. 0 for no limit.
+    int64_t memory_limit = 0;
+};
+
+// An open tenant: its database and the server answering its API.
+struct Tenant {
+    std::string name;
+    std::unique_ptr<DB> db;
+    std::unique_ptr<Server> server;
+};
+
+// TenantPool serves many kitchens from one process, each from its own SQLite file, and keeps
+// only the ones in use open.
+//
+// Tenants are opened on first use and kept in an LRU list bounded by `max_open`. Tenants that
+// requests are using are never closed, so the pool may briefly hold more while all are busy.
+class TenantPool {
+   public:
+    // Makes the server of a tenant once its database is open.
+    using ServerFactory = std::function<std::unique_ptr<Server>(DB*)>;
+
+    TenantPool(TenantOptions options, ServerFactory make_server);
+    ~TenantPool();
+
+    // Names are 1 to 64 lowercase letters, digits, '-' and '_', so they can't leave `dir`.
+    static bool IsValidName(std::string_view name);
+
+    // Returns the tenant, opening it if needed. Fails with INVALID_ARGUMENT for a bad name,
+    // NOT_FOUND if the tenant has no database and INTERNAL_ERROR if it can't be opened.
+    StatusOr<std::shared_ptr<Tenant>> Acquire(std::string_view name);
+
+    // Closes the tenants that haven't been used for `idle_timeout`. Returns how many.
+    size_t CloseIdle();
+
+    // The number of open tenants.
+    size_t Size();
+
+   private:
+    struct Entry {
+        std::shared_ptr<Tenant> tenant;
+        std::chrono::steady_clock::time_point last_used;
+        // The position of the tenant in `lru_`.
+        std::list<std::string>::iterator lru;
+    };
+
+    // Marks the tenant as just used and returns it, or nullptr if it isn't open. Expects `mu_`
+    // held.
+    std::shared_ptr<Tenant> Touch(const std::string& name);
+    // Closes the least recently used tenants that nobody is using, other than `keep`, while
+    // there are more than `max_open` of them or SQLite holds more than `memory_limit`.
+    void Evict(const std::string& keep);
+    // Removes the tenant from the pool and returns it, to be closed without `mu_` held.
+    // Expects `mu_` held.
+    std::shared_ptr<Tenant> Drop(std::string name);
+
+    const TenantOptions options_;
+    const ServerFactory make_server_;
+
+    // Held while looking up tenants; tenants are opened without it, under `open_mu_`, so that
+    // the running tenants don't wait for a migration.
+    std::mutex mu_;
+    std::unordered_map<std::string, Entry> tenants_;
+    // Names of the open tenants, the most recently used first.
+    std::list<std::string> lru_;
+    // Serializes opening tenants, so that no file is opened twice.
+    std::mutex open_mu_;
+};
+
+}  // namespace foodculator
+
+#endif
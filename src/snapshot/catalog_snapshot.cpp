@@ -0,0 +1,493 @@
+#include "catalog_snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+
+#include "fmt/format.h"
+
+namespace foodculator {
+
+namespace {
+
+// The file is a Header followed by the records of every table in the order the DB lists them,
+// the recipe ingredients of all recipes in the order of the recipes, the id indices of
+// ingredients and recipes, and the string pool. Everything is
+// in the byte order of the host; a snapshot from a host with another one fails the format check
+// and is rewritten. All records are a multiple of 8 bytes long, so every section is aligned.
+constexpr char kMagic[8] = {'F', 'C', 'S', 'N', 'A', 'P', '\0', '\0'};
+constexpr uint32_t kFormatVersion = 4;
+
+struct Header {
+    char magic[8];
+    uint32_t format_version;
+    uint32_t reserved;
+    // SYNC_CLOCK.VERSION of the database the snapshot was taken from.
+    uint64_t sync_version;
+    // Of everything after the header.
+    uint64_t checksum;
+    uint64_t ingredients;
+    uint64_t tableware;
+    uint64_t recipes;
+    uint64_t recipe_ingredients;
+    // The id indices have an entry per ingredient and per recipe.
+    // Size of the string pool in bytes.
+    uint64_t strings;
+};
+
+struct StringRef {
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct IngredientRecord {
+    uint64_t id;
+    StringRef name;
+    uint32_t kcal;
+    Nutrients nutrients;
+    uint32_t padding;
+};
+
+struct TablewareRecord {
+    uint64_t id;
+    StringRef name;
+    uint32_t weight;
+    uint32_t padding;
+};
+
+struct RecipeRecord {
+    uint64_t id;
+    uint64_t version;
+    StringRef name;
+    StringRef description;
+    // Range in the recipe ingredients section: the ingredients, then the sub-recipes.
+    uint32_t first_ingredient;
+    uint32_t ingredients;
+    uint32_t subrecipes;
+    uint32_t padding;
+};
+
+struct RecipeIngredientRecord {
+    uint64_t ingredient_id;
+    uint32_t weight;
+    uint32_t padding;
+};
+
+// Entries are sorted by id.
+struct IndexEntry {
+    uint64_t id;
+    uint32_t position;
+    uint32_t padding;
+};
+
+static_assert(sizeof(Header) % 8 == 0 && sizeof(IngredientRecord) % 8 == 0 &&
+              sizeof(TablewareRecord) % 8 == 0 && sizeof(RecipeRecord) % 8 == 0 &&
+              sizeof(RecipeIngredientRecord) % 8 == 0 && sizeof(IndexEntry) % 8 == 0);
+
+// FNV-1a over 8-byte words, with the high bits folded back after every step.
+uint64_t Checksum(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    size_t idx = 0;
+    for (; idx + 8 <= size; idx += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + idx, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+        hash ^= hash >> 32;
+    }
+    for (; idx < size; ++idx) {
+        hash = (hash ^ static_cast<uint8_t>(data[idx])) * 1099511628211ull;
+    }
+    return hash;
+}
+
+template <class T>
+void Append(const std::vector<T>& records, std::string* out) {
+    out->append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T));
+}
+
+template <class T>
+std::vector<IndexEntry> BuildIndex(const std::vector<T>& records) {
+    std::vector<IndexEntry> index;
+    index.reserve(records.size());
+    for (size_t idx = 0; idx < records.size(); ++idx) {
+        index.push_back({records[idx].id, static_cast<uint32_t>(idx), 0});
+    }
+    std::sort(index.begin(), index.end(),
+              [](const IndexEntry& lhs, const IndexEntry& rhs) { return lhs.id < rhs.id; });
+    return index;
+}
+
+// Returns the record with `id`, or nullptr.
+template <class T>
+const T* FindById(const T* records, const IndexEntry* index, size_t count, uint64_t id) {
+    const IndexEntry* end = index + count;
+    const IndexEntry* it = std::lower_bound(
+        index, end, id, [](const IndexEntry& entry, uint64_t id) { return entry.id < id; });
+    return it != end && it->id == id ? records + it->position : nullptr;
+}
+
+}  // namespace
+
+struct CatalogSnapshot::Mapping {
+    ~Mapping() { munmap(const_cast<char*>(data), size); }
+
+    std::string_view String(StringRef ref) const { return {strings + ref.offset, ref.size}; }
+
+    const char* data;
+    size_t size;
+    std::array<uint64_t, 3> generations;
+
+    const IngredientRecord* ingredients;
+    size_t ingredients_count;
+    const TablewareRecord* tableware;
+    size_t tableware_count;
+    const RecipeRecord* recipes;
+    size_t recipes_count;
+    const RecipeIngredientRecord* recipe_ingredients;
+    size_t recipe_ingredients_count;
+    const IndexEntry* ingredients_index;
+    const IndexEntry* recipes_index;
+    const char* strings;
+    size_t strings_size;
+};
+
+CatalogSnapshot::CatalogSnapshot(DB* db, std::string path) : db_(db), path_(std::move(path)) {}
+
+CatalogSnapshot::~CatalogSnapshot() = default;
+
+std::array<uint64_t, 3> CatalogSnapshot::Generations() const {
+    return {db_->Generation(DB::Table::INGREDIENTS), db_->Generation(DB::Table::TABLEWARE),
+            db_->Generation(DB::Table::RECIPE)};
+}
+
+std::shared_ptr<const CatalogSnapshot::Mapping> CatalogSnapshot::Fresh(DB::Table table) const {
+    std::shared_ptr<const Mapping> mapping;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        mapping = mapping_;
+    }
+    const size_t idx = static_cast<size_t>(table);
+    if (mapping == nullptr || mapping->generations[idx] != db_->Generation(table)) {
+        return nullptr;
+    }
+    return mapping;
+}
+
+bool CatalogSnapshot::Load() {
+    // Generations are read first: a write that comes in before the version is read only makes
+    // the snapshot look stale.
+    const auto generations = Generations();
+    auto version = db_->Version();
+    return version.Ok() && Map(version.Value(), generations);
+}
+
+bool CatalogSnapshot::Map(uint64_t version, const std::array<uint64_t, 3>& generations) {
+    const int fd = open(path_.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    auto mapping = std::make_shared<Mapping>();
+    mapping->data = static_cast<const char*>(data);
+    mapping->size = size;
+    mapping->generations = generations;
+
+    Header header;
+    std::memcpy(&header, mapping->data, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.format_version != kFormatVersion) {
+        fmt::print(stderr, "{} is not a catalog snapshot of this version\n", path_);
+        return false;
+    }
+    if (header.sync_version != version) {
+        return false;
+    }
+
+    // Every count is checked against the size first, so the sum can't overflow.
+    const uint64_t body = size - sizeof(Header);
+    if (header.ingredients > body || header.tableware > body || header.recipes > body ||
+        header.recipe_ingredients > body || header.strings > body ||
+        header.ingredients * sizeof(IngredientRecord) + header.tableware * sizeof(TablewareRecord) +
+                header.recipes * sizeof(RecipeRecord) +
+                header.recipe_ingredients * sizeof(RecipeIngredientRecord) +
+                (header.ingredients + header.recipes) * sizeof(IndexEntry) + header.strings !=
+            body) {
+        fmt::print(stderr, "{} is truncated\n", path_);
+        return false;
+    }
+    if (Checksum(mapping->data + sizeof(Header), body) != header.checksum) {
+        fmt::print(stderr, "{} is corrupted\n", path_);
+        return false;
+    }
+
+    const char* section = mapping->data + sizeof(Header);
+    auto next = [&section](auto** records, size_t count) {
+        *records = reinterpret_cast<std::remove_pointer_t<decltype(records)>>(section);
+        section += count * sizeof(**records);
+    };
+    next(&mapping->ingredients, mapping->ingredients_count = header.ingredients);
+    next(&mapping->tableware, mapping->tableware_count = header.tableware);
+    next(&mapping->recipes, mapping->recipes_count = header.recipes);
+    next(&mapping->recipe_ingredients,
+         mapping->recipe_ingredients_count = header.recipe_ingredients);
+    next(&mapping->ingredients_index, header.ingredients);
+    next(&mapping->recipes_index, header.recipes);
+    mapping->strings = section;
+    mapping->strings_size = header.strings;
+
+    // The checksum only catches damage, so the references are checked too.
+    auto valid = [&mapping](StringRef ref) {
+        return uint64_t{ref.offset} + ref.size <= mapping->strings_size;
+    };
+    for (size_t idx = 0; idx < mapping->ingredients_count; ++idx) {
+        if (!valid(mapping->ingredients[idx].name) ||
+            mapping->ingredients_index[idx].position >= mapping->ingredients_count) {
+            return false;
+        }
+    }
+    for (size_t idx = 0; idx < mapping->tableware_count; ++idx) {
+        if (!valid(mapping->tableware[idx].name)) {
+            return false;
+        }
+    }
+    for (size_t idx = 0; idx < mapping->recipes_count; ++idx) {
+        const auto& r = mapping->recipes[idx];
+        if (!valid(r.name) || !valid(r.description) ||
+            uint64_t{r.first_ingredient} + r.ingredients + r.subrecipes >
+                mapping->recipe_ingredients_count ||
+            mapping->recipes_index[idx].position >= mapping->recipes_count) {
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    mapping_ = std::move(mapping);
+    return true;
+}
+
+StatusCode CatalogSnapshot::Write() {
+    const auto generations = Generations();
+    auto before = db_->Version();
+    auto products = db_->GetProducts();
+    auto tableware = db_->GetTableware();
+    auto recipes = db_->GetRecipes();
+    auto full_recipes = db_->GetFullRecipes();
+    auto after = db_->Version();
+    for (StatusCode code : {before.Code(), products.Code(), tableware.Code(), recipes.Code(),
+                            full_recipes.Code(), after.Code()}) {
+        if (code != StatusCode::OK) {
+            return code;
+        }
+    }
+    // The tables are read one by one, so the snapshot is only consistent if nothing was
+    // written in between.
+    if (before.Value() != after.Value()) {
+        return StatusCode::INTERNAL_ERROR;
+    }
+
+    std::string strings;
+    auto intern = [&strings](const std::string& s) {
+        StringRef ref{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(s.size())};
+        strings += s;
+        return ref;
+    };
+
+    std::vector<IngredientRecord> ingredient_records;
+    ingredient_records.reserve(products.Value().size());
+    for (const auto& v : products.Value()) {
+        ingredient_records.push_back({v.id, intern(v.name), v.kcal, v.nutrients, 0});
+    }
+    std::vector<TablewareRecord> tableware_records;
+    tableware_records.reserve(tableware.Value().size());
+    for (const auto& v : tableware.Value()) {
+        tableware_records.push_back({v.id, intern(v.name), v.weight, 0});
+    }
+    std::vector<RecipeRecord> recipe_records;
+    std::vector<RecipeIngredientRecord> recipe_ingredient_records;
+    recipe_records.reserve(recipes.Value().size());
+    // GetFullRecipes() returns the recipes sorted by id.
+    const auto& full = full_recipes.Value();
+    for (const auto& v : recipes.Value()) {
+        auto it = std::lower_bound(
+            full.begin(), full.end(), v.id,
+            [](const FullRecipe& recipe, size_t id) { return recipe.header.id < id; });
+        if (it == full.end() || it->header.id != v.id) {
+            fmt::print(stderr, "GetFullRecipes() has no recipe {}\n", v.id);
+            return StatusCode::INTERNAL_ERROR;
+        }
+        recipe_records.push_back({v.id, it->version, intern(v.name), intern(it->description),
+                                  static_cast<uint32_t>(recipe_ingredient_records.size()),
+                                  static_cast<uint32_t>(it->ingredients.size()),
+                                  static_cast<uint32_t>(it->subrecipes.size()), 0});
+        for (const auto* list : {&it->ingredients, &it->subrecipes}) {
+            for (const auto& ingredient : *list) {
+                recipe_ingredient_records.push_back(
+                    {ingredient.ingredient_id, ingredient.weight, 0});
+            }
+        }
+    }
+
+    // StringRef and RecipeRecord hold 32-bit offsets, which the casts above would have cut.
+    if (strings.size() > UINT32_MAX || recipe_ingredient_records.size() > UINT32_MAX) {
+        fmt::print(stderr, "The catalog is too large for a snapshot: {} bytes of strings\n",
+                   strings.size());
+        return StatusCode::INVALID_ARGUMENT;
+    }
+
+    std::string body;
+    Append(ingredient_records, &body);
+    Append(tableware_records, &body);
+    Append(recipe_records, &body);
+    Append(recipe_ingredient_records, &body);
+    Append(BuildIndex(ingredient_records), &body);
+    Append(BuildIndex(recipe_records), &body);
+    body += strings;
+
+    Header header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.format_version = kFormatVersion;
+    header.sync_version = before.Value();
+    header.checksum = Checksum(body.data(), body.size());
+    header.ingredients = ingredient_records.size();
+    header.tableware = tableware_records.size();
+    header.recipes = recipe_records.size();
+    header.recipe_ingredients = recipe_ingredient_records.size();
+    header.strings = strings.size();
+
+    // Readers of the old file keep their mapping; the new one replaces it in one rename.
+    const std::string tmp_path = path_ + ".tmp";
+    FILE* file = std::fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr) {
+        fmt::print(stderr, "Can't create {}\n", tmp_path);
+        return StatusCode::INTERNAL_ERROR;
+    }
+    const bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                         std::fwrite(body.data(), 1, body.size(), file) == body.size() &&
+                         std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (std::fclose(file) != 0 || !written ||
+        std::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+        fmt::print(stderr, "Can't write {}\n", path_);
+        std::remove(tmp_path.c_str());
+        return StatusCode::INTERNAL_ERROR;
+    }
+
+    return Map(before.Value(), generations) ? StatusCode::OK : StatusCode::INTERNAL_ERROR;
+}
+
+bool CatalogSnapshot::Refresh(bool write) {
+    std::shared_ptr<const Mapping> mapping;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        mapping = mapping_;
+    }
+    if (mapping != nullptr && mapping->generations == Generations()) {
+        return true;
+    }
+    return write ? Write() == StatusCode::OK : Load();
+}
+
+std::optional<std::vector<Ingredient>> CatalogSnapshot::GetProducts() const {
+    auto m = Fresh(DB::Table::INGREDIENTS);
+    if (m == nullptr) {
+        return std::nullopt;
+    }
+
+    std::vector<Ingredient> ret;
+    ret.reserve(m->ingredients_count);
+    for (size_t idx = 0; idx < m->ingredients_count; ++idx) {
+        const auto& r = m->ingredients[idx];
+        ret.emplace_back(std::string(m->String(r.name)), r.kcal, r.id, r.nutrients);
+    }
+    return ret;
+}
+
+std::optional<Ingredient> CatalogSnapshot::GetProduct(size_t id) const {
+    auto m = Fresh(DB::Table::INGREDIENTS);
+    if (m == nullptr) {
+        return std::nullopt;
+    }
+
+    const auto* r = FindById(m->ingredients, m->ingredients_index, m->ingredients_count, id);
+    if (r == nullptr) {
+        return std::nullopt;
+    }
+    return Ingredient(std::string(m->String(r->name)), r->kcal, r->id, r->nutrients);
+}
+
+std::optional<std::vector<Tableware>> CatalogSnapshot::GetTableware() const {
+    auto m = Fresh(DB::Table::TABLEWARE);
+    if (m == nullptr) {
+        return std::nullopt;
+    }
+
+    std::vector<Tableware> ret;
+    ret.reserve(m->tableware_count);
+    for (size_t idx = 0; idx < m->tableware_count; ++idx) {
+        const auto& r = m->tableware[idx];
+        ret.emplace_back(std::string(m->String(r.name)), r.weight, r.id);
+    }
+    return ret;
+}
+
+std::optional<std::vector<RecipeHeader>> CatalogSnapshot::GetRecipes() const {
+    auto m = Fresh(DB::Table::RECIPE);
+    if (m == nullptr) {
+        return std::nullopt;
+    }
+
+    std::vector<RecipeHeader> ret;
+    ret.reserve(m->recipes_count);
+    for (size_t idx = 0; idx < m->recipes_count; ++idx) {
+        const auto& r = m->recipes[idx];
+        ret.emplace_back(std::string(m->String(r.name)), r.id);
+    }
+    return ret;
+}
+
+std::optional<FullRecipe> CatalogSnapshot::GetRecipeInfo(size_t id) const {
+    auto m = Fresh(DB::Table::RECIPE);
+    if (m == nullptr) {
+        return std::nullopt;
+    }
+
+    const auto* r = FindById(m->recipes, m->recipes_index, m->recipes_count, id);
+    if (r == nullptr) {
+        return std::nullopt;
+    }
+    FullRecipe ret;
+    ret.header = RecipeHeader(std::string(m->String(r->name)), r->id);
+    ret.description = m->String(r->description);
+    ret.version = r->version;
+    ret.ingredients.reserve(r->ingredients);
+    for (size_t idx = r->first_ingredient; idx < r->first_ingredient + r->ingredients; ++idx) {
+        const auto& ingredient = m->recipe_ingredients[idx];
+        ret.ingredients.emplace_back(ingredient.ingredient_id, ingredient.weight);
+    }
+    ret.subrecipes.reserve(r->subrecipes);
+    for (size_t idx = r->first_ingredient + r->ingredients;
+         idx < r->first_ingredient + r->ingredients + r->subrecipes; ++idx) {
+        const auto& subrecipe = m->recipe_ingredients[idx];
+        ret.subrecipes.emplace_back(subrecipe.ingredient_id, subrecipe.weight);
+    }
+    return ret;
+}
+
+}  // namespace foodculator
@@ -0,0 +1,71 @@
+#ifndef __SRC_SNAPSHOT_CATALOG_SNAPSHOT_H__
+#define __SRC_SNAPSHOT_CATALOG_SNAPSHOT_H__
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "db/db.h"
+#include "util/statusor.h"
+
+namespace foodculator {
+
+// CatalogSnapshot serves ingredients, tableware and recipes from a memory-mapped file instead
+// of SQLite, so a freshly started server doesn't have to read the tables row by row.
+//
+// The file holds fixed-width records in the order the DB lists them, sorted indices of their
+// ids, a pool with their strings, the sync version of the database it was taken at, and a
+// checksum. It is replaced atomically by Write(). A snapshot is only used while it is as new as
+// the database; after a write the getters return nullopt and callers read from DB until the
+// snapshot is rewritten.
+class CatalogSnapshot {
+   public:
+    CatalogSnapshot(DB* db, std::string path);
+    ~CatalogSnapshot();
+
+    // Maps the file if it is intact and was taken at the current version of the database.
+    bool Load();
+
+    // Takes a snapshot of the database, renames it over the file and maps it. Fails with
+    // INTERNAL_ERROR if the database was written to meanwhile, and with INVALID_ARGUMENT if the
+    // names and descriptions take more than the 4 GiB the offsets of the file can address.
+    StatusCode Write();
+
+    // Brings a stale snapshot up to date by writing a new one, or, in processes that leave
+    // writing to another one, by loading the file it has written. Returns true if the mapped
+    // snapshot is current.
+    bool Refresh(bool write);
+
+    // These return nullopt if the snapshot is stale, and the single row getters also if there
+    // is no such row.
+    std::optional<std::vector<Ingredient>> GetProducts() const;
+    std::optional<Ingredient> GetProduct(size_t id) const;
+    std::optional<std::vector<Tableware>> GetTableware() const;
+    std::optional<std::vector<RecipeHeader>> GetRecipes() const;
+    std::optional<FullRecipe> GetRecipeInfo(size_t id) const;
+
+   private:
+    struct Mapping;
+
+    // Maps `path_` if it is intact and was taken at `version`. Once mapped, the snapshot is
+    // current for as long as the tables stay at `generations`.
+    bool Map(uint64_t version, const std::array<uint64_t, 3>& generations);
+    std::array<uint64_t, 3> Generations() const;
+    // Returns the mapping if it is current for `table`.
+    std::shared_ptr<const Mapping> Fresh(DB::Table table) const;
+
+    DB* db_;
+    const std::string path_;
+
+    // Guards `mapping_`.
+    mutable std::mutex mu_;
+    std::shared_ptr<const Mapping> mapping_;
+};
+
+}  // namespace foodculator
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef __SRC_UTIL_ROUTER_H__
+#define __SRC_UTIL_ROUTER_H__
+
+#include <array>
+#include <charconv>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace foodculator {
+
+// Numeric path parameters captured by Router, in the order they appear in the pattern.
+class RouteParams {
+   public:
+    static constexpr size_t kMaxParams = 4;
+
+    size_t size() const { return size_; }
+    size_t operator[](size_t idx) const { return values_[idx]; }
+
+    void Clear() { size_ = 0; }
+    bool Push(size_t value) {
+        if (size_ == kMaxParams) {
+            return false;
+        }
+        values_[size_++] = value;
+        return true;
+    }
+
+   private:
+    std::array<size_t, kMaxParams> values_;
+    size_t size_ = 0;
+};
+
+// Router maps (method, path) pairs to handlers using a trie of path segments that is built
+// once at startup. A pattern is a sequence of literal segments and `:id` placeholders, e.g.
+// "/recipe/:id". A placeholder matches a non-empty run of decimal digits that fits into
+// size_t; its value is stored into RouteParams, so no regex or allocation happens per request.
+template <class Handler>
+class Router {
+   public:
+    // Returns false if the pattern is malformed or has already been added for this method.
+    bool Add(std::string_view method, std::string_view pattern, Handler handler) {
+        if (pattern.empty() || pattern.front() != '/') {
+            return false;
+        }
+
+        Node* node = &root_;
+        size_t params = 0;
+        for (std::string_view rest = pattern.substr(1); !rest.empty();) {
+            std::string_view segment = NextSegment(&rest);
+            if (segment.empty()) {
+                return false;
+            }
+
+            if (segment == ":id") {
+                if (++params > RouteParams::kMaxParams) {
+                    return false;
+                }
+                if (!node->param_child) {
+                    node->param_child = std::make_unique<Node>();
+                }
+                node = node->param_child.get();
+                continue;
+            }
+
+            Node* next = node->FindChild(segment);
+            if (next == nullptr) {
+                node->children.emplace_back(std::string(segment), std::make_unique<Node>());
+                next = node->children.back().second.get();
+            }
+            node = next;
+        }
+
+        if (node->FindHandler(method) != nullptr) {
+            return false;
+        }
+        node->handlers.emplace_back(std::string(method), std::move(handler));
+        return true;
+    }
+
+    // Returns nullptr if no route matches. `params` receives the values of `:id` segments.
+    const Handler* Match(std::string_view method, std::string_view path,
+                         RouteParams* params) const {
+        params->Clear();
+        if (path.empty() || path.front() != '/') {
+            return nullptr;
+        }
+
+        const Node* node = &root_;
+        for (std::string_view rest = path.substr(1); !rest.empty() && node != nullptr;) {
+            std::string_view segment = NextSegment(&rest);
+            if (segment.empty()) {
+                return nullptr;
+            }
+
+            if (const Node* next = node->FindChild(segment); next != nullptr) {
+                node = next;
+                continue;
+            }
+
+            size_t value = 0;
+            const char* end = segment.data() + segment.size();
+            auto [ptr, ec] = std::from_chars(segment.data(), end, value);
+            if (ec != std::errc() || ptr != end || !params->Push(value)) {
+                return nullptr;
+            }
+            node = node->param_child.get();
+        }
+
+        return node == nullptr ? nullptr : node->FindHandler(method);
+    }
+
+   private:
+    struct Node {
+        std::vector<std::pair<std::string, std::unique_ptr<Node>>> children;
+        std::unique_ptr<Node> param_child;
+        std::vector<std::pair<std::string, Handler>> handlers;
+
+        Node* FindChild(std::string_view segment) const {
+            for (const auto& [name, child] : children) {
+                if (name == segment) {
+                    return child.get();
+                }
+            }
+            return nullptr;
+        }
+
+        const Handler* FindHandler(std::string_view method) const {
+            for (const auto& [name, handler] : handlers) {
+                if (name == method) {
+                    return &handler;
+                }
+            }
+            return nullptr;
+        }
+    };
+
+    // Cuts the next '/'-separated segment off the front of `rest`.
+    static std::string_view NextSegment(std::string_view* rest) {
+        size_t pos = rest->find('/');
+        if (pos == std::string_view::npos) {
+            std::string_view segment = *rest;
+            *rest = {};
+            return segment;
+        }
+
+        std::string_view segment = rest->substr(0, pos);
+        rest->remove_prefix(pos + 1);
+        if (rest->empty()) {
+            // A trailing slash leaves an empty last segment, which never matches.
+            return {};
+        }
+        return segment;
+    }
+
+    Node root_;
+};
+
+}  // namespace foodculator
+
+#endif
@@ -10,6 +10,8 @@ std::string_view ToString(StatusCode code) {
             return "INVALID_ARGUMENT";
         case StatusCode::NOT_FOUND:
             return "NOT_FOUND";
+        case StatusCode::CONFLICT:
+            return "CONFLICT";
         default:
             return "INTERNAL_ERROR";
     }
@@ -7,7 +7,7 @@
 
 namespace foodculator {
 
-enum class StatusCode { OK = 0, INVALID_ARGUMENT, NOT_FOUND, INTERNAL_ERROR };
+enum class StatusCode { OK = 0, INVALID_ARGUMENT, NOT_FOUND, CONFLICT, INTERNAL_ERROR };
 std::string_view ToString(StatusCode code);
 
 template <class T>
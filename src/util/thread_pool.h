@@ -0,0 +1,114 @@
+#ifndef __SRC_UTIL_THREAD_POOL_H__
+#define __SRC_UTIL_THREAD_POOL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace foodculator {
+
+// ThreadPool runs submitted tasks on a fixed set of threads in FIFO order.
+// The destructor waits until all submitted tasks are finished.
+class ThreadPool {
+   public:
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Submit(std::function<void()> task);
+    size_t size() const { return threads_.size(); }
+
+   private:
+    void Work();
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_ = false;
+
+    std::vector<std::thread> threads_;
+};
+
+// Runs `task(worker, idx)` for every idx in [0, count) on `threads` threads and waits for all
+// of them. `worker` < `threads` identifies the thread. A single task runs on the calling thread.
+template <class Task>
+void ParallelFor(size_t count, size_t threads, Task task) {
+    if (count == 1 || threads <= 1) {
+        for (size_t idx = 0; idx < count; ++idx) {
+            task(0, idx);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next = 0;
+    // The destructor of the pool waits for the submitted tasks.
+    ThreadPool pool(std::min(threads, count));
+    for (size_t worker = 0; worker < pool.size(); ++worker) {
+        pool.Submit([&next, &task, count, worker] {
+            for (size_t idx = next++; idx < count; idx = next++) {
+                task(worker, idx);
+            }
+        });
+    }
+}
+
+// Like ParallelFor() above, but on the threads of a long-lived `pool` instead of threads started
+// for the call. The calling thread is worker 0 and is joined by at most `threads` - 1 tasks of
+// the pool. Tasks that only start once all indices are taken return at once, so a busy pool
+// slows the call down but never blocks it, even when it is made from a task of the same pool.
+// A null `pool` starts the threads as above.
+template <class Task>
+void ParallelFor(ThreadPool* pool, size_t count, size_t threads, Task task) {
+    if (pool == nullptr || count == 1 || threads <= 1) {
+        ParallelFor(count, pool == nullptr ? threads : 1, std::move(task));
+        return;
+    }
+
+    // Outlives the call if some of the tasks are still queued when it returns.
+    struct State {
+        std::atomic<size_t> next = 0;
+        std::mutex mu;
+        std::condition_variable cv;
+        size_t running = 0;
+        bool done = false;
+    };
+    auto state = std::make_shared<State>();
+    auto run = [&task, count](State* s, size_t worker) {
+        for (size_t idx = s->next++; idx < count; idx = s->next++) {
+            task(worker, idx);
+        }
+    };
+    for (size_t worker = 1; worker < std::min(threads, count); ++worker) {
+        pool->Submit([state, &run, worker] {
+            {
+                std::lock_guard<std::mutex> lock(state->mu);
+                if (state->done) {
+                    return;
+                }
+                ++state->running;
+            }
+            run(state.get(), worker);
+            std::lock_guard<std::mutex> lock(state->mu);
+            if (--state->running == 0) {
+                state->cv.notify_all();
+            }
+        });
+    }
+
+    run(state.get(), 0);
+    std::unique_lock<std::mutex> lock(state->mu);
+    state->done = true;
+    state->cv.wait(lock, [&state] { return state->running == 0; });
+}
+
+}  // namespace foodculator
+
+#endif
@@ -0,0 +1,40 @@
+#include "timing.h"
+
+#include <cstring>
+
+namespace foodculator {
+
+void RequestTiming::Add(const char* name, Clock::duration duration) {
+    // Requests have a handful of phases, so a linear search beats hashing.
+    for (auto& phase : phases_) {
+        if (phase.name == name || std::strcmp(phase.name, name) == 0) {
+            phase.total += duration;
+            ++phase.count;
+            return;
+        }
+    }
+    phases_.push_back({name, duration, 1});
+}
+
+std::string RequestTiming::ToHeader() const {
+    std::string ret;
+    for (const auto& phase : phases_) {
+        if (!ret.empty()) {
+            ret += ", ";
+        }
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(phase.total);
+        ret += phase.name;
+        ret += ";dur=";
+        ret += std::to_string(us.count() / 1000);
+        ret += '.';
+        const std::string frac = std::to_string(us.count() % 1000);
+        ret.append(3 - frac.size(), '0');
+        ret += frac;
+        if (phase.count > 1) {
+            ret += ";desc=\"x" + std::to_string(phase.count) + "\"";
+        }
+    }
+    return ret;
+}
+
+}  // namespace foodculator
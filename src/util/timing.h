@@ -0,0 +1,74 @@
+#ifndef __SRC_UTIL_TIMING_H__
+#define __SRC_UTIL_TIMING_H__
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace foodculator {
+
+// RequestTiming adds up the time the current thread spends in named phases of a request, e.g.
+// "db_step", while it is alive. TimingSpans created on other threads, or when no RequestTiming
+// exists, cost a thread-local load and a branch.
+class RequestTiming {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    RequestTiming() : prev_(current_) { current_ = this; }
+    ~RequestTiming() { current_ = prev_; }
+
+    RequestTiming(const RequestTiming&) = delete;
+    RequestTiming& operator=(const RequestTiming&) = delete;
+
+    // The innermost RequestTiming of this thread, if any.
+    static RequestTiming* Current() { return current_; }
+
+    // `name` must be a string literal.
+    void Add(const char* name, Clock::duration duration);
+
+    // Formats the phases for the Server-Timing header in the order they first occurred, e.g.
+    // `db_wait;dur=0.004;desc="x3", db_step;dur=1.250;desc="x3", serialize;dur=0.310`.
+    std::string ToHeader() const;
+
+   private:
+    struct Phase {
+        const char* name;
+        Clock::duration total;
+        uint32_t count;
+    };
+
+    static inline thread_local RequestTiming* current_ = nullptr;
+
+    RequestTiming* const prev_;
+    std::vector<Phase> phases_;
+};
+
+// Adds the time from construction to destruction to the phase `name` of the current request.
+class TimingSpan {
+   public:
+    explicit TimingSpan(const char* name) : TimingSpan(RequestTiming::Current(), name) {}
+    // For hot loops: `timing` is RequestTiming::Current() looked up once outside the loop.
+    TimingSpan(RequestTiming* timing, const char* name) : timing_(timing), name_(name) {
+        if (timing_ != nullptr) {
+            start_ = RequestTiming::Clock::now();
+        }
+    }
+    ~TimingSpan() {
+        if (timing_ != nullptr) {
+            timing_->Add(name_, RequestTiming::Clock::now() - start_);
+        }
+    }
+
+    TimingSpan(const TimingSpan&) = delete;
+    TimingSpan& operator=(const TimingSpan&) = delete;
+
+   private:
+    RequestTiming* const timing_;
+    const char* const name_;
+    RequestTiming::Clock::time_point start_;
+};
+
+}  // namespace foodculator
+
+#endif
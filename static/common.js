@@ -7,3 +7,24 @@ function callOnEnter(fn, ...params) {
         fn(params);
     }
 }
+
+// Keeps a list of `table` rows up to date with changes made by other clients.
+// `load()` (re)loads the whole list, `onChange(change)` applies one added or deleted row.
+function watchChanges(table, load, onChange) {
+    let poll = (epoch, since) => getChangesRequest(epoch, since, delta => {
+        if (delta.reset) {
+            load();
+        }
+        delta.changes.filter(c => c.table === table).forEach(onChange);
+
+        // The server may answer right away when it is busy, don't hammer it then.
+        setTimeout(() => poll(delta.epoch, delta.seq), delta.changes.length > 0 ? 0 : 1000);
+    }, err => setTimeout(() => poll(epoch, since), 5000));
+
+    // The list is loaded after the current position in the change log is known, so no
+    // change can slip in between.
+    getChangesRequest(undefined, undefined, delta => {
+        load();
+        poll(delta.epoch, delta.seq);
+    }, err => load());
+}
@@ -44,8 +44,10 @@ function getRecipesRequest(success, fail = function(param) {}) {
     $.get('/get_recipes').done(success).fail(data => fail(data.responseText));
 }
 
-function getRecipeRequest(id, success, fail = function(param) {}) {
-    $.get(`/recipe/${id}`).done(success).fail(data => fail(data.responseText));
+// With `expand`, every ingredient of the recipe comes with its name and kcal.
+function getRecipeRequest(id, success, fail = function(param) {}, expand = false) {
+    const url = expand ? `/recipe/${id}?expand=ingredients` : `/recipe/${id}`;
+    $.get(url).done(success).fail(data => fail(data.responseText));
 }
 
 function addRecipeRequest(
@@ -68,3 +70,9 @@ function deleteRecipeRequest(name, id, success, fail = function(param) {}) {
         .done(success)
         .fail(data => fail(data.responseText));
 }
+
+// `epoch` and `since` come from the previous reply; a log restarted in between resets.
+function getChangesRequest(epoch, since, success, fail = function(param) {}) {
+    const url = (since === undefined) ? '/changes' : `/changes?epoch=${epoch}&since=${since}`;
+    $.get(url).done(success).fail(data => fail(data.responseText));
+}
@@ -0,0 +1,210 @@
+#include "bot/bot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fmt/format.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace foodculator {
+namespace {
+
+// FakeBotApi plays the Telegram Bot API server in-process: tests push updates into it and
+// inspect the messages that the bot sent back.
+class FakeBotApi : public BotApi {
+   public:
+    void Push(int64_t chat_id, std::string text) {
+        std::lock_guard<std::mutex> lock(mu_);
+        updates_.push_back(BotUpdate{next_update_id_++, chat_id, std::move(text)});
+        cv_.notify_all();
+    }
+
+    StatusOr<std::vector<BotUpdate>> GetUpdates(int64_t offset, int timeout_sec) override {
+        std::unique_lock<std::mutex> lock(mu_);
+        // Updates before `offset` are confirmed and never sent again.
+        while (!updates_.empty() && updates_.front().update_id < offset) {
+            updates_.pop_front();
+        }
+        cv_.wait_for(lock, std::chrono::milliseconds(50), [this] { return !updates_.empty(); });
+        return StatusOr{std::vector<BotUpdate>(updates_.begin(), updates_.end())};
+    }
+
+    StatusCode SendMessage(int64_t chat_id, const std::string& text) override {
+        std::lock_guard<std::mutex> lock(mu_);
+        sent_.emplace_back(chat_id, text);
+        cv_.notify_all();
+        return StatusCode::OK;
+    }
+
+    // Waits until the bot has sent messages with all `texts` to `chat_id`.
+    std::vector<std::string> WaitForReplies(int64_t chat_id, size_t texts) {
+        std::unique_lock<std::mutex> lock(mu_);
+        std::vector<std::string> ret;
+        cv_.wait_for(lock, std::chrono::seconds(5), [&] {
+            ret.clear();
+            for (const auto& [id, text] : sent_) {
+                if (id == chat_id) {
+                    ret.push_back(text);
+                }
+            }
+            return CountAnswers(ret) >= texts;
+        });
+        return ret;
+    }
+
+    // Replies to several commands are separated by an empty line.
+    static size_t CountAnswers(const std::vector<std::string>& messages) {
+        size_t ret = 0;
+        for (const auto& message : messages) {
+            ret += 1;
+            for (size_t pos = message.find("\n\n"); pos != std::string::npos;
+                 pos = message.find("\n\n", pos + 2)) {
+                ++ret;
+            }
+        }
+        return ret;
+    }
+
+   private:
+    std::mutex mu_;
+    std::condition_variable cv_;
+    int64_t next_update_id_ = 1;
+    std::deque<BotUpdate> updates_;
+    std::vector<std::pair<int64_t, std::string>> sent_;
+};
+
+class BotTest : public testing::Test {
+   protected:
+    void SetUp() override {
+        db_ = DB::Create(":memory:");
+        ASSERT_TRUE(db_);
+
+        auto milk_id = db_->AddProduct("Молоко", 48).Value();
+        auto flour_id = db_->AddProduct("Мука", 364).Value();
+        ASSERT_TRUE(db_->AddTableware("Сковорода", 1080).Ok());
+        ASSERT_TRUE(db_->CreateRecipe("Блины", "", {{milk_id, 300}, {flour_id, 100}}).Ok());
+
+        bot_ = std::make_unique<Bot>(&api_, db_.get(), 4);
+        thread_ = std::thread([this] { bot_->Run(); });
+    }
+
+    void TearDown() override {
+        bot_->Stop();
+        thread_.join();
+        bot_.reset();
+    }
+
+    FakeBotApi api_;
+    std::unique_ptr<DB> db_;
+    std::unique_ptr<Bot> bot_;
+    std::thread thread_;
+};
+
+TEST_F(BotTest, Commands) {
+    api_.Push(1, "/ingredients");
+    auto replies = api_.WaitForReplies(1, 1);
+    ASSERT_THAT(replies, testing::SizeIs(1));
+    EXPECT_EQ(replies[0], "Наши ингредиенты:\nМолоко - 48 ккал/100г\nМука - 364 ккал/100г");
+
+    api_.Push(2, "/pots@foodculator_bot");
+    replies = api_.WaitForReplies(2, 1);
+    ASSERT_THAT(replies, testing::SizeIs(1));
+    EXPECT_EQ(replies[0], "Наша посуда:\nСковорода - 1080 г");
+
+    api_.Push(3, "/ingredient молоко");
+    replies = api_.WaitForReplies(3, 1);
+    ASSERT_THAT(replies, testing::SizeIs(1));
+    EXPECT_EQ(replies[0], "Молоко - 48 ккал/100г");
+
+    api_.Push(4, "/energy блины");
+    replies = api_.WaitForReplies(4, 1);
+    ASSERT_THAT(replies, testing::SizeIs(1));
+    EXPECT_EQ(replies[0], "Блины: 127 ккал/100г, всего 508 ккал на 400 г");
+
+    api_.Push(5, "/energy борщ");
+    replies = api_.WaitForReplies(5, 1);
+    ASSERT_THAT(replies, testing::SizeIs(1));
+    EXPECT_EQ(replies[0], "Рецепт \"борщ\" не найден.");
+}
+
+TEST_F(BotTest, RepliesAreBatchedPerChatInOrder) {
+    constexpr int kChats = 8;
+    constexpr int kCommands = 20;
+    for (int i = 0; i < kCommands; ++i) {
+        for (int chat = 1; chat <= kChats; ++chat) {
+            api_.Push(chat, i % 2 == 0 ? "/pots" : "/ingredient мука");
+        }
+    }
+
+    for (int chat = 1; chat <= kChats; ++chat) {
+        auto replies = api_.WaitForReplies(chat, kCommands);
+        EXPECT_LE(replies.size(), kCommands);
+
+        std::string all;
+        for (const auto& reply : replies) {
+            all += (all.empty() ? "" : "\n\n") + reply;
+        }
+
+        std::string want;
+        for (int i = 0; i < kCommands; ++i) {
+            want += (want.empty() ? "" : "\n\n");
+            want += i % 2 == 0 ? "Наша посуда:\nСковорода - 1080 г" : "Мука - 364 ккал/100г";
+        }
+        EXPECT_EQ(all, want) << "chat " << chat;
+    }
+}
+
+TEST_F(BotTest, LongAnswersAreSplit) {
+    std::string want = "Наши ингредиенты:\nМолоко - 48 ккал/100г\nМука - 364 ккал/100г";
+    for (int i = 0; i < 300; ++i) {
+        const std::string name = fmt::format("Продукт с длинным названием {}", i);
+        ASSERT_TRUE(db_->AddProduct(name, 100).Ok());
+        want += fmt::format("\n{} - 100 ккал/100г", name);
+    }
+
+    api_.Push(1, "/ingredients");
+    const size_t messages = SplitMessage(want).size();
+    ASSERT_GT(messages, 1);
+    auto replies = api_.WaitForReplies(1, messages);
+    ASSERT_THAT(replies, testing::SizeIs(messages));
+    std::string all;
+    for (const auto& reply : replies) {
+        // All characters here are in the BMP, so each one that doesn't continue another is
+        // one UTF-16 code unit.
+        const size_t length = std::count_if(reply.begin(), reply.end(),
+                                            [](char c) { return (c & 0xc0) != 0x80; });
+        EXPECT_LE(length, BotApi::kMaxMessageLength);
+        all += (all.empty() ? "" : "\n") + reply;
+    }
+    EXPECT_EQ(all, want);
+}
+
+TEST(SplitMessage, CutsAtLineBreaks) {
+    EXPECT_THAT(SplitMessage("", 10), testing::IsEmpty());
+    EXPECT_THAT(SplitMessage("short", 10), testing::ElementsAre("short"));
+    EXPECT_THAT(SplitMessage("0123456789", 10), testing::ElementsAre("0123456789"));
+    EXPECT_THAT(SplitMessage("one\ntwo\nthree", 10), testing::ElementsAre("one\ntwo", "three"));
+    // Answers to several commands are separated by an empty line, which is dropped at a cut.
+    EXPECT_THAT(SplitMessage("first\n\nsecond", 10), testing::ElementsAre("first", "second"));
+    // A line that doesn't fit on its own is cut between characters.
+    EXPECT_THAT(SplitMessage("0123456789abcde\nf", 10),
+                testing::ElementsAre("0123456789", "abcde\nf"));
+}
+
+TEST(SplitMessage, CountsUtf16CodeUnits) {
+    // Cyrillic letters take two bytes and one code unit each.
+    EXPECT_THAT(SplitMessage("Молоко", 6), testing::ElementsAre("Молоко"));
+    EXPECT_THAT(SplitMessage("Молоко", 4), testing::ElementsAre("Моло", "ко"));
+    // Emoji take four bytes and two code units, and are never cut in half.
+    EXPECT_THAT(SplitMessage("🥞🥞🥞", 5), testing::ElementsAre("🥞🥞", "🥞"));
+}
+
+}  // namespace
+}  // namespace foodculator
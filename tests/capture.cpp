@@ -0,0 +1,86 @@
+#include "server/capture.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace foodculator {
+namespace {
+
+std::string TempPath(const std::string& name) {
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+CapturedRequest Request(uint64_t arrival_us, std::string method, std::string target,
+                        std::string body, int status, std::string_view response) {
+    CapturedRequest r;
+    r.arrival_us = arrival_us;
+    r.method = std::move(method);
+    r.target = std::move(target);
+    r.body = std::move(body);
+    r.status = status;
+    r.response_size = response.size();
+    r.response_hash = HashBody(response);
+    return r;
+}
+
+MATCHER_P(SameRequest, expected, "") {
+    return arg.arrival_us == expected.arrival_us && arg.method == expected.method &&
+           arg.target == expected.target && arg.body == expected.body &&
+           arg.status == expected.status && arg.response_size == expected.response_size &&
+           arg.response_hash == expected.response_hash;
+}
+
+TEST(Capture, WriteAndRead) {
+    const std::string path = TempPath("foodculator_capture_test.log");
+    std::string binary(300, '\0');
+    for (size_t i = 0; i < binary.size(); ++i) {
+        binary[i] = static_cast<char>(i);
+    }
+
+    // Requests are appended when they complete, so a slow one comes after a later fast one.
+    const auto slow = Request(10, "GET", "/get_ingredients?since=3", "", 200, R"({"version":4})");
+    const auto fast = Request(7000000000, "POST", "/add_ingredient", binary, 400, "bad request");
+    const auto last = Request(7000000001, "DELETE", "/ingredient/5", "", 200, "");
+    {
+        auto writer = CaptureWriter::Create(path);
+        ASSERT_TRUE(writer);
+        writer->Append(fast);
+        writer->Append(slow);
+        writer->Append(last);
+    }
+
+    auto read = ReadCapture(path);
+    ASSERT_TRUE(read.Ok()) << read.Error();
+    EXPECT_THAT(read.Value(),
+                testing::ElementsAre(SameRequest(slow), SameRequest(fast), SameRequest(last)));
+
+    // A record cut short by a crash is dropped.
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    read = ReadCapture(path);
+    ASSERT_TRUE(read.Ok()) << read.Error();
+    EXPECT_THAT(read.Value(), testing::ElementsAre(SameRequest(slow), SameRequest(fast)));
+
+    std::filesystem::remove(path);
+}
+
+TEST(Capture, NotACaptureLog) {
+    EXPECT_EQ(ReadCapture(TempPath("foodculator_no_such_capture.log")).Code(),
+              StatusCode::NOT_FOUND);
+
+    const std::string path = TempPath("foodculator_not_a_capture.log");
+    std::ofstream(path) << "GET /get_ingredients\n";
+    EXPECT_EQ(ReadCapture(path).Code(), StatusCode::INVALID_ARGUMENT);
+    std::filesystem::remove(path);
+}
+
+TEST(Capture, HashBody) {
+    EXPECT_EQ(HashBody(""), 14695981039346656037ull);
+    EXPECT_NE(HashBody(R"({"kcal":10})"), HashBody(R"({"kcal":11})"));
+}
+
+}  // namespace
+}  // namespace foodculator
@@ -0,0 +1,132 @@
+#include "server/catalog_export.h"
+
+#include <string>
+#include <vector>
+
+#include "fmt/format.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace foodculator {
+namespace {
+
+std::vector<std::string> SplitLines(const std::string& text, std::string_view separator) {
+    std::vector<std::string> ret;
+    size_t start = 0;
+    for (size_t end = text.find(separator); end != std::string::npos;
+         end = text.find(separator, start)) {
+        ret.push_back(text.substr(start, end - start));
+        start = end + separator.size();
+    }
+    EXPECT_EQ(start, text.size()) << "The last line isn't terminated.";
+    return ret;
+}
+
+std::string Export(DB* db, ExportFormat format) {
+    std::string ret;
+    EXPECT_EQ(WriteCatalog(db, format,
+                           [&ret](std::string_view chunk) {
+                               ret += chunk;
+                               return true;
+                           }),
+              StatusCode::OK);
+    return ret;
+}
+
+TEST(CatalogExport, Ndjson) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+    const size_t egg = db->AddProduct("egg", 150, {12.5f, 10, 1, 0, 0.3f, 1}).Value();
+    const size_t pan = db->AddTableware("pan", 800).Value();
+    const size_t omelette = db->CreateRecipe("omelette", "fry", {{egg, 120}}).Value();
+
+    const auto lines = SplitLines(Export(db.get(), ExportFormat::NDJSON), "\n");
+    ASSERT_EQ(lines.size(), 3);
+    std::string err;
+    const auto ingredient = json11::Json::parse(lines[0], err);
+    ASSERT_EQ(err, "");
+    EXPECT_EQ(ingredient["type"].string_value(), "ingredient");
+    EXPECT_EQ(ingredient["id"].string_value(), std::to_string(egg));
+    EXPECT_EQ(ingredient["nutrients"]["protein"].string_value(), "12.5");
+
+    const auto tableware = json11::Json::parse(lines[1], err);
+    EXPECT_EQ(tableware["type"].string_value(), "tableware");
+    EXPECT_EQ(tableware["id"].string_value(), std::to_string(pan));
+
+    const auto recipe = json11::Json::parse(lines[2], err);
+    EXPECT_EQ(recipe["type"].string_value(), "recipe");
+    EXPECT_EQ(recipe["header"]["id"].string_value(), std::to_string(omelette));
+    EXPECT_EQ(recipe["ingredients"][0]["weight"].string_value(), "120");
+}
+
+TEST(CatalogExport, Csv) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+    const size_t egg = db->AddProduct("egg, large", 150, {12.5f, 10, 1, 0, 0.3f, 1}).Value();
+    const size_t pan = db->AddTableware("pan", 800).Value();
+    const size_t stock = db->CreateRecipe("stock", "boil", {{egg, 10}}).Value();
+    const size_t soup =
+        db->CreateRecipe("soup", "say \"yum\"\nand eat", {{egg, 50}}, {{stock, 300}}).Value();
+
+    EXPECT_THAT(
+        SplitLines(Export(db.get(), ExportFormat::CSV), "\r\n"),
+        testing::ElementsAre(
+            "type,id,recipe_id,name,kcal,weight,description,protein,fat,carbohydrate,fibre,salt,"
+            "sugar",
+            fmt::format("ingredient,{},,\"egg, large\",150,,,12.5,10,1,0,0.3,1", egg),
+            fmt::format("tableware,{},,pan,,800,,,,,,,", pan),
+            fmt::format("recipe,{},,stock,,,boil,,,,,,", stock),
+            fmt::format("recipe_ingredient,{},{},,,10,,,,,,,", egg, stock),
+            fmt::format("recipe,{},,soup,,,\"say \"\"yum\"\"\nand eat\",,,,,,", soup),
+            fmt::format("recipe_ingredient,{},{},,,50,,,,,,,", egg, soup),
+            fmt::format("recipe_subrecipe,{},{},,,300,,,,,,,", stock, soup)));
+}
+
+TEST(CatalogExport, StreamsPageByPage) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+    const size_t count = 3 * DB::kExportPageSize + 7;
+    std::vector<Ingredient> products;
+    for (size_t id = 1; id <= count; ++id) {
+        products.emplace_back(fmt::format("product with a rather long name #{}", id), 100, id);
+    }
+    ASSERT_EQ(db->ImportProducts(products), StatusCode::OK);
+
+    size_t chunks = 0;
+    std::string text;
+    ASSERT_EQ(WriteCatalog(db.get(), ExportFormat::NDJSON,
+                           [&](std::string_view chunk) {
+                               EXPECT_LE(chunk.size(), 2 * kExportChunkSize);
+                               ++chunks;
+                               text += chunk;
+                               return true;
+                           }),
+              StatusCode::OK);
+    EXPECT_GT(chunks, 1);
+    const auto lines = SplitLines(text, "\n");
+    ASSERT_EQ(lines.size(), count);
+    std::string err;
+    for (size_t idx = 0; idx < count; ++idx) {
+        ASSERT_EQ(json11::Json::parse(lines[idx], err)["id"].string_value(),
+                  std::to_string(idx + 1));
+    }
+
+    // A client that goes away stops the walk.
+    chunks = 0;
+    EXPECT_EQ(WriteCatalog(db.get(), ExportFormat::NDJSON,
+                           [&chunks](std::string_view chunk) {
+                               ++chunks;
+                               return false;
+                           }),
+              StatusCode::INTERNAL_ERROR);
+    EXPECT_EQ(chunks, 1);
+}
+
+TEST(CatalogExport, ParsesFormats) {
+    EXPECT_EQ(ParseExportFormat("ndjson"), ExportFormat::NDJSON);
+    EXPECT_EQ(ParseExportFormat("csv"), ExportFormat::CSV);
+    EXPECT_EQ(ParseExportFormat("xml"), std::nullopt);
+}
+
+}  // namespace
+}  // namespace foodculator
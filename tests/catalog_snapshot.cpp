@@ -0,0 +1,103 @@
+#include "snapshot/catalog_snapshot.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace foodculator {
+namespace {
+
+class CatalogSnapshotTest : public testing::Test {
+   protected:
+    void SetUp() override {
+        path_ = testing::TempDir() + "foodculator_snapshot_test.bin";
+        std::remove(path_.c_str());
+        db_ = DB::Create(":memory:");
+        ASSERT_TRUE(db_);
+
+        milk_ = db_->AddProduct("milk", 48).Value();
+        flour_ = db_->AddProduct("flour", 364).Value();
+        db_->AddTableware("pot", 1200);
+        pancakes_ =
+            db_->CreateRecipe("pancakes", "Mix and fry.", {{milk_, 300}, {flour_, 200}}).Value();
+        db_->CreateRecipe("porridge", "", {{milk_, 250}}, {{pancakes_, 50}});
+    }
+
+    void TearDown() override { std::remove(path_.c_str()); }
+
+    std::string path_;
+    std::unique_ptr<DB> db_;
+    size_t milk_ = 0;
+    size_t flour_ = 0;
+    size_t pancakes_ = 0;
+};
+
+TEST_F(CatalogSnapshotTest, ServesTheTables) {
+    CatalogSnapshot snapshot(db_.get(), path_);
+    EXPECT_FALSE(snapshot.Load()) << "there is no file yet";
+    EXPECT_FALSE(snapshot.GetProducts());
+
+    ASSERT_EQ(snapshot.Write(), StatusCode::OK);
+    EXPECT_EQ(snapshot.GetProducts(), db_->GetProducts().Value());
+    EXPECT_EQ(snapshot.GetTableware(), db_->GetTableware().Value());
+    EXPECT_EQ(snapshot.GetRecipes(), db_->GetRecipes().Value());
+    EXPECT_EQ(snapshot.GetProduct(flour_), db_->GetProduct(flour_).Value());
+    EXPECT_EQ(snapshot.GetRecipeInfo(pancakes_), db_->GetRecipeInfo(pancakes_).Value());
+    EXPECT_EQ(snapshot.GetRecipeInfo(pancakes_)->version,
+              db_->GetRecipeInfo(pancakes_).Value().version);
+    auto recipes = db_->GetFullRecipes();
+    for (const auto& recipe : recipes.Value()) {
+        EXPECT_EQ(snapshot.GetRecipeInfo(recipe.header.id), recipe);
+    }
+    EXPECT_FALSE(snapshot.GetProduct(100)) << "unknown ids are left to the DB";
+    EXPECT_FALSE(snapshot.GetRecipeInfo(100));
+
+    // Another process maps the same file.
+    CatalogSnapshot reader(db_.get(), path_);
+    ASSERT_TRUE(reader.Load());
+    EXPECT_EQ(reader.GetRecipeInfo(pancakes_), db_->GetRecipeInfo(pancakes_).Value());
+}
+
+TEST_F(CatalogSnapshotTest, StaleAfterWrites) {
+    CatalogSnapshot snapshot(db_.get(), path_);
+    ASSERT_EQ(snapshot.Write(), StatusCode::OK);
+
+    db_->AddProduct("egg", 157);
+    EXPECT_FALSE(snapshot.GetProducts());
+    EXPECT_FALSE(snapshot.GetProduct(milk_));
+    EXPECT_TRUE(snapshot.GetTableware()) << "other tables are still current";
+
+    CatalogSnapshot reader(db_.get(), path_);
+    EXPECT_FALSE(reader.Load()) << "the file is older than the database";
+    EXPECT_FALSE(reader.Refresh(/*write=*/false));
+
+    EXPECT_TRUE(snapshot.Refresh(/*write=*/true));
+    EXPECT_EQ(snapshot.GetProducts(), db_->GetProducts().Value());
+    EXPECT_TRUE(reader.Refresh(/*write=*/false));
+    EXPECT_EQ(reader.GetProducts(), db_->GetProducts().Value());
+}
+
+TEST_F(CatalogSnapshotTest, RejectsCorruptedFiles) {
+    ASSERT_EQ(CatalogSnapshot(db_.get(), path_).Write(), StatusCode::OK);
+
+    {
+        std::fstream file(path_, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(-3, std::ios::end);
+        char byte = 0;
+        file.get(byte);
+        file.seekp(-3, std::ios::end);
+        file.put(byte ^ 0x20);
+    }
+    CatalogSnapshot snapshot(db_.get(), path_);
+    EXPECT_FALSE(snapshot.Load());
+    EXPECT_FALSE(snapshot.GetProducts());
+
+    std::ofstream(path_, std::ios::binary) << "FCSNAP";
+    EXPECT_FALSE(snapshot.Load()) << "truncated";
+}
+
+}  // namespace
+}  // namespace foodculator
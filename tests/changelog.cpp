@@ -0,0 +1,217 @@
+#include "db/changelog.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace foodculator {
+namespace {
+
+using std::chrono::milliseconds;
+
+TEST(ChangeLog, RecordsDatabaseWrites) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    const ChangeLog& changes = db->Changes();
+    EXPECT_EQ(changes.LastSeq(), 0);
+
+    auto milk_id = db->AddProduct("milk", 48).Value();
+    auto wok_id = db->AddTableware("wok", 1080).Value();
+    auto pie_id = db->CreateRecipe("pie", "", {{milk_id, 100}}).Value();
+    ASSERT_FALSE(db->AddProduct("milk", 48).Ok());
+    ASSERT_TRUE(db->DeleteRecipe(pie_id));
+    ASSERT_TRUE(db->DeleteRecipe(pie_id)) << "deleting a missing recipe is not a change";
+
+    auto delta = changes.Wait(0, milliseconds(0));
+    EXPECT_EQ(delta.seq, 4);
+    EXPECT_FALSE(delta.reset);
+    ASSERT_THAT(delta.changes, testing::SizeIs(4));
+
+    EXPECT_EQ(delta.changes[0].seq, 1);
+    EXPECT_EQ(delta.changes[0].table, DB::Table::INGREDIENTS);
+    EXPECT_EQ(delta.changes[0].op, Change::Op::ADDED);
+    EXPECT_EQ(delta.changes[0].id, milk_id);
+    EXPECT_EQ(delta.changes[0].row, Ingredient("milk", 48, milk_id).to_json());
+
+    EXPECT_EQ(delta.changes[1].table, DB::Table::TABLEWARE);
+    EXPECT_EQ(delta.changes[1].row, Tableware("wok", 1080, wok_id).to_json());
+
+    EXPECT_EQ(delta.changes[2].table, DB::Table::RECIPE);
+    EXPECT_EQ(delta.changes[2].op, Change::Op::ADDED);
+    EXPECT_EQ(delta.changes[2].row, RecipeHeader("pie", pie_id).to_json());
+
+    EXPECT_EQ(delta.changes[3].table, DB::Table::RECIPE);
+    EXPECT_EQ(delta.changes[3].op, Change::Op::DELETED);
+    EXPECT_EQ(delta.changes[3].id, pie_id);
+    EXPECT_TRUE(delta.changes[3].row.is_null());
+
+    delta = changes.Wait(2, milliseconds(0));
+    ASSERT_THAT(delta.changes, testing::SizeIs(2));
+    EXPECT_EQ(delta.changes[0].seq, 3);
+}
+
+TEST(ChangeLog, ResetsReadersThatFellBehind) {
+    ChangeLog changes(/*capacity=*/2);
+    for (size_t id = 1; id <= 5; ++id) {
+        changes.Append(DB::Table::INGREDIENTS, Change::Op::DELETED, id);
+    }
+
+    auto delta = changes.Wait(2, milliseconds(0));
+    EXPECT_TRUE(delta.reset) << "changes 3 and 4 are gone";
+    EXPECT_EQ(delta.seq, 5);
+
+    delta = changes.Wait(3, milliseconds(0));
+    EXPECT_FALSE(delta.reset);
+    ASSERT_THAT(delta.changes, testing::SizeIs(2));
+    EXPECT_EQ(delta.changes[0].id, 4);
+
+    delta = changes.Wait(6, milliseconds(0));
+    EXPECT_TRUE(delta.reset) << "readers from before a restart start over";
+}
+
+TEST(ChangeLog, ResetsReadersOfAnotherLog) {
+    // E.g. the log of the server before a restart, or of another worker process.
+    ChangeLog before;
+    ChangeLog changes;
+    EXPECT_NE(before.Epoch(), changes.Epoch());
+    before.Append(DB::Table::INGREDIENTS, Change::Op::DELETED, 1);
+    changes.Append(DB::Table::INGREDIENTS, Change::Op::DELETED, 1);
+    changes.Append(DB::Table::INGREDIENTS, Change::Op::DELETED, 2);
+
+    auto delta = changes.Wait(changes.Epoch(), 1, milliseconds(0));
+    EXPECT_FALSE(delta.reset);
+    EXPECT_THAT(delta.changes, testing::SizeIs(1));
+
+    delta = changes.Wait(before.Epoch(), before.LastSeq(), std::chrono::seconds(10));
+    EXPECT_TRUE(delta.reset) << "seq 1 of another log says nothing about this one";
+    EXPECT_EQ(delta.seq, 2);
+    EXPECT_EQ(delta.epoch, changes.Epoch());
+    EXPECT_THAT(delta.changes, testing::IsEmpty());
+}
+
+TEST(ChangeLog, RolledBackTransactionResetsReaders) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    const ChangeLog& changes = db->Changes();
+    ASSERT_TRUE(db->AddProduct("milk", 48).Ok());
+    const uint64_t seq = changes.LastSeq();
+
+    auto code = db->InTransaction([&db] {
+        db->AddProduct("flour", 364);
+        return StatusCode::INTERNAL_ERROR;
+    });
+    ASSERT_EQ(code, StatusCode::INTERNAL_ERROR);
+
+    auto delta = changes.Wait(seq, milliseconds(0));
+    EXPECT_TRUE(delta.reset) << "the announced flour was rolled back";
+    EXPECT_GT(delta.seq, seq);
+
+    delta = changes.Wait(delta.seq, milliseconds(0));
+    EXPECT_FALSE(delta.reset);
+    EXPECT_THAT(delta.changes, testing::IsEmpty());
+}
+
+TEST(ChangeLog, WaitWakesUpOnAppend) {
+    ChangeLog changes;
+
+    auto delta = changes.Wait(0, milliseconds(10));
+    EXPECT_FALSE(delta.reset);
+    EXPECT_THAT(delta.changes, testing::IsEmpty()) << "times out without changes";
+
+    std::thread writer([&changes] {
+        std::this_thread::sleep_for(milliseconds(20));
+        changes.Append(DB::Table::TABLEWARE, Change::Op::DELETED, 42);
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    delta = changes.Wait(0, std::chrono::seconds(10));
+    writer.join();
+
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    ASSERT_THAT(delta.changes, testing::SizeIs(1));
+    EXPECT_EQ(delta.changes[0].id, 42);
+}
+
+TEST(ChangeLog, AppendCallsSubscribersBack) {
+    ChangeLog changes;
+    changes.Append(DB::Table::TABLEWARE, Change::Op::DELETED, 1);
+
+    int behind = 0;
+    EXPECT_EQ(changes.Subscribe(0, [&behind] { ++behind; }), 0);
+    EXPECT_EQ(behind, 1) << "a subscriber that is behind is called right away";
+
+    int waiting = 0;
+    int gone = 0;
+    EXPECT_NE(changes.Subscribe(1, [&waiting] { ++waiting; }), 0);
+    changes.Unsubscribe(changes.Subscribe(1, [&gone] { ++gone; }));
+    EXPECT_EQ(waiting, 0);
+
+    changes.Append(DB::Table::TABLEWARE, Change::Op::DELETED, 2);
+    changes.Append(DB::Table::TABLEWARE, Change::Op::DELETED, 3);
+    EXPECT_EQ(waiting, 1) << "called once";
+    EXPECT_EQ(gone, 0);
+
+    changes.Subscribe(3, [&waiting] { ++waiting; });
+    changes.Reset();
+    EXPECT_EQ(waiting, 2);
+}
+
+TEST(ChangeLog, ConcurrentWritesAreInCommitOrder) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    constexpr int kWriters = 4;
+    constexpr int kProducts = 100;
+    std::vector<std::thread> writers;
+    for (int writer = 0; writer < kWriters; ++writer) {
+        writers.emplace_back([&db, writer] {
+            for (int i = 0; i < kProducts; ++i) {
+                ASSERT_TRUE(db->AddProduct(std::to_string(writer * kProducts + i), 100).Ok());
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+
+    // Ids are handed out in commit order, so the log has to list them in increasing order.
+    auto delta = db->Changes().Wait(0, milliseconds(0));
+    ASSERT_THAT(delta.changes, testing::SizeIs(kWriters * kProducts));
+    for (size_t idx = 1; idx < delta.changes.size(); ++idx) {
+        ASSERT_LT(delta.changes[idx - 1].id, delta.changes[idx].id) << "at " << idx;
+    }
+}
+
+TEST(ChangeLog, MergeListsTheRecipesThatChanged) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    auto milk = db->AddProduct("milk", 52).Value();
+    auto milk2 = db->AddProduct("Milk", 54).Value();
+    auto flour = db->AddProduct("flour", 364).Value();
+    auto pancakes = db->CreateRecipe("pancakes", "", {{milk2, 300}, {flour, 200}}).Value();
+    ASSERT_TRUE(db->CreateRecipe("bread", "", {{flour, 500}}).Ok());
+    const uint64_t seq = db->Changes().LastSeq();
+
+    ASSERT_EQ(db->MergeProducts(milk, {milk2}), StatusCode::OK);
+    auto delta = db->Changes().Wait(seq, milliseconds(0));
+    ASSERT_THAT(delta.changes, testing::SizeIs(3));
+    EXPECT_EQ(delta.changes[0].table, DB::Table::INGREDIENTS);
+    EXPECT_EQ(delta.changes[0].op, Change::Op::DELETED);
+    EXPECT_EQ(delta.changes[0].id, milk2);
+    EXPECT_EQ(delta.changes[1].table, DB::Table::RECIPE);
+    EXPECT_EQ(delta.changes[1].op, Change::Op::DELETED);
+    EXPECT_EQ(delta.changes[1].id, pancakes);
+    EXPECT_EQ(delta.changes[2].table, DB::Table::RECIPE);
+    EXPECT_EQ(delta.changes[2].op, Change::Op::ADDED);
+    EXPECT_EQ(delta.changes[2].row, RecipeHeader("pancakes", pancakes).to_json());
+}
+
+}  // namespace
+}  // namespace foodculator
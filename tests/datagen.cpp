@@ -0,0 +1,61 @@
+#include "datagen/dataset.h"
+
+#include <algorithm>
+#include <set>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace foodculator {
+namespace {
+
+TEST(GenerateDataset, WritesTheRequestedCatalog) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    DatasetSpec spec{/*ingredients=*/2000, /*tableware=*/100, /*recipes=*/500, /*seed=*/7};
+    ASSERT_EQ(GenerateDataset(db.get(), spec), StatusCode::OK);
+
+    auto products = db->GetProducts();
+    ASSERT_TRUE(products.Ok());
+    EXPECT_EQ(products.Value().size(), spec.ingredients);
+    EXPECT_EQ(db->GetTableware().Value().size(), spec.tableware);
+
+    auto recipes = db->GetRecipes();
+    ASSERT_TRUE(recipes.Ok());
+    ASSERT_EQ(recipes.Value().size(), spec.recipes);
+
+    size_t max_ingredients = 0;
+    for (const auto& header : recipes.Value()) {
+        auto recipe = db->GetRecipeInfo(header.id);
+        ASSERT_TRUE(recipe.Ok());
+        EXPECT_GE(recipe.Value().ingredients.size(), 2u) << header.name;
+        max_ingredients = std::max(max_ingredients, recipe.Value().ingredients.size());
+    }
+    EXPECT_GT(max_ingredients, 8u) << "ingredient counts should have a long tail";
+
+    EXPECT_TRUE(db->AddProduct("milk", 48).Ok()) << "ids continue after the imported ones";
+}
+
+TEST(GenerateDataset, IsReproducible) {
+    DatasetSpec spec{/*ingredients=*/500, /*tableware=*/10, /*recipes=*/50, /*seed=*/42};
+
+    auto first = DB::Create(":memory:");
+    auto second = DB::Create(":memory:");
+    ASSERT_TRUE(first && second);
+    ASSERT_EQ(GenerateDataset(first.get(), spec), StatusCode::OK);
+    ASSERT_EQ(GenerateDataset(second.get(), spec), StatusCode::OK);
+
+    EXPECT_EQ(first->GetProducts().Value(), second->GetProducts().Value());
+    EXPECT_EQ(first->GetTableware().Value(), second->GetTableware().Value());
+    EXPECT_EQ(first->GetRecipeInfo(50).Value(), second->GetRecipeInfo(50).Value());
+
+    spec.seed = 43;
+    auto other = DB::Create(":memory:");
+    ASSERT_TRUE(other);
+    ASSERT_EQ(GenerateDataset(other.get(), spec), StatusCode::OK);
+    EXPECT_NE(first->GetProducts().Value(), other->GetProducts().Value());
+}
+
+}  // namespace
+}  // namespace foodculator
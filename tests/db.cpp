@@ -1,9 +1,18 @@
 #include "db/db.h"
 
+#include <sqlite3.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <limits>
 #include <map>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "db/changelog.h"
+#include "fmt/format.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -122,6 +131,39 @@ TEST(DB, DeleteProduct_WithRecipe) {
     ASSERT_FALSE(db->DeleteProduct(milk_id));
 }
 
+TEST(DB, MergeProducts) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    auto milk = db->AddProduct("milk 3.2%", 52).Value();
+    auto milk2 = db->AddProduct("Milk 3,2 %", 54).Value();
+    auto milk3 = db->AddProduct("milk 3,2%", 53).Value();
+    auto flour = db->AddProduct("flour", 364).Value();
+    auto pancakes =
+        db->CreateRecipe("pancakes", "", {{milk2, 300}, {milk3, 50}, {flour, 200}}).Value();
+    auto porridge = db->CreateRecipe("porridge", "", {{milk, 250}}).Value();
+    const uint64_t version = db->Version().Value();
+
+    EXPECT_EQ(db->MergeProducts(milk, {milk2, 100}), StatusCode::NOT_FOUND);
+    EXPECT_EQ(db->GetProducts().Value().size(), 4u) << "a failed merge is rolled back";
+    EXPECT_EQ(db->MergeProducts(milk, {milk}), StatusCode::INVALID_ARGUMENT);
+
+    ASSERT_EQ(db->MergeProducts(milk, {milk2, milk3}), StatusCode::OK);
+    EXPECT_THAT(db->GetProducts().Value(),
+                testing::UnorderedElementsAre(Ingredient("milk 3.2%", 52, milk),
+                                              Ingredient("flour", 364, flour)));
+    EXPECT_THAT(db->GetRecipeInfo(pancakes).Value().ingredients,
+                testing::UnorderedElementsAre(RecipeIngredient(milk, 350),
+                                              RecipeIngredient(flour, 200)));
+    EXPECT_THAT(db->GetRecipeInfo(porridge).Value().ingredients,
+                testing::ElementsAre(RecipeIngredient(milk, 250)));
+
+    auto products = db->GetProductsSince(version).Value();
+    EXPECT_THAT(products.deleted, testing::UnorderedElementsAre(milk2, milk3));
+    auto recipes = db->GetRecipesSince(version).Value();
+    EXPECT_THAT(recipes.changed, testing::ElementsAre(RecipeHeader("pancakes", pancakes)));
+}
+
 TEST(DB, AddDeleteTableware) {
     auto db = DB::Create(":memory:");
     ASSERT_TRUE(db);
@@ -187,6 +229,135 @@ TEST(DB, GetRecipeInfo) {
                 testing::UnorderedElementsAre(RecipeIngredient(milk_id, 500),
                                               RecipeIngredient(flour_id, 200)))
         << "all non-zero weight ingredients should be present";
+
+    std::vector<Ingredient> details;
+    auto expanded = db->GetRecipeInfo(pancake_id.Value(), &details);
+    ASSERT_TRUE(expanded.Ok());
+    EXPECT_EQ(expanded.Value(), got.Value());
+    ASSERT_EQ(details.size(), expanded.Value().ingredients.size());
+    for (size_t idx = 0; idx < details.size(); ++idx) {
+        EXPECT_EQ(details[idx].id, expanded.Value().ingredients[idx].ingredient_id);
+        EXPECT_EQ(details[idx], db->GetProduct(details[idx].id).Value());
+    }
+}
+
+TEST(DB, GetRecipeKcalPer100g) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    auto milk_id = db->AddProduct("milk", 48).Value();
+    auto flour_id = db->AddProduct("flour", 364).Value();
+
+    auto pancake_id = db->CreateRecipe("pancake", "do it", {{milk_id, 300}, {flour_id, 100}});
+    ASSERT_TRUE(pancake_id.Ok());
+    auto kcal = db->GetRecipeKcalPer100g(pancake_id.Value());
+    ASSERT_TRUE(kcal.Ok()) << "GetRecipeKcalPer100g(" << pancake_id.Value()
+                           << ") = {code: " << ToString(kcal.Code()) << ", error: " << kcal.Error()
+                           << "};";
+    EXPECT_DOUBLE_EQ(kcal.Value(), (48.0 * 300 + 364.0 * 100) / 400);
+
+    auto empty_id = db->CreateRecipe("water", "just pour it", {});
+    ASSERT_TRUE(empty_id.Ok());
+    kcal = db->GetRecipeKcalPer100g(empty_id.Value());
+    ASSERT_TRUE(kcal.Ok());
+    EXPECT_EQ(kcal.Value(), 0.0);
+
+    EXPECT_EQ(db->GetRecipeKcalPer100g(100500).Code(), StatusCode::NOT_FOUND);
+}
+
+TEST(DB, NestedRecipes) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    auto bones = db->AddProduct("bones", 200).Value();
+    auto water = db->AddProduct("water", 0).Value();
+    auto carrot = db->AddProduct("carrot", 40).Value();
+    auto stock = db->CreateRecipe("stock", "", {{bones, 500}, {water, 1500}}).Value();
+    auto soup = db->CreateRecipe("soup", "", {{carrot, 200}}, {{stock, 800}}).Value();
+    auto stew = db->CreateRecipe("stew", "", {}, {{soup, 500}, {stock, 500}}).Value();
+
+    EXPECT_THAT(db->GetRecipeInfo(soup).Value().subrecipes,
+                testing::ElementsAre(RecipeIngredient(stock, 800)));
+    auto full = db->GetFullRecipes().Value();
+    ASSERT_THAT(full, testing::SizeIs(3));
+    EXPECT_EQ(full[2], db->GetRecipeInfo(stew).Value());
+
+    const double stock_kcal = 200.0 * 500 / 2000;
+    const double soup_kcal = (40.0 * 200 + stock_kcal * 800) / 1000;
+    EXPECT_DOUBLE_EQ(db->GetRecipeKcalPer100g(stew).Value(), (soup_kcal + stock_kcal) / 2);
+    EXPECT_DOUBLE_EQ(db->GetRecipeKcalPer100g(soup).Value(), soup_kcal);
+
+    // A richer stock changes every recipe that uses it.
+    auto st = db->UpdateRecipe(stock, db->GetRecipeInfo(stock).Value().version, "stock", "",
+                               {{bones, 1000}, {water, 1000}});
+    ASSERT_TRUE(st.Ok()) << ToString(st.Code()) << ": " << st.Error();
+    const double new_stock_kcal = 200.0 * 1000 / 2000;
+    const double new_soup_kcal = (40.0 * 200 + new_stock_kcal * 800) / 1000;
+    EXPECT_DOUBLE_EQ(db->GetRecipeKcalPer100g(stew).Value(),
+                     (new_soup_kcal + new_stock_kcal) / 2);
+
+    // Cycles are refused.
+    auto stock_version = st.Value();
+    EXPECT_EQ(db->UpdateRecipe(stock, stock_version, "stock", "", {}, {{stew, 100}}).Code(),
+              StatusCode::INVALID_ARGUMENT);
+    EXPECT_EQ(db->UpdateRecipe(stock, stock_version, "stock", "", {}, {{stock, 100}}).Code(),
+              StatusCode::INVALID_ARGUMENT);
+    EXPECT_EQ(db->UpdateRecipe(stock, stock_version, "stock", "", {}, {{100, 100}}).Code(),
+              StatusCode::INVALID_ARGUMENT);
+    EXPECT_EQ(db->CreateRecipe("broth", "", {}, {{100, 100}}).Code(),
+              StatusCode::INVALID_ARGUMENT);
+    EXPECT_THAT(db->GetRecipes().Value(), testing::SizeIs(3)) << "the failed one is removed";
+
+    EXPECT_FALSE(db->DeleteRecipe(stock)) << "stock is used by soup and stew";
+    ASSERT_TRUE(db->DeleteRecipe(stew));
+    EXPECT_DOUBLE_EQ(db->GetRecipeKcalPer100g(soup).Value(), new_soup_kcal);
+}
+
+TEST(DB, FullRecipesWhileWriting) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+    auto flour = db->AddProduct("flour", 364).Value();
+
+    std::atomic<bool> stop = false;
+    std::thread writer([&db, &stop, flour] {
+        for (int i = 0; !stop; ++i) {
+            db->CreateRecipe(fmt::format("bread {}", i), "", {{flour, 500}});
+        }
+    });
+    // Every scan sees each recipe together with its ingredients, or not at all.
+    for (int i = 0; i < 200; ++i) {
+        auto full = db->GetFullRecipes();
+        ASSERT_TRUE(full.Ok()) << full.Error();
+        for (const auto& recipe : full.Value()) {
+            ASSERT_THAT(recipe.ingredients, testing::SizeIs(1)) << recipe.header.name;
+        }
+    }
+    stop = true;
+    writer.join();
+}
+
+TEST(DB, Nutrients) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    const Nutrients milk_nutrients = {3, 2.5, 4.75, 0, 0.125, 4.75};
+    auto milk = db->AddProduct("milk", 52, milk_nutrients).Value();
+    auto flour = db->AddProduct("flour", 364, {10, 1, 76, 2.5, 0, 0.25}).Value();
+    EXPECT_EQ(db->GetProduct(milk).Value(), Ingredient("milk", 52, milk, milk_nutrients));
+    EXPECT_EQ(db->GetProducts().Value()[0].nutrients, milk_nutrients);
+
+    auto pancake = db->CreateRecipe("pancake", "", {{milk, 300}, {flour, 100}}).Value();
+    auto per_100g = db->GetRecipeNutrientsPer100g(pancake);
+    ASSERT_TRUE(per_100g.Ok()) << ToString(per_100g.Code()) << ": " << per_100g.Error();
+    EXPECT_EQ(per_100g.Value(), NutrientProfile(130, {4.75, 2.125, 22.5625, 0.625, 0.09375,
+                                                      3.625}));
+
+    // An unsaved mix of the same ingredients is the same, and a recipe can be a part of one.
+    EXPECT_EQ(db->CalculateNutrients({{milk, 300}, {flour, 100}}, {}).Value(), per_100g.Value());
+    EXPECT_EQ(db->CalculateNutrients({}, {{pancake, 200}}).Value(), per_100g.Value());
+    EXPECT_EQ(db->CalculateNutrients({}, {}).Value(), NutrientProfile());
+    EXPECT_EQ(db->CalculateNutrients({{100500, 100}}, {}).Code(), StatusCode::NOT_FOUND);
+    EXPECT_EQ(db->CalculateNutrients({}, {{100500, 100}}).Code(), StatusCode::NOT_FOUND);
 }
 
 TEST(DB, CreateRecipe_Duplicate) {
@@ -262,5 +433,376 @@ TEST(DB, CreateDeleteRecipe) {
     }
 }
 
+TEST(DB, UpdateRecipe) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    auto milk = db->AddProduct("milk", 48).Value();
+    auto flour = db->AddProduct("flour", 364).Value();
+    auto egg = db->AddProduct("egg", 156).Value();
+    auto id = db->CreateRecipe("pancake", "do it", {{milk, 500}, {flour, 200}}).Value();
+    db->CreateRecipe("omelette", "", {{egg, 100}});
+    const uint64_t version = db->GetRecipeInfo(id).Value().version;
+    const uint64_t clock = db->Version().Value();
+
+    // Every written row advances the clock by one.
+    auto st = db->UpdateRecipe(id, version, "pancake", "do it", {{milk, 400}, {flour, 200}});
+    ASSERT_TRUE(st.Ok()) << ToString(st.Code()) << ": " << st.Error();
+    EXPECT_EQ(st.Value(), clock + 1) << "only the changed weight is written";
+    EXPECT_EQ(db->GetRecipeInfo(id).Value().version, st.Value());
+    EXPECT_THAT(db->GetRecipeInfo(id).Value().ingredients,
+                testing::ElementsAre(RecipeIngredient(milk, 400), RecipeIngredient(flour, 200)));
+
+    EXPECT_EQ(db->UpdateRecipe(id, version, "pancake", "", {}).Code(), StatusCode::CONFLICT);
+    EXPECT_EQ(db->UpdateRecipe(100, version, "pancake", "", {}).Code(), StatusCode::NOT_FOUND);
+    EXPECT_EQ(db->UpdateRecipe(id, st.Value(), "omelette", "", {}).Code(),
+              StatusCode::INVALID_ARGUMENT);
+    EXPECT_EQ(db->UpdateRecipe(id, st.Value(), "pancake", "", {{100, 5}}).Code(),
+              StatusCode::INVALID_ARGUMENT);
+    auto same = db->UpdateRecipe(id, st.Value(), "pancake", "do it", {{flour, 200}, {milk, 400}});
+    EXPECT_EQ(same.Value(), st.Value()) << "nothing to write";
+
+    const uint64_t before = db->Version().Value();
+    const uint64_t seq = db->Changes().LastSeq();
+    st = db->UpdateRecipe(id, st.Value(), "crepe", "thin", {{milk, 400}, {flour, 0}, {egg, 50}});
+    ASSERT_TRUE(st.Ok()) << ToString(st.Code()) << ": " << st.Error();
+    FullRecipe want;
+    want.header = RecipeHeader("crepe", id);
+    want.description = "thin";
+    want.ingredients = {RecipeIngredient(milk, 400), RecipeIngredient(egg, 50)};
+    EXPECT_EQ(db->GetRecipeInfo(id).Value(), want);
+    EXPECT_THAT(db->GetRecipesSince(before).Value().changed,
+                testing::ElementsAre(RecipeHeader("crepe", id)));
+    EXPECT_THAT(db->SearchRecipes("crepe", 0, 10).Value(), testing::SizeIs(1));
+    EXPECT_THAT(db->SearchRecipes("pancake", 0, 10).Value(), testing::IsEmpty());
+
+    auto changes = db->Changes().Wait(seq, std::chrono::milliseconds(0)).changes;
+    ASSERT_THAT(changes, testing::SizeIs(2));
+    EXPECT_EQ(changes[0].op, Change::Op::DELETED);
+    EXPECT_EQ(changes[1].op, Change::Op::ADDED);
+    EXPECT_EQ(changes[1].row, RecipeHeader("crepe", id).to_json());
+}
+
+TEST(DB, SearchRecipes) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    auto milk = db->AddProduct("milk", 48).Value();
+    auto porridge = db->CreateRecipe("Oat porridge", "Boil the oats in milk.", {{milk, 200}});
+    auto pancakes = db->CreateRecipe("Pancakes", "Whisk milk, eggs and flour. Fry in butter.",
+                                     {{milk, 300}});
+    auto milkshake = db->CreateRecipe("Milkshake", "Blend everything.", {{milk, 250}});
+    ASSERT_TRUE(porridge.Ok() && pancakes.Ok() && milkshake.Ok());
+
+    auto ids = [&db](std::string_view query, uint32_t offset = 0, uint32_t limit = 10) {
+        auto found = db->SearchRecipes(query, offset, limit);
+        EXPECT_TRUE(found.Ok()) << found.Error();
+        std::vector<size_t> ret;
+        for (const auto& match : found.Value()) {
+            ret.push_back(match.header.id);
+        }
+        return ret;
+    };
+
+    // Matches in the name rank first; the last word is a prefix.
+    EXPECT_THAT(ids("milk"), testing::ElementsAre(milkshake.Value(), porridge.Value(),
+                                                  pancakes.Value()));
+    EXPECT_THAT(ids("MILK fl"), testing::ElementsAre(pancakes.Value()));
+    EXPECT_THAT(ids("oats \"OR\" NEAR(milk"), testing::IsEmpty()) << "operators are words";
+    EXPECT_THAT(ids("milk", 1, 1), testing::ElementsAre(porridge.Value()));
+    EXPECT_THAT(ids("milk", 3), testing::IsEmpty());
+    EXPECT_THAT(ids("milk", std::numeric_limits<uint32_t>::max()), testing::IsEmpty())
+        << "an offset past INT32_MAX doesn't wrap around";
+
+    auto found = db->SearchRecipes("butter", 0, 10);
+    ASSERT_TRUE(found.Ok());
+    ASSERT_EQ(found.Value().size(), 1u);
+    EXPECT_EQ(found.Value()[0].header, RecipeHeader("Pancakes", pancakes.Value()));
+    EXPECT_EQ(found.Value()[0].snippet, "Whisk milk, eggs and flour. Fry in **butter**.");
+
+    EXPECT_EQ(db->SearchRecipes(" ?! ", 0, 10).Code(), StatusCode::INVALID_ARGUMENT);
+
+    // The index follows deletions and imports.
+    EXPECT_TRUE(db->DeleteRecipe(milkshake.Value()));
+    EXPECT_THAT(ids("milkshake"), testing::IsEmpty());
+    FullRecipe kasha;
+    kasha.header = RecipeHeader("Buckwheat kasha", 100);
+    kasha.description = "Simmer with milk.";
+    ASSERT_EQ(db->ImportRecipes({kasha}), StatusCode::OK);
+    EXPECT_THAT(ids("kasha"), testing::ElementsAre(100u));
+}
+
+TEST(DB, GetProductsSince) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    auto milk_id = db->AddProduct("milk", 48).Value();
+    auto flour_id = db->AddProduct("flour", 364).Value();
+
+    auto full = db->GetProductsSince(0);
+    ASSERT_TRUE(full.Ok()) << "GetProductsSince(0) = {code: " << ToString(full.Code())
+                           << ", error: " << full.Error() << "};";
+    EXPECT_FALSE(full.Value().reset);
+    EXPECT_THAT(full.Value().changed,
+                testing::UnorderedElementsAre(Ingredient("milk", 48, milk_id),
+                                              Ingredient("flour", 364, flour_id)));
+    EXPECT_THAT(full.Value().deleted, testing::IsEmpty());
+
+    const uint64_t version = full.Value().version;
+    auto empty = db->GetProductsSince(version);
+    ASSERT_TRUE(empty.Ok());
+    EXPECT_EQ(empty.Value().version, version);
+    EXPECT_THAT(empty.Value().changed, testing::IsEmpty());
+    EXPECT_THAT(empty.Value().deleted, testing::IsEmpty());
+
+    auto egg_id = db->AddProduct("egg", 156).Value();
+    ASSERT_TRUE(db->DeleteProduct(milk_id));
+    ASSERT_TRUE(db->AddTableware("pan", 1000).Ok());
+
+    auto delta = db->GetProductsSince(version);
+    ASSERT_TRUE(delta.Ok());
+    EXPECT_GT(delta.Value().version, version);
+    EXPECT_FALSE(delta.Value().reset);
+    EXPECT_THAT(delta.Value().changed, testing::ElementsAre(Ingredient("egg", 156, egg_id)));
+    EXPECT_THAT(delta.Value().deleted, testing::ElementsAre(milk_id))
+        << "tombstones of other tables shouldn't be returned";
+
+    EXPECT_FALSE(db->GetProductsSince(delta.Value().version).Value().reset);
+    EXPECT_TRUE(db->GetProductsSince(delta.Value().version + 100).Value().reset)
+        << "versions from the future reset the client";
+}
+
+TEST(DB, GetRecipesSince_IngredientsChange) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    auto milk_id = db->AddProduct("milk", 48).Value();
+    auto pancake_id = db->CreateRecipe("pancake", "do it", {{milk_id, 300}}).Value();
+    auto water_id = db->CreateRecipe("water", "pour it", {}).Value();
+
+    const uint64_t version = db->GetRecipesSince(0).Value().version;
+    ASSERT_TRUE(db->DeleteRecipe(water_id));
+    ASSERT_TRUE(db->DeleteRecipe(pancake_id));
+
+    auto delta = db->GetRecipesSince(version);
+    ASSERT_TRUE(delta.Ok()) << "GetRecipesSince(" << version << ") = {code: "
+                            << ToString(delta.Code()) << ", error: " << delta.Error() << "};";
+    EXPECT_THAT(delta.Value().changed, testing::IsEmpty());
+    EXPECT_THAT(delta.Value().deleted, testing::UnorderedElementsAre(water_id, pancake_id));
+}
+
+TEST(DB, CompactTombstones) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    auto pan_id = db->AddTableware("pan", 1000).Value();
+    const uint64_t before_delete = db->GetTablewareSince(0).Value().version;
+    ASSERT_TRUE(db->DeleteTableware(pan_id));
+    auto pot_id = db->AddTableware("pot", 700).Value();
+    const uint64_t after_delete = db->GetTablewareSince(0).Value().version;
+
+    const auto now = std::chrono::system_clock::now();
+    auto dropped = db->CompactTombstones(now - std::chrono::hours(1));
+    ASSERT_TRUE(dropped.Ok());
+    EXPECT_EQ(dropped.Value(), 0u) << "the tombstone is still within the retention window";
+
+    dropped = db->CompactTombstones(now + std::chrono::hours(1));
+    ASSERT_TRUE(dropped.Ok()) << "CompactTombstones() = {code: " << ToString(dropped.Code())
+                              << ", error: " << dropped.Error() << "};";
+    EXPECT_EQ(dropped.Value(), 1u);
+
+    auto delta = db->GetTablewareSince(before_delete);
+    ASSERT_TRUE(delta.Ok());
+    EXPECT_TRUE(delta.Value().reset) << "the client missed a compacted tombstone";
+    EXPECT_THAT(delta.Value().changed, testing::ElementsAre(Tableware("pot", 700, pot_id)));
+    EXPECT_THAT(delta.Value().deleted, testing::IsEmpty());
+
+    delta = db->GetTablewareSince(after_delete);
+    ASSERT_TRUE(delta.Ok());
+    EXPECT_FALSE(delta.Value().reset);
+    EXPECT_THAT(delta.Value().changed, testing::IsEmpty());
+}
+
+TEST(DB, MigrateExistingDatabase) {
+    const std::string path = testing::TempDir() + "foodculator_migrate.db";
+    std::remove(path.c_str());
+
+    // The schema and data of a database created before row versions were introduced.
+    sqlite3* raw = nullptr;
+    ASSERT_EQ(sqlite3_open(path.c_str(), &raw), SQLITE_OK);
+    const char old_schema[] =
+        "CREATE TABLE INGREDIENTS(ID INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, "
+        "NAME TEXT NOT NULL, KCAL INTEGER DEFAULT 0 NOT NULL, UNIQUE (NAME, KCAL));"
+        "INSERT INTO INGREDIENTS (NAME, KCAL) VALUES ('milk', 48);";
+    ASSERT_EQ(sqlite3_exec(raw, old_schema, nullptr, nullptr, nullptr), SQLITE_OK);
+    sqlite3_close(raw);
+
+    {
+        auto db = DB::Create(path);
+        ASSERT_TRUE(db);
+
+        auto delta = db->GetProductsSince(0);
+        ASSERT_TRUE(delta.Ok()) << "GetProductsSince(0) = {code: " << ToString(delta.Code())
+                                << ", error: " << delta.Error() << "};";
+        EXPECT_THAT(delta.Value().changed, testing::ElementsAre(Ingredient("milk", 48, 1)));
+
+        auto egg_id = db->AddProduct("egg", 156).Value();
+        auto next = db->GetProductsSince(delta.Value().version);
+        ASSERT_TRUE(next.Ok());
+        EXPECT_THAT(next.Value().changed, testing::ElementsAre(Ingredient("egg", 156, egg_id)));
+    }
+
+    auto reopened = DB::Create(path);
+    ASSERT_TRUE(reopened) << "migrations must not be applied twice";
+    EXPECT_EQ(reopened->GetProducts().Value().size(), 2u);
+    reopened.reset();
+    std::remove(path.c_str());
+}
+
+TEST(DB, CatchUpExternalWrites) {
+    const std::string path = testing::TempDir() + "foodculator_shared.db";
+    std::remove(path.c_str());
+
+    // Two workers sharing the database file.
+    auto first = DB::Create(path);
+    auto second = DB::Create(path);
+    ASSERT_TRUE(first && second);
+    EXPECT_FALSE(second->CatchUpExternalWrites());
+
+    const uint64_t generation = second->Generation(DB::Table::INGREDIENTS);
+    const uint64_t tableware_generation = second->Generation(DB::Table::TABLEWARE);
+    const uint64_t recipes_generation = second->Generation(DB::Table::RECIPE);
+    auto milk = first->AddProduct("milk", 48);
+    ASSERT_TRUE(milk.Ok());
+    EXPECT_FALSE(first->CatchUpExternalWrites()) << "own writes are not external";
+
+    EXPECT_TRUE(second->CatchUpExternalWrites());
+    EXPECT_GT(second->Generation(DB::Table::INGREDIENTS), generation);
+    EXPECT_EQ(second->Generation(DB::Table::TABLEWARE), tableware_generation)
+        << "only the tables that were written to change";
+    EXPECT_EQ(second->Generation(DB::Table::RECIPE), recipes_generation);
+    EXPECT_FALSE(second->CatchUpExternalWrites());
+    EXPECT_THAT(second->GetProducts().Value(), testing::ElementsAre(Ingredient("milk", 48, 1)));
+
+    // Deletions are noticed through the tombstones.
+    ASSERT_TRUE(first->DeleteProduct(milk.Value()));
+    EXPECT_TRUE(second->CatchUpExternalWrites());
+    EXPECT_GT(second->Generation(DB::Table::INGREDIENTS), generation + 1);
+    EXPECT_EQ(second->Generation(DB::Table::TABLEWARE), tableware_generation);
+
+    first.reset();
+    second.reset();
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+TEST(DB, InTransaction) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    auto code = db->InTransaction([&db] {
+        for (uint32_t kcal = 0; kcal < 100; ++kcal) {
+            if (auto st = db->AddProduct("milk", kcal); !st.Ok()) {
+                return st.Code();
+            }
+        }
+        return StatusCode::OK;
+    });
+    ASSERT_EQ(code, StatusCode::OK) << ToString(code);
+    EXPECT_EQ(db->GetProducts().Value().size(), 100u);
+
+    const uint64_t generation = db->Generation(DB::Table::INGREDIENTS);
+    code = db->InTransaction([&db] {
+        db->AddProduct("flour", 364);
+        return db->AddProduct("milk", 0).Code();
+    });
+    EXPECT_EQ(code, StatusCode::INVALID_ARGUMENT);
+    EXPECT_EQ(db->GetProducts().Value().size(), 100u) << "flour should be rolled back";
+    EXPECT_NE(db->Generation(DB::Table::INGREDIENTS), generation);
+
+    code = db->InTransaction([&db] { return db->InTransaction([] { return StatusCode::OK; }); });
+    EXPECT_NE(code, StatusCode::OK) << "transactions can't be nested";
+    EXPECT_TRUE(db->AddProduct("flour", 364).Ok()) << "no transaction is left open";
+    EXPECT_EQ(db->GetProducts().Value().size(), 101u);
+}
+
+TEST(DB, ImportRows) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    std::vector<Ingredient> products;
+    for (size_t id = 1; id <= 1000; ++id) {
+        products.emplace_back("product #" + std::to_string(id), id % 900, id);
+    }
+    std::vector<Tableware> tableware = {{"pan", 1000, 7}, {"wok", 1080, 9}};
+
+    FullRecipe pancake;
+    pancake.header = RecipeHeader("pancake", 3);
+    pancake.description = "do it";
+    for (size_t id = 1; id <= 500; ++id) {
+        pancake.ingredients.emplace_back(id, 10);
+    }
+
+    const uint64_t before = db->GetProductsSince(0).Value().version;
+    auto code = db->InTransaction([&] {
+        if (auto code = db->ImportProducts(products); code != StatusCode::OK) {
+            return code;
+        }
+        if (auto code = db->ImportTableware(tableware); code != StatusCode::OK) {
+            return code;
+        }
+        return db->ImportRecipes({pancake});
+    });
+    ASSERT_EQ(code, StatusCode::OK) << ToString(code);
+
+    EXPECT_THAT(db->GetProducts().Value(), testing::UnorderedElementsAreArray(products));
+    EXPECT_THAT(db->GetTableware().Value(), testing::UnorderedElementsAreArray(tableware));
+    auto recipe = db->GetRecipeInfo(3);
+    ASSERT_TRUE(recipe.Ok());
+    EXPECT_EQ(recipe.Value().header, pancake.header);
+    EXPECT_THAT(recipe.Value().ingredients,
+                testing::UnorderedElementsAreArray(pancake.ingredients));
+
+    // The import is a single write for delta sync.
+    auto delta = db->GetProductsSince(before);
+    ASSERT_TRUE(delta.Ok());
+    EXPECT_EQ(delta.Value().changed.size(), products.size());
+    const uint64_t imported = delta.Value().version;
+    EXPECT_TRUE(db->GetProductsSince(imported).Value().changed.empty());
+
+    // Writes after a failed import are versioned one by one again.
+    EXPECT_EQ(db->ImportProducts({{"product #1", 1, 1}}), StatusCode::INVALID_ARGUMENT);
+    EXPECT_EQ(db->AddProduct("milk", 48).Value(), 1001u);
+    delta = db->GetProductsSince(imported);
+    ASSERT_TRUE(delta.Ok());
+    EXPECT_THAT(delta.Value().changed, testing::ElementsAre(Ingredient("milk", 48, 1001)));
+    EXPECT_GT(delta.Value().version, imported);
+}
+
+TEST(DB, ImportInterruptedByCrash) {
+    const std::string path = testing::TempDir() + "foodculator_import.db";
+    std::remove(path.c_str());
+    ASSERT_TRUE(DB::Create(path));
+
+    // What an import that died between setting and clearing the flag leaves behind.
+    sqlite3* raw = nullptr;
+    ASSERT_EQ(sqlite3_open(path.c_str(), &raw), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(raw, "UPDATE SYNC_CLOCK SET IMPORTING = 1;", nullptr, nullptr, nullptr),
+              SQLITE_OK);
+    sqlite3_close(raw);
+
+    {
+        auto db = DB::Create(path);
+        ASSERT_TRUE(db);
+        const uint64_t before = db->Version().Value();
+        auto milk_id = db->AddProduct("milk", 48).Value();
+        auto delta = db->GetProductsSince(before);
+        ASSERT_TRUE(delta.Ok());
+        EXPECT_THAT(delta.Value().changed, testing::ElementsAre(Ingredient("milk", 48, milk_id)));
+    }
+    std::remove(path.c_str());
+}
+
 }  // namespace
 }  // namespace foodculator
@@ -0,0 +1,127 @@
+#include "dialogflow/dialogflow.h"
+
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace foodculator {
+namespace {
+
+json11::Json Query(const std::string& intent, const std::string& text = "") {
+    auto intent_json = json11::Json::object{{"displayName", intent}};
+    return json11::Json::object{
+        {"queryResult",
+         json11::Json::object{{"queryText", text}, {"intent", std::move(intent_json)}}}};
+}
+
+TEST(Dialogflow, UnknownIntent) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    Dialogflow dialogflow(db.get());
+    EXPECT_EQ(dialogflow.Handle(Query("weather")).Code(), StatusCode::NOT_FOUND);
+}
+
+TEST(Dialogflow, IngredientsAreRebuiltAfterWrites) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    Dialogflow dialogflow(db.get());
+    auto before = dialogflow.Handle(Query("ingredients"));
+    ASSERT_TRUE(before.Ok()) << "Handle(ingredients) = {code: " << ToString(before.Code())
+                             << ", error: " << before.Error() << "};";
+    EXPECT_THAT(before.Value(), testing::Not(testing::HasSubstr("milk")));
+
+    auto milk_id = db->AddProduct("milk", 48);
+    ASSERT_TRUE(milk_id.Ok());
+
+    auto after_add = dialogflow.Handle(Query("ingredients"));
+    ASSERT_TRUE(after_add.Ok());
+    EXPECT_THAT(after_add.Value(), testing::HasSubstr("milk"));
+
+    auto pots = dialogflow.Handle(Query("pots"));
+    ASSERT_TRUE(pots.Ok());
+    EXPECT_THAT(pots.Value(), testing::Not(testing::HasSubstr("milk")));
+
+    ASSERT_TRUE(db->DeleteProduct(milk_id.Value()));
+    auto after_delete = dialogflow.Handle(Query("ingredients"));
+    ASSERT_TRUE(after_delete.Ok());
+    EXPECT_EQ(after_delete.Value(), before.Value());
+}
+
+TEST(Dialogflow, CachedIntentRendersOncePerGeneration) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    Dialogflow dialogflow(db.get());
+    int renders = 0;
+    dialogflow.RegisterCached("count", {DB::Table::TABLEWARE}, [&renders](DB& db) {
+        ++renders;
+        return StatusOr{std::to_string(db.GetTableware().Value().size())};
+    });
+
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(dialogflow.Handle(Query("count")).Ok());
+    }
+    EXPECT_EQ(renders, 1);
+
+    ASSERT_TRUE(db->AddProduct("milk", 48).Ok());
+    ASSERT_TRUE(dialogflow.Handle(Query("count")).Ok());
+    EXPECT_EQ(renders, 1) << "writes to other tables should not invalidate the cache";
+
+    ASSERT_TRUE(db->AddTableware("wok", 1080).Ok());
+    auto got = dialogflow.Handle(Query("count"));
+    ASSERT_TRUE(got.Ok());
+    EXPECT_EQ(renders, 2);
+    EXPECT_EQ(got.Value(), RenderDialogflowResponse("1"));
+}
+
+TEST(Dialogflow, Calories) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    auto milk_id = db->AddProduct("Молоко", 48).Value();
+    auto flour_id = db->AddProduct("Мука", 364).Value();
+    ASSERT_TRUE(db->CreateRecipe("Блины", "", {{milk_id, 300}, {flour_id, 100}}).Ok());
+
+    Dialogflow dialogflow(db.get());
+    auto in = json11::Json::object{
+        {"queryResult",
+         json11::Json::object{
+             {"queryText", "сколько калорий в молоке"},
+             {"parameters", json11::Json::object{{"food", "молоко"}}},
+             {"intent", json11::Json::object{{"displayName", "calories"}}},
+         }},
+    };
+    auto got = dialogflow.Handle(in);
+    ASSERT_TRUE(got.Ok()) << "Handle(calories) = {code: " << ToString(got.Code())
+                          << ", error: " << got.Error() << "};";
+    EXPECT_EQ(got.Value(), RenderDialogflowResponse("Молоко: 48 калорий на 100 грамм."));
+
+    got = dialogflow.Handle(Query("calories", "блины"));
+    ASSERT_TRUE(got.Ok());
+    EXPECT_EQ(got.Value(), RenderDialogflowResponse("Блины: 127 калорий на 100 грамм."));
+}
+
+TEST(Dialogflow, QueryIntentIsNotCached) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    Dialogflow dialogflow(db.get());
+    int renders = 0;
+    dialogflow.Register("echo", [&renders](DB& db, const json11::Json& query) {
+        ++renders;
+        return StatusOr{query["queryText"].string_value()};
+    });
+
+    for (int i = 0; i < 2; ++i) {
+        auto got = dialogflow.Handle(Query("echo", "hello"));
+        ASSERT_TRUE(got.Ok());
+        EXPECT_EQ(got.Value(), RenderDialogflowResponse("hello"));
+    }
+    EXPECT_EQ(renders, 2);
+}
+
+}  // namespace
+}  // namespace foodculator
@@ -0,0 +1,230 @@
+#include "server/event_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fmt/format.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace foodculator {
+namespace {
+
+// Echoes the method, path, `q` param and body of every request. /slow waits for `release_`,
+// /park parks the request for `ms` milliseconds and keeps the function that resumes it.
+class EventServerTest : public testing::Test {
+   protected:
+    void SetUp() override {
+        server_ = std::make_unique<EventServer>(
+            [this](const httplib::Request& req, httplib::Response* res) {
+                if (req.path == "/slow") {
+                    while (!release_) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                }
+                if (req.path == "/missing") {
+                    res->status = 404;
+                }
+                if (req.path == "/park") {
+                    auto resume = EventServer::Park(
+                        std::chrono::milliseconds(std::stoi(req.get_param_value("ms"))),
+                        [](httplib::Response* res) { res->body = "resumed"; });
+                    std::lock_guard<std::mutex> lock(parked_mu_);
+                    parked_.push_back(std::move(resume));
+                    return;
+                }
+                res->body = fmt::format("{} {} q={} body={}", req.method, req.path,
+                                        req.get_param_value("q"), req.body);
+            },
+            /*workers=*/2);
+        port_ = server_->Bind("127.0.0.1", 0);
+        ASSERT_GT(port_, 0);
+        thread_ = std::thread([this] { server_->Listen(); });
+    }
+
+    void TearDown() override {
+        release_ = true;
+        server_->Stop();
+        thread_.join();
+    }
+
+    int Connect() {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port_);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        EXPECT_EQ(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+        return fd;
+    }
+
+    static void Send(int fd, const std::string& data) {
+        ASSERT_EQ(send(fd, data.data(), data.size(), MSG_NOSIGNAL), data.size());
+    }
+
+    // Reads one response and returns its status line and body, e.g. "HTTP/1.1 200 OK|GET /".
+    // Returns an empty string if the server has closed the connection.
+    std::string Receive(int fd) {
+        while (buffer_.find("\r\n\r\n") == std::string::npos || !Complete()) {
+            char chunk[4096];
+            ssize_t size = recv(fd, chunk, sizeof(chunk), 0);
+            if (size <= 0) {
+                return "";
+            }
+            buffer_.append(chunk, size);
+        }
+        const size_t head_end = buffer_.find("\r\n\r\n");
+        const size_t length = ContentLength();
+        std::string ret = buffer_.substr(0, buffer_.find("\r\n")) + "|" +
+                          buffer_.substr(head_end + 4, length);
+        buffer_.erase(0, head_end + 4 + length);
+        return ret;
+    }
+
+    std::unique_ptr<EventServer> server_;
+    int port_ = 0;
+    std::thread thread_;
+    std::atomic<bool> release_ = false;
+    std::mutex parked_mu_;
+    std::vector<std::function<void()>> parked_;
+
+   private:
+    size_t ContentLength() const {
+        const size_t pos = buffer_.find("Content-Length: ");
+        return std::stoul(buffer_.substr(pos + 16));
+    }
+
+    bool Complete() const {
+        return buffer_.size() >= buffer_.find("\r\n\r\n") + 4 + ContentLength();
+    }
+
+    std::string buffer_;
+};
+
+TEST_F(EventServerTest, KeepAliveAndPipelining) {
+    int fd = Connect();
+    Send(fd, "GET /a?q=hello%20world+x HTTP/1.1\r\nHost: x\r\n\r\n");
+    EXPECT_EQ(Receive(fd), "HTTP/1.1 200 OK|GET /a q=hello world x body=");
+    Send(fd, "POST /b HTTP/1.1\r\nContent-Length: 5\r\n\r\nhel");
+    Send(fd, "lo");
+    EXPECT_EQ(Receive(fd), "HTTP/1.1 200 OK|POST /b q= body=hello");
+
+    // Two requests in one packet are answered in order.
+    Send(fd, "GET /missing HTTP/1.1\r\n\r\nGET /d HTTP/1.1\r\n\r\n");
+    EXPECT_EQ(Receive(fd), "HTTP/1.1 404 Not Found|GET /missing q= body=");
+    EXPECT_EQ(Receive(fd), "HTTP/1.1 200 OK|GET /d q= body=");
+
+    Send(fd, "GET /e HTTP/1.1\r\nConnection: close\r\n\r\n");
+    EXPECT_EQ(Receive(fd), "HTTP/1.1 200 OK|GET /e q= body=");
+    EXPECT_EQ(Receive(fd), "") << "closed after Connection: close";
+    close(fd);
+}
+
+TEST_F(EventServerTest, IdleConnectionsDontBlockOthers) {
+    // Idle connections hold no worker: with two workers, one of them busy, two hundred idle
+    // clients don't keep the next request from being served.
+    std::vector<int> idle;
+    for (int i = 0; i < 200; ++i) {
+        idle.push_back(Connect());
+    }
+    int slow = Connect();
+    Send(slow, "GET /slow HTTP/1.1\r\n\r\n");
+
+    int fd = Connect();
+    Send(fd, "GET /fast HTTP/1.1\r\n\r\n");
+    EXPECT_EQ(Receive(fd), "HTTP/1.1 200 OK|GET /fast q= body=");
+
+    release_ = true;
+    EXPECT_EQ(Receive(slow), "HTTP/1.1 200 OK|GET /slow q= body=");
+    for (int v : idle) {
+        close(v);
+    }
+    close(slow);
+    close(fd);
+}
+
+TEST_F(EventServerTest, RefusesMalformedRequests) {
+    int fd = Connect();
+    Send(fd, "nonsense\r\n\r\n");
+    EXPECT_EQ(Receive(fd), "HTTP/1.1 400 Bad Request|Bad Request");
+    EXPECT_EQ(Receive(fd), "");
+    close(fd);
+
+    fd = Connect();
+    Send(fd, "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n");
+    EXPECT_EQ(Receive(fd), "HTTP/1.1 501 Not Implemented|Not Implemented");
+    close(fd);
+}
+
+TEST_F(EventServerTest, ParkedRequestsDontHoldWorkers) {
+    std::vector<int> fds;
+    for (int i = 0; i < 3; ++i) {
+        fds.push_back(Connect());
+        Send(fds.back(), "GET /park?ms=60000 HTTP/1.1\r\n\r\n");
+    }
+    const int fd = Connect();
+    Send(fd, "GET /other HTTP/1.1\r\n\r\n");
+    EXPECT_EQ(Receive(fd), "HTTP/1.1 200 OK|GET /other q= body=") << "2 workers are free";
+
+    for (;;) {
+        std::lock_guard<std::mutex> lock(parked_mu_);
+        if (parked_.size() == fds.size()) {
+            break;
+        }
+    }
+    for (size_t i = 0; i < fds.size(); ++i) {
+        parked_[i]();
+        parked_[i]();
+        EXPECT_EQ(Receive(fds[i]), "HTTP/1.1 200 OK|resumed");
+        close(fds[i]);
+    }
+
+    // A request that nothing resumes times out.
+    Send(fd, "GET /park?ms=10 HTTP/1.1\r\n\r\n");
+    EXPECT_EQ(Receive(fd), "HTTP/1.1 200 OK|resumed");
+    Send(fd, "GET /other HTTP/1.1\r\n\r\n");
+    EXPECT_EQ(Receive(fd), "HTTP/1.1 200 OK|GET /other q= body=");
+    close(fd);
+}
+
+TEST_F(EventServerTest, AdoptsAListeningSocket) {
+    const auto handler = [](const httplib::Request& req, httplib::Response* res) {
+        res->body = "adopted";
+    };
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    ASSERT_EQ(bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    EXPECT_EQ(EventServer(handler, 1).Adopt(listener), -1);
+    ASSERT_EQ(listen(listener, SOMAXCONN), 0);
+
+    // A connection that a stopping server hasn't accepted waits for the next one.
+    auto stopping = std::make_unique<EventServer>(handler, 1);
+    port_ = stopping->Adopt(dup(listener));
+    ASSERT_GT(port_, 0);
+    const int fd = Connect();
+    stopping.reset();
+
+    EventServer next(handler, 1);
+    ASSERT_EQ(next.Adopt(listener), port_);
+    std::thread thread([&next] { next.Listen(); });
+    Send(fd, "GET / HTTP/1.1\r\n\r\n");
+    EXPECT_EQ(Receive(fd), "HTTP/1.1 200 OK|adopted");
+    next.Stop();
+    thread.join();
+    close(fd);
+}
+
+}  // namespace
+}  // namespace foodculator
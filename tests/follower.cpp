@@ -0,0 +1,290 @@
+#include "server/follower.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "gmock/gmock.h"
+#include "fmt/format.h"
+#include "gtest/gtest.h"
+#include "httplib.h"
+#include "server/server.h"
+
+namespace foodculator {
+namespace {
+
+// Serves the batches of `db` the way GET /replication does, through json.
+class FakeLeader : public LeaderApi {
+   public:
+    explicit FakeLeader(DB* db, uint64_t limit = 0) : db_(db), limit_(limit) {}
+
+    StatusOr<ReplicationBatch> Fetch(const ReplicationCursor& after,
+                                     std::chrono::seconds timeout) override {
+        ++fetches_;
+        auto batch = db_->GetReplicationBatch(after, limit_);
+        if (!batch.Ok()) {
+            return batch;
+        }
+        std::string err;
+        auto json = json11::Json::parse(json11::Json(batch.Value()).dump(), err);
+        EXPECT_EQ(err, "");
+        return ParseReplicationBatch(json);
+    }
+
+    int fetches() const { return fetches_; }
+
+   private:
+    DB* db_;
+    const uint64_t limit_;
+    int fetches_ = 0;
+};
+
+// Expects the tables of `follower` to hold the same rows as the ones of `leader`.
+void ExpectSameTables(DB* leader, DB* follower) {
+    EXPECT_THAT(follower->GetProducts().Value(),
+                testing::UnorderedElementsAreArray(leader->GetProducts().Value()));
+    EXPECT_THAT(follower->GetTableware().Value(),
+                testing::UnorderedElementsAreArray(leader->GetTableware().Value()));
+    EXPECT_EQ(follower->GetFullRecipes().Value(), leader->GetFullRecipes().Value());
+}
+
+TEST(Follower, ReplaysWrites) {
+    auto leader_db = DB::Create(":memory:");
+    auto follower_db = DB::Create(":memory:");
+    ASSERT_TRUE(leader_db && follower_db);
+    FakeLeader leader(leader_db.get());
+    Follower follower(follower_db.get(), &leader, std::chrono::seconds(10));
+    EXPECT_FALSE(follower.IsFresh());
+
+    const size_t egg = leader_db->AddProduct("egg", 150, {12.5f, 10, 1, 0, 0.3f, 1}).Value();
+    const size_t flour = leader_db->AddProduct("flour", 364).Value();
+    const size_t milk = leader_db->AddProduct("milk", 60).Value();
+    ASSERT_TRUE(leader_db->AddTableware("pan", 800).Ok());
+    const size_t batter =
+        leader_db->CreateRecipe("batter", "whisk", {{egg, 50}, {flour, 100}, {milk, 200}})
+            .Value();
+    const size_t pancakes =
+        leader_db->CreateRecipe("pancakes", "fry", {{egg, 10}}, {{batter, 300}}).Value();
+
+    ASSERT_EQ(follower.SyncOnce(std::chrono::seconds(0)), StatusCode::OK);
+    EXPECT_TRUE(follower.IsFresh());
+    EXPECT_EQ(follower.version(), leader_db->Version().Value());
+    ExpectSameTables(leader_db.get(), follower_db.get());
+    EXPECT_NEAR(follower_db->GetRecipeKcalPer100g(pancakes).Value(),
+                leader_db->GetRecipeKcalPer100g(pancakes).Value(), 1e-3);
+
+    // Deleted rows, and rows written again with the freed names.
+    auto recipe = leader_db->GetRecipeInfo(batter).Value();
+    ASSERT_TRUE(leader_db
+                    ->UpdateRecipe(batter, recipe.version, "batter", "whisk well",
+                                   {{egg, 50}, {flour, 120}})
+                    .Ok());
+    ASSERT_TRUE(leader_db->DeleteProduct(milk));
+    ASSERT_TRUE(leader_db->DeleteRecipe(pancakes));
+    ASSERT_TRUE(leader_db->CreateRecipe("pancakes", "bake", {}, {{batter, 200}}).Ok());
+    ASSERT_TRUE(leader_db->AddProduct("milk", 64).Ok());
+
+    ASSERT_EQ(follower.SyncOnce(std::chrono::seconds(0)), StatusCode::OK);
+    ExpectSameTables(leader_db.get(), follower_db.get());
+
+    // Nothing new.
+    const uint64_t version = follower.version();
+    ASSERT_EQ(follower.SyncOnce(std::chrono::seconds(0)), StatusCode::OK);
+    EXPECT_EQ(follower.version(), version);
+
+    // The version survives a restart of the follower.
+    Follower restarted(follower_db.get(), &leader, std::chrono::seconds(10));
+    EXPECT_EQ(restarted.version(), version);
+}
+
+TEST(Follower, ReloadsWhenTombstonesAreGone) {
+    auto leader_db = DB::Create(":memory:");
+    auto follower_db = DB::Create(":memory:");
+    ASSERT_TRUE(leader_db && follower_db);
+    FakeLeader leader(leader_db.get());
+    Follower follower(follower_db.get(), &leader, std::chrono::seconds(10));
+
+    const size_t egg = leader_db->AddProduct("egg", 150).Value();
+    ASSERT_TRUE(leader_db->AddProduct("flour", 364).Ok());
+    ASSERT_EQ(follower.SyncOnce(std::chrono::seconds(0)), StatusCode::OK);
+
+    ASSERT_TRUE(leader_db->DeleteProduct(egg));
+    const auto now = std::chrono::system_clock::now();
+    ASSERT_TRUE(leader_db->CompactTombstones(now + std::chrono::hours(1)).Ok());
+    ASSERT_TRUE(leader_db->AddTableware("pot", 1200).Ok());
+
+    auto batch = leader_db->GetReplicationBatch(follower.version());
+    ASSERT_TRUE(batch.Ok());
+    EXPECT_TRUE(batch.Value().reset());
+
+    ASSERT_EQ(follower.SyncOnce(std::chrono::seconds(0)), StatusCode::OK);
+    ExpectSameTables(leader_db.get(), follower_db.get());
+}
+
+TEST(Follower, RejectsMalformedBatches) {
+    std::string err;
+    auto json = json11::Json::parse(
+        R"({"ingredients": {"version": "3", "reset": false, "changed": [{"id": "x"}],
+            "deleted": []}})",
+        err);
+    ASSERT_EQ(err, "");
+    EXPECT_EQ(ParseReplicationBatch(json).Code(), StatusCode::INVALID_ARGUMENT);
+    EXPECT_EQ(ParseReplicationBatch(json11::Json()).Code(), StatusCode::INVALID_ARGUMENT);
+}
+
+TEST(Follower, CatchesUpInSeveralBatches) {
+    auto leader_db = DB::Create(":memory:");
+    auto follower_db = DB::Create(":memory:");
+    ASSERT_TRUE(leader_db && follower_db);
+    FakeLeader leader(leader_db.get(), /*limit=*/2);
+    Follower follower(follower_db.get(), &leader, std::chrono::seconds(10));
+
+    const size_t water = leader_db->AddProduct("water", 0).Value();
+    const size_t onion = leader_db->AddProduct("onion", 40).Value();
+    const size_t stock = leader_db->CreateRecipe("stock", "", {{water, 900}}).Value();
+    ASSERT_TRUE(leader_db->CreateRecipe("soup", "", {{onion, 100}}, {{stock, 500}}).Ok());
+    ASSERT_TRUE(leader_db->AddTableware("pot", 1200).Ok());
+    // The stock is now written after the soup that uses it, and the leek after both.
+    const size_t leek = leader_db->AddProduct("leek", 61).Value();
+    auto recipe = leader_db->GetRecipeInfo(stock).Value();
+    ASSERT_TRUE(
+        leader_db->UpdateRecipe(stock, recipe.version, "stock", "", {{water, 900}, {leek, 100}})
+            .Ok());
+
+    auto batch = leader_db->GetReplicationBatch(0, 2);
+    ASSERT_TRUE(batch.Ok());
+    EXPECT_TRUE(batch.Value().reset());
+    EXPECT_TRUE(batch.Value().more);
+    EXPECT_THAT(batch.Value().ingredients.changed, testing::SizeIs(2));
+    EXPECT_EQ(batch.Value().next.kind, 0);
+    EXPECT_EQ(batch.Value().next.id, onion);
+
+    ASSERT_EQ(follower.SyncOnce(std::chrono::seconds(0)), StatusCode::OK);
+    EXPECT_GT(leader.fetches(), 2);
+    EXPECT_EQ(follower.version(), leader_db->Version().Value());
+    ExpectSameTables(leader_db.get(), follower_db.get());
+
+    ASSERT_TRUE(leader_db->AddProduct("salt", 0).Ok());
+    const size_t pepper = leader_db->AddProduct("pepper", 250).Value();
+    ASSERT_TRUE(leader_db->AddProduct("dill", 40).Ok());
+    ASSERT_TRUE(leader_db->DeleteProduct(pepper));
+    ASSERT_EQ(follower.SyncOnce(std::chrono::seconds(0)), StatusCode::OK);
+    ExpectSameTables(leader_db.get(), follower_db.get());
+    EXPECT_FALSE(leader_db->GetReplicationBatch(follower.version(), 2).Value().more);
+}
+
+TEST(Follower, SplitsAVersion) {
+    auto leader_db = DB::Create(":memory:");
+    auto follower_db = DB::Create(":memory:");
+    ASSERT_TRUE(leader_db && follower_db);
+    FakeLeader leader(leader_db.get(), /*limit=*/3);
+    Follower follower(follower_db.get(), &leader, std::chrono::seconds(10));
+
+    // An import stamps all its rows with one version.
+    std::vector<Ingredient> products;
+    for (size_t id = 1; id <= 10; ++id) {
+        products.emplace_back(fmt::format("product #{}", id), id, id);
+    }
+    ASSERT_EQ(leader_db->ImportProducts(products), StatusCode::OK);
+    ASSERT_TRUE(leader_db->AddTableware("pot", 1200).Ok());
+
+    auto batch = leader_db->GetReplicationBatch(0, 3);
+    ASSERT_TRUE(batch.Ok());
+    EXPECT_THAT(batch.Value().ingredients.changed, testing::SizeIs(3));
+    ASSERT_TRUE(batch.Value().more);
+    batch = leader_db->GetReplicationBatch(batch.Value().next, 3);
+    ASSERT_TRUE(batch.Ok());
+    EXPECT_FALSE(batch.Value().reset());
+    EXPECT_THAT(batch.Value().ingredients.changed, testing::SizeIs(3));
+    EXPECT_EQ(batch.Value().ingredients.changed[0].id, 4);
+
+    ASSERT_EQ(follower.SyncOnce(std::chrono::seconds(0)), StatusCode::OK);
+    EXPECT_EQ(leader.fetches(), 4);
+    EXPECT_EQ(follower.version(), leader_db->Version().Value());
+    ExpectSameTables(leader_db.get(), follower_db.get());
+
+    // Deletions are paged the same way.
+    for (size_t id = 2; id <= 9; ++id) {
+        ASSERT_TRUE(leader_db->DeleteProduct(id));
+    }
+    ASSERT_EQ(follower.SyncOnce(std::chrono::seconds(0)), StatusCode::OK);
+    EXPECT_EQ(leader.fetches(), 7);
+    ExpectSameTables(leader_db.get(), follower_db.get());
+}
+
+TEST(Follower, ReplicatesOverHttp) {
+    auto leader_db = DB::Create(":memory:");
+    auto follower_db = DB::Create(":memory:");
+    ASSERT_TRUE(leader_db && follower_db);
+
+    Server leader_server(leader_db.get(), ".", "test");
+    const int leader_port = leader_server.Bind("127.0.0.1", 0);
+    ASSERT_GT(leader_port, 0);
+    std::thread leader_thread([&leader_server] { leader_server.Listen(); });
+
+    auto leader = CreateHttpLeaderApi(fmt::format("http://127.0.0.1:{}", leader_port));
+    Follower follower(follower_db.get(), leader.get(), std::chrono::seconds(10));
+    Server follower_server(follower_db.get(), ".", "test");
+    follower_server.SetFollower(&follower);
+    const int follower_port = follower_server.Bind("127.0.0.1", 0);
+    ASSERT_GT(follower_port, 0);
+    std::thread follower_thread([&follower_server] { follower_server.Listen(); });
+
+    // More rows than fit one batch of /replication, each with its own version.
+    httplib::Client to_leader("127.0.0.1", leader_port);
+    auto res = to_leader.Post("/add_ingredient", R"({"product": "egg", "kcal": 150})",
+                              "application/json");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200) << res->body;
+    const std::string egg = res->body;
+    ASSERT_EQ(leader_db->InTransaction([&] {
+        for (int i = 0; i < 1500; ++i) {
+            if (auto st = leader_db->AddProduct(fmt::format("product #{}", i), i); !st.Ok()) {
+                return st.Code();
+            }
+        }
+        return StatusCode::OK;
+    }),
+              StatusCode::OK);
+    ASSERT_TRUE(leader_db->AddTableware("pot", 1200).Ok());
+
+    httplib::Client to_follower("127.0.0.1", follower_port);
+    res = to_follower.Get("/get_ingredients");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 503) << "the follower hasn't synced yet";
+
+    ASSERT_EQ(follower.SyncOnce(std::chrono::seconds(0)), StatusCode::OK);
+    EXPECT_EQ(follower.version(), leader_db->Version().Value());
+    ExpectSameTables(leader_db.get(), follower_db.get());
+
+    res = to_follower.Get(("/ingredient/" + egg).c_str());
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200) << res->body;
+    std::string err;
+    const auto ingredient = json11::Json::parse(res->body, err);
+    ASSERT_EQ(err, "");
+    EXPECT_EQ(ingredient["name"].string_value(), "egg");
+    res = to_follower.Post("/add_ingredient", R"({"product": "milk", "kcal": 60})",
+                           "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 403);
+
+    // A long poll of the follower returns as soon as the leader is written to.
+    std::thread writer([&leader_db] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ASSERT_TRUE(leader_db->AddProduct("milk", 60).Ok());
+    });
+    ASSERT_EQ(follower.SyncOnce(std::chrono::seconds(10)), StatusCode::OK);
+    writer.join();
+    ExpectSameTables(leader_db.get(), follower_db.get());
+
+    follower_server.Stop();
+    follower_thread.join();
+    leader_server.Stop();
+    leader_thread.join();
+}
+
+}  // namespace
+}  // namespace foodculator
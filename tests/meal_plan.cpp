@@ -0,0 +1,123 @@
+#include "plan/meal_plan.h"
+
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "util/thread_pool.h"
+
+namespace foodculator {
+namespace {
+
+class MealPlanTest : public testing::Test {
+   protected:
+    void SetUp() override {
+        request_.threads = 4;
+        request_.items = {
+            {/*id=*/1, NutrientProfile(200, {/*protein=*/10, 0, 0, 0, 0, 0}), 0, 200},
+            {/*id=*/2, NutrientProfile(100, {}), 0, 300},
+        };
+    }
+
+    PlanRequest request_;
+};
+
+TEST_F(MealPlanTest, HitsTheTarget) {
+    request_.kcal = 500;
+    auto plan = SolveMealPlan(request_);
+    ASSERT_TRUE(plan.Ok()) << ToString(plan.Code()) << ": " << plan.Error();
+    EXPECT_TRUE(plan.Value().optimal);
+    EXPECT_NEAR(plan.Value().kcal, 500, 0.5);
+    ASSERT_THAT(plan.Value().weights, testing::SizeIs(2));
+    EXPECT_LE(plan.Value().weights[0], 200);
+    EXPECT_LE(plan.Value().weights[1], 300);
+    EXPECT_FLOAT_EQ(plan.Value().kcal,
+                    2.0 * plan.Value().weights[0] + 1.0 * plan.Value().weights[1]);
+}
+
+TEST_F(MealPlanTest, KeepsNutrientsWithinRanges) {
+    request_.kcal = 500;
+    request_.ranges = {{Nutrient::PROTEIN, 20}};
+    auto plan = SolveMealPlan(request_);
+    ASSERT_TRUE(plan.Ok()) << ToString(plan.Code()) << ": " << plan.Error();
+    EXPECT_THAT(plan.Value().weights, testing::ElementsAre(200, 100));
+    EXPECT_FLOAT_EQ(plan.Value().nutrients[static_cast<size_t>(Nutrient::PROTEIN)], 20);
+
+    request_.ranges = {{Nutrient::PROTEIN, 100}};
+    EXPECT_EQ(SolveMealPlan(request_).Code(), StatusCode::NOT_FOUND);
+}
+
+TEST_F(MealPlanTest, ComesClosestToAnUnreachableTarget) {
+    request_.kcal = 10000;
+    auto plan = SolveMealPlan(request_);
+    ASSERT_TRUE(plan.Ok());
+    EXPECT_TRUE(plan.Value().optimal);
+    EXPECT_THAT(plan.Value().weights, testing::ElementsAre(200, 300));
+
+    request_.kcal = 0;
+    request_.items[1].min_weight = 55;
+    plan = SolveMealPlan(request_);
+    ASSERT_TRUE(plan.Ok());
+    EXPECT_THAT(plan.Value().weights, testing::ElementsAre(0, 55));
+}
+
+TEST_F(MealPlanTest, StopsAtTheDeadline) {
+    // Every portion is a multiple of 100 kcal, so no plan comes within 0.5 kcal of the target
+    // and the search can't stop early; there are 21^20 plans to go through.
+    request_.items.clear();
+    for (size_t id = 1; id <= 20; ++id) {
+        request_.items.push_back({id, NutrientProfile(1000, {}), 0, 200});
+    }
+    request_.kcal = 12345;
+    request_.deadline = std::chrono::milliseconds(50);
+
+    const auto start = std::chrono::steady_clock::now();
+    auto plan = SolveMealPlan(request_);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    ASSERT_TRUE(plan.Ok()) << ToString(plan.Code()) << ": " << plan.Error();
+    EXPECT_FALSE(plan.Value().optimal);
+    EXPECT_NEAR(plan.Value().kcal, 12345, 100);
+}
+
+TEST_F(MealPlanTest, RejectsBadRequests) {
+    request_.step = 0;
+    EXPECT_EQ(SolveMealPlan(request_).Code(), StatusCode::INVALID_ARGUMENT);
+    request_.step = 10;
+    request_.items[0].min_weight = 300;
+    EXPECT_EQ(SolveMealPlan(request_).Code(), StatusCode::INVALID_ARGUMENT);
+    request_.items.clear();
+    EXPECT_EQ(SolveMealPlan(request_).Code(), StatusCode::INVALID_ARGUMENT);
+}
+
+TEST_F(MealPlanTest, SharesAPool) {
+    request_.kcal = 500;
+    request_.ranges = {{Nutrient::PROTEIN, 20}};
+    ThreadPool pool(2);
+    request_.pool = &pool;
+
+    // More plans are solved at a time than the pool has threads, some from the pool itself.
+    std::vector<std::thread> requests;
+    for (int i = 0; i < 4; ++i) {
+        requests.emplace_back([this] {
+            auto plan = SolveMealPlan(request_);
+            ASSERT_TRUE(plan.Ok()) << ToString(plan.Code()) << ": " << plan.Error();
+            EXPECT_THAT(plan.Value().weights, testing::ElementsAre(200, 100));
+        });
+    }
+    for (int i = 0; i < 4; ++i) {
+        pool.Submit([this] {
+            auto plan = SolveMealPlan(request_);
+            ASSERT_TRUE(plan.Ok()) << ToString(plan.Code()) << ": " << plan.Error();
+            EXPECT_THAT(plan.Value().weights, testing::ElementsAre(200, 100));
+        });
+    }
+    for (auto& request : requests) {
+        request.join();
+    }
+}
+
+}  // namespace
+}  // namespace foodculator
@@ -0,0 +1,44 @@
+#include "db/nutrients.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace foodculator {
+namespace {
+
+TEST(Nutrients, MixPer100g) {
+    const std::vector<NutrientProfile> profiles = {
+        NutrientProfile(52, {3, 2.5, 4.75, 0, 0.125, 4.75}),
+        NutrientProfile(364, {10, 1, 76, 2.5, 0, 0.25}),
+    };
+    const std::vector<float> weights = {300, 100};
+
+    const auto mix = MixPer100g(profiles.data(), weights.data(), profiles.size());
+    EXPECT_EQ(mix.kcal(), 130);
+    EXPECT_EQ(mix.Get(Nutrient::PROTEIN), 4.75);
+    EXPECT_EQ(mix.Get(Nutrient::CARBOHYDRATE), 22.5625);
+    EXPECT_EQ(mix.Get(Nutrient::SUGAR), 3.625);
+    EXPECT_EQ(mix.lanes.back(), 0) << "the padding lane stays zero";
+
+    EXPECT_EQ(MixPer100g(profiles.data(), weights.data(), 1), profiles[0]);
+    EXPECT_EQ(MixPer100g(profiles.data(), weights.data(), 0), NutrientProfile());
+    const std::vector<float> nothing = {0, 0};
+    EXPECT_EQ(MixPer100g(profiles.data(), nothing.data(), 2), NutrientProfile());
+}
+
+TEST(Nutrients, Json) {
+    EXPECT_EQ(ToString(Nutrient::PROTEIN), "protein");
+    EXPECT_EQ(ToString(Nutrient::SUGAR), "sugar");
+
+    EXPECT_EQ(ToJson({3.2, 0, 0, 0, 0, 0.5}).dump(),
+              R"({"carbohydrate": "0", "fat": "0", "fibre": "0", "protein": "3.2", )"
+              R"("salt": "0", "sugar": "0.5"})");
+    EXPECT_EQ(NutrientProfile(52.5, {3.2, 0, 0, 0, 0, 0.5}).to_json().dump(),
+              R"({"carbohydrate": "0.00", "fat": "0.00", "fibre": "0.00", "kcal": "52.50", )"
+              R"("protein": "3.20", "salt": "0.00", "sugar": "0.50"})");
+}
+
+}  // namespace
+}  // namespace foodculator
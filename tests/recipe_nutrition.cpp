@@ -0,0 +1,73 @@
+#include "db/recipe_nutrition.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace foodculator {
+namespace {
+
+NutrientProfile Kcal(float kcal) { return NutrientProfile(kcal, {}); }
+
+// Recipes 1 and 2 use recipe 3, which uses recipe 4; recipe 5 is on its own.
+//
+//   1   2
+//    \ /
+//     3   5
+//     |
+//     4
+class RecipeNutritionTest : public testing::Test {
+   protected:
+    void SetUp() override {
+        nutrition_.Set(4, Kcal(40), {/*salt=*/100}, {});
+        nutrition_.Set(3, Kcal(30), {/*milk=*/101}, {4});
+        nutrition_.Set(2, Kcal(20), {}, {3});
+        nutrition_.Set(1, Kcal(10), {/*salt=*/100, /*flour=*/102}, {3});
+        nutrition_.Set(5, Kcal(50), {/*flour=*/102}, {});
+    }
+
+    RecipeNutrition nutrition_;
+};
+
+TEST_F(RecipeNutritionTest, Memoizes) {
+    EXPECT_EQ(nutrition_.size(), 5u);
+    EXPECT_EQ(nutrition_.Get(3), Kcal(30));
+    EXPECT_EQ(nutrition_.Get(6), std::nullopt);
+}
+
+TEST_F(RecipeNutritionTest, InvalidatesDependentRecipes) {
+    nutrition_.InvalidateRecipe(3);
+    EXPECT_EQ(nutrition_.Get(1), std::nullopt);
+    EXPECT_EQ(nutrition_.Get(2), std::nullopt);
+    EXPECT_EQ(nutrition_.Get(3), std::nullopt);
+    EXPECT_EQ(nutrition_.Get(4), Kcal(40)) << "a sub-recipe doesn't depend on its users";
+    EXPECT_EQ(nutrition_.Get(5), Kcal(50));
+
+    nutrition_.InvalidateRecipe(2);
+    EXPECT_EQ(nutrition_.size(), 2u) << "invalidating a missing value is a no-op";
+}
+
+TEST_F(RecipeNutritionTest, InvalidatesUsersOfIngredients) {
+    nutrition_.InvalidateIngredient(101);
+    EXPECT_EQ(nutrition_.size(), 2u) << "recipe 3 and its users";
+    EXPECT_EQ(nutrition_.Get(4), Kcal(40));
+    EXPECT_EQ(nutrition_.Get(5), Kcal(50));
+
+    nutrition_.InvalidateIngredient(102);
+    EXPECT_EQ(nutrition_.size(), 1u);
+    nutrition_.InvalidateIngredient(100);
+    EXPECT_EQ(nutrition_.size(), 0u);
+}
+
+TEST_F(RecipeNutritionTest, SetReplacesEdges) {
+    // Recipe 3 no longer uses recipe 4, so a change of 4 keeps the new value of 3.
+    nutrition_.Set(3, Kcal(33), {101}, {});
+    EXPECT_EQ(nutrition_.Get(1), std::nullopt) << "users of the old value are dropped";
+    nutrition_.InvalidateRecipe(4);
+    EXPECT_EQ(nutrition_.Get(3), Kcal(33));
+
+    nutrition_.Clear();
+    EXPECT_EQ(nutrition_.size(), 0u);
+}
+
+}  // namespace
+}  // namespace foodculator
@@ -0,0 +1,107 @@
+#include "util/router.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace foodculator {
+namespace {
+
+TEST(Router, StaticRoutes) {
+    Router<std::string> router;
+    ASSERT_TRUE(router.Add("GET", "/", "index"));
+    ASSERT_TRUE(router.Add("GET", "/get_ingredients", "get_ingredients"));
+    ASSERT_TRUE(router.Add("POST", "/add_ingredient", "add_ingredient"));
+
+    RouteParams params;
+    for (const auto& [method, path, want] : std::vector<std::array<std::string, 3>>{
+             {"GET", "/", "index"},
+             {"GET", "/get_ingredients", "get_ingredients"},
+             {"POST", "/add_ingredient", "add_ingredient"},
+         }) {
+        const std::string* got = router.Match(method, path, &params);
+        ASSERT_NE(got, nullptr) << method << " " << path;
+        EXPECT_EQ(*got, want) << method << " " << path;
+        EXPECT_EQ(params.size(), 0) << method << " " << path;
+    }
+
+    EXPECT_EQ(router.Match("POST", "/get_ingredients", &params), nullptr) << "wrong method";
+    EXPECT_EQ(router.Match("GET", "/get_ingredients/", &params), nullptr) << "trailing slash";
+    EXPECT_EQ(router.Match("GET", "/get", &params), nullptr) << "prefix of a route";
+    EXPECT_EQ(router.Match("GET", "/get_ingredientsX", &params), nullptr) << "longer segment";
+    EXPECT_EQ(router.Match("GET", "", &params), nullptr) << "empty path";
+}
+
+TEST(Router, IdParams) {
+    Router<std::string> router;
+    ASSERT_TRUE(router.Add("GET", "/recipe/:id", "get_recipe"));
+    ASSERT_TRUE(router.Add("DELETE", "/recipe/:id", "delete_recipe"));
+    ASSERT_TRUE(router.Add("GET", "/recipe", "recipe_page"));
+    ASSERT_TRUE(router.Add("GET", "/a/:id/b/:id", "nested"));
+
+    RouteParams params;
+    const std::string* got = router.Match("GET", "/recipe/42", &params);
+    ASSERT_NE(got, nullptr);
+    EXPECT_EQ(*got, "get_recipe");
+    ASSERT_EQ(params.size(), 1);
+    EXPECT_EQ(params[0], 42);
+
+    got = router.Match("DELETE", "/recipe/18446744073709551615", &params);
+    ASSERT_NE(got, nullptr);
+    EXPECT_EQ(*got, "delete_recipe");
+    ASSERT_EQ(params.size(), 1);
+    EXPECT_EQ(params[0], 18446744073709551615ull);
+
+    got = router.Match("GET", "/recipe", &params);
+    ASSERT_NE(got, nullptr);
+    EXPECT_EQ(*got, "recipe_page");
+    EXPECT_EQ(params.size(), 0) << "params should be reset between matches";
+
+    got = router.Match("GET", "/a/1/b/2", &params);
+    ASSERT_NE(got, nullptr);
+    EXPECT_EQ(*got, "nested");
+    ASSERT_EQ(params.size(), 2);
+    EXPECT_EQ(params[0], 1);
+    EXPECT_EQ(params[1], 2);
+
+    EXPECT_EQ(router.Match("GET", "/recipe/", &params), nullptr);
+    EXPECT_EQ(router.Match("GET", "/recipe/-1", &params), nullptr);
+    EXPECT_EQ(router.Match("GET", "/recipe/12abc", &params), nullptr);
+    EXPECT_EQ(router.Match("GET", "/recipe/18446744073709551616", &params), nullptr)
+        << "ids that overflow size_t should not match";
+    EXPECT_EQ(router.Match("GET", "/recipe/1/2", &params), nullptr);
+}
+
+TEST(Router, LiteralSegmentsWinOverIds) {
+    Router<std::string> router;
+    ASSERT_TRUE(router.Add("GET", "/recipe/:id", "by_id"));
+    ASSERT_TRUE(router.Add("GET", "/recipe/0", "zero"));
+
+    RouteParams params;
+    const std::string* got = router.Match("GET", "/recipe/0", &params);
+    ASSERT_NE(got, nullptr);
+    EXPECT_EQ(*got, "zero");
+
+    got = router.Match("GET", "/recipe/00", &params);
+    ASSERT_NE(got, nullptr);
+    EXPECT_EQ(*got, "by_id");
+}
+
+TEST(Router, InvalidPatterns) {
+    Router<std::string> router;
+    EXPECT_FALSE(router.Add("GET", "", "empty"));
+    EXPECT_FALSE(router.Add("GET", "no-slash", "relative"));
+    EXPECT_FALSE(router.Add("GET", "/double//slash", "empty segment"));
+    EXPECT_FALSE(router.Add("GET", "/trailing/", "trailing slash"));
+    EXPECT_FALSE(router.Add("GET", "/:id/:id/:id/:id/:id", "too many params"));
+
+    ASSERT_TRUE(router.Add("GET", "/x/:id", "first"));
+    EXPECT_FALSE(router.Add("GET", "/x/:id", "duplicate")) << "duplicate route";
+    EXPECT_TRUE(router.Add("PUT", "/x/:id", "other method"));
+}
+
+}  // namespace
+}  // namespace foodculator
@@ -0,0 +1,306 @@
+#include <random>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "search/catalog_index.h"
+#include "search/duplicates.h"
+#include "search/name_index.h"
+#include "search/normalize.h"
+#include "search/recipe_report.h"
+#include "util/thread_pool.h"
+
+namespace foodculator {
+namespace {
+
+TEST(NormalizeName, FoldsCaseAndPunctuation) {
+    EXPECT_EQ(NormalizeName("Milk 3,2 %"), "milk 3 2");
+    EXPECT_EQ(NormalizeName("  milk 3.2%  "), "milk 3 2");
+    EXPECT_EQ(NormalizeName("МОЛОКО «Простоквашино»"), "молоко простоквашино");
+    EXPECT_EQ(NormalizeName("Ёжик в тумане"), "ежик в тумане");
+    EXPECT_EQ(NormalizeName("Щи—Борщ"), "щи борщ");
+    EXPECT_EQ(NormalizeName("!!!"), "");
+    EXPECT_EQ(NormalizeName("caf\xC3"), "caf") << "truncated UTF-8 is dropped";
+}
+
+TEST(FindDuplicateIngredients, ClustersSimilarNamesWithCloseKcal) {
+    std::vector<Ingredient> products = {
+        {"milk 3.2%", 52, 1},      {"Milk 3,2 %", 54, 2},      {"Молоко 3,2%", 59, 3},
+        {"Молоко 3.2 %", 58, 4},   {"Молоко 3,2%", 300, 5},    {"Сахар белый", 398, 6},
+        {"Мука пшеничная", 364, 7}, {"Мука пшеничная в/с", 362, 8}, {"Мука ржаная", 357, 9},
+        {"соль", 0, 10},           {"Соль", 0, 11},            {"Соль", 0, 12},
+    };
+    // Enough unrelated names for the work to be split between threads.
+    std::mt19937 rng(1);
+    for (size_t id = 100; id < 5000; ++id) {
+        std::string name;
+        for (int i = 0; i < 10; ++i) {
+            name += static_cast<char>('a' + rng() % 26);
+        }
+        products.emplace_back(std::move(name), id % 500, id);
+    }
+
+    DuplicateOptions options;
+    options.min_similarity = 0.6;
+    options.threads = 4;
+    auto clusters = FindDuplicateIngredients(products, options);
+    EXPECT_THAT(clusters,
+                testing::ElementsAre(testing::ElementsAre(1, 2), testing::ElementsAre(3, 4),
+                                     testing::ElementsAre(7, 8), testing::ElementsAre(10, 11, 12)));
+
+    options.threads = 1;
+    EXPECT_EQ(FindDuplicateIngredients(products, options), clusters);
+
+    options.min_similarity = 0.9;
+    EXPECT_THAT(FindDuplicateIngredients(products, options),
+                testing::ElementsAre(testing::ElementsAre(1, 2), testing::ElementsAre(3, 4),
+                                     testing::ElementsAre(10, 11, 12)));
+}
+
+TEST(NameIndex, ExactAndFuzzyMatches) {
+    NameIndex index;
+    index.Add(NameIndex::Kind::INGREDIENT, 1, "Молоко 3,2%");
+    index.Add(NameIndex::Kind::INGREDIENT, 2, "Сахар белый");
+    index.Add(NameIndex::Kind::INGREDIENT, 3, "Мука пшеничная");
+    index.Add(NameIndex::Kind::RECIPE, 10, "Блины на молоке");
+
+    auto exact = index.Find("молоко 3.2 %");
+    ASSERT_TRUE(exact);
+    EXPECT_EQ(exact->entry.id, 1);
+    EXPECT_EQ(exact->entry.name, "Молоко 3,2%");
+    EXPECT_EQ(exact->score, 1.0);
+
+    auto fuzzy = index.Find("сахар");
+    ASSERT_TRUE(fuzzy);
+    EXPECT_EQ(fuzzy->entry.id, 2);
+    EXPECT_LT(fuzzy->score, 1.0);
+
+    auto recipe = index.Find("блины");
+    ASSERT_TRUE(recipe);
+    EXPECT_EQ(recipe->entry.kind, NameIndex::Kind::RECIPE);
+    EXPECT_EQ(recipe->entry.id, 10);
+
+    auto typo = index.Find("пшеничная мкуа");
+    ASSERT_TRUE(typo);
+    EXPECT_EQ(typo->entry.id, 3);
+
+    EXPECT_FALSE(index.Find("avocado"));
+    EXPECT_FALSE(index.Find(""));
+}
+
+TEST(NameIndex, RemovesAndReplaces) {
+    NameIndex index;
+    index.Add(NameIndex::Kind::INGREDIENT, 1, "Сахар белый");
+    index.Add(NameIndex::Kind::INGREDIENT, 2, "Сахар тростниковый");
+    index.Add(NameIndex::Kind::RECIPE, 1, "Сахарный сироп");
+
+    index.Remove(NameIndex::Kind::INGREDIENT, 1);
+    EXPECT_EQ(index.size(), 2);
+    EXPECT_EQ(index.removed(), 1);
+    auto found = index.Find("сахар белый", NameIndex::Kind::INGREDIENT);
+    ASSERT_TRUE(found);
+    EXPECT_EQ(found->entry.id, 2);
+    // Removing an ingredient leaves the recipe with the same id alone.
+    found = index.Find("сахарный сироп");
+    ASSERT_TRUE(found);
+    EXPECT_EQ(found->score, 1.0);
+
+    index.Add(NameIndex::Kind::INGREDIENT, 2, "Мёд");
+    EXPECT_EQ(index.size(), 2);
+    EXPECT_EQ(index.removed(), 2);
+    EXPECT_FALSE(index.Find("сахар тростниковый", NameIndex::Kind::INGREDIENT));
+    found = index.Find("мед");
+    ASSERT_TRUE(found);
+    EXPECT_EQ(found->entry.id, 2);
+
+    index.Remove(NameIndex::Kind::INGREDIENT, 3);
+    EXPECT_EQ(index.size(), 2);
+}
+
+TEST(CatalogIndex, FollowsDatabaseWrites) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    CatalogIndex catalog(db.get());
+    EXPECT_EQ(catalog.Find("avocado").Code(), StatusCode::NOT_FOUND);
+
+    auto avocado_id = db->AddProduct("Avocado", 160);
+    ASSERT_TRUE(avocado_id.Ok());
+    auto found = catalog.Find("avocado");
+    ASSERT_TRUE(found.Ok()) << "Find(avocado) = {code: " << ToString(found.Code())
+                            << ", error: " << found.Error() << "};";
+    EXPECT_EQ(found.Value().entry.id, avocado_id.Value());
+
+    auto salad_id = db->CreateRecipe("Avocado salad", "", {{avocado_id.Value(), 200}});
+    ASSERT_TRUE(salad_id.Ok());
+    found = catalog.Find("avocado salad");
+    ASSERT_TRUE(found.Ok());
+    EXPECT_EQ(found.Value().entry.kind, NameIndex::Kind::RECIPE);
+    EXPECT_EQ(found.Value().entry.id, salad_id.Value());
+
+    ASSERT_TRUE(db->DeleteRecipe(salad_id.Value()));
+    found = catalog.Find("avocado salad");
+    ASSERT_TRUE(found.Ok());
+    EXPECT_EQ(found.Value().entry.kind, NameIndex::Kind::INGREDIENT);
+}
+
+TEST(RecipeReportIndex, FiltersAndRanks) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    auto milk = db->AddProduct("milk", 52, {3, 2.5, 4.75, 0, 0.125, 4.75}).Value();
+    auto flour = db->AddProduct("flour", 364, {10, 1, 76, 2.5, 0, 0.25}).Value();
+    auto water = db->AddProduct("water", 0).Value();
+    auto pancakes = db->CreateRecipe("pancakes", "", {{milk, 300}, {flour, 100}}).Value();
+    auto bread = db->CreateRecipe("bread", "", {{flour, 500}, {water, 300}}).Value();
+    auto cocoa = db->CreateRecipe("cocoa", "", {{milk, 200}}).Value();
+    auto breakfast = db->CreateRecipe("breakfast", "", {{milk, 200}}, {{pancakes, 200}}).Value();
+
+    ThreadPool pool(3);
+    RecipeReportIndex report(db.get(), &pool);
+    auto ids = [&report](const RecipeReportQuery& query) {
+        std::vector<size_t> ret;
+        auto st = report.Query(query);
+        EXPECT_TRUE(st.Ok()) << ToString(st.Code()) << ": " << st.Error();
+        for (const auto& v : st.Value().recipes) {
+            ret.push_back(v.id);
+        }
+        return ret;
+    };
+
+    RecipeReportQuery query;
+    EXPECT_THAT(ids(query), testing::ElementsAre(cocoa, breakfast, pancakes, bread));
+    auto all = report.Query(query).Value();
+    EXPECT_EQ(all.total, 4);
+    EXPECT_EQ(all.recipes[1].name, "breakfast");
+    EXPECT_EQ(all.recipes[1].weight, 400);
+    EXPECT_EQ(all.recipes[1].per_100g, NutrientProfile(91, {3.875, 2.3125, 13.65625, 0.3125,
+                                                             0.109375, 4.1875}));
+    EXPECT_EQ(all.recipes[2].per_100g, db->GetRecipeNutrientsPer100g(pancakes).Value());
+
+    query.max_kcal = 150;
+    query.sort = ReportKey::PROTEIN;
+    query.descending = true;
+    query.limit = 2;
+    EXPECT_THAT(ids(query), testing::ElementsAre(pancakes, breakfast));
+    EXPECT_EQ(report.Query(query).Value().total, 3);
+
+    query = RecipeReportQuery();
+    query.ingredient = milk;
+    query.sort = ReportKey::SHARE;
+    query.descending = true;
+    auto with_milk = report.Query(query).Value();
+    EXPECT_THAT(ids(query), testing::ElementsAre(cocoa, pancakes, breakfast));
+    EXPECT_EQ(with_milk.recipes[1].share, 75);
+    query.ingredient = 100500;
+    EXPECT_THAT(ids(query), testing::IsEmpty());
+    query.ingredient = std::nullopt;
+    EXPECT_EQ(report.Query(query).Code(), StatusCode::INVALID_ARGUMENT);
+
+    // Writes are picked up by the next query.
+    ASSERT_TRUE(db->DeleteRecipe(cocoa));
+    query = RecipeReportQuery();
+    query.sort = ReportKey::WEIGHT;
+    EXPECT_THAT(ids(query), testing::ElementsAre(pancakes, breakfast, bread));
+}
+
+TEST(RecipeReportIndex, ManyRecipes) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    // Both levels of nesting have more recipes than fit one chunk, so that they are evaluated
+    // and scanned in parallel.
+    std::vector<Ingredient> products;
+    std::vector<FullRecipe> recipes;
+    for (size_t id = 1; id <= 10000; ++id) {
+        products.emplace_back("ingredient #" + std::to_string(id), id % 500, id);
+        FullRecipe recipe;
+        recipe.header = RecipeHeader("recipe #" + std::to_string(id), id);
+        recipe.ingredients = {RecipeIngredient(id, 100)};
+        if (id % 2 == 0) {
+            recipe.subrecipes = {RecipeIngredient(id - 1, 100)};
+        }
+        recipes.push_back(std::move(recipe));
+    }
+    ASSERT_EQ(db->InTransaction([&] {
+        if (auto code = db->ImportProducts(products); code != StatusCode::OK) {
+            return code;
+        }
+        return db->ImportRecipes(recipes);
+    }),
+              StatusCode::OK);
+
+    ThreadPool pool(3);
+    RecipeReportIndex report(db.get(), &pool);
+    RecipeReportQuery query;
+    query.descending = true;
+    query.limit = 3;
+    auto top = report.Query(query);
+    ASSERT_TRUE(top.Ok()) << ToString(top.Code()) << ": " << top.Error();
+    EXPECT_EQ(top.Value().total, 10000);
+    ASSERT_THAT(top.Value().recipes, testing::SizeIs(3));
+    for (const auto& v : top.Value().recipes) {
+        EXPECT_FLOAT_EQ(v.per_100g.kcal(), db->GetRecipeNutrientsPer100g(v.id).Value().kcal());
+    }
+}
+
+TEST(RecipeReportIndex, FollowsWrites) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+
+    auto milk = db->AddProduct("milk", 52, {3, 2.5, 4.75, 0, 0.125, 4.75}).Value();
+    auto milk2 = db->AddProduct("Milk", 60, {3, 3.5, 4.75, 0, 0.125, 4.75}).Value();
+    auto flour = db->AddProduct("flour", 364, {10, 1, 76, 2.5, 0, 0.25}).Value();
+    auto water = db->AddProduct("water", 0).Value();
+    auto stock = db->CreateRecipe("stock", "", {{water, 900}, {flour, 100}}).Value();
+    auto soup = db->CreateRecipe("soup", "", {{milk2, 200}}, {{stock, 300}}).Value();
+    auto lunch = db->CreateRecipe("lunch", "", {{milk, 100}}, {{soup, 400}}).Value();
+    auto bread = db->CreateRecipe("bread", "", {{flour, 500}, {water, 300}}).Value();
+
+    ThreadPool pool(3);
+    RecipeReportIndex report(db.get(), &pool);
+    // Checks the report against the profiles DB computes on its own.
+    auto check = [&](std::vector<size_t> want) {
+        RecipeReportQuery query;
+        query.sort = ReportKey::WEIGHT;
+        auto st = report.Query(query);
+        ASSERT_TRUE(st.Ok()) << ToString(st.Code()) << ": " << st.Error();
+        std::vector<size_t> ids;
+        for (const auto& v : st.Value().recipes) {
+            ids.push_back(v.id);
+            auto profile = db->GetRecipeNutrientsPer100g(v.id).Value();
+            for (size_t lane = 0; lane < profile.lanes.size(); ++lane) {
+                EXPECT_NEAR(v.per_100g.lanes[lane], profile.lanes[lane], 1e-3)
+                    << "recipe " << v.name << ", lane " << lane;
+            }
+        }
+        EXPECT_EQ(st.Value().total, want.size());
+        EXPECT_THAT(ids, testing::UnorderedElementsAreArray(want));
+    };
+    check({stock, soup, lunch, bread});
+
+    // The change of the stock reaches the lunch through the soup, and leaves the bread alone.
+    auto version = db->GetRecipeInfo(stock).Value().version;
+    ASSERT_TRUE(db->UpdateRecipe(stock, version, "stock", "", {{water, 500}, {flour, 300}}).Ok());
+    check({stock, soup, lunch, bread});
+
+    ASSERT_EQ(db->MergeProducts(milk, {milk2}), StatusCode::OK);
+    auto cocoa = db->CreateRecipe("cocoa", "", {{milk, 200}}, {{soup, 50}}).Value();
+    check({stock, soup, lunch, bread, cocoa});
+
+    ASSERT_TRUE(db->DeleteRecipe(bread));
+    check({stock, soup, lunch, cocoa});
+    RecipeReportQuery query;
+    query.ingredient = flour;
+    EXPECT_THAT(report.Query(query).Value().recipes, testing::SizeIs(1));
+
+    // Once most slots are dead, the snapshot is built anew.
+    ASSERT_TRUE(db->DeleteRecipe(cocoa));
+    ASSERT_TRUE(db->DeleteRecipe(lunch));
+    ASSERT_TRUE(db->DeleteRecipe(soup));
+    check({stock});
+    check({stock});
+}
+
+}  // namespace
+}  // namespace foodculator
@@ -0,0 +1,236 @@
+#include "server/server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "fmt/format.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "httplib.h"
+
+namespace foodculator {
+namespace {
+
+// Runs a Server on a free port of localhost, with httplib's threads or with the event loop.
+class ServerTest : public testing::TestWithParam<bool> {
+   protected:
+    void SetUp() override {
+        db_ = DB::Create(":memory:");
+        ASSERT_TRUE(db_);
+        server_ = std::make_unique<Server>(db_.get(), ".", "test");
+        if (GetParam()) {
+            server_->UseEventLoop(/*workers=*/2);
+        }
+        port_ = server_->Bind("127.0.0.1", 0);
+        ASSERT_GT(port_, 0);
+        thread_ = std::thread([this] { server_->Listen(); });
+    }
+
+    void TearDown() override {
+        server_->Stop();
+        thread_.join();
+    }
+
+    std::unique_ptr<DB> db_;
+    std::unique_ptr<Server> server_;
+    int port_ = 0;
+    std::thread thread_;
+};
+
+TEST_P(ServerTest, PostsTheBodyToTheRoute) {
+    httplib::Client client("127.0.0.1", port_);
+    client.set_keep_alive(true);
+
+    auto res = client.Post("/add_ingredient", R"({"product": "egg", "kcal": 150})",
+                           "application/json");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200) << res->body;
+    const std::string id = res->body;
+
+    // The next request on the same connection doesn't trip over what is left of the first.
+    res = client.Get(("/ingredient/" + id).c_str());
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200) << res->body;
+    std::string err;
+    const auto ingredient = json11::Json::parse(res->body, err);
+    ASSERT_EQ(err, "");
+    EXPECT_EQ(ingredient["name"].string_value(), "egg");
+    EXPECT_EQ(ingredient["kcal"].string_value(), "150");
+
+    res = client.Post("/add_ingredient", "{", "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 400);
+
+    res = client.Get("/no_such_route");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 404);
+}
+
+TEST_P(ServerTest, ListsTheChanges) {
+    httplib::Client client("127.0.0.1", port_);
+    std::string err;
+    auto res = client.Get("/changes");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200) << res->body;
+    const auto start = json11::Json::parse(res->body, err);
+    ASSERT_EQ(err, "");
+    const std::string epoch = start["epoch"].string_value();
+    const std::string seq = start["seq"].string_value();
+
+    ASSERT_TRUE(db_->AddProduct("egg", 150).Ok());
+    res = client.Get(("/changes?timeout=0&epoch=" + epoch + "&since=" + seq).c_str());
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200) << res->body;
+    auto delta = json11::Json::parse(res->body, err);
+    EXPECT_FALSE(delta["reset"].bool_value());
+    ASSERT_THAT(delta["changes"].array_items(), testing::SizeIs(1));
+    EXPECT_EQ(delta["changes"][0]["row"]["name"].string_value(), "egg");
+
+    // The same `since` of another server, e.g. one before a restart.
+    const std::string other_epoch = std::to_string(std::stoull(epoch) ^ 1);
+    res = client.Get(("/changes?timeout=0&epoch=" + other_epoch + "&since=" + seq).c_str());
+    ASSERT_TRUE(res);
+    delta = json11::Json::parse(res->body, err);
+    EXPECT_TRUE(delta["reset"].bool_value());
+    EXPECT_EQ(delta["epoch"].string_value(), epoch);
+}
+
+TEST_P(ServerTest, SampledTimingsOnlyGoToTheLog) {
+    std::mutex mu;
+    std::vector<std::string> logged;
+    server_->SetTimingSample(1);
+    server_->SetLogger([&mu, &logged](const httplib::Request& req, const httplib::Response& res,
+                                      std::string_view timing) {
+        std::lock_guard<std::mutex> lock(mu);
+        logged.emplace_back(timing);
+    });
+
+    httplib::Client client("127.0.0.1", port_);
+    auto res = client.Get("/get_ingredients");
+    ASSERT_TRUE(res);
+    EXPECT_FALSE(res->has_header("Server-Timing"));
+    res = client.Get("/get_ingredients", {{Server::kTimingHeader, "1"}});
+    ASSERT_TRUE(res);
+    EXPECT_THAT(res->get_header_value("Server-Timing"), testing::HasSubstr("total"));
+
+    // The logger runs after the reply is sent.
+    for (;;) {
+        std::lock_guard<std::mutex> lock(mu);
+        if (logged.size() == 2) {
+            EXPECT_THAT(logged, testing::Each(testing::HasSubstr("total")));
+            break;
+        }
+    }
+}
+
+TEST_P(ServerTest, LongPollsWaitForTheNextChange) {
+    httplib::Client client("127.0.0.1", port_);
+    auto res = client.Get("/changes");
+    ASSERT_TRUE(res);
+    std::string err;
+    const auto start = json11::Json::parse(res->body, err);
+    const std::string path = fmt::format("/changes?timeout=30&epoch={}&since={}",
+                                         start["epoch"].string_value(),
+                                         start["seq"].string_value());
+
+    // Under httplib only Server::kMaxLongPolls of them wait, the event loop parks them all.
+    const size_t polls = GetParam() ? 8 : 1;
+    std::vector<std::thread> pollers;
+    std::vector<size_t> changes(polls);
+    for (size_t i = 0; i < polls; ++i) {
+        pollers.emplace_back([this, &path, &changes, i] {
+            httplib::Client client("127.0.0.1", port_);
+            auto res = client.Get(path.c_str());
+            ASSERT_TRUE(res);
+            ASSERT_EQ(res->status, 200) << res->body;
+            std::string err;
+            changes[i] = json11::Json::parse(res->body, err)["changes"].array_items().size();
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    ASSERT_TRUE(db_->AddProduct("egg", 150).Ok());
+    for (auto& poller : pollers) {
+        poller.join();
+    }
+    EXPECT_THAT(changes, testing::Each(1));
+}
+
+TEST_P(ServerTest, StreamsTheExport) {
+    // More than EventServer lets a worker get ahead of the socket.
+    constexpr size_t kProducts = 6000;
+    ASSERT_EQ(db_->InTransaction([this] {
+        for (size_t i = 0; i < kProducts; ++i) {
+            if (!db_->AddProduct(fmt::format("product {}", i), i).Ok()) {
+                return StatusCode::INTERNAL_ERROR;
+            }
+        }
+        return StatusCode::OK;
+    }),
+              StatusCode::OK);
+
+    httplib::Client client("127.0.0.1", port_);
+    client.set_keep_alive(true);
+
+    auto res = client.Get("/export");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200) << res->body;
+    EXPECT_EQ(res->get_header_value("Content-Type"), "application/x-ndjson");
+    EXPECT_EQ(res->get_header_value("Transfer-Encoding"), "chunked");
+    ASSERT_FALSE(res->body.empty());
+    EXPECT_EQ(res->body.back(), '\n');
+    EXPECT_EQ(std::count(res->body.begin(), res->body.end(), '\n'), kProducts);
+    EXPECT_THAT(res->body, testing::HasSubstr("\"product 5999\""));
+
+    // The connection is ready for the next request after the last chunk.
+    res = client.Get("/export?format=xml");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 400);
+}
+
+TEST_P(ServerTest, ExportStopsWhenTheClientLeaves) {
+    ASSERT_EQ(db_->InTransaction([this] {
+        for (size_t i = 0; i < 20000; ++i) {
+            if (!db_->AddProduct(fmt::format("product {}", i), i).Ok()) {
+                return StatusCode::INTERNAL_ERROR;
+            }
+        }
+        return StatusCode::OK;
+    }),
+              StatusCode::OK);
+
+    for (int attempt = 0; attempt < 20; ++attempt) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port_);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_EQ(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+        const std::string request = "GET /export HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        ASSERT_EQ(send(fd, request.data(), request.size(), 0), request.size());
+        char buffer[1024];
+        ASSERT_GT(recv(fd, buffer, sizeof(buffer), 0), 0);
+        close(fd);
+    }
+
+    // The workers of the abandoned exports are free again.
+    httplib::Client client("127.0.0.1", port_);
+    auto res = client.Get("/export?format=xml");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 400);
+}
+
+INSTANTIATE_TEST_SUITE_P(Modes, ServerTest, testing::Bool());
+
+}  // namespace
+}  // namespace foodculator
@@ -0,0 +1,101 @@
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bot/bot_api.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "tgbot/tgbot.h"
+
+namespace foodculator {
+namespace {
+
+// FakeHttpClient plays the Telegram servers behind tgbot-cpp: it answers every method with the
+// reply set by the test, and records the method and the arguments of every request.
+class FakeHttpClient : public TgBot::HttpClient {
+   public:
+    using Args = std::map<std::string, std::string>;
+
+    void Reply(const std::string& method, std::string json) { replies_[method] = std::move(json); }
+
+    std::string makeRequest(const TgBot::Url& url,
+                            const std::vector<TgBot::HttpReqArg>& args) const override {
+        const std::string method = url.path.substr(url.path.rfind('/') + 1);
+        Args named;
+        for (const auto& arg : args) {
+            named[arg.name] = arg.value;
+        }
+        requests_.emplace_back(method, std::move(named));
+
+        auto it = replies_.find(method);
+        if (it == replies_.end()) {
+            return R"({"ok": false, "error_code": 404, "description": "Not Found"})";
+        }
+        return it->second;
+    }
+
+    const std::vector<std::pair<std::string, Args>>& requests() const { return requests_; }
+
+   private:
+    std::map<std::string, std::string> replies_;
+    // makeRequest() is const in tgbot-cpp.
+    mutable std::vector<std::pair<std::string, Args>> requests_;
+};
+
+TEST(TelegramApi, GetsUpdates) {
+    FakeHttpClient http;
+    http.Reply("getUpdates", R"({"ok": true, "result": [
+        {"update_id": 5, "message": {"message_id": 1, "date": 1600000000,
+                                     "chat": {"id": 42, "type": "private"}, "text": "/pots"}},
+        {"update_id": 6, "edited_message": {"message_id": 1, "date": 1600000000,
+                                            "chat": {"id": 42, "type": "private"},
+                                            "text": "/ingredients"}}]})");
+    auto api = CreateTelegramApi("123:token", http);
+
+    auto updates = api->GetUpdates(5, 30);
+    ASSERT_TRUE(updates.Ok()) << updates.Error();
+    ASSERT_THAT(updates.Value(), testing::SizeIs(2));
+    EXPECT_EQ(updates.Value()[0].update_id, 5);
+    EXPECT_EQ(updates.Value()[0].chat_id, 42);
+    EXPECT_EQ(updates.Value()[0].text, "/pots");
+    // Updates without a message are still passed on, to be acknowledged.
+    EXPECT_EQ(updates.Value()[1].update_id, 6);
+    EXPECT_EQ(updates.Value()[1].chat_id, 0);
+
+    ASSERT_THAT(http.requests(), testing::SizeIs(1));
+    EXPECT_EQ(http.requests()[0].first, "getUpdates");
+    EXPECT_THAT(http.requests()[0].second, testing::Contains(testing::Pair("offset", "5")));
+    EXPECT_THAT(http.requests()[0].second, testing::Contains(testing::Pair("timeout", "30")));
+}
+
+TEST(TelegramApi, SendsMessages) {
+    FakeHttpClient http;
+    http.Reply("sendMessage", R"({"ok": true, "result": {
+        "message_id": 2, "date": 1600000000, "chat": {"id": 42, "type": "private"},
+        "text": "Наша посуда:"}})");
+    auto api = CreateTelegramApi("123:token", http);
+
+    EXPECT_EQ(api->SendMessage(42, "Наша посуда:"), StatusCode::OK);
+    ASSERT_THAT(http.requests(), testing::SizeIs(1));
+    EXPECT_EQ(http.requests()[0].first, "sendMessage");
+    EXPECT_THAT(http.requests()[0].second, testing::Contains(testing::Pair("chat_id", "42")));
+    EXPECT_THAT(http.requests()[0].second,
+                testing::Contains(testing::Pair("text", "Наша посуда:")));
+}
+
+TEST(TelegramApi, ReportsErrors) {
+    FakeHttpClient http;
+    http.Reply("sendMessage",
+               R"({"ok": false, "error_code": 400,
+                   "description": "Bad Request: message is too long"})");
+    auto api = CreateTelegramApi("123:token", http);
+
+    EXPECT_EQ(api->GetUpdates(0, 30).Code(), StatusCode::INTERNAL_ERROR);
+    EXPECT_EQ(api->SendMessage(42, std::string(BotApi::kMaxMessageLength + 1, 'a')),
+              StatusCode::INTERNAL_ERROR);
+}
+
+}  // namespace
+}  // namespace foodculator
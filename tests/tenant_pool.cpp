@@ -0,0 +1,107 @@
+#include "server/tenant_pool.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "server/server.h"
+
+namespace foodculator {
+namespace {
+
+class TenantPoolTest : public testing::Test {
+   protected:
+    void SetUp() override {
+        dir_ = (std::filesystem::temp_directory_path() / "foodculator_tenants_test").string();
+        std::filesystem::remove_all(dir_);
+        std::filesystem::create_directory(dir_);
+        for (const char* name : {"bistro", "canteen", "diner"}) {
+            // An empty file is an empty database.
+            std::ofstream(dir_ + "/" + name + ".db");
+        }
+    }
+
+    void TearDown() override { std::filesystem::remove_all(dir_); }
+
+    TenantPool MakePool(size_t max_open, std::chrono::seconds idle_timeout) {
+        TenantOptions options;
+        options.dir = dir_;
+        options.max_open = max_open;
+        options.idle_timeout = idle_timeout;
+        return TenantPool(std::move(options), [this](DB* db) {
+            ++servers_;
+            return std::make_unique<Server>(db, ".", "test");
+        });
+    }
+
+    std::string dir_;
+    int servers_ = 0;
+};
+
+TEST_F(TenantPoolTest, OpensEachKitchenOnce) {
+    TenantPool pool = MakePool(4, std::chrono::seconds(300));
+    auto bistro = pool.Acquire("bistro");
+    ASSERT_TRUE(bistro.Ok()) << bistro.Error();
+    ASSERT_TRUE(bistro.Value()->db->AddProduct("egg", 150).Ok());
+
+    auto again = pool.Acquire("bistro");
+    ASSERT_TRUE(again.Ok());
+    EXPECT_EQ(again.Value(), bistro.Value());
+    EXPECT_EQ(servers_, 1);
+
+    // Kitchens don't see each other's data.
+    auto canteen = pool.Acquire("canteen");
+    ASSERT_TRUE(canteen.Ok());
+    EXPECT_THAT(canteen.Value()->db->GetProducts().Value(), testing::IsEmpty());
+    EXPECT_EQ(pool.Size(), 2);
+
+    EXPECT_EQ(pool.Acquire("cafe").Code(), StatusCode::NOT_FOUND);
+    EXPECT_EQ(pool.Acquire("../bistro").Code(), StatusCode::INVALID_ARGUMENT);
+    EXPECT_EQ(pool.Acquire("Bistro").Code(), StatusCode::INVALID_ARGUMENT);
+    EXPECT_EQ(pool.Acquire("").Code(), StatusCode::INVALID_ARGUMENT);
+}
+
+TEST_F(TenantPoolTest, EvictsLeastRecentlyUsed) {
+    TenantPool pool = MakePool(2, std::chrono::seconds(300));
+    {
+        ASSERT_TRUE(pool.Acquire("bistro").Ok());
+        ASSERT_TRUE(pool.Acquire("canteen").Ok());
+        // bistro becomes the most recently used.
+        ASSERT_TRUE(pool.Acquire("bistro").Ok());
+        ASSERT_TRUE(pool.Acquire("diner").Ok());
+    }
+    EXPECT_EQ(pool.Size(), 2);
+    EXPECT_EQ(servers_, 3);
+
+    // canteen was closed, bistro is still open.
+    ASSERT_TRUE(pool.Acquire("bistro").Ok());
+    EXPECT_EQ(servers_, 3);
+    ASSERT_TRUE(pool.Acquire("canteen").Ok());
+    EXPECT_EQ(servers_, 4);
+
+    // Kitchens in use stay open even if that exceeds the limit.
+    auto canteen = pool.Acquire("canteen");
+    auto diner = pool.Acquire("diner");
+    auto bistro = pool.Acquire("bistro");
+    ASSERT_TRUE(bistro.Ok());
+    EXPECT_EQ(pool.Size(), 3);
+}
+
+TEST_F(TenantPoolTest, ClosesIdleKitchens) {
+    TenantPool pool = MakePool(4, std::chrono::seconds(0));
+    std::shared_ptr<Tenant> bistro = pool.Acquire("bistro").Value();
+    ASSERT_TRUE(pool.Acquire("canteen").Ok());
+
+    // bistro is still in use.
+    EXPECT_EQ(pool.CloseIdle(), 1);
+    EXPECT_EQ(pool.Size(), 1);
+
+    bistro.reset();
+    EXPECT_EQ(pool.CloseIdle(), 1);
+    EXPECT_EQ(pool.Size(), 0);
+}
+
+}  // namespace
+}  // namespace foodculator
@@ -0,0 +1,57 @@
+#include "util/timing.h"
+
+#include <string>
+#include <thread>
+
+#include "db/db.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace foodculator {
+namespace {
+
+using testing::HasSubstr;
+using testing::MatchesRegex;
+
+TEST(RequestTiming, AddsUpPhases) {
+    RequestTiming timing;
+    timing.Add("db_step", std::chrono::microseconds(1500));
+    timing.Add("serialize", std::chrono::microseconds(20));
+    timing.Add("db_step", std::chrono::microseconds(250));
+    EXPECT_EQ(timing.ToHeader(), R"(db_step;dur=1.750;desc="x2", serialize;dur=0.020)");
+}
+
+TEST(RequestTiming, SpansNeedATiming) {
+    { TimingSpan span("lost"); }
+    EXPECT_EQ(RequestTiming::Current(), nullptr);
+
+    RequestTiming outer;
+    {
+        RequestTiming inner;
+        EXPECT_EQ(RequestTiming::Current(), &inner);
+        TimingSpan span("inner");
+    }
+    EXPECT_EQ(RequestTiming::Current(), &outer);
+    { TimingSpan span("outer"); }
+
+    // Other threads don't see the timing of this one.
+    std::thread([] { TimingSpan span("other"); }).join();
+    EXPECT_THAT(outer.ToHeader(), MatchesRegex(R"(outer;dur=[0-9]+\.[0-9]{3})"));
+}
+
+TEST(RequestTiming, CoversDatabaseStatements) {
+    auto db = DB::Create(":memory:");
+    ASSERT_TRUE(db);
+    ASSERT_TRUE(db->AddProduct("milk", 42).Ok());
+
+    RequestTiming timing;
+    ASSERT_TRUE(db->GetProducts().Ok());
+    const std::string header = timing.ToHeader();
+    EXPECT_THAT(header, HasSubstr("db_prepare;dur="));
+    EXPECT_THAT(header, HasSubstr("db_wait;dur="));
+    EXPECT_THAT(header, HasSubstr("db_step;dur="));
+    EXPECT_THAT(header, HasSubstr("db_rows;dur="));
+}
+
+}  // namespace
+}  // namespace foodculator
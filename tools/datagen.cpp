@@ -0,0 +1,85 @@
+// datagen writes a synthetic catalog of production scale into a new database, e.g.
+//
+//   datagen --ingredients=1000000 --tableware=50000 --recipes=200000 --seed=1 /tmp/big.db
+//
+// The result can be served by foodculator or used by loadgen with --db=/tmp/big.db.
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include "datagen/dataset.h"
+#include "db/db.h"
+#include "fmt/format.h"
+
+namespace {
+
+constexpr char kUsage[] =
+    "usage: {} [--ingredients=N] [--tableware=N] [--recipes=N] [--seed=S] path_to_new_database\n";
+
+bool ParseOptions(int argc, char** argv, foodculator::DatasetSpec* spec, std::string* path) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.substr(0, 2) != "--") {
+            if (!path->empty()) {
+                return false;
+            }
+            *path = arg;
+            continue;
+        }
+
+        size_t eq = arg.find('=');
+        if (eq == std::string_view::npos) {
+            return false;
+        }
+        std::string_view key = arg.substr(2, eq - 2);
+        std::string value(arg.substr(eq + 1));
+        if (key == "ingredients") {
+            spec->ingredients = std::stoul(value);
+        } else if (key == "tableware") {
+            spec->tableware = std::stoul(value);
+        } else if (key == "recipes") {
+            spec->recipes = std::stoul(value);
+        } else if (key == "seed") {
+            spec->seed = static_cast<uint32_t>(std::stoul(value));
+        } else {
+            return false;
+        }
+    }
+    return !path->empty();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    foodculator::DatasetSpec spec;
+    std::string path;
+    if (!ParseOptions(argc, argv, &spec, &path)) {
+        fmt::print(stderr, kUsage, argv[0]);
+        return 1;
+    }
+
+    if (std::filesystem::exists(path)) {
+        fmt::print(stderr, "{} already exists\n", path);
+        return 1;
+    }
+
+    auto db = foodculator::DB::Create(path);
+    if (!db) {
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    if (auto code = GenerateDataset(db.get(), spec); code != foodculator::StatusCode::OK) {
+        fmt::print(stderr, "Generating the dataset failed: {}\n", foodculator::ToString(code));
+        db.reset();
+        std::filesystem::remove(path);
+        return 1;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    fmt::print("Wrote {} ingredients, {} pots and {} recipes (seed {}) to {} in {:.1f}s\n",
+               spec.ingredients, spec.tableware, spec.recipes, spec.seed, path, elapsed.count());
+    return 0;
+}
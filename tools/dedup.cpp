@@ -0,0 +1,122 @@
+// dedup lists clusters of near-duplicate ingredients in a database and optionally merges every
+// cluster into its oldest ingredient, e.g.
+//
+//   dedup --similarity=0.8 --threads=8 /tmp/database.db
+//   dedup --merge /tmp/database.db
+//
+// It can run next to a live server: merges are ordinary transactions, which the server notices
+// within 100ms, like the writes of any other process.
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "db/db.h"
+#include "fmt/format.h"
+#include "search/duplicates.h"
+
+namespace {
+
+constexpr char kUsage[] =
+    "usage: {} [--similarity=0.7] [--kcal-tolerance=5] [--kcal-ratio=0.1] [--threads=N] "
+    "[--merge] path_to_database\n";
+
+bool ParseOptions(int argc, char** argv, foodculator::DuplicateOptions* options, bool* merge,
+                  std::string* path) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.substr(0, 2) != "--") {
+            if (!path->empty()) {
+                return false;
+            }
+            *path = arg;
+            continue;
+        }
+        if (arg == "--merge") {
+            *merge = true;
+            continue;
+        }
+
+        size_t eq = arg.find('=');
+        if (eq == std::string_view::npos) {
+            return false;
+        }
+        std::string_view key = arg.substr(2, eq - 2);
+        std::string value(arg.substr(eq + 1));
+        if (key == "similarity") {
+            options->min_similarity = std::stod(value);
+        } else if (key == "kcal-tolerance") {
+            options->kcal_tolerance = static_cast<uint32_t>(std::stoul(value));
+        } else if (key == "kcal-ratio") {
+            options->kcal_tolerance_ratio = std::stod(value);
+        } else if (key == "threads") {
+            options->threads = std::stoul(value);
+        } else {
+            return false;
+        }
+    }
+    return !path->empty();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    foodculator::DuplicateOptions options;
+    options.threads = std::max(1u, std::thread::hardware_concurrency());
+    bool merge = false;
+    std::string path;
+    if (!ParseOptions(argc, argv, &options, &merge, &path)) {
+        fmt::print(stderr, kUsage, argv[0]);
+        return 1;
+    }
+
+    auto db = foodculator::DB::Create(path);
+    if (!db) {
+        return 1;
+    }
+    auto products = db->GetProducts();
+    if (!products.Ok()) {
+        fmt::print(stderr, "Can't read the ingredients: {}\n", products.Error());
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    auto clusters = FindDuplicateIngredients(products.Value(), options);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::unordered_map<size_t, const foodculator::Ingredient*> by_id;
+    for (const auto& v : products.Value()) {
+        by_id[v.id] = &v;
+    }
+    size_t duplicates = 0;
+    for (const auto& ids : clusters) {
+        fmt::print("{} ({} kcal)\n", by_id[ids[0]]->name, by_id[ids[0]]->kcal);
+        for (size_t idx = 1; idx < ids.size(); ++idx) {
+            fmt::print("  #{} {} ({} kcal)\n", ids[idx], by_id[ids[idx]]->name,
+                       by_id[ids[idx]]->kcal);
+        }
+        duplicates += ids.size() - 1;
+    }
+    fmt::print("{} duplicates of {} ingredients among {} found in {:.1f}s on {} threads\n",
+               duplicates, clusters.size(), products.Value().size(), elapsed.count(),
+               options.threads);
+
+    if (!merge) {
+        return 0;
+    }
+    size_t merged = 0;
+    for (const auto& ids : clusters) {
+        const std::vector<size_t> rest(ids.begin() + 1, ids.end());
+        if (auto code = db->MergeProducts(ids[0], rest); code != foodculator::StatusCode::OK) {
+            // The ingredients might have been changed meanwhile; the other clusters still merge.
+            fmt::print(stderr, "Merging into #{} failed: {}\n", ids[0],
+                       foodculator::ToString(code));
+            continue;
+        }
+        merged += rest.size();
+    }
+    fmt::print("Merged {} ingredients\n", merged);
+    return merged == duplicates ? 0 : 1;
+}
@@ -0,0 +1,324 @@
+// loadgen starts foodculator on an ephemeral port against a generated database, or one written
+// by datagen and passed with --db, and measures the latency of its HTTP routes, e.g.
+//
+//   loadgen --mode=open --rate=5000 --connections=64 --duration=30
+//
+// Closed loop: every connection sends its next request as soon as the previous one completes,
+// and the latency of a request is its round trip time.
+// Open loop: requests are scheduled at a fixed total `rate`, and the latency of a request is
+// counted from its scheduled start rather than from the moment a connection got free to send
+// it. A stalled server therefore shows up in the percentiles instead of silently lowering the
+// request rate (coordinated omission).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "datagen/dataset.h"
+#include "db/db.h"
+#include "fmt/format.h"
+#include "httplib.h"
+#include "json11/json11.hpp"
+#include "server/server.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string mode = "closed";
+    double rate = 1000;
+    size_t connections = 16;
+    size_t duration_sec = 10;
+    size_t ingredients = 10000;
+    size_t recipes = 1000;
+    std::string db_path = ":memory:";
+    // Serves the connections from an event loop with this many workers, see
+    // Server::UseEventLoop(). 0 keeps httplib's thread per connection.
+    size_t event_loop_workers = 0;
+    // Weights of the request kinds.
+    std::map<std::string, uint32_t> mix = {
+        {"get_ingredients", 10}, {"recipe", 70}, {"create_recipe", 5}, {"dialogflow", 15}};
+};
+
+constexpr char kUsage[] =
+    "usage: {} [--mode=closed|open] [--rate=<requests/s, open loop>] [--connections=N]\n"
+    "       [--duration=<seconds>] [--ingredients=N] [--recipes=N] [--db=<path>]\n"
+    "       [--event-loop-workers=N]\n"
+    "       [--mix=get_ingredients:10,recipe:70,create_recipe:5,dialogflow:15]\n";
+
+bool ParseMix(std::string_view value, std::map<std::string, uint32_t>* mix) {
+    std::map<std::string, uint32_t> ret;
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+
+        size_t colon = item.find(':');
+        if (colon == std::string_view::npos) {
+            return false;
+        }
+        std::string name(item.substr(0, colon));
+        if (mix->count(name) == 0) {
+            return false;
+        }
+        ret[name] = static_cast<uint32_t>(std::stoul(std::string(item.substr(colon + 1))));
+    }
+    *mix = std::move(ret);
+    return true;
+}
+
+bool ParseOptions(int argc, char** argv, Options* opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.substr(0, 2) != "--" || eq == std::string_view::npos) {
+            return false;
+        }
+        std::string_view key = arg.substr(2, eq - 2);
+        std::string value(arg.substr(eq + 1));
+
+        if (key == "mode" && (value == "closed" || value == "open")) {
+            opts->mode = value;
+        } else if (key == "rate") {
+            opts->rate = std::stod(value);
+        } else if (key == "connections") {
+            opts->connections = std::max<size_t>(1, std::stoul(value));
+        } else if (key == "duration") {
+            opts->duration_sec = std::stoul(value);
+        } else if (key == "ingredients") {
+            opts->ingredients = std::max<size_t>(3, std::stoul(value));
+        } else if (key == "recipes") {
+            opts->recipes = std::max<size_t>(1, std::stoul(value));
+        } else if (key == "db") {
+            opts->db_path = value;
+        } else if (key == "event-loop-workers") {
+            opts->event_loop_workers = std::stoul(value);
+        } else if (key == "mix") {
+            if (!ParseMix(value, &opts->mix)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return opts->rate > 0;
+}
+
+struct Catalog {
+    std::vector<size_t> ingredient_ids;
+    std::vector<std::string> ingredient_names;
+    std::vector<size_t> recipe_ids;
+};
+
+// Generates the database unless it already exists, e.g. because it was written by datagen.
+bool LoadCatalog(const Options& opts, std::unique_ptr<foodculator::DB>* db, Catalog* catalog) {
+    const bool generate = opts.db_path == ":memory:" || !std::filesystem::exists(opts.db_path);
+    *db = foodculator::DB::Create(opts.db_path);
+    if (!*db) {
+        return false;
+    }
+
+    if (generate) {
+        foodculator::DatasetSpec spec;
+        spec.ingredients = opts.ingredients;
+        spec.tableware = opts.ingredients / 20;
+        spec.recipes = opts.recipes;
+        if (GenerateDataset(db->get(), spec) != foodculator::StatusCode::OK) {
+            return false;
+        }
+    }
+
+    auto products = (*db)->GetProducts();
+    auto recipes = (*db)->GetRecipes();
+    if (!products.Ok() || !recipes.Ok() || products.Value().empty() || recipes.Value().empty()) {
+        return false;
+    }
+    for (auto& product : products.Value()) {
+        catalog->ingredient_ids.push_back(product.id);
+        catalog->ingredient_names.push_back(std::move(product.name));
+    }
+    for (const auto& recipe : recipes.Value()) {
+        catalog->recipe_ids.push_back(recipe.id);
+    }
+    return true;
+}
+
+// Latencies of one request kind, in microseconds.
+struct Samples {
+    std::vector<uint64_t> latencies;
+    size_t errors = 0;
+};
+
+// Sends one request of the given kind. Returns false on transport errors and non-2xx replies.
+bool Send(httplib::Client& cli, const std::string& kind, const Catalog& catalog,
+          std::mt19937& rng) {
+    static std::atomic<size_t> created = 0;
+    auto ok = [](const auto& res) { return res && res->status >= 200 && res->status < 300; };
+
+    if (kind == "get_ingredients") {
+        return ok(cli.Get("/get_ingredients"));
+    }
+
+    if (kind == "recipe") {
+        size_t id = catalog.recipe_ids[rng() % catalog.recipe_ids.size()];
+        return ok(cli.Get(fmt::format("/recipe/{}", id).c_str()));
+    }
+
+    if (kind == "create_recipe") {
+        json11::Json::array ingredients;
+        for (size_t i = 0; i < 3; ++i) {
+            size_t id = catalog.ingredient_ids[rng() % catalog.ingredient_ids.size()];
+            ingredients.push_back(
+                json11::Json::object{{"id", static_cast<double>(id)}, {"weight", 100.0}});
+        }
+        json11::Json body = json11::Json::object{
+            {"header", json11::Json::object{{"name", fmt::format("loadgen #{}", created++)}}},
+            {"description", "generated by loadgen"},
+            {"ingredients", ingredients}};
+        return ok(cli.Post("/create_recipe", body.dump(), "application/json"));
+    }
+
+    const std::string& food = catalog.ingredient_names[rng() % catalog.ingredient_names.size()];
+    json11::Json body = json11::Json::object{
+        {"queryResult",
+         json11::Json::object{{"queryText", food},
+                              {"parameters", json11::Json::object{{"food", food}}},
+                              {"intent", json11::Json::object{{"displayName", "calories"}}}}}};
+    return ok(cli.Post("/dialogflow", body.dump(), "application/json"));
+}
+
+uint64_t Percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t idx = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+void Report(const std::string& name, Samples samples, double elapsed_sec) {
+    std::sort(samples.latencies.begin(), samples.latencies.end());
+    const auto& l = samples.latencies;
+    fmt::print("{:<16} {:>9} {:>7} {:>10.1f} {:>9} {:>9} {:>9} {:>9}\n", name, l.size(),
+               samples.errors, l.size() / elapsed_sec, Percentile(l, 0.5), Percentile(l, 0.99),
+               Percentile(l, 0.999), l.empty() ? 0 : l.back());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    if (!ParseOptions(argc, argv, &opts)) {
+        fmt::print(stderr, kUsage, argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> kinds;
+    std::vector<uint32_t> weights;
+    for (const auto& [kind, weight] : opts.mix) {
+        if (weight > 0) {
+            kinds.push_back(kind);
+            weights.push_back(weight);
+        }
+    }
+    if (kinds.empty()) {
+        fmt::print(stderr, "--mix has no requests with a positive weight\n");
+        return 1;
+    }
+
+    std::unique_ptr<foodculator::DB> db;
+    Catalog catalog;
+    if (!LoadCatalog(opts, &db, &catalog)) {
+        fmt::print(stderr, "Failed to load or generate the database in {}\n", opts.db_path);
+        return 1;
+    }
+
+    foodculator::Server srv(db.get(), ".", "loadgen");
+    if (opts.event_loop_workers > 0) {
+        srv.UseEventLoop(opts.event_loop_workers);
+    }
+    const int port = srv.Bind("127.0.0.1", 0);
+    if (port < 0) {
+        fmt::print(stderr, "Failed to bind the server\n");
+        return 1;
+    }
+    std::thread server_thread([&srv] { srv.Listen(); });
+
+    fmt::print("{} loop, {} connections, {}s, {} ingredients, {} recipes, port {}\n", opts.mode,
+               opts.connections, opts.duration_sec, catalog.ingredient_ids.size(),
+               catalog.recipe_ids.size(), port);
+
+    const bool open_loop = opts.mode == "open";
+    const auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / opts.rate));
+    const auto start = Clock::now() + std::chrono::milliseconds(100);
+    const auto deadline = start + std::chrono::seconds(opts.duration_sec);
+    std::atomic<uint64_t> next_slot = 0;
+
+    // samples[connection][kind]
+    std::vector<std::vector<Samples>> samples(opts.connections,
+                                              std::vector<Samples>(kinds.size()));
+    std::vector<std::thread> workers;
+    for (size_t c = 0; c < opts.connections; ++c) {
+        workers.emplace_back([&, c] {
+            httplib::Client cli("127.0.0.1", port);
+            cli.set_keep_alive(true);
+            std::mt19937 rng(static_cast<uint32_t>(c));
+            std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+
+            std::this_thread::sleep_until(start);
+            while (true) {
+                auto scheduled = Clock::now();
+                if (open_loop) {
+                    scheduled = start + interval * next_slot.fetch_add(1);
+                    std::this_thread::sleep_until(scheduled);
+                }
+                if (scheduled >= deadline) {
+                    break;
+                }
+
+                size_t kind = pick(rng);
+                bool ok = Send(cli, kinds[kind], catalog, rng);
+                auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - scheduled);
+                samples[c][kind].latencies.push_back(latency.count());
+                samples[c][kind].errors += ok ? 0 : 1;
+            }
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    const double elapsed_sec = std::chrono::duration<double>(Clock::now() - start).count();
+    srv.Stop();
+    server_thread.join();
+
+    fmt::print("{:<16} {:>9} {:>7} {:>10} {:>9} {:>9} {:>9} {:>9}\n", "request", "count",
+               "errors", "req/s", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+    Samples total;
+    for (size_t kind = 0; kind < kinds.size(); ++kind) {
+        Samples merged;
+        for (auto& per_connection : samples) {
+            auto& s = per_connection[kind];
+            merged.latencies.insert(merged.latencies.end(), s.latencies.begin(),
+                                    s.latencies.end());
+            merged.errors += s.errors;
+        }
+        total.latencies.insert(total.latencies.end(), merged.latencies.begin(),
+                               merged.latencies.end());
+        total.errors += merged.errors;
+        Report(kinds[kind], std::move(merged), elapsed_sec);
+    }
+    Report("total", std::move(total), elapsed_sec);
+    return 0;
+}
@@ -0,0 +1,206 @@
+// replay sends the requests recorded by foodculator with CAPTURE_FILE to a running server and
+// compares the responses with the recorded ones, e.g.
+//
+//   replay --speed=4 localhost:1234 /tmp/capture.log
+//
+// Requests are scheduled at their recorded arrival times divided by `speed`; --speed=0 sends
+// them back to back. With the default single connection they are sent in arrival order, so a
+// server started on a copy of the database taken when the capture began should answer exactly
+// as the original one did. More connections reproduce the original concurrency, at the cost of
+// the order of writes. Exits with 1 if any response differs from the recorded one.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "fmt/format.h"
+#include "httplib.h"
+#include "server/capture.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    double speed = 1;
+    size_t connections = 1;
+    size_t max_diffs = 10;
+    std::string host;
+    int port = 0;
+    std::string path;
+};
+
+constexpr char kUsage[] =
+    "usage: {} [--speed=<x, 0 for back to back>] [--connections=N] [--diffs=<printed diffs>]\n"
+    "       host:port path_to_capture\n";
+
+bool ParseOptions(int argc, char** argv, Options* opts) {
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.substr(0, 2) != "--") {
+            positional.emplace_back(arg);
+            continue;
+        }
+
+        size_t eq = arg.find('=');
+        if (eq == std::string_view::npos) {
+            return false;
+        }
+        std::string_view key = arg.substr(2, eq - 2);
+        std::string value(arg.substr(eq + 1));
+        if (key == "speed") {
+            opts->speed = std::stod(value);
+        } else if (key == "connections") {
+            opts->connections = std::max<size_t>(1, std::stoul(value));
+        } else if (key == "diffs") {
+            opts->max_diffs = std::stoul(value);
+        } else {
+            return false;
+        }
+    }
+    if (positional.size() != 2 || opts->speed < 0) {
+        return false;
+    }
+
+    size_t colon = positional[0].rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    opts->host = positional[0].substr(0, colon);
+    opts->port = std::stoi(positional[0].substr(colon + 1));
+    opts->path = positional[1];
+    return true;
+}
+
+// Sends `r` as it was received by the original server. The result is empty on transport errors.
+httplib::Result Send(httplib::Client& cli, const foodculator::CapturedRequest& r) {
+    const char* target = r.target.c_str();
+    constexpr char kContentType[] = "application/json";
+    if (r.method == "GET") {
+        return cli.Get(target);
+    }
+    if (r.method == "POST") {
+        return cli.Post(target, r.body, kContentType);
+    }
+    if (r.method == "PUT") {
+        return cli.Put(target, r.body, kContentType);
+    }
+    if (r.method == "DELETE") {
+        if (r.body.empty()) {
+            return cli.Delete(target);
+        }
+        return cli.Delete(target, httplib::Headers(), r.body, kContentType);
+    }
+    return httplib::Result();
+}
+
+struct Diff {
+    size_t idx;
+    int status;
+    uint64_t size;
+    std::string body;
+};
+
+uint64_t Percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t idx = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    if (!ParseOptions(argc, argv, &opts)) {
+        fmt::print(stderr, kUsage, argv[0]);
+        return 1;
+    }
+
+    auto capture = foodculator::ReadCapture(opts.path);
+    if (!capture.Ok()) {
+        fmt::print(stderr, "{}\n", capture.Error());
+        return 1;
+    }
+    const auto& requests = capture.Value();
+    if (requests.empty()) {
+        fmt::print(stderr, "{} has no requests\n", opts.path);
+        return 1;
+    }
+
+    std::atomic<size_t> next = 0;
+    size_t transport_errors = 0;
+    std::mutex mu;
+    std::vector<Diff> diffs;
+    std::vector<uint64_t> latencies;
+    latencies.reserve(requests.size());
+
+    const auto start = Clock::now();
+    std::vector<std::thread> workers;
+    for (size_t c = 0; c < opts.connections; ++c) {
+        workers.emplace_back([&] {
+            httplib::Client cli(opts.host, opts.port);
+            cli.set_keep_alive(true);
+            for (size_t idx = next++; idx < requests.size(); idx = next++) {
+                const auto& r = requests[idx];
+                // As in loadgen's open loop, a late request counts from its scheduled time.
+                auto scheduled = Clock::now();
+                if (opts.speed > 0) {
+                    scheduled = start + std::chrono::duration_cast<Clock::duration>(
+                                            std::chrono::microseconds(r.arrival_us) / opts.speed);
+                    std::this_thread::sleep_until(scheduled);
+                }
+
+                auto res = Send(cli, r);
+                auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - scheduled);
+                const bool same = res && res->status == r.status &&
+                                  res->body.size() == r.response_size &&
+                                  foodculator::HashBody(res->body) == r.response_hash;
+
+                std::lock_guard<std::mutex> lock(mu);
+                latencies.push_back(latency.count());
+                if (!res) {
+                    ++transport_errors;
+                } else if (!same) {
+                    diffs.push_back({idx, res->status, res->body.size(), res->body.substr(0, 200)});
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    const double elapsed_sec = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::sort(diffs.begin(), diffs.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.idx < rhs.idx;
+    });
+    size_t status_diffs = 0;
+    for (size_t i = 0; i < diffs.size(); ++i) {
+        const auto& diff = diffs[i];
+        const auto& r = requests[diff.idx];
+        status_diffs += diff.status != r.status ? 1 : 0;
+        if (i < opts.max_diffs) {
+            fmt::print("#{} {} {}: status {} -> {}, {}b -> {}b: {}\n", diff.idx, r.method,
+                       r.target, r.status, diff.status, r.response_size, diff.size, diff.body);
+        }
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    fmt::print("Replayed {} requests in {:.1f}s (recorded over {:.1f}s)\n", requests.size(),
+               elapsed_sec, requests.back().arrival_us / 1e6);
+    fmt::print("Different status: {}, different body only: {}, transport errors: {}\n",
+               status_diffs, diffs.size() - status_diffs, transport_errors);
+    fmt::print("Latency (us): p50 {}, p99 {}, p999 {}, max {}\n", Percentile(latencies, 0.5),
+               Percentile(latencies, 0.99), Percentile(latencies, 0.999), latencies.back());
+    return diffs.empty() && transport_errors == 0 ? 0 : 1;
+}